@@ -29,10 +29,11 @@ import sys
 import itertools
 import random
 import os
+import re
 import string
 import json
 
-from f1_common import LimitFuzzer
+from f1_common import LimitFuzzer, pop_rule_weights
 
 
 class TreeNode:
@@ -146,20 +147,42 @@ def bytes_to_c_str(data: bytes):
 
 
 class PooledFuzzer(LimitFuzzer):
-    def __init__(self, grammar):
+    def __init__(self, grammar, rule_weights=None):
         super().__init__(grammar)
         self.c_grammar = self.cheap_grammar()
         self.c_grammar_keys = list(self.c_grammar.keys())
 
         self.MAX_SAMPLE = 255
 
-        # reorder our grammar rules by cost.
+        # reorder our grammar rules by cost, and their weights with them.
+        if rule_weights is None:
+            rule_weights = {}
+        self.rule_weights = {}
         for k in self.grammar_keys:
+            orig_rules = list(self.grammar[k])
             self.grammar[k] = [r for (i, r) in self.cost[k]]
+            if k in rule_weights:
+                self.rule_weights[k] = self.reorder_weights(
+                    orig_rules, self.grammar[k], rule_weights[k])
         self.ordered_grammar = True
 
         self.pool_of_trees = self.completion_trees()
 
+    @staticmethod
+    def reorder_weights(orig_rules, rules, weights):
+        '''
+        Map the weights of the original rules to the reordered rules, from
+        which the rules that cannot be expanded have been dropped.
+        '''
+        used = [False] * len(orig_rules)
+        reordered = []
+        for rule in rules:
+            i = next(i for i, r in enumerate(orig_rules)
+                     if not used[i] and r == rule)
+            used[i] = True
+            reordered.append(weights[i])
+        return reordered
+
     def cheap_grammar(self):
         new_grammar = {}
         for k in self.grammar_keys:
@@ -258,8 +281,9 @@ class PyCompiledFuzzer(PooledFuzzer):
 
 
 class CFuzzer(PyCompiledFuzzer):
-    def __init__(self, grammar):
-        super().__init__(grammar)
+    def __init__(self, grammar, rule_weights=None, name='grammar'):
+        super().__init__(grammar, rule_weights)
+        self.name = name
         assert self.ordered_grammar
 
     def gen_rule_src(self, rule, key, min_rule_cost):
@@ -294,6 +318,20 @@ class CFuzzer(PyCompiledFuzzer):
             res.append('subnode->parent = node;')
         return '\n    '.join(res)
 
+    def rule_tiers(self, k):
+        '''
+        All possible numbers of rules that fit the budget (`rules_that_fit`),
+        in ascending order.
+        '''
+        tiers = []
+        num_rules = 0
+        for i, (min_rule_size, _) in enumerate(self.cost[k]):
+            num_rules += 1
+            if i + 1 == len(self.cost[k]) or \
+                    self.cost[k][i + 1][0] != min_rule_size:
+                tiers.append(num_rules)
+        return tiers
+
     def gen_num_candidate_rules(self, k):
         min_rule_sizes = []
         num_min_rules = []
@@ -347,7 +385,7 @@ node_t *gen_node_%(name)s(int max_len, int *consumed, int rule_index) {
     int rules_that_fit = 0;
     %(gen_num_candidate_rules)s
 
-    val = map_rand(rules_that_fit);
+    val = pick_rule(NODE_%(node_type)s, rules_that_fit);
   } else {
     val = rule_index;
   }
@@ -389,8 +427,8 @@ node_t *gen_node_%(name)s(int max_len, int *consumed, int rule_index) {
             ser_cheap_trees = [tree.to_bytes() for tree in cheap_trees]
             ser_cheap_trees_c_str = [bytes_to_c_str(ser_tree) for ser_tree in ser_cheap_trees]
             result.append('''
-const char* pool_ser_%(k)s[] = {%(ser_trees)s};
-const size_t pool_l_ser_%(k)s[] = {%(ser_trees_len)s};''' % {
+static const char* pool_ser_%(k)s[] = {%(ser_trees)s};
+static const size_t pool_l_ser_%(k)s[] = {%(ser_trees_len)s};''' % {
                 'k': self.k_to_s(k),
                 'ser_trees': ', '.join(['"%s"' % ser_tree_c_str for ser_tree_c_str in ser_cheap_trees_c_str]),
                 'ser_trees_len': ', '.join([str(len(ser_tree)) for ser_tree in ser_cheap_trees])})
@@ -399,7 +437,8 @@ const size_t pool_l_ser_%(k)s[] = {%(ser_trees_len)s};''' % {
     def fuzz_fn_decs(self):
         result = []
         for k in self.grammar_keys:
-            result.append('''node_t *gen_node_%s(int max_len, int *consumed, int rule_index);''' % self.k_to_s(k))
+            result.append('''node_t *gen_node_%(name)s(int max_len, int *consumed, int rule_index)
+    F1_SYMBOL(gen_node_%(name)s);''' % {'name': self.k_to_s(k)})
         return '\n'.join(result)
 
     def fuzz_fn_defs(self):
@@ -475,6 +514,49 @@ size_t node_num_rules[%d] = {
             len(self.grammar_keys) + 1,
             '\n  '.join(node_num_rules))
 
+    def rule_weights_array_defs(self):
+        result = []
+        weights_names = []
+        for k in self.grammar_keys:
+            if k not in self.rule_weights:
+                weights_names.append('NULL,')
+                continue
+            name = 'rule_weights_%s' % self.k_to_s(k)
+            result.append('static const double %s[] = {%s};' % (
+                name, ', '.join(repr(float(w)) for w in self.rule_weights[k])))
+            weights_names.append('%s,' % name)
+        result.append('''
+const double *node_rule_weights[%d] = {
+  NULL,
+  %s
+};''' % (len(self.grammar_keys) + 1, '\n  '.join(weights_names)))
+        return '\n'.join(result)
+
+    def rule_tiers_array_defs(self):
+        result = []
+        tiers_names = []
+        num_tiers = []
+        for k in self.grammar_keys:
+            tiers = self.rule_tiers(k)
+            name = 'rule_tiers_%s' % self.k_to_s(k)
+            result.append('static const size_t %s[] = {%s};' % (
+                name, ', '.join(str(t) for t in tiers)))
+            tiers_names.append('%s,' % name)
+            num_tiers.append('%d,' % len(tiers))
+        result.append('''
+const size_t *node_rule_tiers[%(num_nodes)d] = {
+  NULL,
+  %(tiers_names)s
+};
+size_t node_num_rule_tiers[%(num_nodes)d] = {
+  0,
+  %(num_tiers)s
+};''' % {
+            'num_nodes': len(self.grammar_keys) + 1,
+            'tiers_names': '\n  '.join(tiers_names),
+            'num_tiers': '\n  '.join(num_tiers)})
+        return '\n'.join(result)
+
     def gen_fuzz_hdr(self):
         hdr_content = '''
 #ifndef __F1_C_FUZZ_H__
@@ -484,21 +566,47 @@ size_t node_num_rules[%d] = {
 
 #include "tree.h"
 
+// The symbols of the generated code are prefixed with the name of the grammar
+// (e.g., `f1_json_gen_init__`), which is the C++ namespace of its ANTLR4 parser
+// too. The rest of the grammar mutator is not, so that the libraries of
+// several grammars in one process rely on versioned symbols as well.
+#define F1_NAMESPACE %(namespace)s
+
+#define F1_STR_(s) #s
+#define F1_STR(s) F1_STR_(s)
+#define F1_SYMBOL(name) \\
+  __asm__(F1_STR(__USER_LABEL_PREFIX__) F1_STR(F1_NAMESPACE) "_" #name)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 %(fuzz_fn_decs)s
 
-tree_t *gen_init__(int max_len);
+tree_t *gen_init__(int max_len) F1_SYMBOL(gen_init__);
 
 %(node_type_decs)s
-const char *node_type_str(int node_type);
+const char *node_type_str(int node_type) F1_SYMBOL(node_type_str);
 
 typedef node_t *(*gen_func_t)(int max_len, int *consumed, int rule_index);
-extern gen_func_t gen_funcs[%(num_nodes)d];
-extern size_t node_min_lens[%(num_nodes)d];
-extern size_t node_num_rules[%(num_nodes)d];
+extern gen_func_t gen_funcs[%(num_nodes)d] F1_SYMBOL(gen_funcs);
+// generate a subtree of a node type, i.e., `gen_funcs[node_type]`
+node_t *gen_node(int node_type, int max_len, int *consumed, int rule_index)
+    F1_SYMBOL(gen_node);
+extern size_t node_min_lens[%(num_nodes)d] F1_SYMBOL(node_min_lens);
+extern size_t node_num_rules[%(num_nodes)d] F1_SYMBOL(node_num_rules);
+
+// the static weights of the rules of each node type from the grammar file (in
+// the same order as `rule_index`), or NULL if there are none
+extern const double *node_rule_weights[%(num_nodes)d]
+    F1_SYMBOL(node_rule_weights);
+// all possible numbers of rules that fit the budget of each node type
+extern const size_t *node_rule_tiers[%(num_nodes)d] F1_SYMBOL(node_rule_tiers);
+extern size_t node_num_rule_tiers[%(num_nodes)d]
+    F1_SYMBOL(node_num_rule_tiers);
+
+typedef int (*gen_rule_picker_t)(int node_type, int rules_that_fit);
+extern gen_rule_picker_t gen_rule_picker F1_SYMBOL(gen_rule_picker);
 
 #ifdef __cplusplus
 }
@@ -507,6 +615,7 @@ extern size_t node_num_rules[%(num_nodes)d];
 #endif'''
 
         params = {
+            "namespace": 'f1_' + self.name,
             "fuzz_fn_decs": self.fuzz_fn_decs(),
             "node_type_decs": self.node_type_decs(),
             "num_nodes": len(self.grammar_keys) + 1
@@ -530,6 +639,13 @@ static inline int map_rand(int v) {
   return random_below(v);
 }
 
+gen_rule_picker_t gen_rule_picker = NULL;
+
+static inline int pick_rule(int node_type, int rules_that_fit) {
+  if (gen_rule_picker) return gen_rule_picker(node_type, rules_that_fit);
+  return map_rand(rules_that_fit);
+}
+
 static int get_random_len(int num_subnodes, int total_remaining_len) {
   int ret = total_remaining_len;
   int temp = 0;
@@ -545,6 +661,12 @@ static int get_random_len(int num_subnodes, int total_remaining_len) {
 %(fuzz_fn_array_defs)s
 %(node_cost_array_defs)s
 %(node_num_rules_array_defs)s
+%(rule_weights_array_defs)s
+%(rule_tiers_array_defs)s
+
+node_t *gen_node(int node_type, int max_len, int *consumed, int rule_index) {
+  return gen_funcs[node_type](max_len, consumed, rule_index);
+}
 
 tree_t *gen_init__(int max_len) {
   tree_t *tree = tree_create();
@@ -559,7 +681,9 @@ tree_t *gen_init__(int max_len) {
             "fuzz_fn_array_defs": self.fuzz_fn_array_defs(),
             "node_type_str_defs": self.node_type_str_defs(),
             "node_cost_array_defs": self.node_cost_array_defs(),
-            "node_num_rules_array_defs": self.node_num_rules_array_defs()
+            "node_num_rules_array_defs": self.node_num_rules_array_defs(),
+            "rule_weights_array_defs": self.rule_weights_array_defs(),
+            "rule_tiers_array_defs": self.rule_tiers_array_defs()
         }
 
         return src_content % params
@@ -568,14 +692,15 @@ tree_t *gen_init__(int max_len) {
         return self.gen_fuzz_hdr(), self.gen_fuzz_src()
 
 
-def main(grammar, root_dir):
+def main(grammar, root_dir, name):
     random.seed(0)  # Fixed seed
 
     c_grammar = grammar
+    rule_weights = pop_rule_weights(c_grammar)
 
     hdr_path = os.path.join(root_dir, 'include/f1_c_fuzz.h')
     src_path = os.path.join(root_dir, 'src/f1_c_fuzz.c')
-    fuzz_hdr, fuzz_src = CFuzzer(c_grammar).fuzz_src()
+    fuzz_hdr, fuzz_src = CFuzzer(c_grammar, rule_weights, name).fuzz_src()
     with open(hdr_path, 'w') as f:
         print(fuzz_hdr, file=f)
     with open(src_path, 'w') as f:
@@ -584,9 +709,16 @@ def main(grammar, root_dir):
 
 if __name__ == '__main__':
     if len(sys.argv) < 3:
-        print(sys.argv[0] + ' </path/to/grammar/file> </path/to/output/dir>')
+        print(sys.argv[0] + ' </path/to/grammar/file> </path/to/output/dir> [<grammar name>]')
         sys.exit(1)
 
     grammar_file_path = sys.argv[1]
+    if len(sys.argv) > 3:
+        name = sys.argv[3]
+    else:
+        # The same as GRAMMAR_FILENAME
+        name = re.split('[_.-]', os.path.basename(grammar_file_path))[0].lower()
+    # The prefix of symbols, and a C++ namespace
+    name = re.sub('[^0-9A-Za-z_]', '_', name)
     with open(grammar_file_path, 'r') as fp:
-        main(json.load(fp), sys.argv[2])
+        main(json.load(fp), sys.argv[2], name)
@@ -25,6 +25,29 @@
 # We have made lots of changes to this file to satisfy our requirements.
 #
 
+# The optional key of the static rule weights in a grammar file, e.g.,
+# "@weights": {"<value>": [1, 1, 1, 5, 1, 1, 1]}, with one weight per rule of
+# a key, in the same order as the rules
+RULE_WEIGHTS_KEY = '@weights'
+
+
+def pop_rule_weights(grammar):
+    '''
+    Remove the static rule weights from a grammar, and return them.
+    '''
+    weights = grammar.pop(RULE_WEIGHTS_KEY, {})
+    for k, rule_weights in weights.items():
+        if k not in grammar:
+            raise ValueError('%s: unknown key %s' % (RULE_WEIGHTS_KEY, k))
+        if len(rule_weights) != len(grammar[k]):
+            raise ValueError('%s: %s has %d rules, but %d weights' % (
+                RULE_WEIGHTS_KEY, k, len(grammar[k]), len(rule_weights)))
+        if any(not isinstance(w, (int, float)) or w < 0 for w in rule_weights):
+            raise ValueError('%s: invalid weights of %s' % (
+                RULE_WEIGHTS_KEY, k))
+    return weights
+
+
 class Fuzzer:
     def __init__(self, grammar):
         self.grammar = grammar
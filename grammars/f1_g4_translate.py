@@ -23,7 +23,7 @@ import sys
 import json
 import random
 
-from f1_common import LimitFuzzer
+from f1_common import LimitFuzzer, pop_rule_weights
 
 
 #
@@ -103,6 +103,7 @@ def main(grammar_file_path, root_dir):
 
     with open(grammar_file_path, 'r') as fp:
         grammar = json.load(fp)
+    pop_rule_weights(grammar)
     g4 = AntlrG(grammar).translate()
     g4_file_path = os.path.join(
         root_dir, 'Grammar.g4')
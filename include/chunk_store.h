@@ -26,6 +26,22 @@ void chunk_store_add_tree(tree_t *tree);
  */
 node_t *chunk_store_get_alternative_node(node_t *node);
 
+/**
+ * Get the number of unique chunks (i.e., subtrees) in the chunk store
+ * @return The number of stored chunks
+ */
+size_t chunk_store_get_num_chunks();
+
+/**
+ * Visit every node type in the chunk store
+ * @param func The function called with `arg`, a node type, and the number
+ *             of chunks of that type
+ * @param arg  The argument of `func`
+ */
+void chunk_store_foreach_type(void (*func)(void *arg, const char *node_type,
+                                           size_t num_chunks),
+                              void *arg);
+
 /**
  * Clear all stored chunks
  */
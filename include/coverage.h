@@ -0,0 +1,97 @@
+#ifndef __COVERAGE_H__
+#define __COVERAGE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the number of counters of each k-path map (k = 2, 3)
+#define COVERAGE_PATH_MAP_SIZE (1 << 16)
+
+/**
+ * Initialize the structural coverage map, which counts the kept inputs (queue
+ * entries) that cover each (node type, rule) pair and each parent -> child
+ * rule path of length 2 and 3.
+ * @param bias Whether to bias the generation (see `rule_weights_set_scales`)
+ *             and the rules mutation toward rarely covered rules
+ */
+void coverage_init(bool bias);
+
+/**
+ * Add the rules and rule paths of a kept input. Each input is only counted
+ * once, however often it is added.
+ * @param  name The name of the queue entry (or of its tree file)
+ * @param  tree The tree of the queue entry
+ * @return      True if the input has been counted; False if it had already
+ *              been counted, or the coverage map is not initialized
+ */
+bool coverage_add_tree(const char *name, tree_t *tree);
+
+/**
+ * Recompute which rules are rare and, if biased, scale the generation weight
+ * of each rule by `1 / sqrt(1 + the number of covering inputs)`, if any input
+ * has been added since the last update. Until then, `coverage_is_rare` keeps
+ * its previous results, so that a stage of the rules mutation sees the same
+ * rare rules from its start to its end.
+ * @return True if the coverage map has changed; otherwise, False
+ */
+bool coverage_update();
+
+/**
+ * Get the number of kept inputs that cover a rule
+ * @param  node_type The node type
+ * @param  rule_id   The index of the rule of `node_type`
+ * @return           The number of inputs
+ */
+uint32_t coverage_get_rule_count(uint32_t node_type, uint32_t rule_id);
+
+/**
+ * Check whether a rule is covered by at most as many inputs as the average rule
+ * of its node type, as of the last `coverage_update`
+ * @param  node_type The node type
+ * @param  rule_id   The index of the rule of `node_type`
+ * @return           True if the rule is rare; otherwise, False
+ */
+bool coverage_is_rare(uint32_t node_type, uint32_t rule_id);
+
+/**
+ * Get the number of counted inputs
+ * @return The number of inputs
+ */
+size_t coverage_get_num_entries();
+
+/**
+ * Get the number of (node type, rule) pairs in the grammar
+ * @return The number of rules
+ */
+size_t coverage_get_num_rules();
+
+/**
+ * Get the number of (node type, rule) pairs covered by any input
+ * @return The number of covered rules
+ */
+size_t coverage_get_covered_rules();
+
+/**
+ * Get the number of covered rule paths, up to the collisions in the map
+ * @param  k The length of the paths (2 or 3)
+ * @return   The number of non-zero counters of the k-path map
+ */
+size_t coverage_get_covered_paths(int k);
+
+/**
+ * Stop biasing and free the coverage map
+ */
+void coverage_clear();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
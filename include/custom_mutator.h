@@ -18,6 +18,7 @@
 #include "helpers.h"
 #include "tree.h"
 #include "list.h"
+#include "parse_pool.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -48,6 +49,7 @@ typedef struct my_mutator {
                                // 1: recursive trimming
 
   bool trim_was_effective; // Did we change the file *at all* during trim?
+  size_t trim_orig_len;    // the length of the test case before trimming
 
   size_t cur_subtree_trimming_step;
   size_t finished_subtree_trimming_nodes;
@@ -69,10 +71,18 @@ typedef struct my_mutator {
   size_t total_random_recursive_mutation_steps;
   size_t total_splicing_mutation_steps;
 
+  // The stage and the node type that created `mutated_tree`, to which a new
+  // queue entry is attributed (see `stats_add_new_entry`)
+  uint8_t mutated_stage;
+  int     mutated_node_type;
+
   // Rules mutation
   node_t * cur_rules_mutation_node;
   uint32_t cur_rules_mutation_rule_id;
 
+  // Background parsing of imported test cases
+  parse_pool_t *parse_pool;
+
   // Reused buffers:
   BUF_VAR(uint8_t, fuzz);
 
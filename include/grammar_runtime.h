@@ -0,0 +1,124 @@
+#ifndef __GRAMMAR_RUNTIME_H__
+#define __GRAMMAR_RUNTIME_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the limit of the number of Earley items of one parse, so that ambiguous
+// grammars cannot take all memory (24 bytes per item)
+#define GRAMMAR_RUNTIME_MAX_ITEMS (1 << 22)
+
+// the limit of the depth of generated cheap subtrees (see `node_min_lens`) and
+// of parse trees
+#define GRAMMAR_RUNTIME_CHEAP_DEPTH 32
+#define GRAMMAR_RUNTIME_MAX_DEPTH (1 << 14)
+
+typedef struct grammar_runtime_rules grammar_runtime_rules_t;
+
+/*
+ * A grammar loaded at runtime, with the same tables as the generated
+ * `f1_c_fuzz.h` (see `grammars/f1_c_gen.py`). Node type `i` is the i-th key of
+ * the grammar file, counting from 1, and the rules of a node type are sorted
+ * by their minimal lengths. Thus, trees of a grammar are interchangeable with
+ * trees of the generated code of the same grammar file.
+ */
+typedef struct grammar_runtime {
+
+  size_t num_node_types;  // including `NODE_TERM__` (0)
+
+  // e.g., "NODE_JSON" for the key "<json>"
+  const char **node_type_strs;
+
+  size_t *node_min_lens;
+  size_t *node_num_rules;
+
+  // the static weights of the rules of each node type, or NULL if there are
+  // none
+  const double **node_rule_weights;
+
+  // all possible numbers of rules that fit the budget of each node type
+  const size_t **node_rule_tiers;
+  size_t *       node_num_rule_tiers;
+
+  grammar_runtime_rules_t *rules;
+
+} grammar_runtime_t;
+
+// the same as `gen_rule_picker_t` of the generated code
+typedef int (*grammar_runtime_picker_t)(int node_type, int rules_that_fit);
+
+/**
+ * Load a grammar file in the JSON format of `grammars` (e.g., `json.json`),
+ * including the optional static rule weights (the key "@weights")
+ * @param  filename The path to the grammar file
+ * @return          The loaded grammar, or NULL if the file cannot be read or
+ *                  the grammar is invalid (the reason is printed)
+ */
+grammar_runtime_t *grammar_runtime_load(const char *filename);
+
+/**
+ * Load a grammar from a buffer, as in `grammar_runtime_load`
+ * @param  buf The grammar in the JSON format
+ * @param  len The length of `buf`
+ * @return     The loaded grammar, or NULL if the grammar is invalid
+ */
+grammar_runtime_t *grammar_runtime_load_buf(const char *buf, size_t len);
+
+/**
+ * Free a grammar. Trees of the grammar stay valid.
+ * @param grammar The grammar, or NULL
+ */
+void grammar_runtime_free(grammar_runtime_t *grammar);
+
+/**
+ * Generate a subtree of a node type, as `gen_node` of the generated code does
+ * @param  grammar    The grammar
+ * @param  picker     The rule picker (see `gen_rule_picker`), or NULL to pick
+ *                    rules uniformly
+ * @param  node_type  The node type, i.e., 1 to `num_node_types - 1`
+ * @param  max_len    The budget of the length of the subtree
+ * @param  consumed   The minimal length of the generated subtree
+ * @param  rule_index The rule of the root node, or -1 for a random rule
+ * @return            The generated subtree
+ */
+node_t *grammar_runtime_gen_node(const grammar_runtime_t *grammar,
+                                 grammar_runtime_picker_t picker,
+                                 int node_type, int max_len, int *consumed,
+                                 int rule_index);
+
+/**
+ * Generate a tree of the first node type, as `gen_init__` does
+ * @param  grammar The grammar
+ * @param  picker  The rule picker, or NULL
+ * @param  max_len The budget of the length of the tree
+ * @return         The generated tree
+ */
+tree_t *grammar_runtime_gen_tree(const grammar_runtime_t *grammar,
+                                 grammar_runtime_picker_t picker, int max_len);
+
+/**
+ * Parse a test case with an Earley parser, instead of the ANTLR4 parser
+ * generated from the grammar. The root node is of a node type that no rule of
+ * another node type refers to (the first node type if there is none), like
+ * the entry rule of `grammars/f1_g4_translate.py`, which also counts the rules
+ * of the node type itself. Terminal nodes are the tokens of the rules.
+ * @param  grammar   The grammar
+ * @param  data_buf  The test case
+ * @param  data_size The length of `data_buf`
+ * @return           The parse tree, or NULL if the test case does not match the
+ *                   grammar (or has too many parses)
+ */
+tree_t *grammar_runtime_parse(const grammar_runtime_t *grammar,
+                              const uint8_t *data_buf, size_t data_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -29,6 +29,11 @@ extern "C" {
   #endif
 #endif
 
+/* Thread-local state of the mutations (e.g., the random number generator), so
+ that several threads can mutate trees at once. The initial-exec model keeps
+ each access as cheap as a global variable, also in a dlopen'ed library. */
+#define THREAD_LOCAL __thread __attribute__((tls_model("initial-exec")))
+
 /* Initial size used for ck_maybe_grow */
 #define INITIAL_GROWTH_SIZE (64)
 
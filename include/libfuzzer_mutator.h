@@ -0,0 +1,75 @@
+#ifndef __LIBFUZZER_MUTATOR_H__
+#define __LIBFUZZER_MUTATOR_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the default number of trees kept by the input cache
+#define LIBFUZZER_CACHE_SLOTS (1 << 12)
+
+typedef struct libfuzzer_mutator_stats {
+
+  size_t num_calls;      // the number of mutations and crossovers
+  size_t cache_hits;     // the number of inputs found in the input cache
+  size_t num_parsed;     // the number of inputs parsed
+  size_t num_generated;  // the number of test cases generated from scratch
+  size_t num_truncated;  // the number of outputs truncated to `max_size`
+
+} libfuzzer_mutator_stats_t;
+
+/**
+ * The custom mutator of libFuzzer. libFuzzer only passes the bytes of a test
+ * case, so that its tree is looked up in an input cache by the hash of the
+ * bytes, or parsed (and its subtrees are added to the chunk store) on a miss.
+ * Each output is cached by its own hash, since libFuzzer mutates its latest
+ * output again and keeps interesting outputs in the corpus. Inputs that
+ * cannot be parsed are replaced with generated test cases. The first call
+ * reads the same environment variables as `afl_custom_init` (i.e.,
+ * `NODE_WEIGHTS_FILE`), and `LIBFUZZER_CACHE_SLOTS`.
+ * @param  data     The test case, which is overwritten by the mutated one
+ * @param  size     The length of the test case
+ * @param  max_size The capacity of `data`
+ * @param  seed     The seed of all random choices of this call
+ * @return          The length of the mutated test case, at most `max_size`
+ */
+size_t LLVMFuzzerCustomMutator(uint8_t *data, size_t size, size_t max_size,
+                               unsigned int seed);
+
+/**
+ * The custom crossover of libFuzzer: replace a random subtree of the first
+ * test case with a subtree of the same node type from the second one (or from
+ * the chunk store, if there is none)
+ * @param  data1        The first test case
+ * @param  size1        The length of the first test case
+ * @param  data2        The second test case
+ * @param  size2        The length of the second test case
+ * @param  out          The output buffer
+ * @param  max_out_size The capacity of `out`
+ * @param  seed         The seed of all random choices of this call
+ * @return              The length of the output, at most `max_out_size`
+ */
+size_t LLVMFuzzerCustomCrossOver(const uint8_t *data1, size_t size1,
+                                 const uint8_t *data2, size_t size2,
+                                 uint8_t *out, size_t max_out_size,
+                                 unsigned int seed);
+
+/**
+ * Get the statistics since the first call
+ * @param stats The output of the statistics
+ */
+void libfuzzer_mutator_get_stats(libfuzzer_mutator_stats_t *stats);
+
+/**
+ * Free the input cache and the chunk store. The next call starts over.
+ */
+void libfuzzer_mutator_deinit();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef __MUTATOR_DAEMON_H__
+#define __MUTATOR_DAEMON_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The protocol of `mutator_daemon` over a Unix domain stream socket. Each
+ * request is a `mutator_daemon_request_t` followed by `len` bytes, and is
+ * answered by a `mutator_daemon_response_t` followed by `len` bytes. All
+ * integers are in the native byte order, since both sides are on the same
+ * host. A connection may send any number of requests, one after another.
+ */
+
+// the first field of every request and response
+#define MUTATOR_DAEMON_MAGIC 0x474d4d44  // "DMMG"
+
+// `tree_id` of a mutation request: a random tree of the corpus per mutant
+#define MUTATOR_DAEMON_ANY_TREE UINT32_MAX
+
+// the limits of one request: the number of mutants, and the length of an
+// added input and of all mutants of a batch
+#define MUTATOR_DAEMON_MAX_COUNT (1 << 16)
+#define MUTATOR_DAEMON_MAX_LEN (1 << 26)
+
+typedef enum mutator_daemon_op {
+
+  // Mutate the tree `tree_id` (or `MUTATOR_DAEMON_ANY_TREE`) `count` times.
+  // The response has `value` mutants, each a uint32_t length followed by at
+  // most `max_size` bytes. `value` is less than `count` only if the mutants
+  // would exceed `MUTATOR_DAEMON_MAX_LEN`.
+  MUTATOR_DAEMON_MUTATE = 1,
+
+  // Parse the input in the payload and add it to the corpus (and its subtrees
+  // to the chunk store). `value` of the response is the new tree id.
+  MUTATOR_DAEMON_ADD = 2,
+
+  // The response has a `mutator_daemon_stats_t`
+  MUTATOR_DAEMON_STATS = 3,
+
+} mutator_daemon_op_t;
+
+typedef enum mutator_daemon_status {
+
+  MUTATOR_DAEMON_OK = 0,
+  MUTATOR_DAEMON_BAD_REQUEST = 1,  // an unknown op, or out of the limits
+  MUTATOR_DAEMON_NO_TREE = 2,      // no such tree, or an empty corpus
+  MUTATOR_DAEMON_PARSE_ERROR = 3,  // the input cannot be parsed
+
+} mutator_daemon_status_t;
+
+typedef struct mutator_daemon_request {
+
+  uint32_t magic;
+  uint32_t op;
+  uint32_t tree_id;   // MUTATE: the tree to mutate
+  uint32_t count;     // MUTATE: the number of mutants
+  uint32_t max_size;  // MUTATE: the maximal length of a mutant
+  uint32_t len;       // the length of the payload (ADD: the input)
+
+} mutator_daemon_request_t;
+
+typedef struct mutator_daemon_response {
+
+  uint32_t magic;
+  uint32_t status;
+  uint32_t value;  // MUTATE: the number of mutants; ADD: the new tree id
+  uint32_t len;    // the length of the payload
+
+} mutator_daemon_response_t;
+
+typedef struct mutator_daemon_stats {
+
+  uint64_t num_trees;     // the number of trees in the corpus
+  uint64_t num_chunks;    // the number of chunks in the chunk store
+  uint64_t num_requests;  // the number of served requests
+  uint64_t num_mutants;   // the number of sent mutants
+  uint64_t num_added;     // the number of added inputs
+  uint64_t uptime_ms;
+
+} mutator_daemon_stats_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
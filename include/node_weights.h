@@ -0,0 +1,49 @@
+#ifndef __NODE_WEIGHTS_H__
+#define __NODE_WEIGHTS_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the number of new mutations between two updates of the learned weights
+#define NODE_WEIGHTS_UPDATE_INTERVAL (10000)
+
+// the learned yield scales a weight by at most this factor (or its inverse)
+#define NODE_WEIGHTS_MAX_SCALE (16)
+
+/**
+ * Pick the nodes to mutate by the weights of their types, instead of
+ * uniformly. The weight of a node type is the static weight from the weight
+ * table (1 by default), scaled by how often mutating this node type produced
+ * new queue entries compared to all node types, if learning.
+ * @param  filename A weight table with a line "<node type> <weight>" for each
+ *                  weighted node type (e.g., "node_array 0.1"), or NULL
+ * @param  learn    Whether to scale the weights by the learned yield
+ * @return          True if the nodes are picked by weights; False if neither
+ *                  a weight table nor learning is given, or on errors
+ */
+bool node_weights_init(const char *filename, bool learn);
+
+/**
+ * Recompute the learned weights from the yield statistics (see
+ * `stats_add_new_entry`), at most once per NODE_WEIGHTS_UPDATE_INTERVAL
+ * mutations. Weight sums of existing trees are only updated by
+ * `node_get_size`.
+ * @return True if the weights have changed; otherwise, False
+ */
+bool node_weights_update();
+
+/**
+ * Pick nodes uniformly again and free all weights
+ */
+void node_weights_clear();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
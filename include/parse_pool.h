@@ -0,0 +1,90 @@
+#ifndef __PARSE_POOL_H__
+#define __PARSE_POOL_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// a pool of worker threads parsing test cases in the background
+typedef struct parse_pool parse_pool_t;
+
+/**
+ * The callback receiving a parsed test case (see `parse_pool_drain`)
+ * @param arg          The argument passed to `parse_pool_drain`
+ * @param test_case_fn The path to the parsed test case
+ * @param tree_fn      The path to the written tree file, or an empty string
+ * @param tree         The parsed tree with its sizes calculated. The callback
+ *                     takes the ownership of the tree.
+ */
+typedef void (*parse_pool_result_func_t)(void *arg, const char *test_case_fn,
+                                         const char *tree_fn, tree_t *tree);
+
+/**
+ * Create a parse pool and start all worker threads
+ * @param  num_threads The number of worker threads
+ * @return             A newly created parse pool, or NULL on errors
+ */
+parse_pool_t *parse_pool_create(size_t num_threads);
+
+/**
+ * Wait for running parses, drop all queued parses and parsed trees, stop all
+ * worker threads and free all memory
+ * @param pool The parse pool
+ */
+void parse_pool_free(parse_pool_t *pool);
+
+/**
+ * Queue a test case to parse. A worker thread reads the tree file `tree_fn`
+ * if it exists; otherwise, it parses the test case and writes the tree to
+ * `tree_fn` (see `tree_store_load_test_case`). Since the chunk store and the
+ * tree cache are not thread-safe, parsed trees are handed over by
+ * `parse_pool_drain`.
+ * @param  pool         The parse pool
+ * @param  test_case_fn The path to the test case
+ * @param  tree_fn      The path to the tree file. An empty string skips
+ *                      writing the tree file.
+ * @return              True if the test case has been queued or is already
+ *                      pending; otherwise, False
+ */
+bool parse_pool_submit(parse_pool_t *pool, const char *test_case_fn,
+                       const char *tree_fn);
+
+/**
+ * Make sure that the given test case is not being parsed in the background. A
+ * queued parse is taken over and done on the calling thread, while a running
+ * parse is waited on. The result still has to be collected by
+ * `parse_pool_drain`.
+ * @param  pool         The parse pool
+ * @param  test_case_fn The path to the test case
+ * @return              True if the test case was pending; otherwise, False
+ */
+bool parse_pool_wait(parse_pool_t *pool, const char *test_case_fn);
+
+/**
+ * Hand over all parsed trees to `func` on the calling thread. Test cases that
+ * cannot be parsed are silently dropped.
+ * @param  pool The parse pool
+ * @param  func The callback receiving parsed trees
+ * @param  arg  The argument passed to the callback
+ * @return      The number of finished parses, including failures
+ */
+size_t parse_pool_drain(parse_pool_t *pool, parse_pool_result_func_t func,
+                        void *arg);
+
+/**
+ * Get the number of queued or running parses
+ * @param  pool The parse pool
+ * @return      The number of queued or running parses
+ */
+size_t parse_pool_get_num_pending(parse_pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
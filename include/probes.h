@@ -0,0 +1,37 @@
+#ifndef __PROBES_H__
+#define __PROBES_H__
+
+/*
+ * Static tracepoints (USDT probes) of the provider "grammar_mutator", e.g.,
+ *
+ *   perf probe -x libgrammarmutator-json.so sdt_grammar_mutator:fuzz__entry
+ *   bpftrace -e 'usdt:./libgrammarmutator-json.so:grammar_mutator:fuzz__return
+ *                { @len = hist(arg2); }'
+ *
+ * A probe is a single `nop` until a tracer attaches to it, and its arguments
+ * are only read by the tracer. Without `sys/sdt.h` (systemtap-sdt-dev), or
+ * with DISABLE_PROBES, the probes compile to nothing; their arguments are not
+ * evaluated.
+ */
+
+#if !defined(DISABLE_PROBES) && defined(__has_include)
+  #if __has_include(<sys/sdt.h>)
+    #include <sys/sdt.h>
+    #define HAVE_PROBES
+  #endif
+#endif
+
+#ifdef HAVE_PROBES
+  #define PROBE0(name) DTRACE_PROBE(grammar_mutator, name)
+  #define PROBE1(name, a) DTRACE_PROBE1(grammar_mutator, name, a)
+  #define PROBE2(name, a, b) DTRACE_PROBE2(grammar_mutator, name, a, b)
+  #define PROBE3(name, a, b, c) DTRACE_PROBE3(grammar_mutator, name, a, b, c)
+#else
+  #define PROBE0(name) ((void)0)
+  #define PROBE1(name, a) ((void)sizeof(a))
+  #define PROBE2(name, a, b) ((void)sizeof(a), (void)sizeof(b))
+  #define PROBE3(name, a, b, c) \
+    ((void)sizeof(a), (void)sizeof(b), (void)sizeof(c))
+#endif
+
+#endif
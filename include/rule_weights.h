@@ -0,0 +1,65 @@
+#ifndef __RULE_WEIGHTS_H__
+#define __RULE_WEIGHTS_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the resolution of the probabilities in the alias tables
+#define RULE_WEIGHTS_ALIAS_ONE (1 << 16)
+
+/**
+ * Pick the rules of generated subtrees by their weights, instead of uniformly.
+ * The weight of a rule is its static weight from the grammar file (1 by
+ * default; see `node_rule_weights`), multiplied by a dynamic scale (see
+ * `rule_weights_set_scales`). Picking a rule takes O(1) with an alias table
+ * for each budget tier of each node type (see `node_rule_tiers`).
+ * @return True if the grammar file has any static weight, so that the rules
+ *         are picked by weights; otherwise, False
+ */
+bool rule_weights_init();
+
+/**
+ * Set the dynamic scales of the rules of a node type, and rebuild its alias
+ * tables. Rules are picked by weights from then on.
+ * @param  node_type The node type
+ * @param  scales    The scale of each rule of `node_type`, or NULL to reset all
+ *                   scales of `node_type` to 1
+ * @return           True if the alias tables have been rebuilt; otherwise,
+ *                   False (e.g., an invalid node type)
+ */
+bool rule_weights_set_scales(uint32_t node_type, const double *scales);
+
+/**
+ * Get the weight of a rule
+ * @param  node_type The node type
+ * @param  rule_id   The index of the rule of `node_type`
+ * @return           The static weight multiplied by the dynamic scale
+ */
+double rule_weights_get(uint32_t node_type, uint32_t rule_id);
+
+/**
+ * Pick one of the first `rules_that_fit` rules of a node type by their
+ * weights. This is the `gen_rule_picker` once weights are set. If all of them
+ * weigh zero, or `rules_that_fit` is not a budget tier of `node_type`, the rule
+ * is picked uniformly.
+ * @param  node_type      The node type
+ * @param  rules_that_fit The number of rules to pick from
+ * @return                The index of the picked rule
+ */
+int rule_weights_pick(int node_type, int rules_that_fit);
+
+/**
+ * Pick rules uniformly again, and free all alias tables
+ */
+void rule_weights_clear();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef __F1_C_FUZZ_H__
+#define __F1_C_FUZZ_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The interface of the generated `f1_c_fuzz.h` (see `grammars/f1_c_gen.py`)
+ * for the runtime build, which loads the grammar file at the initialization
+ * (see `f1_runtime_load`) instead of generating code for it. The tables have
+ * room for `F1_RUNTIME_MAX_NODE_TYPES` node types, and are all zeros beyond
+ * the node types of the loaded grammar.
+ */
+#define F1_RUNTIME
+
+#define F1_RUNTIME_MAX_NODE_TYPES 1024
+
+/**
+ * Load a grammar file (see `grammar_runtime_load`) in place of the previous
+ * one. Trees of the previous grammar must have been freed.
+ * @param  filename The path to the grammar file
+ * @return          True on success; otherwise, False, and the previous grammar
+ *                  stays
+ */
+bool f1_runtime_load(const char *filename);
+
+/**
+ * Unload the grammar, if any
+ */
+void f1_runtime_unload();
+
+tree_t *gen_init__(int max_len);
+
+enum node_type { NODE_TERM__ = 0 };
+const char *node_type_str(int node_type);
+
+// generate a subtree of a node type
+node_t *gen_node(int node_type, int max_len, int *consumed, int rule_index);
+extern size_t node_min_lens[F1_RUNTIME_MAX_NODE_TYPES];
+extern size_t node_num_rules[F1_RUNTIME_MAX_NODE_TYPES];
+
+// the static weights of the rules of each node type from the grammar file (in
+// the same order as `rule_index`), or NULL if there are none
+extern const double *node_rule_weights[F1_RUNTIME_MAX_NODE_TYPES];
+// all possible numbers of rules that fit the budget of each node type
+extern const size_t *node_rule_tiers[F1_RUNTIME_MAX_NODE_TYPES];
+extern size_t        node_num_rule_tiers[F1_RUNTIME_MAX_NODE_TYPES];
+
+typedef int (*gen_rule_picker_t)(int node_type, int rules_that_fit);
+extern gen_rule_picker_t gen_rule_picker;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
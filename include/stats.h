@@ -0,0 +1,293 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the name of the statistics file, next to `fuzzer_stats` of afl-fuzz
+#define STATS_FILENAME "grammar_mutator_stats"
+
+// the name of the table of mutations and new queue entries per node type,
+// next to the statistics file
+#define STATS_YIELD_FILENAME "grammar_mutator_yield.csv"
+
+typedef enum stats_stage {
+
+  STATS_RULES_MUTATION = 0,
+  STATS_RANDOM_MUTATION,
+  STATS_RANDOM_RECURSIVE_MUTATION,
+  STATS_SPLICING_MUTATION,
+  STATS_SUBTREE_TRIMMING,
+  STATS_RECURSIVE_TRIMMING,
+  STATS_NUM_STAGES
+
+} stats_stage_t;
+
+typedef enum stats_load {
+
+  STATS_PARSE = 0,    // `tree_from_buf` of a test case
+  STATS_DESERIALIZE,  // `tree_deserialize` of a tree file
+  STATS_NUM_LOADS
+
+} stats_load_t;
+
+// where `afl_custom_queue_get` found the tree of a queue entry
+typedef enum stats_source {
+
+  STATS_FROM_TREE_CACHE = 0,
+  STATS_FROM_TREE_FILE,
+  STATS_FROM_TEST_CASE,  // parsed, or found in the tree store
+  STATS_NO_TREE,
+  STATS_NUM_SOURCES
+
+} stats_source_t;
+
+// hot paths with latency histograms (compiled in with ENABLE_PROFILING)
+typedef enum stats_profile {
+
+  STATS_PROFILE_TREE_FROM_BUF = 0,
+  STATS_PROFILE_TREE_DESERIALIZE,
+  STATS_PROFILE_TREE_CLONE,
+  STATS_PROFILE_TREE_TO_BUF,
+  STATS_PROFILE_TREE_GET_SIZE,
+  STATS_PROFILE_RULES_MUTATION,
+  STATS_PROFILE_RANDOM_MUTATION,
+  STATS_PROFILE_RANDOM_RECURSIVE_MUTATION,
+  STATS_PROFILE_SPLICING_MUTATION,
+  STATS_PROFILE_CHUNK_STORE_ADD_TREE,
+  STATS_PROFILE_WRITE_TREE_TO_FILE,
+  STATS_NUM_PROFILES
+
+} stats_profile_t;
+
+typedef struct stats_profile_scope {
+
+  stats_profile_t profile;
+  uint64_t        start;
+
+} stats_profile_scope_t;
+
+/**
+ * A cheap monotonic timestamp in CPU cycles (TSC on x86), which is converted
+ * into seconds only when the statistics file is written
+ * @return The current timestamp
+ */
+static inline uint64_t stats_cycles() {
+
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  uint64_t cycles;
+  __asm__ volatile("mrs %0, cntvct_el0" : "=r"(cycles));
+  return cycles;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+
+}
+
+/**
+ * Record one call of a hot path. This can be called from any thread.
+ * @param profile The hot path
+ * @param cycles  The latency in cycles (see `stats_cycles`)
+ */
+void stats_add_profile(stats_profile_t profile, uint64_t cycles);
+
+static inline void stats_profile_scope_end(stats_profile_scope_t *scope) {
+
+  stats_add_profile(scope->profile, stats_cycles() - scope->start);
+
+}
+
+/**
+ * Record the latency of the enclosing block (i.e., until it is left, by any
+ * `return`) into the histogram of `profile`. This is a no-op unless compiled
+ * with ENABLE_PROFILING.
+ */
+#ifdef ENABLE_PROFILING
+  #define STATS_PROFILE(profile)                           \
+    stats_profile_scope_t __stats_profile_scope            \
+        __attribute__((cleanup(stats_profile_scope_end))) = \
+            {(profile), stats_cycles()}
+#else
+  #define STATS_PROFILE(profile) ((void)0)
+#endif
+
+/**
+ * Reset all statistics and start the clock
+ * @param interval The minimal interval between two writes of the statistics
+ *                 file in seconds. Zero disables the statistics file.
+ */
+void stats_init(size_t interval);
+
+/**
+ * Set the statistics file. Nothing is written before it is set.
+ * @param filename The path to the statistics file
+ */
+void stats_set_filename(const char *filename);
+
+/**
+ * Get the statistics file
+ * @return The path to the statistics file, or an empty string if it is not
+ *         set (or the statistics file is disabled)
+ */
+const char *stats_get_filename();
+
+/**
+ * Record one mutation or trimming step
+ * @param stage  The stage
+ * @param cycles The latency in cycles (see `stats_cycles`)
+ */
+void stats_add_stage(stats_stage_t stage, uint64_t cycles);
+
+/**
+ * Record one parse or deserialization. This can be called from any thread.
+ * @param load    Parsing or deserialization
+ * @param cycles  The latency in cycles (see `stats_cycles`)
+ * @param success Whether a tree has been created
+ */
+void stats_add_load(stats_load_t load, uint64_t cycles, bool success);
+
+/**
+ * Record where the tree of a queue entry comes from
+ * @param source The source of the tree
+ */
+void stats_add_source(stats_source_t source);
+
+/**
+ * Record one test case returned to afl-fuzz
+ * @param tree_size The number of non-terminal nodes of the mutated tree
+ * @param out_len   The length of the rendered test case
+ * @param truncated Whether the test case is truncated to `max_size`
+ */
+void stats_add_output(size_t tree_size, size_t out_len, bool truncated);
+
+/**
+ * Record a finished trimming of a test case
+ * @param orig_len    The length of the test case before trimming
+ * @param trimmed_len The length of the test case after trimming
+ */
+void stats_add_trim(size_t orig_len, size_t trimmed_len);
+
+/**
+ * Record one mutation of a node type, i.e., one execution spent on it
+ * @param stage     The mutation stage
+ * @param node_type The mutated node type (see `tree_mutation_get_node_type`),
+ *                  or -1 if the tree was not changed
+ */
+void stats_add_mutation(stats_stage_t stage, int node_type);
+
+/**
+ * Record one mutated test case that afl-fuzz saved into the queue
+ * @param stage     The mutation stage that created the test case
+ * @param node_type The mutated node type, as in `stats_add_mutation`
+ */
+void stats_add_new_entry(stats_stage_t stage, int node_type);
+
+/**
+ * Get the number of mutations of a node type in a stage
+ * @param  stage     The mutation stage
+ * @param  node_type The node type, or -1 for unchanged trees
+ * @return           The number of mutations
+ */
+size_t stats_get_mutation_count(stats_stage_t stage, int node_type);
+
+/**
+ * Get the number of new queue entries from mutating a node type in a stage
+ * @param  stage     The mutation stage
+ * @param  node_type The node type, or -1 for unchanged trees
+ * @return           The number of new queue entries
+ */
+size_t stats_get_new_entry_count(stats_stage_t stage, int node_type);
+
+/**
+ * Get the number of recorded steps of a stage
+ * @param  stage The stage
+ * @return       The number of steps
+ */
+size_t stats_get_stage_count(stats_stage_t stage);
+
+/**
+ * Get a percentile of the latencies of a stage. Latencies are kept in buckets
+ * of about 1/8 of a power of two, so the result is the upper bound of the
+ * bucket of the percentile.
+ * @param  stage      The stage
+ * @param  percentile The percentile, e.g., 0.99
+ * @return            The latency in cycles, or 0 if there are no steps
+ */
+uint64_t stats_get_stage_percentile(stats_stage_t stage, double percentile);
+
+/**
+ * Get the name of a hot path, e.g., "tree_clone"
+ * @param  profile The hot path
+ * @return         The name
+ */
+const char *stats_get_profile_name(stats_profile_t profile);
+
+/**
+ * Get the number of recorded calls of a hot path
+ * @param  profile The hot path
+ * @return         The number of calls
+ */
+size_t stats_get_profile_count(stats_profile_t profile);
+
+/**
+ * Get a percentile of the latencies of a hot path, in the same way as
+ * `stats_get_stage_percentile`
+ * @param  profile    The hot path
+ * @param  percentile The percentile, e.g., 0.999
+ * @return            The latency in cycles, or 0 if there are no calls
+ */
+uint64_t stats_get_profile_percentile(stats_profile_t profile,
+                                      double          percentile);
+
+/**
+ * Clear the histograms of all hot paths, which `stats_init` keeps
+ */
+void stats_reset_profiles();
+
+/**
+ * Convert cycles (see `stats_cycles`) into nanoseconds, with the cycle rate
+ * measured since the program started
+ * @param  cycles The cycles
+ * @return        The nanoseconds
+ */
+double stats_cycles_to_ns(uint64_t cycles);
+
+/**
+ * Write the statistics file, if at least `interval` seconds have passed since
+ * the last write. Most calls only read the cycle counter.
+ * @return True if the file has been written; otherwise, False
+ */
+bool stats_maybe_write();
+
+/**
+ * Write the statistics file now (to a temporary file, and then rename it)
+ * @return True on success; otherwise, False
+ */
+bool stats_write();
+
+/**
+ * Write the mutations and new queue entries per node type and stage as CSV
+ * (`STATS_YIELD_FILENAME`, next to the statistics file)
+ * @return True on success; otherwise, False
+ */
+bool stats_write_yield();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*thread_pool_func_t)(void *arg);
+
+// a fixed-size pool of worker threads, consuming tasks in FIFO order
+typedef struct thread_pool thread_pool_t;
+
+/**
+ * Create a thread pool and start all worker threads
+ * @param  num_threads The number of worker threads
+ * @return             A newly created thread pool, or NULL on errors
+ */
+thread_pool_t *thread_pool_create(size_t num_threads);
+
+/**
+ * Wait for all submitted tasks, stop all worker threads and free all memory
+ * @param pool The thread pool
+ */
+void thread_pool_free(thread_pool_t *pool);
+
+/**
+ * Submit a task to the thread pool. `func(arg)` will be invoked by one of the
+ * worker threads.
+ * @param  pool The thread pool
+ * @param  func The task function
+ * @param  arg  The argument passed to the task function
+ * @return      True if the task has been queued; otherwise, False
+ */
+bool thread_pool_submit(thread_pool_t *pool, thread_pool_func_t func,
+                        void *arg);
+
+/**
+ * Block until all submitted tasks have been finished
+ * @param pool The thread pool
+ */
+void thread_pool_wait(thread_pool_t *pool);
+
+/**
+ * Get the number of worker threads in the thread pool
+ * @param  pool The thread pool
+ * @return      The number of worker threads
+ */
+size_t thread_pool_get_num_threads(thread_pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
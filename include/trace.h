@@ -0,0 +1,131 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the maximal number of integer arguments and strings of a trace record
+#define TRACE_MAX_ARGS (7)
+#define TRACE_MAX_STRS (2)
+
+// One `afl_custom_*` call. The arguments of each call are listed below, in the
+// order of `args`, followed by the strings in `strs`. Buffers are recorded as
+// their lengths and 64-bit hashes (see `trace_hash`).
+typedef enum trace_op {
+
+  // seed, success; the configuration ("NAME=value ...")
+  TRACE_INIT = 0,
+  // -
+  TRACE_DEINIT,
+  // test case length, test case hash, result; filename
+  TRACE_QUEUE_GET,
+  // test case length, test case hash; new filename, original filename (NULL
+  // for imported test cases)
+  TRACE_QUEUE_NEW_ENTRY,
+  // buf_size, buf hash, result
+  TRACE_FUZZ_COUNT,
+  // buf_size, buf hash, add_buf_size, add_buf hash, max_size, output length,
+  // output hash
+  TRACE_FUZZ,
+  // buf_size, buf hash, result
+  TRACE_INIT_TRIM,
+  // output length, output hash
+  TRACE_TRIM,
+  // success, result
+  TRACE_POST_TRIM,
+  TRACE_NUM_OPS
+
+} trace_op_t;
+
+typedef struct trace_record {
+
+  trace_op_t  op;
+  uint64_t    time_ns;  // the latency of the call
+  uint64_t    args[TRACE_MAX_ARGS];
+  const char *strs[TRACE_MAX_STRS];
+
+} trace_record_t;
+
+typedef struct trace_reader trace_reader_t;
+
+/**
+ * Get the name of a call, e.g., "fuzz"
+ * @param  op The call
+ * @return    The name
+ */
+const char *trace_op_name(trace_op_t op);
+
+/**
+ * Hash a buffer, as the recorded buffers are hashed
+ * @param  buf The buffer, which can be NULL if `len` is zero
+ * @param  len The length of the buffer
+ * @return     The hash
+ */
+uint64_t trace_hash(const uint8_t *buf, size_t len);
+
+/**
+ * Hash a file, as the recorded test cases are hashed
+ * @param  filename The file
+ * @param  len      The output length of the file
+ * @return          The hash, or 0 if the file cannot be read
+ */
+uint64_t trace_hash_file(const char *filename, size_t *len);
+
+/**
+ * Start recording all calls into a trace file, replacing an existing one
+ * @param  filename The trace file
+ * @return          True on success; otherwise, False
+ */
+bool trace_start(const char *filename);
+
+/**
+ * Finish recording and close the trace file
+ */
+void trace_stop();
+
+/**
+ * Check whether calls are being recorded
+ * @return True if a trace file is open; otherwise, False
+ */
+bool trace_is_recording();
+
+/**
+ * Append a call to the trace file, if recording
+ * @param record The call
+ */
+void trace_write(const trace_record_t *record);
+
+/**
+ * Open a trace file for reading. A trace recorded with another grammar is
+ * rejected.
+ * @param  filename The trace file
+ * @return          A newly created reader, or NULL on errors
+ */
+trace_reader_t *trace_reader_open(const char *filename);
+
+/**
+ * Read the next call. The strings are valid until the next call of
+ * `trace_read`.
+ * @param  reader The reader
+ * @param  record The output call
+ * @return        True if a call has been read; False at the end of the trace
+ *                or on a truncated record
+ */
+bool trace_read(trace_reader_t *reader, trace_record_t *record);
+
+/**
+ * Close a trace file and free all memory
+ * @param reader The reader
+ */
+void trace_reader_close(trace_reader_t *reader);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -31,13 +31,19 @@ struct tree_node {
   node_t **subnodes;
   uint32_t subnode_count;
 
-  // The following two sizes are calculated by `node_get_size`
+  // The following four sizes are calculated by `node_get_size`
   size_t recursion_edge_size;  // the total number of recursion edges in the
   // subtree
-  size_t non_term_size;  // the number of non-terminal nodes in the subtree
+  size_t   non_term_size;  // the number of non-terminal nodes in the subtree
+  size_t   data_len;       // the length of the concrete data of the subtree
+  uint64_t weight_sum;  // the total weight of the non-terminal nodes in the
+                        // subtree (see `node_set_type_weights`)
 
 };
 
+// the weight of a node type if no weights are set
+#define NODE_WEIGHT_ONE (256)
+
 typedef struct edge edge_t;
 struct edge {
 
@@ -126,8 +132,8 @@ node_t *node_clone(node_t *node);
 bool node_equal(node_t *node_a, node_t *node_b);
 
 /**
- * Calculate the total number of non-terminal subnodes and the total number of
- * recursive edges in the tree
+ * Calculate the total number of non-terminal subnodes, the total number of
+ * recursive edges and the length of the concrete data in the tree
  * @param  node The root node of a tree
  */
 void node_get_size(node_t *node);
@@ -156,6 +162,35 @@ bool node_replace_subnode(node_t *root, node_t *subnode, node_t *new_subnode);
  */
 node_t *node_pick_non_term_subnode(node_t *node);
 
+/**
+ * Pick a non-terminal subnode in a tree (`node`) with a probability of `the
+ * weight of its type / the total weight of the tree`, using the weight sums
+ * calculated by `node_get_size`. Like `node_pick_non_term_subnode`, it only
+ * walks down one path of the tree.
+ * @param node The root node of a tree
+ * @return     The randomly picked subnode
+ */
+node_t *node_pick_weighted_non_term_subnode(node_t *node);
+
+/**
+ * Set the weights of all node types, which are summed up by `node_get_size`.
+ * Node types without a weight have the weight `NODE_WEIGHT_ONE`, and terminal
+ * nodes have none. The weights of the same number of node types are updated in
+ * place, while other threads may be creating nodes; otherwise, no other thread
+ * may be creating nodes (e.g., a parse pool).
+ * @param weights   The weight of each node type (copied), or NULL to reset all
+ *                  weights to `NODE_WEIGHT_ONE`
+ * @param num_types The number of node types in `weights`
+ */
+void node_set_type_weights(const uint32_t *weights, size_t num_types);
+
+/**
+ * Get the weight of a node type
+ * @param  id The node type
+ * @return    The weight
+ */
+uint32_t node_get_type_weight(uint32_t id);
+
 /**
  * Similar to `node_pick_non_term_subnode`, this function uniformly picks a
  * recursion edge, in which two end points have the same node type (i.e., `id`).
@@ -208,6 +243,30 @@ void tree_free(tree_t *tree);
  */
 void tree_to_buf(tree_t *tree);
 
+/**
+ * Convert a parsing tree into a concrete test case stored in a caller-provided
+ * buffer. Unlike `tree_to_buf`, the data buffer of the tree is not touched.
+ * The output relies on the lengths cached by `tree_get_size`, and the
+ * conversion stops once `max_size` bytes have been written.
+ * @param  tree     The parsing tree
+ * @param  buf      The output buffer, which can hold at least `max_size` bytes
+ * @param  max_size The maximal number of bytes to write
+ * @return          The number of written bytes
+ */
+size_t tree_render_to_buf(tree_t *tree, uint8_t *buf, size_t max_size);
+
+/**
+ * Configure the parallel path of `tree_render_to_buf`. Test cases with at
+ * least `threshold` bytes are rendered by `num_threads` worker threads, each
+ * of which copies disjoint subtrees into their final positions of the output
+ * buffer. The worker threads are created on the first parallel rendering.
+ * @param threshold   The minimal length of a test case to render in parallel.
+ *                    Zero disables the parallel rendering and stops the
+ *                    worker threads.
+ * @param num_threads The number of worker threads
+ */
+void tree_set_parallel_render(size_t threshold, size_t num_threads);
+
 /**
  * Parse the given buffer to construct a parsing tree
  * @param  data_buf  The buffer of a test case
@@ -254,6 +313,22 @@ bool tree_equal(tree_t *tree_a, tree_t *tree_b);
  */
 size_t tree_get_size(tree_t *tree);
 
+/**
+ * Get the length of the concrete test case of a given tree, which is cached by
+ * the last `tree_get_size` call
+ * @param  tree A given tree
+ * @return      The length of the concrete test case
+ */
+size_t tree_get_data_len(tree_t *tree);
+
+/**
+ * Estimate the heap memory held by the nodes of a given tree (i.e., the node
+ * structures, the attached values and the subnode arrays)
+ * @param  tree A given tree
+ * @return      The memory footprint of the tree in bytes
+ */
+size_t tree_get_mem_size(tree_t *tree);
+
 /**
  * Get all recursion edges in the tree, and store them in a linked list
  * @param tree A given tree
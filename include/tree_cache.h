@@ -0,0 +1,65 @@
+#ifndef __TREE_CACHE_H__
+#define __TREE_CACHE_H__
+
+#include "tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Initialize the tree cache, which keeps deserialized trees in memory, indexed
+ * by the names of their tree files, so that revisiting a queue entry does not
+ * need to read the trees folder again.
+ * @param max_mem_size The memory budget of all cached trees in bytes (see
+ *                     `tree_get_mem_size`). Zero disables the cache.
+ */
+void tree_cache_init(size_t max_mem_size);
+
+/**
+ * Add a tree to the cache, replacing the cached tree with the same name, if
+ * any. The sizes calculated by `tree_get_size` are kept in the cache.
+ * @param  name The name of the tree file
+ * @param  tree The tree. The cache takes the ownership of the tree, only if
+ *              the tree has been added.
+ * @return      True if the tree has been added; otherwise (e.g., the memory
+ *              budget is exceeded), False
+ */
+bool tree_cache_put(const char *name, tree_t *tree);
+
+/**
+ * Get a copy of a cached tree
+ * @param  name The name of the tree file
+ * @return      A newly created tree with the same data as the cached tree, or
+ *              NULL if there is no such tree in the cache
+ */
+tree_t *tree_cache_get(const char *name);
+
+/**
+ * Remove a tree from the cache and free it
+ * @param name The name of the tree file
+ */
+void tree_cache_remove(const char *name);
+
+/**
+ * Get the number of cached trees
+ * @return The number of cached trees
+ */
+size_t tree_cache_get_num_trees();
+
+/**
+ * Get the memory footprint of all cached trees
+ * @return The memory footprint in bytes
+ */
+size_t tree_cache_get_mem_size();
+
+/**
+ * Free all cached trees
+ */
+void tree_cache_clear();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -13,6 +13,21 @@ extern "C" {
  */
 void tree_set_max_len(size_t max_len);
 
+/**
+ * Pick the nodes of the random mutation and the splicing mutation by the
+ * weights of their types (see `node_set_type_weights`), instead of uniformly.
+ * The default value is false
+ * @param enabled Whether to pick nodes by their weights
+ */
+void tree_set_weighted_pick(bool enabled);
+
+/**
+ * Only try the rare rules (see `coverage_is_rare`) in the rules mutation. The
+ * default value is false
+ * @param enabled Whether to skip the rules covered by many inputs
+ */
+void tree_set_coverage_bias(bool enabled);
+
 /**
  * Reference: "NAUTILUS: Fishing for Deep Bugs with Grammars", NDSS 2019
  * Link:
@@ -43,6 +58,15 @@ tree_t *rules_mutation(tree_t *tree, node_t *node, uint32_t rule_id);
  */
 size_t rules_mutation_count(tree_t *tree);
 
+/**
+ * Check whether the rules mutation tries a rule for a node, which is not the
+ * current rule of the node, and a rare rule if biased by the coverage
+ * @param  node    A non-terminal node
+ * @param  rule_id A rule index of the node type
+ * @return         True if the rule is tried; otherwise, False
+ */
+bool rules_mutation_tries(node_t *node, uint32_t rule_id);
+
 /**
  * Pick a random recursion of a tree and repeats that recursion 2^n times
  * (0 < n < 16). This creates trees with higher degree of nesting.
@@ -64,6 +88,26 @@ tree_t *random_recursive_mutation(tree_t *tree, uint8_t n);
  */
 tree_t *splicing_mutation(tree_t *tree);
 
+/**
+ * Apply one of the four mutations above, picked uniformly: a rules mutation of
+ * a random node with another random rule, a random mutation, a random
+ * recursive mutation (a random mutation if there is no recursion), or a
+ * splicing mutation. Unlike `rules_mutation`, the input tree is never touched,
+ * so that several threads can mutate the same tree at once.
+ * @param  tree  A sized parsing tree (see `tree_get_size`)
+ * @param  max_n The maximal recursion factor of the random recursive mutation
+ * @return       A mutated parsing tree
+ */
+tree_t *random_any_mutation(tree_t *tree, uint8_t max_n);
+
+/**
+ * Get the type of the node that the last mutation of the calling thread
+ * replaced (or, for the random recursive mutation, the type of the repeated
+ * recursion), which the yield statistics are attributed to
+ * @return The node type, or -1 if the last mutation did not change the tree
+ */
+int tree_mutation_get_node_type();
+
 #ifdef __cplusplus
 }
 #endif
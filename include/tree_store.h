@@ -0,0 +1,109 @@
+#ifndef __TREE_STORE_H__
+#define __TREE_STORE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tree.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the length of a tree store key (a hex-encoded 128-bit hash), without the null
+#define TREE_STORE_KEY_LEN (32)
+
+/**
+ * Initialize the host-wide tree store, a folder of serialized trees shared by
+ * all fuzzing instances. Trees are keyed by the content hash of their test
+ * cases and never modified once written, so that instances only hardlink
+ * their tree files to the shared copies. All functions below can be called
+ * from any thread after the initialization.
+ * @param  store_dir The store folder, which is created if it does not exist.
+ *                   NULL or an empty string disables the tree store.
+ * @return           True if the tree store is enabled; otherwise, False
+ */
+bool tree_store_init(const char *store_dir);
+
+/**
+ * Disable the tree store. The store folder is kept on the disk.
+ */
+void tree_store_clear();
+
+/**
+ * Check whether the tree store is enabled
+ * @return True if the tree store is enabled; otherwise, False
+ */
+bool tree_store_enabled();
+
+/**
+ * Compute the key of a test case
+ * @param buf The buffer of the test case
+ * @param len The length of the test case
+ * @param key The output key
+ */
+void tree_store_hash_buf(const uint8_t *buf, size_t len,
+                         char key[TREE_STORE_KEY_LEN + 1]);
+
+/**
+ * Compute the key of a test case file
+ * @param  filename The path to the test case
+ * @param  key      The output key
+ * @return          True if the file has been read; otherwise, False
+ */
+bool tree_store_hash_file(const char *filename,
+                          char        key[TREE_STORE_KEY_LEN + 1]);
+
+/**
+ * Compute the key of the test case of a tree, without rendering it
+ * @param tree The tree
+ * @param key  The output key
+ */
+void tree_store_hash_tree(tree_t *tree, char key[TREE_STORE_KEY_LEN + 1]);
+
+/**
+ * Add a tree to the tree store, if it is not there yet, and then link the
+ * tree file to the stored copy. The tree file is atomically replaced rather
+ * than written in place, as it may be a link to another stored tree.
+ * @param  tree    The tree
+ * @param  key     The key of the test case of the tree
+ * @param  tree_fn The path to the tree file, or NULL to skip linking
+ * @return         True on success; otherwise, False
+ */
+bool tree_store_put(tree_t *tree, const char *key, const char *tree_fn);
+
+/**
+ * Read a tree from the tree store, and link the tree file to the stored copy
+ * @param  key     The key of the test case
+ * @param  tree_fn The path to the tree file, or NULL to skip linking
+ * @return         The deserialized tree, or NULL if there is no such tree
+ */
+tree_t *tree_store_get(const char *key, const char *tree_fn);
+
+/**
+ * Write a tree file. With the tree store enabled, the tree is added to the
+ * store, keyed by the test case of the tree, and the tree file becomes a link
+ * to the stored copy. Otherwise, this is the same as `write_tree_to_file`.
+ * @param tree    The tree
+ * @param tree_fn The path to the tree file, or NULL or "" to do nothing
+ */
+void tree_store_save_tree(tree_t *tree, const char *tree_fn);
+
+/**
+ * Load the tree of a test case file. With the tree store enabled, a stored
+ * tree with the same test case is reused, or the parsed tree is added to the
+ * store. Otherwise, this is the same as `load_tree_from_test_case` followed by
+ * `write_tree_to_file`.
+ * @param  test_case_fn The path to the test case
+ * @param  tree_fn      The path to the tree file, or NULL to skip writing it
+ * @return              The tree, or NULL if the test case cannot be parsed
+ */
+tree_t *tree_store_load_test_case(const char *test_case_fn,
+                                  const char *tree_fn);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
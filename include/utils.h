@@ -78,6 +78,13 @@ RANDOM_RETURN random_next();
  */
 uint32_t random_below(uint32_t limit);
 
+/**
+ * Same as `random_below`, but for limits beyond 32 bits
+ * @param limit The maximum limit of the generated random number
+ * @return      A random number that is smaller than `limit`
+ */
+uint64_t random_below64(uint64_t limit);
+
 #ifdef __cplusplus
 }
 #endif
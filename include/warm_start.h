@@ -0,0 +1,48 @@
+#ifndef __WARM_START_H__
+#define __WARM_START_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct warm_start_stats {
+
+  size_t num_files;       // the number of files in the trees folder
+  size_t num_loaded;      // the number of loaded trees
+  size_t num_cached;      // the number of trees added into the tree cache
+  size_t num_duplicates;  // the number of trees seen by the chunk store before
+  size_t num_failed;      // the number of unreadable tree files
+  size_t num_skipped;     // the number of tree files skipped due to the budget
+  size_t mem_size;        // the memory footprint of all loaded trees
+  double elapsed;         // time-to-ready in seconds
+
+} warm_start_stats_t;
+
+/**
+ * Load all serialized trees in a trees folder, and add them into the chunk
+ * store and the tree cache. Worker threads read and deserialize tree files,
+ * while the calling thread adds the trees into the chunk store and the tree
+ * cache, which are not thread-safe. Both have to be initialized beforehand.
+ * @param  trees_dir   The trees folder (e.g., `out/default/trees`)
+ * @param  num_threads The number of worker threads. Zero loads all trees on
+ *                     the calling thread.
+ * @param  mem_budget  Stop loading trees once the memory footprint (see
+ *                     `tree_get_mem_size`) of loaded trees reaches this many
+ *                     bytes
+ * @param  verbose     Whether to report the progress on stderr
+ * @param  stats       Optional output of the statistics
+ * @return             True if the trees folder has been scanned; otherwise,
+ *                     False
+ */
+bool warm_start_load_trees(const char *trees_dir, size_t num_threads,
+                           size_t mem_budget, bool verbose,
+                           warm_start_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
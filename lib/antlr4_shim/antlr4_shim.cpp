@@ -23,10 +23,14 @@
 #include <GrammarParser.h>
 
 #include "antlr4_shim.h"
+#include "f1_c_fuzz.h"
+#include "stats.h"
 
 using namespace antlr4;
+// The lexer and parser of the grammar (see `F1_NAMESPACE`)
+using namespace F1_NAMESPACE;
 
-node_t *node_from_parse_tree(antlr4::tree::ParseTree *t) {
+static node_t *node_from_parse_tree(antlr4::tree::ParseTree *t) {
   node_t *node = nullptr;
 
   if (antlrcpp::is<antlr4::tree::ErrorNode *>(t)) {
@@ -70,6 +74,7 @@ node_t *node_from_parse_tree(antlr4::tree::ParseTree *t) {
 }
 
 tree_t *tree_from_buf(const uint8_t *data_buf, size_t data_size) {
+  STATS_PROFILE(STATS_PROFILE_TREE_FROM_BUF);
   node_t *root;
 
   /**
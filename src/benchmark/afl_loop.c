@@ -0,0 +1,400 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+/*
+   Simulate how afl-fuzz drives the custom mutator (see `fuzz_one` and
+   `trim_case_custom` in AFL++), with a stub target instead of a real one:
+
+   - every corpus file is copied into `<out_dir>/queue` and announced by
+     `afl_custom_queue_new_entry`, like the initial seeds
+   - the queue is cycled: `afl_custom_queue_get`, then trimming (once per
+     entry), then `afl_custom_fuzz_count` and repeated `afl_custom_fuzz`
+   - a mutated test case is "interesting" with a configurable probability, in
+     which case it is saved into the queue and announced to the mutator
+
+   The stub target only computes the set of bytes used by a test case, which
+   stands for its coverage: trimming succeeds if the set does not change.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "benchmark.h"
+#include "custom_mutator.h"
+#include "utils.h"
+
+#define AFL_LOOP_SEED (0)
+#define AFL_LOOP_MAX_FILE (1 * 1024 * 1024)  // MAX_FILE in afl-fuzz
+#define AFL_LOOP_REPORT_INTERVAL (5)         // seconds
+#define AFL_LOOP_NUM_STAGES (4)
+#define AFL_LOOP_FN_LEN (PATH_MAX + 512)  // room for a name in the queue folder
+
+static const char *afl_loop_stage_names[AFL_LOOP_NUM_STAGES] = {
+    "rules mutation", "random mutation", "random recursive mutation",
+    "splicing mutation"};
+
+typedef struct afl_loop_entry {
+  char *fn;
+  bool  trim_done;
+} afl_loop_entry_t;
+
+typedef struct afl_loop_stats {
+  size_t execs;
+  size_t num_initial;
+  size_t num_new;  // interesting test cases added to the queue
+  size_t num_skipped;
+  double import_time;
+
+  // Queue switches, i.e., `afl_custom_queue_get` + `afl_custom_fuzz_count`
+  size_t queue_switches;
+  double queue_switch_time;
+  double queue_switch_max;
+
+  size_t stage_mutations[AFL_LOOP_NUM_STAGES];
+  double stage_time[AFL_LOOP_NUM_STAGES];
+
+  size_t trim_steps;
+  size_t trim_success;
+  size_t trim_bytes;  // bytes removed by successful trimming steps
+  double trim_time;
+} afl_loop_stats_t;
+
+static afl_loop_entry_t *queue;
+static size_t            queue_len, queue_size;
+static afl_loop_stats_t  stats;
+static char              queue_dir[PATH_MAX];
+static uint64_t          rng_state;
+
+static double current_time() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000;
+}
+
+// A private generator, so that the decisions of the stub target do not change
+// the random choices of the mutator
+static double afl_loop_random() {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return (double)(rng_state >> 11) / (double)(1ULL << 53);
+}
+
+static size_t afl_loop_rss() {
+  FILE  *f = fopen("/proc/self/statm", "r");
+  size_t size = 0, rss = 0;
+  if (!f) return 0;
+  if (fscanf(f, "%zu %zu", &size, &rss) != 2) rss = 0;
+  fclose(f);
+  return rss * sysconf(_SC_PAGESIZE);
+}
+
+// The stub target: the "coverage" of a test case is the set of its bytes
+static void afl_loop_run_target(const uint8_t *buf, size_t len,
+                                uint64_t cov[4]) {
+  memset(cov, 0, 4 * sizeof(uint64_t));
+  for (size_t i = 0; i < len; ++i) cov[buf[i] >> 6] |= 1ULL << (buf[i] & 63);
+}
+
+static uint8_t *afl_loop_read_file(const char *fn, size_t *len) {
+  int fd = open(fn, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    return NULL;
+  }
+
+  *len = info.st_size;
+  uint8_t *buf = malloc(*len + 1);
+  if (buf && read(fd, buf, *len) != (ssize_t)*len) {
+    free(buf);
+    buf = NULL;
+  }
+  close(fd);
+  return buf;
+}
+
+static bool afl_loop_write_file(const char *fn, const uint8_t *buf,
+                                size_t len) {
+  int fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) return false;
+  bool ok = write(fd, buf, len) == (ssize_t)len;
+  close(fd);
+  return ok;
+}
+
+static void afl_loop_add_entry(const char *fn) {
+  if (queue_len == queue_size) {
+    queue_size = queue_size ? 2 * queue_size : 64;
+    queue = realloc(queue, queue_size * sizeof(afl_loop_entry_t));
+    if (!queue) {
+      perror("Cannot grow the queue (afl loop)");
+      exit(EXIT_FAILURE);
+    }
+  }
+  queue[queue_len].fn = strdup(fn);
+  queue[queue_len].trim_done = false;
+  ++queue_len;
+}
+
+// Copy the corpus into the queue, as afl-fuzz does for the initial seeds
+static bool afl_loop_import(my_mutator_t *data, const char *corpus_dir) {
+  struct dirent **entries;
+  char            fn[AFL_LOOP_FN_LEN];
+  uint8_t        *buf;
+  size_t          len;
+
+  int n = scandir(corpus_dir, &entries, NULL, alphasort);
+  if (n < 0) {
+    perror("Cannot read the corpus folder (afl loop)");
+    return false;
+  }
+
+  double start = current_time();
+  for (int i = 0; i < n; ++i) {
+    snprintf(fn, AFL_LOOP_FN_LEN, "%s/%s", corpus_dir, entries[i]->d_name);
+    struct stat info;
+    if (entries[i]->d_name[0] == '.' || stat(fn, &info) != 0 ||
+        !S_ISREG(info.st_mode) || !(buf = afl_loop_read_file(fn, &len))) {
+      free(entries[i]);
+      continue;
+    }
+
+    snprintf(fn, AFL_LOOP_FN_LEN, "%s/id:%06zu,orig:%s", queue_dir, queue_len,
+             entries[i]->d_name);
+    if (afl_loop_write_file(fn, buf, len)) {
+      afl_loop_add_entry(fn);
+      afl_custom_queue_new_entry(data, (const uint8_t *)fn, NULL);
+    }
+    free(buf);
+    free(entries[i]);
+  }
+  free(entries);
+
+  stats.import_time = current_time() - start;
+  stats.num_initial = queue_len;
+  return queue_len > 0;
+}
+
+// Trim the current entry, as `trim_case_custom` in afl-fuzz does
+static void afl_loop_trim(my_mutator_t *data, afl_loop_entry_t *entry,
+                          uint8_t **in_buf, size_t *in_len) {
+  uint64_t cov[4], trimmed_cov[4];
+  uint8_t *out_buf;
+  bool     changed = false;
+
+  afl_loop_run_target(*in_buf, *in_len, cov);
+
+  double  start = current_time();
+  int32_t stage_max = afl_custom_init_trim(data, *in_buf, *in_len);
+  int32_t stage_cur = 0;
+  while (stage_cur < stage_max) {
+    size_t out_len = afl_custom_trim(data, &out_buf);
+    if (!out_buf) break;
+
+    afl_loop_run_target(out_buf, out_len, trimmed_cov);
+    bool success = out_len <= *in_len && !memcmp(cov, trimmed_cov, sizeof(cov));
+    if (success) {
+      stats.trim_bytes += *in_len - out_len;
+      ++stats.trim_success;
+      memcpy(*in_buf, out_buf, out_len);
+      *in_len = out_len;
+      changed = true;
+    }
+
+    ++stats.trim_steps;
+    stage_cur = afl_custom_post_trim(data, success);
+  }
+  stats.trim_time += current_time() - start;
+
+  if (changed) afl_loop_write_file(entry->fn, *in_buf, *in_len);
+  entry->trim_done = true;
+}
+
+// Fuzz the current entry, as the custom mutator stage in afl-fuzz does
+static void afl_loop_fuzz(my_mutator_t *data, size_t cur, uint8_t *in_buf,
+                          size_t in_len, uint32_t stage_max,
+                          double interesting_rate, double stop_time) {
+  uint8_t *out_buf;
+  char     fn[AFL_LOOP_FN_LEN];
+  uint64_t cov[4];
+
+  for (uint32_t stage_cur = 0; stage_cur < stage_max; ++stage_cur) {
+    uint8_t stage = data->cur_fuzzing_stage;
+    double  start = current_time();
+    size_t  out_len = afl_custom_fuzz(data, in_buf, in_len, &out_buf, NULL, 0,
+                                      AFL_LOOP_MAX_FILE);
+    double  end = current_time();
+    if (stage < AFL_LOOP_NUM_STAGES) {
+      stats.stage_time[stage] += end - start;
+      ++stats.stage_mutations[stage];
+    }
+    ++stats.execs;
+    if (!out_buf) continue;
+
+    afl_loop_run_target(out_buf, out_len, cov);
+    if (afl_loop_random() < interesting_rate) {
+      snprintf(fn, AFL_LOOP_FN_LEN, "%s/id:%06zu,src:%06zu,op:custom",
+               queue_dir, queue_len, cur);
+      if (afl_loop_write_file(fn, out_buf, out_len)) {
+        afl_loop_add_entry(fn);
+        afl_custom_queue_new_entry(data, (const uint8_t *)fn,
+                                   (const uint8_t *)queue[cur].fn);
+        ++stats.num_new;
+      }
+    }
+
+    if ((stats.execs & 255) == 0 && end >= stop_time) return;
+  }
+}
+
+static void afl_loop_report_progress(double elapsed, size_t last_execs,
+                                     double interval) {
+  printf("[afl loop] %6.1lf s: %zu execs (%.1lf execs/s), queue: %zu, "
+         "rss: %.1lf MB\n",
+         elapsed, stats.execs, (stats.execs - last_execs) / interval,
+         queue_len, afl_loop_rss() / 1048576.0);
+  fflush(stdout);
+}
+
+static void afl_loop_report(double elapsed) {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  double fuzz_time = 0;
+  for (int i = 0; i < AFL_LOOP_NUM_STAGES; ++i)
+    fuzz_time += stats.stage_time[i];
+
+  printf("Queue: %zu initial entries (imported in %lf s), %zu new entries, "
+         "%zu skipped\n",
+         stats.num_initial, stats.import_time, stats.num_new,
+         stats.num_skipped);
+  printf("Fuzzing loop: %.1lf s, %.1lf execs/s (including the stub target)\n",
+         elapsed, elapsed > 0 ? stats.execs / elapsed : 0);
+  printf("Mutations: %zu, %.1lf mutations/s\n", stats.execs,
+         fuzz_time > 0 ? stats.execs / fuzz_time : 0);
+  for (int i = 0; i < AFL_LOOP_NUM_STAGES; ++i) {
+    printf("  %s: %zu, %.1lf mutations/s\n", afl_loop_stage_names[i],
+           stats.stage_mutations[i],
+           stats.stage_time[i] > 0 ? stats.stage_mutations[i] /
+                                         stats.stage_time[i]
+                                   : 0);
+  }
+  printf("Queue switches: %zu, avg: %lf s, max: %lf s\n", stats.queue_switches,
+         stats.queue_switches ? stats.queue_switch_time / stats.queue_switches
+                              : 0,
+         stats.queue_switch_max);
+  printf("Trimming: %zu steps (%zu successful), %.1lf steps/s, "
+         "%zu bytes removed\n",
+         stats.trim_steps, stats.trim_success,
+         stats.trim_time > 0 ? stats.trim_steps / stats.trim_time : 0,
+         stats.trim_bytes);
+  printf("Peak RSS: %.1lf MB\n", usage.ru_maxrss / 1024.0);
+}
+
+void bench_afl_loop(const char *corpus_dir, const char *out_dir,
+                    double duration, double interesting_rate) {
+  uint8_t *in_buf;
+  size_t   in_len;
+
+  snprintf(queue_dir, PATH_MAX, "%s/queue", out_dir);
+  if (access(queue_dir, F_OK) == 0) {
+    fprintf(stderr, "The queue folder exists already: %s\n", queue_dir);
+    return;
+  }
+  if (!create_directory(out_dir) || !create_directory(queue_dir)) {
+    perror("Cannot create the output folder (afl loop)");
+    return;
+  }
+
+  printf("========== AFL Loop [START] ==========\n");
+  printf("Corpus: %s, duration: %.1lf s, interesting rate: %lf\n", corpus_dir,
+         duration, interesting_rate);
+
+  memset(&stats, 0, sizeof(stats));
+  rng_state = 0x9e3779b97f4a7c15ULL ^ AFL_LOOP_SEED;
+
+  my_mutator_t *data = afl_custom_init(NULL, AFL_LOOP_SEED);
+  if (!data) return;
+  if (!afl_loop_import(data, corpus_dir)) {
+    fprintf(stderr, "No test case in the corpus: %s\n", corpus_dir);
+    afl_custom_deinit(data);
+    return;
+  }
+
+  double start = current_time();
+  double stop_time = start + duration;
+  double last_report = start;
+  size_t last_execs = 0;
+  for (size_t cur = 0; current_time() < stop_time;
+       cur = (cur + 1) % queue_len) {
+    afl_loop_entry_t *entry = &queue[cur];
+    in_buf = afl_loop_read_file(entry->fn, &in_len);
+    if (!in_buf) continue;
+
+    // The time of trimming does not count as the queue-switch latency
+    double   switch_start = current_time();
+    uint32_t stage_max = 0;
+    uint8_t  ok = afl_custom_queue_get(data, (const uint8_t *)entry->fn);
+    double   switch_time = current_time() - switch_start;
+    if (ok) {
+      // afl-fuzz trims an entry before fuzzing it for the first time
+      if (!entry->trim_done) afl_loop_trim(data, entry, &in_buf, &in_len);
+      switch_start = current_time();
+      stage_max = afl_custom_fuzz_count(data, in_buf, in_len);
+      switch_time += current_time() - switch_start;
+    }
+    stats.queue_switch_time += switch_time;
+    if (switch_time > stats.queue_switch_max)
+      stats.queue_switch_max = switch_time;
+    ++stats.queue_switches;
+
+    if (stage_max == 0) {
+      ++stats.num_skipped;
+    } else {
+      afl_loop_fuzz(data, cur, in_buf, in_len, stage_max, interesting_rate,
+                    stop_time);
+    }
+    free(in_buf);
+
+    double now = current_time();
+    if (now - last_report >= AFL_LOOP_REPORT_INTERVAL) {
+      afl_loop_report_progress(now - start, last_execs, now - last_report);
+      last_report = now;
+      last_execs = stats.execs;
+    }
+  }
+
+  afl_loop_report(current_time() - start);
+  afl_custom_deinit(data);
+
+  for (size_t i = 0; i < queue_len; ++i) free(queue[i].fn);
+  free(queue);
+  queue = NULL;
+  queue_len = queue_size = 0;
+  printf("=========== AFL Loop [END] ===========\n\n");
+}
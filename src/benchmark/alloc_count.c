@@ -0,0 +1,317 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+/*
+   Count the heap allocations of single operations of `src/tree.c`,
+   `src/tree_mutation.c` and `src/chunk_store.c`, and of `afl_custom_fuzz`.
+
+   The benchmark program interposes malloc/calloc/realloc/free (glibc), which
+   also catches the allocations of the grammar mutator library. The counters
+   are only updated between `alloc_count_start` and `alloc_count_stop`, and
+   the setup of each operation (e.g., generating the input tree) as well as
+   freeing its result are excluded.
+ */
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "benchmark.h"
+#include "results.h"
+#include "chunk_store.h"
+#include "custom_mutator.h"
+#include "f1_c_fuzz.h"
+#include "tree.h"
+#include "tree_mutation.h"
+#include "utils.h"
+
+#define ALLOC_BENCH_NUM (1000)
+#define ALLOC_SEED (0)
+#define ALLOC_SPLICING_NUM_TREES (100)
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void  __libc_free(void *ptr);
+
+typedef struct alloc_stats {
+  size_t num_allocs;   // malloc, calloc and realloc
+  size_t num_frees;    // free, and realloc of a non-NULL pointer
+  size_t alloc_bytes;  // the requested bytes
+  long   live_bytes;   // the usable bytes of allocated chunks, minus freed ones
+} alloc_stats_t;
+
+static volatile int  alloc_counting;
+static alloc_stats_t alloc_stats;
+
+static inline void alloc_count_alloc(void *ptr, size_t size) {
+  if (!alloc_counting || !ptr) return;
+  __atomic_fetch_add(&alloc_stats.num_allocs, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&alloc_stats.alloc_bytes, size, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&alloc_stats.live_bytes, malloc_usable_size(ptr),
+                     __ATOMIC_RELAXED);
+}
+
+static inline void alloc_count_free(void *ptr) {
+  if (!alloc_counting || !ptr) return;
+  __atomic_fetch_add(&alloc_stats.num_frees, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_sub(&alloc_stats.live_bytes, malloc_usable_size(ptr),
+                     __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size) {
+  void *ptr = __libc_malloc(size);
+  alloc_count_alloc(ptr, size);
+  return ptr;
+}
+
+void *calloc(size_t nmemb, size_t size) {
+  void *ptr = __libc_calloc(nmemb, size);
+  alloc_count_alloc(ptr, nmemb * size);
+  return ptr;
+}
+
+void *realloc(void *ptr, size_t size) {
+  alloc_count_free(ptr);
+  void *new_ptr = __libc_realloc(ptr, size);
+  alloc_count_alloc(new_ptr, size);
+  return new_ptr;
+}
+
+void free(void *ptr) {
+  alloc_count_free(ptr);
+  __libc_free(ptr);
+}
+
+static void alloc_count_start() {
+  memset(&alloc_stats, 0, sizeof(alloc_stats));
+  alloc_counting = 1;
+}
+
+static void alloc_count_stop(alloc_stats_t *stats) {
+  alloc_counting = 0;
+  stats->num_allocs += alloc_stats.num_allocs;
+  stats->num_frees += alloc_stats.num_frees;
+  stats->alloc_bytes += alloc_stats.alloc_bytes;
+  stats->live_bytes += alloc_stats.live_bytes;
+}
+
+static void alloc_stats_print(const char *op, int max_len,
+                              alloc_stats_t *stats, size_t num_ops) {
+  bench_result_t result;
+
+  if (!num_ops) return;
+
+  bench_result_init(&result, op, max_len);
+  result.n = num_ops;
+  result.allocs = (double)stats->num_allocs / num_ops;
+  result.alloc_bytes = (double)stats->alloc_bytes / num_ops;
+  bench_results_add(&result);
+
+  printf("%s, max_len=%d - allocs/op: %.1lf, bytes/op: %.1lf, "
+         "frees/op: %.1lf\n",
+         op, max_len, result.allocs, result.alloc_bytes,
+         (double)stats->num_frees / num_ops);
+}
+
+static size_t alloc_count_nodes(node_t *node) {
+  size_t n = 1;
+  for (uint32_t i = 0; i < node->subnode_count; ++i)
+    n += alloc_count_nodes(node->subnodes[i]);
+  return n;
+}
+
+// The input of an operation: a generated tree with its sizes
+static tree_t *alloc_gen_tree(int max_len) {
+  tree_t *tree = gen_init__(max_len);
+  tree_get_size(tree);
+  return tree;
+}
+
+// Run `op` on a new tree for ALLOC_BENCH_NUM times, counting only `op`
+#define ALLOC_BENCH(name, max_len, op)                                  \
+  do {                                                                  \
+    alloc_stats_t stats = {0};                                          \
+    for (int i = 0; i < ALLOC_BENCH_NUM; ++i) {                         \
+      tree_t *tree = alloc_gen_tree(max_len);                           \
+      tree_t *result = NULL;                                            \
+      alloc_count_start();                                              \
+      op;                                                               \
+      alloc_count_stop(&stats);                                         \
+      tree_free(result);                                                \
+      tree_free(tree);                                                  \
+    }                                                                   \
+    alloc_stats_print(name, max_len, &stats, ALLOC_BENCH_NUM);          \
+  } while (0)
+
+static void bench_alloc_tree(int max_len) {
+  alloc_stats_t stats = {0};
+  size_t        num_nodes = 0;
+
+  // The memory footprint of a tree
+  for (int i = 0; i < ALLOC_BENCH_NUM; ++i) {
+    alloc_count_start();
+    tree_t *tree = gen_init__(max_len);
+    alloc_count_stop(&stats);
+    num_nodes += alloc_count_nodes(tree->root);
+    tree_free(tree);
+  }
+  alloc_stats_print("gen_init__", max_len, &stats, ALLOC_BENCH_NUM);
+  printf("Tree footprint, max_len=%d - nodes/tree: %.1lf, bytes/node: %.1lf\n",
+         max_len, (double)num_nodes / ALLOC_BENCH_NUM,
+         num_nodes ? (double)stats.live_bytes / num_nodes : 0);
+
+  ALLOC_BENCH("tree_clone", max_len, result = tree_clone(tree));
+  ALLOC_BENCH("tree_get_size", max_len, tree_get_size(tree));
+  ALLOC_BENCH("tree_to_buf", max_len, tree_to_buf(tree));
+  ALLOC_BENCH("tree_serialize", max_len, tree_serialize(tree));
+  ALLOC_BENCH("tree_get_non_terminal_nodes", max_len,
+              tree_get_non_terminal_nodes(tree));
+  ALLOC_BENCH("tree_get_recursion_edges", max_len,
+              tree_get_recursion_edges(tree));
+
+  // Deserializing needs a serialized tree, which is prepared outside
+  stats = (alloc_stats_t){0};
+  for (int i = 0; i < ALLOC_BENCH_NUM; ++i) {
+    tree_t *tree = alloc_gen_tree(max_len);
+    tree_serialize(tree);
+    alloc_count_start();
+    tree_t *result = tree_deserialize(tree->ser_buf, tree->ser_len);
+    alloc_count_stop(&stats);
+    tree_free(result);
+    tree_free(tree);
+  }
+  alloc_stats_print("tree_deserialize", max_len, &stats, ALLOC_BENCH_NUM);
+}
+
+static void bench_alloc_mutation(int max_len) {
+  alloc_stats_t stats = {0};
+  size_t        num_ops = 0;
+
+  ALLOC_BENCH("random_mutation", max_len, result = random_mutation(tree));
+  ALLOC_BENCH("random_recursive_mutation", max_len,
+              result = random_recursive_mutation(tree, random_below(10)));
+
+  // Rules mutation of a random node, if it has other rules
+  for (int i = 0; i < ALLOC_BENCH_NUM; ++i) {
+    tree_t *tree = alloc_gen_tree(max_len);
+    tree_get_non_terminal_nodes(tree);
+    node_t  *node = list_get(tree->non_terminal_node_list,
+                             random_below(tree->non_terminal_node_list->size));
+    uint32_t rule_id = random_below(node_num_rules[node->id]);
+    if (rule_id != node->rule_id) {
+      alloc_count_start();
+      tree_t *result = rules_mutation(tree, node, rule_id);
+      alloc_count_stop(&stats);
+      tree_free(result);
+      ++num_ops;
+    }
+    tree_free(tree);
+  }
+  alloc_stats_print("rules_mutation", max_len, &stats, num_ops);
+
+  chunk_store_init();
+  for (int i = 0; i < ALLOC_SPLICING_NUM_TREES; ++i) {
+    tree_t *tree = gen_init__(max_len);
+    chunk_store_add_tree(tree);
+    tree_free(tree);
+  }
+  ALLOC_BENCH("splicing_mutation", max_len, result = splicing_mutation(tree));
+  chunk_store_clear();
+}
+
+static void bench_alloc_chunk_store(int max_len) {
+  alloc_stats_t stats = {0};
+
+  // Adding trees, which also gives the memory footprint of stored chunks
+  chunk_store_init();
+  for (int i = 0; i < ALLOC_BENCH_NUM; ++i) {
+    tree_t *tree = alloc_gen_tree(max_len);
+    alloc_count_start();
+    chunk_store_add_tree(tree);
+    alloc_count_stop(&stats);
+    tree_free(tree);
+  }
+  alloc_stats_print("chunk_store_add_tree", max_len, &stats, ALLOC_BENCH_NUM);
+
+  size_t num_chunks = chunk_store_get_num_chunks();
+  printf("Chunk store footprint, max_len=%d - chunks: %zu, "
+         "bytes/chunk: %.1lf\n",
+         max_len, num_chunks,
+         num_chunks ? (double)stats.live_bytes / num_chunks : 0);
+
+  stats = (alloc_stats_t){0};
+  for (int i = 0; i < ALLOC_BENCH_NUM; ++i) {
+    tree_t *tree = alloc_gen_tree(max_len);
+    node_t *node = node_pick_non_term_subnode(tree->root);
+    alloc_count_start();
+    node_t *alternative_node = chunk_store_get_alternative_node(node);
+    alloc_count_stop(&stats);
+    node_free(alternative_node);
+    tree_free(tree);
+  }
+  alloc_stats_print("chunk_store_get_alternative_node", max_len, &stats,
+                    ALLOC_BENCH_NUM);
+  chunk_store_clear();
+}
+
+static void bench_alloc_custom_fuzz(int max_len) {
+  alloc_stats_t stats = {0};
+  size_t        num_ops = 0;
+  uint8_t      *out_buf;
+
+  my_mutator_t *data = afl_custom_init(NULL, ALLOC_SEED);
+  if (!data) return;
+
+  // Fuzz generated trees, as if they were picked from the queue
+  for (int i = 0; i < ALLOC_BENCH_NUM / 10; ++i) {
+    tree_free(data->tree_cur);
+    data->tree_cur = alloc_gen_tree(max_len);
+    chunk_store_add_tree(data->tree_cur);
+    uint32_t stage_max = afl_custom_fuzz_count(data, NULL, 0);
+    for (uint32_t j = 0; j < stage_max && j < 100; ++j) {
+      alloc_count_start();
+      afl_custom_fuzz(data, NULL, 0, &out_buf, NULL, 0, 1024 * 1024);
+      alloc_count_stop(&stats);
+      ++num_ops;
+    }
+  }
+  alloc_stats_print("afl_custom_fuzz", max_len, &stats, num_ops);
+
+  afl_custom_deinit(data);
+}
+
+void bench_alloc() {
+  struct rusage usage;
+
+  random_set_seed(ALLOC_SEED);
+
+  printf("========== Allocations [START] ==========\n");
+  for (int max_len = 10; max_len <= 1000; max_len *= 10) {
+    bench_alloc_tree(max_len);
+    bench_alloc_mutation(max_len);
+    bench_alloc_chunk_store(max_len);
+    bench_alloc_custom_fuzz(max_len);
+  }
+
+  getrusage(RUSAGE_SELF, &usage);
+  printf("Peak RSS: %.1lf MB\n", usage.ru_maxrss / 1024.0);
+  printf("=========== Allocations [END] ===========\n\n");
+}
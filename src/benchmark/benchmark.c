@@ -18,32 +18,61 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
-#include <sys/time.h>
 #include <math.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
 
 #include "benchmark.h"
+#include "chunk_store.h"
 #include "f1_c_fuzz.h"
+#include "stats.h"
 #include "tree.h"
 #include "tree_mutation.h"
 #include "tree_trimming.h"
 #include "utils.h"
 
+#include "results.h"
+
 #define BENCH_NUM (1000)
 #define MAX_TREE_LEN (1000 + 1)
 #define MAX_LABEL_LEN (100)
+#define SPLICING_NUM_TREES (100)  // trees in the chunk store
+
+// Rendering large trees: 1 MB - 100 MB
+#define RENDER_BENCH_NUM (10)
+#define RENDER_MIN_SIZE (1024 * 1024)
+#define RENDER_MAX_SIZE (100 * 1024 * 1024)
+#define RENDER_LEAF_LEN (128)  // average length of leaf values
+#define RENDER_FANOUT (64)
+#define RENDER_THREADS (4)
+
+// Simulating afl-fuzz
+#define AFL_LOOP_DURATION (60)         // seconds
+#define AFL_LOOP_INTERESTING (0.0001)  // 1 out of 10000 test cases
+
+// Parsing a corpus: the runs per file
+#define CORPUS_RUNS (100)
 
+// Stressing synthetic trees: the size of the largest tree
+#define STRESS_MAX_NODES (10000000)
+
+// Comparing results: the tolerated slowdown
+#define COMPARE_THRESHOLD (0.05)
+
+// A monotonic clock in seconds, which has a much finer resolution than
+// `gettimeofday` and is not affected by clock adjustments
 static double current_time() {
-  struct timeval tv;
-  gettimeofday(&tv, NULL);
-  return (double)tv.tv_sec + (double)tv.tv_usec / 1000000;
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000;
 }
 
 static double start, end;  // start and end time
 static double times[BENCH_NUM];
+static int    bench_num = BENCH_NUM;  // the number of valid entries in `times`
 static char   label[MAX_LABEL_LEN];
 
 void bench_all() {
@@ -76,16 +105,23 @@ void bench_parsing_test_case(const char *fn) {
   }
   close(fd);
 
-  // Single time
-  // TODO: 1000 times?
-  start = current_time();
+  // The first run reports whether the test case can be parsed at all
   tree_t *tree = tree_from_buf(buf, file_size);
-  end = current_time();
-  printf("File: %s\n", fn);
-  printf("Parsing time: %lf s\n", (end - start));
+  printf("File: %s (%zu bytes)\n", fn, file_size);
+  if (!tree) printf("Parsing failed\n");
+  tree_free(tree);
+
+  for (int i = 0; i < BENCH_NUM; ++i) {
+    start = current_time();
+    tree = tree_from_buf(buf, file_size);
+    end = current_time();
+    times[i] = (end - start);
+
+    tree_free(tree);
+  }
+  bench_stats_print("tree_from_buf", file_size, "Parsing");
 
   munmap(buf, file_size);
-  tree_free(tree);
 }
 
 void bench_generating() {
@@ -102,7 +138,7 @@ void bench_generating() {
       tree_free(tree);
     }
     snprintf(label, MAX_LABEL_LEN, "Generating, max_len=%d", max_len);
-    bench_stats_print(label);
+    bench_stats_print("gen_init__", max_len, label);
   }
   printf("=========== Generating [END] ===========\n\n");
 }
@@ -125,7 +161,7 @@ void bench_parsing() {
       tree_free(tree);
     }
     snprintf(label, MAX_LABEL_LEN, "Parsing, max_len=%d", max_len);
-    bench_stats_print(label);
+    bench_stats_print("tree_from_buf", max_len, label);
   }
   printf("=========== Parsing [END] ===========\n\n");
 }
@@ -154,7 +190,7 @@ void bench_random_mutation() {
       tree_free(tree);
     }
     snprintf(label, MAX_LABEL_LEN, "Random mutation, max_len=%d", max_len);
-    bench_stats_print(label);
+    bench_stats_print("random_mutation", max_len, label);
   }
   printf("=========== Random Mutation [END] ===========\n\n");
 }
@@ -180,13 +216,41 @@ void bench_random_recursive_mutation() {
     }
     snprintf(label, MAX_LABEL_LEN, "Random recursive mutation, max_len=%d",
              max_len);
-    bench_stats_print(label);
+    bench_stats_print("random_recursive_mutation", max_len, label);
   }
   printf("=========== Random Recursive Mutation [END] ===========\n\n");
 }
 
 void bench_splicing_mutation() {
-  // TODO: this relies on the chunk store
+  tree_t *tree, *mutated_tree;
+
+  printf("========== Splicing Mutation [START] ==========\n");
+  for (int max_len = 0; max_len < MAX_TREE_LEN; max_len += 10) {
+    // Fill the chunk store with trees of the same size
+    chunk_store_init();
+    for (int i = 0; i < SPLICING_NUM_TREES; ++i) {
+      tree = gen_init__(max_len);
+      chunk_store_add_tree(tree);
+      tree_free(tree);
+    }
+
+    for (int i = 0; i < BENCH_NUM; ++i) {
+      tree = gen_init__(max_len);
+      tree_get_size(tree);
+
+      start = current_time();
+      mutated_tree = splicing_mutation(tree);
+      end = current_time();
+      times[i] = (end - start);
+
+      tree_free(mutated_tree);
+      tree_free(tree);
+    }
+    chunk_store_clear();
+    snprintf(label, MAX_LABEL_LEN, "Splicing mutation, max_len=%d", max_len);
+    bench_stats_print("splicing_mutation", max_len, label);
+  }
+  printf("=========== Splicing Mutation [END] ===========\n\n");
 }
 
 inline void bench_trimming() {
@@ -216,7 +280,7 @@ void bench_subtree_trimming() {
     tree_free(tree);
   }
   snprintf(label, MAX_LABEL_LEN, "Subtree trimming, single node");
-  bench_stats_print(label);
+  bench_stats_print("subtree_trimming", MAX_TREE_LEN, label);
   printf("=========== Subtree Trimming, Single Node [END] ===========\n\n");
 }
 
@@ -245,10 +309,91 @@ void bench_recursive_trimming() {
   }
   tree_free(tree);
   snprintf(label, MAX_LABEL_LEN, "Recursive trimming, single node");
-  bench_stats_print(label);
+  bench_stats_print("recursive_trimming", MAX_TREE_LEN, label);
   printf("=========== Recursive Trimming, Single Node [END] ===========\n\n");
 }
 
+// Build a balanced tree, in which leaf nodes carry `num_leaves` random values
+static node_t *bench_build_large_node(size_t num_leaves) {
+  static uint8_t val[2 * RENDER_LEAF_LEN];
+  node_t        *node;
+
+  if (num_leaves <= 1) {
+    size_t val_len = 1 + random_below(2 * RENDER_LEAF_LEN);
+    for (size_t i = 0; i < val_len; ++i) val[i] = 'a' + random_below(26);
+    return node_create_with_val(0, val, val_len);
+  }
+
+  size_t num_subnodes = num_leaves < RENDER_FANOUT ? num_leaves : RENDER_FANOUT;
+  node = node_create(1);
+  node_init_subnodes(node, num_subnodes);
+  for (size_t i = 0; i < num_subnodes; ++i) {
+    // split leaf nodes evenly
+    size_t n = num_leaves / num_subnodes + (i < num_leaves % num_subnodes);
+    node_set_subnode(node, i, bench_build_large_node(n));
+  }
+  return node;
+}
+
+void bench_rendering() {
+  tree_t  *tree;
+  uint8_t *buf;
+  size_t   data_len;
+
+  printf("========== Rendering [START] ==========\n");
+  bench_num = RENDER_BENCH_NUM;
+  for (size_t size = RENDER_MIN_SIZE; size <= RENDER_MAX_SIZE; size *= 10) {
+    tree = tree_create();
+    tree->root = bench_build_large_node(size / RENDER_LEAF_LEN);
+    tree_get_size(tree);
+    data_len = tree_get_data_len(tree);
+    buf = malloc(data_len);
+
+    // The original path: render into the tree buffer
+    for (int i = 0; i < bench_num; ++i) {
+      start = current_time();
+      tree_to_buf(tree);
+      end = current_time();
+      times[i] = (end - start);
+    }
+    snprintf(label, MAX_LABEL_LEN, "Rendering, tree_to_buf, size=%zu",
+             data_len);
+    bench_stats_print("tree_to_buf", data_len, label);
+
+    tree_set_parallel_render(0, 0);
+    for (int i = 0; i < bench_num; ++i) {
+      start = current_time();
+      tree_render_to_buf(tree, buf, data_len);
+      end = current_time();
+      times[i] = (end - start);
+    }
+    snprintf(label, MAX_LABEL_LEN, "Rendering, serial, size=%zu", data_len);
+    bench_stats_print("tree_render_to_buf", data_len, label);
+
+    tree_set_parallel_render(1, RENDER_THREADS);
+    for (int i = 0; i < bench_num; ++i) {
+      start = current_time();
+      tree_render_to_buf(tree, buf, data_len);
+      end = current_time();
+      times[i] = (end - start);
+    }
+    snprintf(label, MAX_LABEL_LEN, "Rendering, %d threads, size=%zu",
+             RENDER_THREADS, data_len);
+    bench_stats_print("tree_render_to_buf_parallel", data_len, label);
+    tree_set_parallel_render(0, 0);
+
+    free(buf);
+    tree_free(tree);
+  }
+  bench_num = BENCH_NUM;
+  printf("=========== Rendering [END] ===========\n\n");
+}
+
+static int bench_compare_times(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
 /**
  * The algorithm used to calculate the average and standard deviation can avoid
  * overflow.
@@ -256,23 +401,42 @@ void bench_recursive_trimming() {
  * Reference:
  * https://stackoverflow.com/questions/1930454/what-is-a-good-solution-for-calculating-an-average-where-the-sum-of-all-values-e
  */
-void bench_stats_print(const char *prefix_label) {
-  double time_avg = 0, time_var = 0, time_std = 0;
+void bench_stats_print(const char *op, size_t size, const char *prefix_label) {
+  double         time_avg = 0, time_var = 0, time_std = 0;
+  static double  sorted[BENCH_NUM];
+  bench_result_t result;
+
   // Avoid overflow
-  for (int i = 0; i < BENCH_NUM; ++i) {
+  for (int i = 0; i < bench_num; ++i) {
     time_avg += (times[i] - time_avg) / (i + 1);
   }
-  for (int i = 0; i < BENCH_NUM; ++i) {
+  for (int i = 0; i < bench_num; ++i) {
     time_var += (pow(times[i] - time_avg, 2) - time_var) / (i + 1);
   }
   time_std = sqrt(time_var);
 
-  printf("%s - avg: %lf s, std: %lf\n", prefix_label, time_avg, time_std);
+  // Percentiles (nearest rank)
+  memcpy(sorted, times, bench_num * sizeof(double));
+  qsort(sorted, bench_num, sizeof(double), bench_compare_times);
+
+  bench_result_init(&result, op, size);
+  result.n = bench_num;
+  result.avg = time_avg;
+  result.std = time_std;
+  result.p50 = sorted[(bench_num - 1) * 50 / 100];
+  result.p90 = sorted[(bench_num - 1) * 90 / 100];
+  result.p99 = sorted[(bench_num - 1) * 99 / 100];
+  result.max = sorted[bench_num - 1];
+  result.throughput = time_avg > 0 ? 1 / time_avg : NAN;
+  bench_results_add(&result);
+
+  printf("%s - avg: %lf s, std: %lf, p50: %lf s, p90: %lf s, p99: %lf s\n",
+         prefix_label, time_avg, time_std, result.p50, result.p90, result.p99);
 #ifdef DEBUG_BUILD
   if (time_std < time_avg) return;
 
   printf("[DEBUG] Raw data: ");
-  for (int i = 0; i < BENCH_NUM; ++i) {
+  for (int i = 0; i < bench_num; ++i) {
     time_avg += times[i];
     printf("%lf ", times[i]);
   }
@@ -280,35 +444,172 @@ void bench_stats_print(const char *prefix_label) {
 #endif
 }
 
+#ifdef ENABLE_PROFILING
+// The latency histograms of the hot paths, over the whole run
+static void bench_profile_print() {
+  bench_result_t result;
+  char           op[BENCH_RESULT_OP_LEN];
+
+  printf("========== Profiling [START] ==========\n");
+  printf("%-28s %10s %10s %10s %10s %10s\n", "hot path", "calls", "p50 (us)",
+         "p99 (us)", "p999 (us)", "max (us)");
+  for (int i = 0; i < STATS_NUM_PROFILES; ++i) {
+    size_t count = stats_get_profile_count(i);
+    if (!count) continue;
+
+    // p50, p90, p99, p999 and max, in seconds as the other results
+    double percentiles[] = {0.5, 0.9, 0.99, 0.999, 1};
+    double t[5];
+    for (int j = 0; j < 5; ++j) {
+      uint64_t cycles = stats_get_profile_percentile(i, percentiles[j]);
+      t[j] = stats_cycles_to_ns(cycles) / 1e9;
+    }
+
+    snprintf(op, sizeof(op), "profile_%s", stats_get_profile_name(i));
+    bench_result_init(&result, op, 0);
+    result.n = count;
+    result.p50 = t[0];
+    result.p90 = t[1];
+    result.p99 = t[2];
+    result.max = t[4];
+    bench_results_add(&result);
+
+    printf("%-28s %10zu %10.2lf %10.2lf %10.2lf %10.2lf\n",
+           stats_get_profile_name(i), count, t[0] * 1e6, t[2] * 1e6,
+           t[3] * 1e6, t[4] * 1e6);
+  }
+  printf("=========== Profiling [END] ===========\n\n");
+}
+#endif
+
 static void usage(const char *program) {
+  printf("Options (before the command):\n");
+  printf("  -o <results.json|results.csv>  also write the results to a file\n");
+  printf("Commands:\n");
   printf("%s single </path/to/a/test/case>\n", program);
   printf("%s all\n", program);
+  printf("%s render\n", program);
+  printf("%s alloc\n", program);
+  printf("%s corpus <corpus_dir> [<runs per file>]\n", program);
+  printf("%s stress [<max nodes>]\n", program);
+  printf("%s afl <corpus_dir> <out_dir> [<seconds> [<interesting rate>]]\n",
+         program);
+  printf("%s replay <trace> <out_dir> [<queue_dir>]\n", program);
+  printf("%s compare <baseline results> <current results> [<threshold>]\n",
+         program);
+  printf("%s matrix <results> [<results> ...]\n", program);
 }
 
 int main(int argc, const char *argv[]) {
+  const char *program = argv[0];
+
+  // Write the results to a file as well
+  if (argc > 2 && strcmp(argv[1], "-o") == 0) {
+    if (!bench_results_open(argv[2])) return 1;
+    atexit(bench_results_close);
+    argc -= 2;
+    argv += 2;
+  }
+
   if (argc < 2) {
-    usage(argv[0]);
+    usage(program);
     return 1;
   }
 
+#ifdef ENABLE_PROFILING
+  // Before closing the result file, which is registered earlier
+  atexit(bench_profile_print);
+#endif
+
   random_set_seed(time(NULL));
 
+  // Compare two result files
+  if (strncmp(argv[1], "compare", 7) == 0) {
+    if (argc < 4) {
+      usage(program);
+      return 1;
+    }
+    double threshold = argc > 4 ? atof(argv[4]) : COMPARE_THRESHOLD;
+    int    regressions = bench_results_compare(argv[2], argv[3], threshold);
+    return regressions < 0 ? 2 : regressions > 0;
+  }
+
+  // One table of the results of several grammars
+  if (strncmp(argv[1], "matrix", 6) == 0) {
+    if (argc < 3) {
+      usage(program);
+      return 1;
+    }
+    bench_results_matrix(argv + 2, argc - 2);
+    return 0;
+  }
+
   // Parse single test case file
   if (strncmp(argv[1], "single", 6) == 0) {
     if (argc < 3) {
-      usage(argv[0]);
+      usage(program);
       return 1;
     }
     bench_parsing_test_case(argv[2]);
     return 0;
   }
 
+  // Heap allocations and memory footprint (before "all", a prefix of it)
+  if (strncmp(argv[1], "alloc", 5) == 0) {
+    bench_alloc();
+    return 0;
+  }
+
   // All
   if (strncmp(argv[1], "all", 3) == 0) {
     bench_all();
     return 0;
   }
 
-  usage(argv[0]);
+  // Rendering large trees
+  if (strncmp(argv[1], "render", 6) == 0) {
+    bench_rendering();
+    return 0;
+  }
+
+  // Parse every file of a corpus
+  if (strncmp(argv[1], "corpus", 6) == 0) {
+    if (argc < 3) {
+      usage(program);
+      return 1;
+    }
+    bench_corpus(argv[2], argc > 3 ? atoi(argv[3]) : CORPUS_RUNS);
+    return 0;
+  }
+
+  // Deep, wide and huge synthetic trees
+  if (strncmp(argv[1], "stress", 6) == 0) {
+    bench_stress(argc > 2 ? strtoull(argv[2], NULL, 10) : STRESS_MAX_NODES);
+    return 0;
+  }
+
+  // Simulate the fuzzing loop of afl-fuzz
+  if (strncmp(argv[1], "afl", 3) == 0) {
+    if (argc < 4) {
+      usage(program);
+      return 1;
+    }
+    double duration = argc > 4 ? atof(argv[4]) : AFL_LOOP_DURATION;
+    double interesting_rate = argc > 5 ? atof(argv[5]) : AFL_LOOP_INTERESTING;
+    bench_afl_loop(argv[2], argv[3], duration, interesting_rate);
+    return 0;
+  }
+
+  // Replay a trace of a fuzzing session
+  if (strncmp(argv[1], "replay", 6) == 0) {
+    if (argc < 4) {
+      usage(program);
+      return 1;
+    }
+    bench_replay(argv[2], argv[3], argc > 4 ? argv[4] : NULL);
+    return 0;
+  }
+
+  usage(program);
   return 1;
 }
@@ -19,6 +19,8 @@
 #ifndef __MUTATOR_BENCHMARK_H__
 #define __MUTATOR_BENCHMARK_H__
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -35,8 +37,16 @@ void bench_splicing_mutation();
 void bench_trimming();
 void bench_subtree_trimming();
 void bench_recursive_trimming();
-
-void bench_stats_print(const char *label);
+void bench_rendering();
+void bench_alloc();
+void bench_corpus(const char *corpus_dir, int num_runs);
+void bench_stress(size_t max_nodes);
+void bench_afl_loop(const char *corpus_dir, const char *out_dir,
+                    double duration, double interesting_rate);
+void bench_replay(const char *trace_fn, const char *out_dir,
+                  const char *queue_dir);
+
+void bench_stats_print(const char *op, size_t size, const char *label);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,260 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+/*
+   Parse the test cases of a real corpus (e.g., an AFL++ queue or
+   `examples/JSON/in`), instead of the ones rendered from generated trees.
+
+   Every file is parsed `num_runs` times. The latencies are grouped into
+   buckets by input size, and each bucket reports its p50/p99/max latency,
+   failure rate (`tree_from_buf` returning NULL) and throughput in MB/s.
+   The slowest inputs (by median latency) are listed at the end.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "benchmark.h"
+#include "results.h"
+#include "tree.h"
+#include "utils.h"
+
+#define CORPUS_FN_LEN (PATH_MAX + 256)
+#define CORPUS_NUM_BUCKETS (5)  // < 1 KB, < 10 KB, < 100 KB, < 1 MB, >= 1 MB
+#define CORPUS_NUM_SLOWEST (10)
+
+typedef struct corpus_file {
+  char   *name;
+  size_t  len;
+  double *times;      // `num_runs` latencies, sorted
+  double  p50;
+  size_t  num_fails;  // parsing failures
+} corpus_file_t;
+
+typedef struct corpus_bucket {
+  size_t  num_files;
+  size_t  num_parses;
+  size_t  num_fails;
+  size_t  bytes;  // parsed bytes, over all runs
+  double  time;   // total parsing time
+  double *times;  // all latencies of the bucket
+} corpus_bucket_t;
+
+static const char *corpus_bucket_names[CORPUS_NUM_BUCKETS] = {
+    "< 1 KB", "1 KB - 10 KB", "10 KB - 100 KB", "100 KB - 1 MB", ">= 1 MB"};
+
+// The upper bound of a bucket, as the size of its results
+static const size_t corpus_bucket_sizes[CORPUS_NUM_BUCKETS] = {
+    1024, 10 * 1024, 100 * 1024, 1024 * 1024, SIZE_MAX};
+
+static double current_time() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000;
+}
+
+static int corpus_compare_times(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Slowest first, by the median latency
+static int corpus_compare_files(const void *a, const void *b) {
+  const corpus_file_t *x = *(corpus_file_t *const *)a;
+  const corpus_file_t *y = *(corpus_file_t *const *)b;
+  return corpus_compare_times(&y->p50, &x->p50);
+}
+
+// Nearest rank of sorted latencies
+static double corpus_percentile(const double *sorted, size_t n, int p) {
+  return sorted[(n - 1) * p / 100];
+}
+
+static size_t corpus_bucket(size_t len) {
+  size_t i = 0;
+  while (i < CORPUS_NUM_BUCKETS - 1 && len >= corpus_bucket_sizes[i])
+    ++i;
+  return i;
+}
+
+static uint8_t *corpus_read_file(const char *fn, size_t *len) {
+  int fd = open(fn, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    return NULL;
+  }
+
+  *len = info.st_size;
+  uint8_t *buf = malloc(*len + 1);
+  if (buf && read(fd, buf, *len) != (ssize_t)*len) {
+    free(buf);
+    buf = NULL;
+  }
+  close(fd);
+  return buf;
+}
+
+// Parse a file `num_runs` times
+static bool corpus_parse_file(const char *fn, corpus_file_t *file,
+                              int num_runs) {
+  uint8_t *buf = corpus_read_file(fn, &file->len);
+  if (!buf) return false;
+
+  file->times = malloc(num_runs * sizeof(double));
+  file->num_fails = 0;
+  for (int i = 0; i < num_runs; ++i) {
+    double  start = current_time();
+    tree_t *tree = tree_from_buf(buf, file->len);
+    file->times[i] = current_time() - start;
+
+    if (!tree) ++file->num_fails;
+    tree_free(tree);
+  }
+  qsort(file->times, num_runs, sizeof(double), corpus_compare_times);
+  file->p50 = corpus_percentile(file->times, num_runs, 50);
+
+  free(buf);
+  return true;
+}
+
+static void corpus_bucket_print(const char *name, size_t size,
+                                corpus_bucket_t *bucket) {
+  bench_result_t result;
+  double         avg = 0, var = 0;
+
+  if (!bucket->num_parses) return;
+
+  size_t n = bucket->num_parses;
+  for (size_t i = 0; i < n; ++i)
+    avg += (bucket->times[i] - avg) / (i + 1);
+  for (size_t i = 0; i < n; ++i)
+    var += (pow(bucket->times[i] - avg, 2) - var) / (i + 1);
+  qsort(bucket->times, n, sizeof(double), corpus_compare_times);
+
+  bench_result_init(&result, "corpus_tree_from_buf", size);
+  result.n = n;
+  result.avg = avg;
+  result.std = sqrt(var);
+  result.p50 = corpus_percentile(bucket->times, n, 50);
+  result.p90 = corpus_percentile(bucket->times, n, 90);
+  result.p99 = corpus_percentile(bucket->times, n, 99);
+  result.max = bucket->times[n - 1];
+  result.throughput = bucket->time > 0 ? n / bucket->time : NAN;
+  bench_results_add(&result);
+
+  printf("%-16s %6zu %12.1lf %12.1lf %12.1lf %8.2lf%% %10.2lf\n", name,
+         bucket->num_files, result.p50 * 1e6, result.p99 * 1e6,
+         result.max * 1e6,
+         100.0 * bucket->num_fails / n,
+         bucket->time > 0 ? bucket->bytes / bucket->time / (1024 * 1024) : 0);
+}
+
+void bench_corpus(const char *corpus_dir, int num_runs) {
+  struct dirent **entries;
+  char            fn[CORPUS_FN_LEN];
+  corpus_bucket_t buckets[CORPUS_NUM_BUCKETS] = {0};
+  corpus_bucket_t total = {0};
+
+  if (num_runs < 1) num_runs = 1;
+
+  int n = scandir(corpus_dir, &entries, NULL, alphasort);
+  if (n < 0) {
+    perror("Cannot read the corpus folder");
+    return;
+  }
+
+  corpus_file_t *files = calloc(n, sizeof(corpus_file_t));
+  size_t         num_files = 0;
+
+  printf("========== Corpus parsing [START] ==========\n");
+  printf("Corpus: %s, runs per file: %d\n", corpus_dir, num_runs);
+  for (int i = 0; i < n; ++i) {
+    snprintf(fn, CORPUS_FN_LEN, "%s/%s", corpus_dir, entries[i]->d_name);
+    struct stat info;
+    if (entries[i]->d_name[0] != '.' && stat(fn, &info) == 0 &&
+        S_ISREG(info.st_mode) &&
+        corpus_parse_file(fn, &files[num_files], num_runs)) {
+      files[num_files].name = strdup(entries[i]->d_name);
+      ++num_files;
+    }
+    free(entries[i]);
+  }
+  free(entries);
+
+  // Group the latencies by input size
+  total.times = malloc(num_files * num_runs * sizeof(double));
+  for (size_t i = 0; i < CORPUS_NUM_BUCKETS; ++i)
+    buckets[i].times = malloc(num_files * num_runs * sizeof(double));
+  for (size_t i = 0; i < num_files; ++i) {
+    corpus_file_t   *file = &files[i];
+    corpus_bucket_t *targets[2] = {&buckets[corpus_bucket(file->len)], &total};
+    for (int j = 0; j < 2; ++j) {
+      corpus_bucket_t *bucket = targets[j];
+      ++bucket->num_files;
+      bucket->num_fails += file->num_fails;
+      bucket->bytes += file->len * num_runs;
+      for (int k = 0; k < num_runs; ++k) {
+        bucket->times[bucket->num_parses++] = file->times[k];
+        bucket->time += file->times[k];
+      }
+    }
+  }
+
+  printf("%-16s %6s %12s %12s %12s %9s %10s\n", "size", "files", "p50 (us)",
+         "p99 (us)", "max (us)", "failures", "MB/s");
+  for (size_t i = 0; i < CORPUS_NUM_BUCKETS; ++i)
+    corpus_bucket_print(corpus_bucket_names[i], corpus_bucket_sizes[i],
+                        &buckets[i]);
+  corpus_bucket_print("all", 0, &total);
+
+  // The slowest inputs, by their median latencies
+  corpus_file_t **slowest = malloc(num_files * sizeof(corpus_file_t *));
+  for (size_t i = 0; i < num_files; ++i)
+    slowest[i] = &files[i];
+  qsort(slowest, num_files, sizeof(corpus_file_t *), corpus_compare_files);
+
+  printf("Slowest inputs (p50):\n");
+  for (size_t i = 0; i < num_files && i < CORPUS_NUM_SLOWEST; ++i) {
+    corpus_file_t *file = slowest[i];
+    printf("  %12.1lf us %10zu bytes %8.2lf MB/s%s  %s\n", file->p50 * 1e6,
+           file->len,
+           file->p50 > 0 ? file->len / file->p50 / (1024 * 1024) : 0,
+           file->num_fails ? "  (failed)" : "", file->name);
+  }
+  printf("=========== Corpus parsing [END] ===========\n\n");
+
+  free(slowest);
+  for (size_t i = 0; i < CORPUS_NUM_BUCKETS; ++i)
+    free(buckets[i].times);
+  free(total.times);
+  for (size_t i = 0; i < num_files; ++i) {
+    free(files[i].name);
+    free(files[i].times);
+  }
+  free(files);
+}
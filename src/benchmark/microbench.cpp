@@ -0,0 +1,523 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+/*
+   Microbenchmarks of the tree operations, based on Google Benchmark.
+
+   Every benchmark starts from the same random seed, so that the input trees
+   (and the sequence of random choices) are identical across runs and
+   machines. Results are reported per operation (ns/op), together with the
+   number of nodes (items/s) and test case bytes (bytes/s) processed.
+   Unless overridden on the command line, each benchmark is repeated
+   MICROBENCH_REPETITIONS times and only the aggregates are reported.
+
+   e.g.: ./microbench-json --benchmark_filter=Mutation
+         ./microbench-json --benchmark_format=json --benchmark_out=out.json
+ */
+
+#include <string>
+#include <vector>
+
+#include "chunk_store.h"
+#include "f1_c_fuzz.h"
+#include "tree.h"
+#include "tree_mutation.h"
+#include "tree_trimming.h"
+#include "utils.h"
+
+#include "../chunk_store_internal.h"
+
+#include "benchmark/benchmark.h"
+
+using namespace std;
+
+#define MICROBENCH_SEED (0x5eed)
+#define MICROBENCH_REPETITIONS (5)
+#define MICROBENCH_NUM_SPLICING_TREES (100)
+#define MICROBENCH_RECURSION_FACTOR (4)
+
+// Generate the input tree of a benchmark. The size of the tree is controlled
+// by the first argument of the benchmark, i.e., the `max_len` of `gen_init__`.
+static tree_t *microbench_tree(benchmark::State &state) {
+
+  random_set_seed(MICROBENCH_SEED);
+
+  tree_t *tree = gen_init__(state.range(0));
+  tree_get_size(tree);
+  tree_to_buf(tree);
+
+  state.counters["nodes"] = tree->root->non_term_size;
+  state.counters["tree_bytes"] = tree->data_len;
+
+  return tree;
+
+}
+
+// Report the number of nodes and test case bytes processed by all iterations
+static void microbench_set_processed(benchmark::State &state, tree_t *tree) {
+
+  state.SetItemsProcessed(state.iterations() * tree->root->non_term_size);
+  state.SetBytesProcessed(state.iterations() * tree->data_len);
+
+}
+
+static void microbench_tree_sizes(benchmark::internal::Benchmark *bench) {
+
+  bench->ArgName("max_len")->Arg(10)->Arg(100)->Arg(1000);
+
+}
+
+/* Nodes */
+
+static void BM_NodeCreateFree(benchmark::State &state) {
+
+  const char val[] = "microbench";
+
+  for (auto _ : state) {
+
+    node_t *node = node_create_with_val(1, val, sizeof(val) - 1);
+    benchmark::DoNotOptimize(node);
+    node_free(node);
+
+  }
+
+  state.SetItemsProcessed(state.iterations());
+
+}
+
+BENCHMARK(BM_NodeCreateFree);
+
+static void BM_NodeClone(benchmark::State &state) {
+
+  tree_t *tree = microbench_tree(state);
+
+  for (auto _ : state) {
+
+    node_t *node = node_clone(tree->root);
+    benchmark::DoNotOptimize(node);
+    node_free(node);
+
+  }
+
+  microbench_set_processed(state, tree);
+  tree_free(tree);
+
+}
+
+BENCHMARK(BM_NodeClone)->Apply(microbench_tree_sizes);
+
+/* Trees */
+
+static void BM_TreeClone(benchmark::State &state) {
+
+  tree_t *tree = microbench_tree(state);
+
+  for (auto _ : state) {
+
+    tree_t *cloned_tree = tree_clone(tree);
+    benchmark::DoNotOptimize(cloned_tree);
+    tree_free(cloned_tree);
+
+  }
+
+  microbench_set_processed(state, tree);
+  tree_free(tree);
+
+}
+
+BENCHMARK(BM_TreeClone)->Apply(microbench_tree_sizes);
+
+static void BM_TreeToBuf(benchmark::State &state) {
+
+  tree_t *tree = microbench_tree(state);
+
+  for (auto _ : state) {
+
+    tree_to_buf(tree);
+    benchmark::DoNotOptimize(tree->data_buf);
+
+  }
+
+  microbench_set_processed(state, tree);
+  tree_free(tree);
+
+}
+
+BENCHMARK(BM_TreeToBuf)->Apply(microbench_tree_sizes);
+
+static void BM_TreeRenderToBuf(benchmark::State &state) {
+
+  tree_t         *tree = microbench_tree(state);
+  vector<uint8_t> buf(tree->data_len);
+
+  for (auto _ : state) {
+
+    size_t len = tree_render_to_buf(tree, buf.data(), buf.size());
+    benchmark::DoNotOptimize(len);
+    benchmark::ClobberMemory();
+
+  }
+
+  microbench_set_processed(state, tree);
+  tree_free(tree);
+
+}
+
+BENCHMARK(BM_TreeRenderToBuf)->Apply(microbench_tree_sizes);
+
+static void BM_TreeGetSize(benchmark::State &state) {
+
+  tree_t *tree = microbench_tree(state);
+
+  for (auto _ : state) {
+
+    size_t size = tree_get_size(tree);
+    benchmark::DoNotOptimize(size);
+
+  }
+
+  microbench_set_processed(state, tree);
+  tree_free(tree);
+
+}
+
+BENCHMARK(BM_TreeGetSize)->Apply(microbench_tree_sizes);
+
+static void BM_HashNode(benchmark::State &state) {
+
+  tree_t *tree = microbench_tree(state);
+  char    hash[16 + 1];
+
+  for (auto _ : state) {
+
+    hash_node(tree->root, hash);
+    benchmark::DoNotOptimize(hash);
+
+  }
+
+  microbench_set_processed(state, tree);
+  tree_free(tree);
+
+}
+
+BENCHMARK(BM_HashNode)->Apply(microbench_tree_sizes);
+
+static void BM_TreeSerialize(benchmark::State &state) {
+
+  tree_t *tree = microbench_tree(state);
+
+  for (auto _ : state) {
+
+    tree_serialize(tree);
+    benchmark::DoNotOptimize(tree->ser_buf);
+
+  }
+
+  microbench_set_processed(state, tree);
+  state.counters["ser_bytes"] = tree->ser_len;
+  tree_free(tree);
+
+}
+
+BENCHMARK(BM_TreeSerialize)->Apply(microbench_tree_sizes);
+
+static void BM_TreeDeserialize(benchmark::State &state) {
+
+  tree_t *tree = microbench_tree(state);
+  tree_serialize(tree);
+
+  for (auto _ : state) {
+
+    tree_t *deserialized_tree = tree_deserialize(tree->ser_buf, tree->ser_len);
+    benchmark::DoNotOptimize(deserialized_tree);
+    tree_free(deserialized_tree);
+
+  }
+
+  microbench_set_processed(state, tree);
+  state.counters["ser_bytes"] = tree->ser_len;
+  tree_free(tree);
+
+}
+
+BENCHMARK(BM_TreeDeserialize)->Apply(microbench_tree_sizes);
+
+static void BM_TreeFromBuf(benchmark::State &state) {
+
+  tree_t *tree = microbench_tree(state);
+
+  for (auto _ : state) {
+
+    tree_t *parsed_tree = tree_from_buf(tree->data_buf, tree->data_len);
+    benchmark::DoNotOptimize(parsed_tree);
+    tree_free(parsed_tree);
+
+  }
+
+  microbench_set_processed(state, tree);
+  tree_free(tree);
+
+}
+
+BENCHMARK(BM_TreeFromBuf)->Apply(microbench_tree_sizes);
+
+/* Mutations. The time includes freeing the mutated tree. */
+
+static void BM_RulesMutation(benchmark::State &state) {
+
+  tree_t *tree = microbench_tree(state);
+
+  // All (node, rule) pairs visited by the deterministic rules mutation
+  vector<pair<node_t *, uint32_t> > mutations;
+  tree_get_non_terminal_nodes(tree);
+  for (size_t i = 0; i < tree->non_terminal_node_list->size; ++i) {
+
+    node_t *node = (node_t *)list_get(tree->non_terminal_node_list, i);
+    for (uint32_t rule_id = 0; rule_id < node_num_rules[node->id]; ++rule_id)
+      if (rule_id != node->rule_id) mutations.emplace_back(node, rule_id);
+
+  }
+
+  if (mutations.empty()) {
+
+    state.SkipWithError("No rules mutation for this tree");
+    tree_free(tree);
+    return;
+
+  }
+
+  size_t i = 0;
+  for (auto _ : state) {
+
+    auto   &mutation = mutations[i++ % mutations.size()];
+    tree_t *mutated_tree = rules_mutation(tree, mutation.first, mutation.second);
+    benchmark::DoNotOptimize(mutated_tree);
+    tree_free(mutated_tree);
+
+  }
+
+  microbench_set_processed(state, tree);
+  state.counters["mutations"] = mutations.size();
+  tree_free(tree);
+
+}
+
+BENCHMARK(BM_RulesMutation)->Apply(microbench_tree_sizes);
+
+static void BM_RandomMutation(benchmark::State &state) {
+
+  tree_t *tree = microbench_tree(state);
+
+  for (auto _ : state) {
+
+    tree_t *mutated_tree = random_mutation(tree);
+    benchmark::DoNotOptimize(mutated_tree);
+    tree_free(mutated_tree);
+
+  }
+
+  microbench_set_processed(state, tree);
+  tree_free(tree);
+
+}
+
+BENCHMARK(BM_RandomMutation)->Apply(microbench_tree_sizes);
+
+static void BM_RandomRecursiveMutation(benchmark::State &state) {
+
+  tree_t *tree = microbench_tree(state);
+
+  for (auto _ : state) {
+
+    tree_t *mutated_tree =
+        random_recursive_mutation(tree, MICROBENCH_RECURSION_FACTOR);
+    benchmark::DoNotOptimize(mutated_tree);
+    tree_free(mutated_tree);
+
+  }
+
+  microbench_set_processed(state, tree);
+  tree_free(tree);
+
+}
+
+BENCHMARK(BM_RandomRecursiveMutation)->Apply(microbench_tree_sizes);
+
+static void BM_SplicingMutation(benchmark::State &state) {
+
+  tree_t *tree = microbench_tree(state);
+
+  // Splice subtrees of other generated trees
+  chunk_store_init();
+  for (int i = 0; i < MICROBENCH_NUM_SPLICING_TREES; ++i) {
+
+    tree_t *other_tree = gen_init__(state.range(0));
+    chunk_store_add_tree(other_tree);
+    tree_free(other_tree);
+
+  }
+
+  for (auto _ : state) {
+
+    tree_t *mutated_tree = splicing_mutation(tree);
+    benchmark::DoNotOptimize(mutated_tree);
+    tree_free(mutated_tree);
+
+  }
+
+  microbench_set_processed(state, tree);
+  chunk_store_clear();
+  tree_free(tree);
+
+}
+
+BENCHMARK(BM_SplicingMutation)->Apply(microbench_tree_sizes);
+
+/* Trimming. The time includes freeing the trimmed tree. */
+
+static void BM_SubtreeTrimming(benchmark::State &state) {
+
+  tree_t *tree = microbench_tree(state);
+  tree_get_non_terminal_nodes(tree);
+  list_t *nodes = tree->non_terminal_node_list;
+
+  size_t i = 0;
+  for (auto _ : state) {
+
+    node_t *node = (node_t *)list_get(nodes, i++ % nodes->size);
+    tree_t *trimmed_tree = subtree_trimming(tree, node);
+    benchmark::DoNotOptimize(trimmed_tree);
+    tree_free(trimmed_tree);
+
+  }
+
+  microbench_set_processed(state, tree);
+  tree_free(tree);
+
+}
+
+BENCHMARK(BM_SubtreeTrimming)->Apply(microbench_tree_sizes);
+
+static void BM_RecursiveTrimming(benchmark::State &state) {
+
+  tree_t *tree = microbench_tree(state);
+  tree_get_recursion_edges(tree);
+  list_t *edges = tree->recursion_edge_list;
+
+  if (edges->size == 0) {
+
+    state.SkipWithError("No recursion edge in this tree");
+    tree_free(tree);
+    return;
+
+  }
+
+  size_t i = 0;
+  for (auto _ : state) {
+
+    edge_t *edge = (edge_t *)list_get(edges, i++ % edges->size);
+    tree_t *trimmed_tree = recursive_trimming(tree, *edge);
+    benchmark::DoNotOptimize(trimmed_tree);
+    tree_free(trimmed_tree);
+
+  }
+
+  microbench_set_processed(state, tree);
+  tree_free(tree);
+
+}
+
+BENCHMARK(BM_RecursiveTrimming)->Apply(microbench_tree_sizes);
+
+/* Chunk store */
+
+static void BM_ChunkStoreAddTree(benchmark::State &state) {
+
+  tree_t *tree = microbench_tree(state);
+
+  chunk_store_init();
+  for (auto _ : state) {
+
+    // Only the first iteration adds new chunks; the others measure the lookup
+    // of known chunks, which is the common case while fuzzing
+    chunk_store_add_tree(tree);
+
+  }
+
+  microbench_set_processed(state, tree);
+  chunk_store_clear();
+  tree_free(tree);
+
+}
+
+BENCHMARK(BM_ChunkStoreAddTree)->Apply(microbench_tree_sizes);
+
+static void BM_ChunkStoreGetAlternativeNode(benchmark::State &state) {
+
+  tree_t *tree = microbench_tree(state);
+
+  chunk_store_init();
+  for (int i = 0; i < MICROBENCH_NUM_SPLICING_TREES; ++i) {
+
+    tree_t *other_tree = gen_init__(state.range(0));
+    chunk_store_add_tree(other_tree);
+    tree_free(other_tree);
+
+  }
+
+  tree_get_non_terminal_nodes(tree);
+  list_t *nodes = tree->non_terminal_node_list;
+
+  size_t i = 0;
+  for (auto _ : state) {
+
+    node_t *node = (node_t *)list_get(nodes, i++ % nodes->size);
+    node_t *alternative_node = chunk_store_get_alternative_node(node);
+    benchmark::DoNotOptimize(alternative_node);
+    node_free(alternative_node);
+
+  }
+
+  state.SetItemsProcessed(state.iterations());
+  chunk_store_clear();
+  tree_free(tree);
+
+}
+
+BENCHMARK(BM_ChunkStoreGetAlternativeNode)->Apply(microbench_tree_sizes);
+
+int main(int argc, char **argv) {
+
+  // Default options, which can be overridden by the command line
+  string repetitions =
+      "--benchmark_repetitions=" + to_string(MICROBENCH_REPETITIONS);
+  string         aggregates = "--benchmark_report_aggregates_only=true";
+  vector<char *> args = {argv[0], &repetitions[0], &aggregates[0]};
+  for (int i = 1; i < argc; ++i)
+    args.push_back(argv[i]);
+
+  int num_args = args.size();
+  benchmark::Initialize(&num_args, args.data());
+  if (benchmark::ReportUnrecognizedArguments(num_args, args.data())) return 1;
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+
+  return 0;
+
+}
@@ -0,0 +1,464 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+/*
+   Replay a trace recorded by a fuzzing session (see `TRACE_FILE`): the same
+   `afl_custom_*` calls are made in the same order, with the recorded seed and
+   configuration, and their latencies are compared with the recorded ones.
+
+   - queue files are recreated under `<out_dir>/<folder>/<name>`, where
+     `<folder>/<name>` are the last two components of the recorded path. The
+     content is the last mutated test case if it has the recorded hash (i.e.,
+     the new entries found by afl-fuzz), or is copied from `<queue_dir>/<name>`
+     or from the recorded path otherwise.
+   - the input buffers of `afl_custom_fuzz` and friends are not used by the
+     mutator, so zero-filled buffers of the recorded lengths are passed.
+   - the results and the hashes of the outputs are compared with the recorded
+     ones. A divergence means that the mutator does not behave as it did while
+     recording, e.g., because of a change of the code, of the configuration,
+     or of a queue file. The recorded configuration is applied unless it is
+     overridden by the environment. Imported test cases are parsed by
+     background threads by default, so a bit-exact replay needs
+     `PARSE_THREADS=0` at both recording and replaying.
+ */
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "benchmark.h"
+#include "custom_mutator.h"
+#include "results.h"
+#include "trace.h"
+#include "utils.h"
+
+#define REPLAY_FN_LEN (PATH_MAX + 512)
+
+typedef struct replay_times {
+  double *recorded;  // seconds
+  double *replayed;
+  size_t  len, size;
+} replay_times_t;
+
+static replay_times_t times[TRACE_NUM_OPS];
+static size_t         num_divergences, num_input_mismatches;
+static size_t         first_divergence;  // the index of the record
+
+// The last output of `afl_custom_fuzz`, which becomes a new queue entry if it
+// is interesting
+static uint8_t *last_out;
+static size_t   last_out_len, last_out_size;
+
+static double current_time() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000;
+}
+
+static void replay_add_time(trace_op_t op, uint64_t recorded_ns,
+                            double replayed) {
+  replay_times_t *t = &times[op];
+  if (t->len == t->size) {
+    t->size = t->size ? 2 * t->size : 1024;
+    t->recorded = realloc(t->recorded, t->size * sizeof(double));
+    t->replayed = realloc(t->replayed, t->size * sizeof(double));
+    if (!t->recorded || !t->replayed) {
+      perror("Cannot grow the latencies (replay)");
+      exit(EXIT_FAILURE);
+    }
+  }
+  t->recorded[t->len] = recorded_ns / 1e9;
+  t->replayed[t->len] = replayed;
+  ++t->len;
+}
+
+static void replay_diverge(size_t index, const trace_record_t *record,
+                           const char *what, uint64_t recorded,
+                           uint64_t replayed) {
+  if (num_divergences++ == 0) {
+    first_divergence = index;
+    printf("First divergence at record %zu (%s): %s is %lu, recorded %lu\n",
+           index, trace_op_name(record->op), what, (unsigned long)replayed,
+           (unsigned long)recorded);
+  }
+}
+
+static void replay_check_output(size_t index, const trace_record_t *record,
+                                int arg, const uint8_t *buf, size_t len) {
+  if (len != record->args[arg]) {
+    replay_diverge(index, record, "the output length", record->args[arg], len);
+  } else if (trace_hash(buf, buf ? len : 0) != record->args[arg + 1]) {
+    replay_diverge(index, record, "the output hash", record->args[arg + 1],
+                   trace_hash(buf, buf ? len : 0));
+  }
+}
+
+static uint8_t *replay_read_file(const char *fn, size_t *len) {
+  int fd = open(fn, O_RDONLY);
+  if (fd < 0) return NULL;
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    return NULL;
+  }
+
+  *len = info.st_size;
+  uint8_t *buf = malloc(*len + 1);
+  if (buf && read(fd, buf, *len) != (ssize_t)*len) {
+    free(buf);
+    buf = NULL;
+  }
+  close(fd);
+  return buf;
+}
+
+static bool replay_write_file(const char *fn, const uint8_t *buf,
+                              size_t len) {
+  int fd = open(fn, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  if (fd < 0) return false;
+  bool ok = write(fd, buf, len) == (ssize_t)len;
+  close(fd);
+  return ok;
+}
+
+// Map a recorded queue file to `<out_dir>/<folder>/<name>`, and return the
+// position of `<name>` in `fn`
+static size_t replay_map_file(const char *recorded_fn, const char *out_dir,
+                              char *fn) {
+  const char *name = strrchr(recorded_fn, '/');
+  const char *folder = name;
+  while (folder && folder > recorded_fn && folder[-1] != '/') --folder;
+
+  // No folder in the recorded path
+  if (!name || name == folder) {
+    snprintf(fn, REPLAY_FN_LEN, "%s/queue/", out_dir);
+  } else {
+    snprintf(fn, REPLAY_FN_LEN, "%s/%.*s/", out_dir, (int)(name - folder),
+             folder);
+  }
+
+  size_t name_pos = strlen(fn);
+  snprintf(fn + name_pos, REPLAY_FN_LEN - name_pos, "%s",
+           name ? name + 1 : recorded_fn);
+  return name_pos;
+}
+
+// Map a recorded queue file, and create it on the first reference. The
+// recorded length and hash tell whether the content is the recorded one.
+static const char *replay_queue_file(const char *recorded_fn,
+                                     const char *out_dir,
+                                     const char *queue_dir, size_t len,
+                                     uint64_t hash) {
+  static char fn[REPLAY_FN_LEN];
+  char        src_fn[REPLAY_FN_LEN];
+
+  size_t name_pos = replay_map_file(recorded_fn, out_dir, fn);
+  if (access(fn, F_OK) == 0) return fn;
+
+  fn[name_pos - 1] = '\0';
+  bool ok = create_directory(fn);
+  fn[name_pos - 1] = '/';
+  if (!ok) {
+    perror("Cannot create the queue folder (replay)");
+    return fn;
+  }
+
+  // A new entry found by afl-fuzz is the last mutated test case
+  if (last_out && last_out_len == len &&
+      trace_hash(last_out, last_out_len) == hash) {
+    replay_write_file(fn, last_out, last_out_len);
+    return fn;
+  }
+
+  size_t   buf_len = 0;
+  uint8_t *buf = NULL;
+  if (queue_dir) {
+    snprintf(src_fn, REPLAY_FN_LEN, "%s/%s", queue_dir, fn + name_pos);
+    buf = replay_read_file(src_fn, &buf_len);
+  }
+  if (!buf) buf = replay_read_file(recorded_fn, &buf_len);
+  if (!buf) {
+    fprintf(stderr, "Cannot find the queue file: %s\n", recorded_fn);
+    ++num_input_mismatches;
+    return fn;
+  }
+
+  if (buf_len != len || trace_hash(buf, buf_len) != hash)
+    ++num_input_mismatches;
+  replay_write_file(fn, buf, buf_len);
+  free(buf);
+  return fn;
+}
+
+// Apply "NAME=value ..." without overriding the environment
+static void replay_apply_config(const char *config) {
+  char *copy = strdup(config ? config : "");
+  char *save = NULL;
+  for (char *token = strtok_r(copy, " ", &save); token;
+       token = strtok_r(NULL, " ", &save)) {
+    char *value = strchr(token, '=');
+    if (!value) continue;
+    *value++ = '\0';
+    setenv(token, value, 0);
+  }
+  free(copy);
+}
+
+static int replay_compare_times(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void replay_report(size_t num_records, double elapsed) {
+  bench_result_t result;
+  char           op[BENCH_RESULT_OP_LEN];
+  double         recorded_total = 0, replayed_total = 0;
+
+  printf("%-16s %10s %21s %21s %21s\n", "", "",
+         "recorded p50/p99 (us)", "replayed p50/p99 (us)",
+         "total rec/rep (s)");
+  for (int i = 0; i < TRACE_NUM_OPS; ++i) {
+    replay_times_t *t = &times[i];
+    if (!t->len) continue;
+
+    double rec_sum = 0, rep_sum = 0;
+    for (size_t j = 0; j < t->len; ++j) {
+      rec_sum += t->recorded[j];
+      rep_sum += t->replayed[j];
+    }
+    recorded_total += rec_sum;
+    replayed_total += rep_sum;
+
+    qsort(t->recorded, t->len, sizeof(double), replay_compare_times);
+    qsort(t->replayed, t->len, sizeof(double), replay_compare_times);
+    size_t p50 = (t->len - 1) * 50 / 100, p90 = (t->len - 1) * 90 / 100;
+    size_t p99 = (t->len - 1) * 99 / 100;
+
+    snprintf(op, sizeof(op), "replay_%s", trace_op_name(i));
+    bench_result_init(&result, op, 0);
+    result.n = t->len;
+    result.avg = rep_sum / t->len;
+    result.p50 = t->replayed[p50];
+    result.p90 = t->replayed[p90];
+    result.p99 = t->replayed[p99];
+    result.max = t->replayed[t->len - 1];
+    result.throughput = rep_sum > 0 ? t->len / rep_sum : NAN;
+    bench_results_add(&result);
+
+    printf("%-16s %10zu %10.2lf %10.2lf %10.2lf %10.2lf %10.3lf %10.3lf\n",
+           trace_op_name(i), t->len, t->recorded[p50] * 1e6,
+           t->recorded[p99] * 1e6, t->replayed[p50] * 1e6,
+           t->replayed[p99] * 1e6, rec_sum, rep_sum);
+
+    free(t->recorded);
+    free(t->replayed);
+    memset(t, 0, sizeof(replay_times_t));
+  }
+
+  printf("Records: %zu, replayed in %lf s (%lf s in the mutator, recorded: "
+         "%lf s)\n",
+         num_records, elapsed, replayed_total, recorded_total);
+  printf("Queue files with another content: %zu\n", num_input_mismatches);
+  if (num_divergences) {
+    printf("Divergences: %zu, the first one at record %zu\n", num_divergences,
+           first_divergence);
+  } else {
+    printf("Divergences: 0, the replay matches the trace\n");
+  }
+}
+
+void bench_replay(const char *trace_fn, const char *out_dir,
+                  const char *queue_dir) {
+  trace_record_t record;
+  char           fn[REPLAY_FN_LEN];
+  uint8_t       *buf = NULL, *out_buf = NULL;
+  size_t         buf_size = 0, index = 0, ret;
+  my_mutator_t  *data = NULL;
+
+  snprintf(fn, REPLAY_FN_LEN, "%s/queue", out_dir);
+  if (access(fn, F_OK) == 0) {
+    fprintf(stderr, "The queue folder exists already: %s\n", fn);
+    return;
+  }
+  if (!create_directory(out_dir) || !create_directory(fn)) {
+    perror("Cannot create the output folder (replay)");
+    return;
+  }
+
+  trace_reader_t *reader = trace_reader_open(trace_fn);
+  if (!reader) return;
+
+  printf("========== Replay [START] ==========\n");
+  printf("Trace: %s\n", trace_fn);
+
+  num_divergences = num_input_mismatches = first_divergence = 0;
+  double start = current_time();
+  for (; trace_read(reader, &record); ++index) {
+    const uint64_t *args = record.args;
+    const char     *file, *orig;
+    double          call_start;
+
+    // A mutator is needed by every call except the initialization
+    if (!data && record.op != TRACE_INIT) {
+      fprintf(stderr, "The trace does not start with init (record %zu)\n",
+              index);
+      break;
+    }
+
+    // The input buffers are not read by the mutator, but must be valid
+    size_t need = record.op == TRACE_FUZZ ||
+                          record.op == TRACE_FUZZ_COUNT ||
+                          record.op == TRACE_INIT_TRIM
+                      ? args[0]
+                      : 0;
+    if (need >= buf_size) {
+      buf_size = need + 1;
+      free(buf);
+      buf = calloc(1, buf_size);
+      if (!buf) {
+        perror("Cannot allocate the input buffer (replay)");
+        break;
+      }
+    }
+
+    switch (record.op) {
+      case TRACE_INIT:
+        if (data) afl_custom_deinit(data);
+        replay_apply_config(record.strs[0]);
+        printf("Seed: %lu, configuration: %s\n", (unsigned long)args[0],
+               record.strs[0] ? record.strs[0] : "");
+        call_start = current_time();
+        data = afl_custom_init(NULL, (unsigned int)args[0]);
+        replay_add_time(record.op, record.time_ns,
+                        current_time() - call_start);
+        if (!data) {
+          replay_diverge(index, &record, "the success", args[1], 0);
+          goto out;
+        }
+        break;
+
+      case TRACE_DEINIT:
+        call_start = current_time();
+        afl_custom_deinit(data);
+        replay_add_time(record.op, record.time_ns,
+                        current_time() - call_start);
+        data = NULL;
+        break;
+
+      case TRACE_QUEUE_GET:
+        file = replay_queue_file(record.strs[0], out_dir, queue_dir, args[0],
+                                 args[1]);
+        call_start = current_time();
+        ret = afl_custom_queue_get(data, (const uint8_t *)file);
+        replay_add_time(record.op, record.time_ns,
+                        current_time() - call_start);
+        if (ret != args[2])
+          replay_diverge(index, &record, "the result", args[2], ret);
+        break;
+
+      case TRACE_QUEUE_NEW_ENTRY:
+        file = replay_queue_file(record.strs[0], out_dir, queue_dir, args[0],
+                                 args[1]);
+        // The original entry has been created before
+        orig = NULL;
+        if (record.strs[1]) {
+          replay_map_file(record.strs[1], out_dir, fn);
+          orig = fn;
+        }
+        call_start = current_time();
+        afl_custom_queue_new_entry(data, (const uint8_t *)file,
+                                   (const uint8_t *)orig);
+        replay_add_time(record.op, record.time_ns,
+                        current_time() - call_start);
+        break;
+
+      case TRACE_FUZZ_COUNT:
+        call_start = current_time();
+        ret = afl_custom_fuzz_count(data, buf, args[0]);
+        replay_add_time(record.op, record.time_ns,
+                        current_time() - call_start);
+        if (ret != args[2])
+          replay_diverge(index, &record, "the result", args[2], ret);
+        break;
+
+      case TRACE_FUZZ:
+        call_start = current_time();
+        ret = afl_custom_fuzz(data, buf, args[0], &out_buf, NULL, 0, args[4]);
+        replay_add_time(record.op, record.time_ns,
+                        current_time() - call_start);
+        replay_check_output(index, &record, 5, out_buf, ret);
+
+        // Keep a copy, as the next call reuses the output buffer
+        last_out_len = out_buf ? ret : 0;
+        if (last_out_len + 1 > last_out_size) {
+          last_out_size = last_out_len + 1;
+          free(last_out);
+          last_out = malloc(last_out_size);
+        }
+        if (last_out && last_out_len) memcpy(last_out, out_buf, last_out_len);
+        break;
+
+      case TRACE_INIT_TRIM:
+        call_start = current_time();
+        ret = afl_custom_init_trim(data, buf, args[0]);
+        replay_add_time(record.op, record.time_ns,
+                        current_time() - call_start);
+        if ((int32_t)ret != (int32_t)args[2])
+          replay_diverge(index, &record, "the result", args[2], ret);
+        break;
+
+      case TRACE_TRIM:
+        call_start = current_time();
+        ret = afl_custom_trim(data, &out_buf);
+        replay_add_time(record.op, record.time_ns,
+                        current_time() - call_start);
+        replay_check_output(index, &record, 0, out_buf, ret);
+        break;
+
+      case TRACE_POST_TRIM:
+        call_start = current_time();
+        ret = afl_custom_post_trim(data, (int)args[0]);
+        replay_add_time(record.op, record.time_ns,
+                        current_time() - call_start);
+        if ((int32_t)ret != (int32_t)args[1])
+          replay_diverge(index, &record, "the result", args[1], ret);
+        break;
+
+      default:
+        break;
+    }
+  }
+
+out:
+  // A trace of a killed afl-fuzz has no deinit
+  if (data) afl_custom_deinit(data);
+  trace_reader_close(reader);
+  replay_report(index, current_time() - start);
+
+  free(buf);
+  free(last_out);
+  last_out = NULL;
+  last_out_len = last_out_size = 0;
+  printf("=========== Replay [END] ===========\n\n");
+}
@@ -0,0 +1,349 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "results.h"
+
+#define RESULTS_LINE_LEN (1024)
+
+// |t| of Welch's t-test above which a difference is significant (~99.9%)
+#define RESULTS_T_CRITICAL (3.29)
+
+#define RESULTS_MAX_GRAMMARS (32)  // columns of the matrix
+
+static const char *results_fields[] = {
+    "op",  "grammar", "size", "n",          "avg",    "std",        "p50",
+    "p90", "p99",     "max",  "throughput", "allocs", "alloc_bytes"};
+#define RESULTS_NUM_FIELDS (sizeof(results_fields) / sizeof(results_fields[0]))
+
+static FILE *results_file = NULL;
+static bool  results_csv = false;
+static bool  results_first = true;
+
+void bench_result_init(bench_result_t *result, const char *op, size_t size) {
+  memset(result, 0, sizeof(bench_result_t));
+  snprintf(result->op, BENCH_RESULT_OP_LEN, "%s", op);
+  snprintf(result->grammar, BENCH_RESULT_OP_LEN, "%s", BENCH_GRAMMAR);
+  result->size = size;
+  result->avg = result->std = NAN;
+  result->p50 = result->p90 = result->p99 = result->max = NAN;
+  result->throughput = NAN;
+  result->allocs = result->alloc_bytes = NAN;
+}
+
+static bool results_has_suffix(const char *s, const char *suffix) {
+  size_t len = strlen(s), suffix_len = strlen(suffix);
+  return len >= suffix_len && strcmp(s + len - suffix_len, suffix) == 0;
+}
+
+bool bench_results_open(const char *filename) {
+  bench_results_close();
+
+  results_file = fopen(filename, "w");
+  if (!results_file) {
+    perror("Cannot open the result file");
+    return false;
+  }
+
+  results_csv = results_has_suffix(filename, ".csv");
+  results_first = true;
+  if (results_csv) {
+    for (size_t i = 0; i < RESULTS_NUM_FIELDS; ++i)
+      fprintf(results_file, "%s%s", i ? "," : "", results_fields[i]);
+    fprintf(results_file, "\n");
+  } else {
+    fprintf(results_file, "[\n");
+  }
+  return true;
+}
+
+// NAN is written as an empty CSV field or a JSON null
+static void results_write_number(double v) {
+  if (isnan(v)) {
+    if (!results_csv) fputs("null", results_file);
+  } else
+    fprintf(results_file, "%.9g", v);
+}
+
+void bench_results_add(const bench_result_t *result) {
+  if (!results_file) return;
+
+  double values[] = {result->avg,        result->std,    result->p50,
+                     result->p90,        result->p99,    result->max,
+                     result->throughput, result->allocs, result->alloc_bytes};
+
+  if (results_csv) {
+    fprintf(results_file, "%s,%s,%zu,%zu", result->op, result->grammar,
+            result->size, result->n);
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+      fprintf(results_file, ",");
+      results_write_number(values[i]);
+    }
+    fprintf(results_file, "\n");
+  } else {
+    // One object per line, which keeps `bench_results_load` simple
+    fprintf(results_file, "%s  {\"op\": \"%s\", \"grammar\": \"%s\", "
+            "\"size\": %zu, \"n\": %zu",
+            results_first ? "" : ",\n", result->op, result->grammar,
+            result->size, result->n);
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+      fprintf(results_file, ", \"%s\": ", results_fields[4 + i]);
+      results_write_number(values[i]);
+    }
+    fprintf(results_file, "}");
+  }
+  results_first = false;
+  fflush(results_file);
+}
+
+void bench_results_close() {
+  if (!results_file) return;
+  if (!results_csv) fprintf(results_file, "%s]\n", results_first ? "" : "\n");
+  fclose(results_file);
+  results_file = NULL;
+}
+
+static void results_set_field(bench_result_t *result, size_t field,
+                              const char *val, size_t len) {
+  char buf[BENCH_RESULT_OP_LEN];
+  if (len >= BENCH_RESULT_OP_LEN) len = BENCH_RESULT_OP_LEN - 1;
+  memcpy(buf, val, len);
+  buf[len] = '\0';
+
+  double *numbers[] = {&result->avg,        &result->std,
+                       &result->p50,        &result->p90,
+                       &result->p99,        &result->max,
+                       &result->throughput, &result->allocs,
+                       &result->alloc_bytes};
+  switch (field) {
+    case 0:
+      memcpy(result->op, buf, len + 1);
+      break;
+    case 1:
+      memcpy(result->grammar, buf, len + 1);
+      break;
+    case 2:
+      result->size = strtoull(buf, NULL, 10);
+      break;
+    case 3:
+      result->n = strtoull(buf, NULL, 10);
+      break;
+    default:
+      *numbers[field - 4] =
+          (len == 0 || strcmp(buf, "null") == 0) ? NAN : strtod(buf, NULL);
+  }
+}
+
+static bool results_parse_csv(const char *line, bench_result_t *result) {
+  const char *p = line;
+  for (size_t i = 0; i < RESULTS_NUM_FIELDS; ++i) {
+    size_t len = strcspn(p, ",\n");
+    results_set_field(result, i, p, len);
+    if (p[len] != ',') return i == RESULTS_NUM_FIELDS - 1;
+    p += len + 1;
+  }
+  return true;
+}
+
+static bool results_parse_json(const char *line, bench_result_t *result) {
+  char key[BENCH_RESULT_OP_LEN];
+  for (size_t i = 0; i < RESULTS_NUM_FIELDS; ++i) {
+    snprintf(key, sizeof(key), "\"%s\": ", results_fields[i]);
+    const char *p = strstr(line, key);
+    if (!p) return false;
+    p += strlen(key);
+    if (*p == '"') {
+      ++p;
+      results_set_field(result, i, p, strcspn(p, "\""));
+    } else {
+      results_set_field(result, i, p, strcspn(p, ",}"));
+    }
+  }
+  return true;
+}
+
+bench_result_t *bench_results_load(const char *filename, size_t *num_results) {
+  char            line[RESULTS_LINE_LEN];
+  bench_result_t *results = NULL;
+  size_t          n = 0, size = 0;
+
+  FILE *f = fopen(filename, "r");
+  if (!f) {
+    perror("Cannot open the result file");
+    return NULL;
+  }
+
+  bool csv = results_has_suffix(filename, ".csv");
+  bool header = csv;
+  while (fgets(line, sizeof(line), f)) {
+    if (header) {
+      header = false;
+      continue;
+    }
+    if (!csv && !strstr(line, "{")) continue;
+
+    if (n == size) {
+      size = size ? 2 * size : 64;
+      bench_result_t *new_results = realloc(results, size * sizeof(*results));
+      if (!new_results) break;
+      results = new_results;
+    }
+
+    bench_result_init(&results[n], "", 0);
+    if (csv ? results_parse_csv(line, &results[n])
+            : results_parse_json(line, &results[n]))
+      ++n;
+  }
+  fclose(f);
+
+  *num_results = n;
+  return results;
+}
+
+static const bench_result_t *results_find(const bench_result_t *results,
+                                          size_t                n,
+                                          const bench_result_t *result) {
+  for (size_t i = 0; i < n; ++i) {
+    if (results[i].size == result->size &&
+        strcmp(results[i].op, result->op) == 0 &&
+        strcmp(results[i].grammar, result->grammar) == 0)
+      return &results[i];
+  }
+  return NULL;
+}
+
+// Welch's t-test of the means of two samples
+static double results_welch_t(const bench_result_t *a,
+                              const bench_result_t *b) {
+  if (a->n < 2 || b->n < 2 || isnan(a->std) || isnan(b->std)) return NAN;
+  double se = sqrt(a->std * a->std / a->n + b->std * b->std / b->n);
+  if (se == 0) return a->avg == b->avg ? 0 : INFINITY;
+  return (b->avg - a->avg) / se;
+}
+
+int bench_results_compare(const char *baseline_fn, const char *current_fn,
+                          double threshold) {
+  size_t          num_baseline, num_current;
+  bench_result_t *baseline = bench_results_load(baseline_fn, &num_baseline);
+  bench_result_t *current = bench_results_load(current_fn, &num_current);
+  int             regressions = 0;
+
+  if (!baseline || !current) {
+    free(baseline);
+    free(current);
+    return -1;
+  }
+
+  printf("%-36s %-10s %10s %14s %14s %9s\n", "op", "grammar", "size",
+         "baseline", "current", "change");
+  for (size_t i = 0; i < num_current; ++i) {
+    const bench_result_t *cur = &current[i];
+    const bench_result_t *base = results_find(baseline, num_baseline, cur);
+    if (!base) continue;
+
+    // Compare latencies if both have them; otherwise, allocations
+    bool   latency = !isnan(base->p50) && !isnan(cur->p50);
+    double base_val = latency ? base->p50 : base->allocs;
+    double cur_val = latency ? cur->p50 : cur->allocs;
+    if (isnan(base_val) || isnan(cur_val)) continue;
+
+    double change = base_val > 0 ? (cur_val - base_val) / base_val : 0;
+    bool   regressed = change > threshold;
+    if (regressed && latency) {
+      double t = results_welch_t(base, cur);
+      regressed = isnan(t) || t > RESULTS_T_CRITICAL;
+    }
+    if (regressed) ++regressions;
+
+    printf("%-36s %-10s %10zu %14.9g %14.9g %+8.1lf%%%s\n", cur->op,
+           cur->grammar, cur->size, base_val, cur_val, change * 100,
+           regressed ? "  REGRESSION" : "");
+  }
+  printf("%d regression(s) above %.1lf%%\n", regressions, threshold * 100);
+
+  free(baseline);
+  free(current);
+  return regressions;
+}
+
+void bench_results_matrix(const char **filenames, int num_files) {
+  bench_result_t *results = NULL;
+  size_t          n = 0;
+  const char     *grammars[RESULTS_MAX_GRAMMARS];
+  size_t          num_grammars = 0;
+
+  // All results of all files
+  for (int i = 0; i < num_files; ++i) {
+    size_t          num;
+    bench_result_t *loaded = bench_results_load(filenames[i], &num);
+    if (!loaded) continue;
+
+    bench_result_t *new_results =
+        realloc(results, (n + num) * sizeof(*results));
+    if (new_results) {
+      results = new_results;
+      memcpy(results + n, loaded, num * sizeof(*results));
+      n += num;
+    }
+    free(loaded);
+  }
+
+  for (size_t i = 0; i < n; ++i) {
+    size_t j = 0;
+    while (j < num_grammars && strcmp(grammars[j], results[i].grammar) != 0)
+      ++j;
+    if (j == num_grammars && num_grammars < RESULTS_MAX_GRAMMARS)
+      grammars[num_grammars++] = results[i].grammar;
+  }
+
+  printf("%-40s %10s %-8s", "op", "size", "metric");
+  for (size_t j = 0; j < num_grammars; ++j)
+    printf(" %12s", grammars[j]);
+  printf("\n");
+
+  // One row for each operation and size, in the order of their first results
+  for (size_t i = 0; i < n; ++i) {
+    bench_result_t key = results[i];
+    bool           printed = false;
+    for (size_t k = 0; k < i && !printed; ++k)
+      printed = results[k].size == key.size &&
+                strcmp(results[k].op, key.op) == 0;
+    if (printed) continue;
+
+    // Latencies if measured; otherwise, allocations
+    bool latency = !isnan(key.p50);
+    printf("%-40s %10zu %-8s", key.op, key.size,
+           latency ? "p50 (us)" : "allocs");
+    for (size_t j = 0; j < num_grammars; ++j) {
+      snprintf(key.grammar, BENCH_RESULT_OP_LEN, "%s", grammars[j]);
+      const bench_result_t *result = results_find(results, n, &key);
+      double v = !result ? NAN : latency ? result->p50 * 1e6 : result->allocs;
+      if (isnan(v))
+        printf(" %12s", "-");
+      else
+        printf(" %12.3lf", v);
+    }
+    printf("\n");
+  }
+
+  free(results);
+}
@@ -0,0 +1,115 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#ifndef __MUTATOR_BENCHMARK_RESULTS_H__
+#define __MUTATOR_BENCHMARK_RESULTS_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef BENCH_GRAMMAR
+  #define BENCH_GRAMMAR "unknown"
+#endif
+
+#define BENCH_RESULT_OP_LEN (64)
+
+/**
+ * One benchmarked operation at one size. `size` is the `max_len` of generated
+ * trees, or the length of test cases in bytes (e.g., rendering). Fields that
+ * are not measured by a benchmark are NAN, e.g., the latencies of `alloc`.
+ */
+typedef struct bench_result {
+  char   op[BENCH_RESULT_OP_LEN];
+  char   grammar[BENCH_RESULT_OP_LEN];
+  size_t size;
+  size_t n;            // the number of samples
+  double avg, std;     // seconds
+  double p50, p90, p99, max;
+  double throughput;   // operations per second
+  double allocs;       // heap allocations per operation
+  double alloc_bytes;  // requested heap bytes per operation
+} bench_result_t;
+
+/**
+ * Initialize a result with all measurements set to NAN
+ * @param result The result
+ * @param op     The name of the operation
+ * @param size   The size bucket
+ */
+void bench_result_init(bench_result_t *result, const char *op, size_t size);
+
+/**
+ * Start writing results to a file. The format is CSV if the filename ends with
+ * ".csv"; otherwise, JSON.
+ * @param  filename The output file
+ * @return          True on success; otherwise, False
+ */
+bool bench_results_open(const char *filename);
+
+/**
+ * Append a result to the output file, if there is one
+ * @param result The result
+ */
+void bench_results_add(const bench_result_t *result);
+
+/**
+ * Finish and close the output file
+ */
+void bench_results_close();
+
+/**
+ * Read the results written by `bench_results_add`, in either format
+ * @param  filename    The result file
+ * @param  num_results The number of returned results
+ * @return             The results, which must be freed by the caller, or NULL
+ */
+bench_result_t *bench_results_load(const char *filename, size_t *num_results);
+
+/**
+ * Compare the results of the same operations and sizes in two files, and
+ * report the regressions of the current results. A latency regression must
+ * exceed `threshold` (relative to the p50 of the baseline) and be significant
+ * by Welch's t-test; allocations are deterministic and only need to exceed the
+ * threshold.
+ * @param  baseline_fn The baseline result file
+ * @param  current_fn  The current result file
+ * @param  threshold   The tolerated relative slowdown, e.g., 0.05 for 5%
+ * @return             The number of regressions, or -1 on errors
+ */
+int bench_results_compare(const char *baseline_fn, const char *current_fn,
+                          double threshold);
+
+/**
+ * Print one table of the results in several files, e.g., of different
+ * grammars: a row for each operation and size, and a column for each grammar.
+ * The cells are p50 latencies, or allocations per operation if there are no
+ * latencies.
+ * @param filenames The result files
+ * @param num_files The number of result files
+ */
+void bench_results_matrix(const char **filenames, int num_files);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,404 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+/*
+   Stress the core operations with synthetic trees of pathological shapes,
+   which `gen_init__` does not produce but many rounds of
+   `random_recursive_mutation` and splicing do:
+
+   - deep: a recursion edge of a generated tree unrolled `depth` times, the
+     same way as `random_recursive_mutation` (a valid tree of the grammar)
+   - wide: a node with `fan-out` generated subtrees of the same type
+   - huge: generated subtrees under a balanced tree of `STRESS_FANOUT`, with
+     `nodes` nodes in total
+
+   Every operation runs in a child process, so that a stack overflow
+   (recursion depth) or a timeout (quadratic behavior) of one operation is
+   reported and does not end the benchmark.
+ */
+
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "benchmark.h"
+#include "chunk_store.h"
+#include "f1_c_fuzz.h"
+#include "results.h"
+#include "tree.h"
+#include "tree_mutation.h"
+#include "tree_trimming.h"
+#include "utils.h"
+
+#define STRESS_SEED (0)
+#define STRESS_RUNS (3)                   // runs of each operation
+#define STRESS_TIMEOUT (60)               // seconds, for each operation
+#define STRESS_MAX_DEPTH (100000)         // 10^2 - 10^5
+#define STRESS_MAX_FANOUT (100000)        // 10^2 - 10^5
+#define STRESS_MIN_NODES (10000)          // 10^4 - `max_nodes`
+#define STRESS_FANOUT (64)                // inner nodes of huge trees
+#define STRESS_SUBTREE_LEN (100)          // `max_len` of generated subtrees
+#define STRESS_WIDE_SUBTREE_LEN (10)      // ... under the node of wide trees
+#define STRESS_SPLICING_NUM_TREES (100)   // trees in the chunk store
+#define STRESS_MAX_TRIES (1000)           // to find a recursion edge
+#define STRESS_RECURSIVE_MUTATION_N (4)   // repeat a recursion 2^4 times
+
+typedef enum { STRESS_DEEP, STRESS_WIDE, STRESS_HUGE } stress_shape_t;
+
+static const char *stress_shape_names[] = {"deep", "wide", "huge"};
+static const char *stress_size_names[] = {"depth", "fan-out", "nodes"};
+
+static int stress_fd = -1;  // results are sent to the parent process
+
+static double current_time() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1000000000;
+}
+
+static int stress_compare_times(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Count nodes without recursion, which would overflow the stack of deep trees
+static size_t stress_count_nodes(node_t *root) {
+  size_t   n = 0, top = 0, size = 1024;
+  node_t **stack = malloc(size * sizeof(node_t *));
+
+  stack[top++] = root;
+  while (top) {
+    node_t *node = stack[--top];
+    if (!node) continue;
+    ++n;
+    if (top + node->subnode_count > size) {
+      while (top + node->subnode_count > size) size *= 2;
+      stack = realloc(stack, size * sizeof(node_t *));
+    }
+    for (uint32_t i = 0; i < node->subnode_count; ++i)
+      stack[top++] = node->subnodes[i];
+  }
+  free(stack);
+  return n;
+}
+
+static node_t *stress_gen_subtree(int max_len) {
+  tree_t *tree = gen_init__(max_len);
+  node_t *root = tree->root;
+  tree->root = NULL;
+  tree_free(tree);
+  return root;
+}
+
+// Unroll the recursion edge with the smallest subtree `depth` times
+static tree_t *stress_build_deep(size_t depth) {
+  tree_t *tree = NULL;
+  edge_t *edge = NULL;
+
+  for (int i = 0; i < STRESS_MAX_TRIES && !edge; ++i) {
+    tree_free(tree);
+    tree = gen_init__(STRESS_SUBTREE_LEN);
+    tree_get_size(tree);
+    tree_get_recursion_edges(tree);
+
+    size_t min_size = SIZE_MAX;
+    for (list_node_t *cur = tree->recursion_edge_list->head; cur;
+         cur = cur->next) {
+      edge_t *e = cur->data;
+      size_t  size = e->parent->non_term_size - e->subnode->non_term_size;
+      if (size < min_size) {
+        min_size = size;
+        edge = e;
+      }
+    }
+  }
+  if (!edge) {
+    tree_free(tree);
+    return NULL;
+  }
+
+  node_t *parent = edge->parent;
+  node_t *tail = edge->subnode;
+  size_t  offset = edge->subnode_offset;
+
+  // As `random_recursive_mutation`, but iteratively
+  tail->parent = NULL;
+  parent->subnodes[offset] = NULL;
+  for (size_t i = 0; i < depth; ++i) {
+    node_t *cloned_part = node_clone(parent);
+    tail->parent = cloned_part;
+    cloned_part->subnodes[offset] = tail;
+    tail = cloned_part;
+  }
+  tail->parent = parent;
+  parent->subnodes[offset] = tail;
+
+  return tree;
+}
+
+// Put `n` nodes under new nodes of `fanout`, level by level
+static node_t *stress_build_levels(node_t **nodes, size_t n, size_t fanout) {
+  while (n > 1) {
+    size_t num_parents = (n + fanout - 1) / fanout;
+    for (size_t i = 0; i < num_parents; ++i) {
+      size_t  num_subnodes = i + 1 < num_parents ? fanout : n - i * fanout;
+      node_t *parent = node_create_with_rule_id(nodes[i * fanout]->id,
+                                                nodes[i * fanout]->rule_id);
+      node_init_subnodes(parent, num_subnodes);
+      for (size_t j = 0; j < num_subnodes; ++j)
+        node_set_subnode(parent, j, nodes[i * fanout + j]);
+      nodes[i] = parent;
+    }
+    n = num_parents;
+  }
+  return nodes[0];
+}
+
+static tree_t *stress_build_wide(size_t fanout) {
+  node_t **nodes = malloc(fanout * sizeof(node_t *));
+  for (size_t i = 0; i < fanout; ++i)
+    nodes[i] = stress_gen_subtree(STRESS_WIDE_SUBTREE_LEN);
+
+  tree_t *tree = tree_create();
+  tree->root = stress_build_levels(nodes, fanout, fanout);
+  free(nodes);
+  return tree;
+}
+
+static tree_t *stress_build_huge(size_t num_nodes) {
+  size_t   n = 0, size = 1024, total = 0;
+  node_t **nodes = malloc(size * sizeof(node_t *));
+
+  // Inner nodes add about 1/STRESS_FANOUT more nodes
+  while (total + total / STRESS_FANOUT < num_nodes) {
+    if (n == size) {
+      size *= 2;
+      nodes = realloc(nodes, size * sizeof(node_t *));
+    }
+    nodes[n] = stress_gen_subtree(STRESS_SUBTREE_LEN);
+    total += stress_count_nodes(nodes[n++]);
+  }
+
+  tree_t *tree = tree_create();
+  tree->root = stress_build_levels(nodes, n, STRESS_FANOUT);
+  free(nodes);
+  return tree;
+}
+
+static void stress_report(const char *shape, size_t size, const char *op,
+                          double *times, int n) {
+  bench_result_t result;
+  char           name[BENCH_RESULT_OP_LEN];
+  double         avg = 0, var = 0;
+
+  for (int i = 0; i < n; ++i)
+    avg += (times[i] - avg) / (i + 1);
+  for (int i = 0; i < n; ++i)
+    var += (pow(times[i] - avg, 2) - var) / (i + 1);
+  qsort(times, n, sizeof(double), stress_compare_times);
+
+  snprintf(name, sizeof(name), "stress_%s_%s", shape, op);
+  bench_result_init(&result, name, size);
+  result.n = n;
+  result.avg = avg;
+  result.std = sqrt(var);
+  result.p50 = times[(n - 1) * 50 / 100];
+  result.p90 = times[(n - 1) * 90 / 100];
+  result.p99 = times[(n - 1) * 99 / 100];
+  result.max = times[n - 1];
+  result.throughput = avg > 0 ? 1 / avg : NAN;
+  if (write(stress_fd, &result, sizeof(result)) != sizeof(result))
+    perror("Cannot send the stress result");
+
+  printf(" p50: %lf s, max: %lf s\n", result.p50, result.max);
+  fflush(stdout);
+}
+
+// Wait for a child process, and report how it ended abnormally
+static void stress_wait(pid_t pid) {
+  int status;
+
+  if (pid < 0) {
+    perror("Cannot fork");
+    return;
+  }
+  waitpid(pid, &status, 0);
+  if (WIFSIGNALED(status)) {
+    int sig = WTERMSIG(status);
+    if (sig == SIGALRM)
+      printf(" timed out (%d s)\n", STRESS_TIMEOUT);
+    else
+      printf(" %s\n", strsignal(sig));
+    fflush(stdout);
+  }
+}
+
+// Time `op` for STRESS_RUNS times in a child process, with a timeout; `setup`
+// and `cleanup` are not timed
+#define STRESS_OP(name, setup, op, cleanup)                   \
+  do {                                                        \
+    printf("  %-28s", name);                                  \
+    fflush(stdout);                                           \
+    pid_t pid = fork();                                       \
+    if (pid == 0) {                                           \
+      double times[STRESS_RUNS];                              \
+      alarm(STRESS_TIMEOUT);                                  \
+      for (int i = 0; i < STRESS_RUNS; ++i) {                 \
+        setup;                                                \
+        double start = current_time();                        \
+        op;                                                   \
+        times[i] = current_time() - start;                    \
+        cleanup;                                              \
+      }                                                       \
+      stress_report(shape, size, name, times, STRESS_RUNS);   \
+      _exit(0);                                               \
+    }                                                         \
+    stress_wait(pid);                                         \
+  } while (0)
+
+static void stress_run_ops(const char *shape, size_t size, tree_t *tree) {
+  tree_t *result = NULL;
+  node_t *node = NULL;
+  edge_t  edge = {NULL, NULL, 0};
+
+  // Operations run in child processes, so the tree is prepared for all of
+  // them here
+  tree_get_size(tree);
+  tree_to_buf(tree);
+  tree_serialize(tree);
+  tree_get_non_terminal_nodes(tree);
+  tree_get_recursion_edges(tree);
+
+  STRESS_OP("tree_get_size", , tree_get_size(tree), );
+  STRESS_OP("tree_clone", , result = tree_clone(tree), tree_free(result));
+  STRESS_OP("tree_free", result = tree_clone(tree), tree_free(result), );
+  STRESS_OP("tree_to_buf", , tree_to_buf(tree), );
+  STRESS_OP("tree_serialize", , tree_serialize(tree), );
+  STRESS_OP("tree_deserialize", ,
+            result = tree_deserialize(tree->ser_buf, tree->ser_len),
+            tree_free(result));
+  STRESS_OP("tree_from_buf", ,
+            result = tree_from_buf(tree->data_buf, tree->data_len),
+            tree_free(result));
+  STRESS_OP("tree_get_non_terminal_nodes", ,
+            tree_get_non_terminal_nodes(tree), );
+  STRESS_OP("tree_get_recursion_edges", , tree_get_recursion_edges(tree), );
+
+  STRESS_OP("random_mutation", , result = random_mutation(tree),
+            tree_free(result));
+  STRESS_OP("random_recursive_mutation", ,
+            result = random_recursive_mutation(tree,
+                                               STRESS_RECURSIVE_MUTATION_N),
+            tree_free(result));
+  STRESS_OP("rules_mutation",
+            node = list_get(tree->non_terminal_node_list,
+                            random_below(tree->non_terminal_node_list->size)),
+            result = rules_mutation(
+                tree, node, random_below(node_num_rules[node->id])),
+            tree_free(result));
+
+  // Splice chunks of generated trees into the stress tree
+  chunk_store_init();
+  for (int i = 0; i < STRESS_SPLICING_NUM_TREES; ++i) {
+    result = gen_init__(STRESS_SUBTREE_LEN);
+    chunk_store_add_tree(result);
+    tree_free(result);
+  }
+  STRESS_OP("splicing_mutation", , result = splicing_mutation(tree),
+            tree_free(result));
+  chunk_store_clear();
+
+  // Add the stress tree into an empty chunk store
+  STRESS_OP("chunk_store_add_tree", chunk_store_init(),
+            chunk_store_add_tree(tree), chunk_store_clear());
+
+  STRESS_OP("subtree_trimming",
+            node = list_get(tree->non_terminal_node_list,
+                            random_below(tree->non_terminal_node_list->size)),
+            result = subtree_trimming(tree, node), tree_free(result));
+  if (tree->recursion_edge_list->size) {
+    STRESS_OP("recursive_trimming",
+              edge = *(edge_t *)list_get(
+                  tree->recursion_edge_list,
+                  random_below(tree->recursion_edge_list->size)),
+              result = recursive_trimming(tree, edge), tree_free(result));
+  }
+}
+
+// Build and stress a tree in a child process
+static void stress_run(stress_shape_t shape, size_t size) {
+  int            fds[2];
+  bench_result_t result;
+
+  printf("%s, %s=%zu:\n", stress_shape_names[shape], stress_size_names[shape],
+         size);
+  fflush(stdout);
+  if (pipe(fds) != 0) {
+    perror("Cannot create a pipe");
+    return;
+  }
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    stress_fd = fds[1];
+    random_set_seed(STRESS_SEED);
+
+    double  start = current_time();
+    tree_t *tree = shape == STRESS_DEEP   ? stress_build_deep(size)
+                   : shape == STRESS_WIDE ? stress_build_wide(size)
+                                          : stress_build_huge(size);
+    if (!tree) {
+      printf("  no recursion edge in the grammar\n");
+      fflush(stdout);
+      _exit(0);
+    }
+    printf("  %zu nodes, built in %lf s\n", stress_count_nodes(tree->root),
+           current_time() - start);
+    fflush(stdout);
+
+    stress_run_ops(stress_shape_names[shape], size, tree);
+    tree_free(tree);
+    // Skip `atexit` handlers, which belong to the parent process
+    _exit(0);
+  }
+
+  close(fds[1]);
+  if (pid > 0) {
+    while (read(fds[0], &result, sizeof(result)) == sizeof(result))
+      bench_results_add(&result);
+  }
+  close(fds[0]);
+  stress_wait(pid);
+}
+
+void bench_stress(size_t max_nodes) {
+  printf("========== Stress [START] ==========\n");
+  for (size_t depth = 100; depth <= STRESS_MAX_DEPTH; depth *= 10)
+    stress_run(STRESS_DEEP, depth);
+  for (size_t fanout = 100; fanout <= STRESS_MAX_FANOUT; fanout *= 10)
+    stress_run(STRESS_WIDE, fanout);
+  for (size_t nodes = STRESS_MIN_NODES; nodes <= max_nodes; nodes *= 10)
+    stress_run(STRESS_HUGE, nodes);
+  printf("=========== Stress [END] ===========\n\n");
+}
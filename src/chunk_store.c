@@ -22,6 +22,8 @@
 #include "f1_c_fuzz.h"
 #include "chunk_store.h"
 #include "chunk_store_internal.h"
+#include "probes.h"
+#include "stats.h"
 #include "utils.h"
 
 // the list, in `chunk_store`, contains a collection of `node_t`
@@ -162,11 +164,17 @@ void chunk_store_init() {
 
 void chunk_store_add_tree(tree_t *tree) {
 
+  STATS_PROFILE(STATS_PROFILE_CHUNK_STORE_ADD_TREE);
+
   if (!tree || !tree->root) return;
 
+  PROBE2(chunk_store_add__start, tree->root->id, tree->root->non_term_size);
+
   // Clone the tree and then hand it off to the chunk_store
   chunk_store_take_node(node_clone(tree->root));
 
+  PROBE1(chunk_store_add__done, chunk_store_get_num_chunks());
+
 }
 
 node_t *chunk_store_get_alternative_node(node_t *node) {
@@ -174,7 +182,9 @@ node_t *chunk_store_get_alternative_node(node_t *node) {
   if (!node) return NULL;
 
   const char *node_type = node_type_str(node->id);
-  list_t **   p_node_list = map_get(&chunk_store, node_type);
+  // `map_get` stores the result in the map, so that several threads cannot
+  // look up the chunks at once
+  list_t **p_node_list = (list_t **)map_get_(&chunk_store.base, node_type);
   if (unlikely(!p_node_list)) return NULL;
 
   list_t *node_list = *p_node_list;
@@ -185,6 +195,26 @@ node_t *chunk_store_get_alternative_node(node_t *node) {
 
 }
 
+size_t chunk_store_get_num_chunks() {
+
+  return seen_chunks.base.nnodes;
+
+}
+
+void chunk_store_foreach_type(void (*func)(void *arg, const char *node_type,
+                                           size_t num_chunks),
+                              void *arg) {
+
+  const char *key;
+  map_iter_t  iter = map_iter(&chunk_store);
+  while ((key = map_next(&chunk_store, &iter))) {
+
+    func(arg, key, (*map_get(&chunk_store, key))->size);
+
+  }
+
+}
+
 void chunk_store_clear() {
 
   map_deinit(&seen_chunks);
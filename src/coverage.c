@@ -0,0 +1,277 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "coverage.h"
+#include "f1_c_fuzz.h"
+#include "helpers.h"
+#include "map.h"
+#include "rule_weights.h"
+#include "tree_mutation.h"
+
+#define NUM_NODE_TYPES (sizeof(node_num_rules) / sizeof(node_num_rules[0]))
+
+// no parent rule
+#define COVERAGE_NO_RULE (SIZE_MAX)
+
+static bool coverage_ready = false;
+static bool coverage_bias = false;
+static bool coverage_dirty = false;
+
+// The rules of node type `i` are counted at [rule_base[i], rule_base[i + 1])
+static size_t rule_base[NUM_NODE_TYPES + 1];
+
+// The number of inputs that cover each rule, and the last input that has been
+// counted (so that an input is counted once per rule)
+static uint32_t *rule_counts = NULL;
+static uint32_t *rule_stamps = NULL;
+
+// Updated by `coverage_update`: whether a rule is rare, and the generation
+// scales of the rules
+static uint8_t *rule_rare = NULL;
+static double * rule_scales = NULL;
+
+// The k-path maps, for k = 2 and 3
+static uint32_t *path_counts[2] = {NULL, NULL};
+static uint32_t *path_stamps[2] = {NULL, NULL};
+
+static uint32_t  coverage_stamp = 0;
+static size_t    num_entries = 0;
+static size_t    covered_rules = 0;
+static size_t    covered_paths[2] = {0, 0};
+static map_int_t counted_entries;
+
+static inline uint32_t coverage_hash(uint64_t a, uint64_t b) {
+
+  uint64_t h = ((a + 1) * 0x9E3779B97F4A7C15ULL) ^ b;
+  return (uint32_t)((h * 0xC2B2AE3D27D4EB4FULL) >> 32) &
+         (COVERAGE_PATH_MAP_SIZE - 1);
+
+}
+
+static inline void coverage_hit(uint32_t *counts, uint32_t *stamps,
+                                size_t offset, size_t *covered) {
+
+  if (stamps[offset] == coverage_stamp) return;
+  stamps[offset] = coverage_stamp;
+
+  if (counts[offset] == 0) ++(*covered);
+  if (counts[offset] < UINT32_MAX) ++counts[offset];
+
+}
+
+static void coverage_add_node(node_t *node, size_t parent,
+                              size_t grandparent) {
+
+  // `node` may be NULL due to parsing errors
+  if (unlikely(!node) || node->id == 0) return;
+
+  size_t rule = COVERAGE_NO_RULE;
+  if (likely(node->id < NUM_NODE_TYPES &&
+             node->rule_id < node_num_rules[node->id])) {
+
+    rule = rule_base[node->id] + node->rule_id;
+    coverage_hit(rule_counts, rule_stamps, rule, &covered_rules);
+
+    if (parent != COVERAGE_NO_RULE) {
+
+      coverage_hit(path_counts[0], path_stamps[0], coverage_hash(parent, rule),
+                   &covered_paths[0]);
+
+      if (grandparent != COVERAGE_NO_RULE)
+        coverage_hit(path_counts[1], path_stamps[1],
+                     coverage_hash(grandparent * rule_base[NUM_NODE_TYPES] +
+                                       parent,
+                                   rule),
+                     &covered_paths[1]);
+
+    }
+
+  }
+
+  for (uint32_t i = 0; i < node->subnode_count; ++i)
+    coverage_add_node(node->subnodes[i], rule, parent);
+
+}
+
+void coverage_init(bool bias) {
+
+  coverage_clear();
+
+  rule_base[0] = 0;
+  for (size_t i = 0; i < NUM_NODE_TYPES; ++i)
+    rule_base[i + 1] = rule_base[i] + node_num_rules[i];
+
+  size_t num_rules = rule_base[NUM_NODE_TYPES];
+  rule_counts = calloc(num_rules + 1, sizeof(uint32_t));
+  rule_stamps = calloc(num_rules + 1, sizeof(uint32_t));
+  rule_rare = calloc(num_rules + 1, sizeof(uint8_t));
+  rule_scales = calloc(num_rules + 1, sizeof(double));
+  for (int k = 0; k < 2; ++k) {
+
+    path_counts[k] = calloc(COVERAGE_PATH_MAP_SIZE, sizeof(uint32_t));
+    path_stamps[k] = calloc(COVERAGE_PATH_MAP_SIZE, sizeof(uint32_t));
+
+  }
+
+  if (!rule_counts || !rule_stamps || !rule_rare || !rule_scales ||
+      !path_counts[0] || !path_stamps[0] || !path_counts[1] ||
+      !path_stamps[1]) {
+
+    perror("coverage_init (calloc)");
+    coverage_clear();
+    return;
+
+  }
+
+  map_init(&counted_entries);
+  coverage_ready = true;
+  coverage_bias = bias;
+  if (bias) tree_set_coverage_bias(true);
+
+  coverage_dirty = true;
+  coverage_update();
+
+}
+
+bool coverage_add_tree(const char *name, tree_t *tree) {
+
+  if (!coverage_ready || !name || !tree || !tree->root) return false;
+  if (map_get(&counted_entries, name)) return false;
+  map_set(&counted_entries, name, 1);
+
+  // A stamp is never 0, which all stamps start with
+  if (unlikely(++coverage_stamp == 0)) ++coverage_stamp;
+  coverage_add_node(tree->root, COVERAGE_NO_RULE, COVERAGE_NO_RULE);
+
+  ++num_entries;
+  coverage_dirty = true;
+  return true;
+
+}
+
+bool coverage_update() {
+
+  if (!coverage_ready || !coverage_dirty) return false;
+  coverage_dirty = false;
+
+  for (size_t i = 1; i < NUM_NODE_TYPES; ++i) {
+
+    size_t   num_rules = rule_base[i + 1] - rule_base[i];
+    uint64_t total = 0;
+    for (size_t j = rule_base[i]; j < rule_base[i + 1]; ++j)
+      total += rule_counts[j];
+
+    for (size_t j = rule_base[i]; j < rule_base[i + 1]; ++j) {
+
+      rule_rare[j] = (uint64_t)rule_counts[j] * num_rules <= total;
+      rule_scales[j] = 1 / sqrt(1.0 + rule_counts[j]);
+
+    }
+
+    if (coverage_bias) rule_weights_set_scales(i, rule_scales + rule_base[i]);
+
+  }
+
+  return true;
+
+}
+
+uint32_t coverage_get_rule_count(uint32_t node_type, uint32_t rule_id) {
+
+  if (!coverage_ready || node_type >= NUM_NODE_TYPES ||
+      rule_id >= node_num_rules[node_type])
+    return 0;
+  return rule_counts[rule_base[node_type] + rule_id];
+
+}
+
+bool coverage_is_rare(uint32_t node_type, uint32_t rule_id) {
+
+  if (!coverage_ready || node_type >= NUM_NODE_TYPES ||
+      rule_id >= node_num_rules[node_type])
+    return true;
+  return rule_rare[rule_base[node_type] + rule_id];
+
+}
+
+size_t coverage_get_num_entries() {
+
+  return num_entries;
+
+}
+
+size_t coverage_get_num_rules() {
+
+  // Excluding the terminal node type
+  return coverage_ready ? rule_base[NUM_NODE_TYPES] - rule_base[1] : 0;
+
+}
+
+size_t coverage_get_covered_rules() {
+
+  return covered_rules;
+
+}
+
+size_t coverage_get_covered_paths(int k) {
+
+  if (k < 2 || k > 3) return 0;
+  return covered_paths[k - 2];
+
+}
+
+void coverage_clear() {
+
+  if (coverage_bias) {
+
+    for (size_t i = 1; i < NUM_NODE_TYPES; ++i)
+      rule_weights_set_scales(i, NULL);
+    tree_set_coverage_bias(false);
+    coverage_bias = false;
+
+  }
+
+  if (coverage_ready) map_deinit(&counted_entries);
+  coverage_ready = false;
+  coverage_dirty = false;
+
+  free(rule_counts);
+  free(rule_stamps);
+  free(rule_rare);
+  free(rule_scales);
+  rule_counts = rule_stamps = NULL;
+  rule_rare = NULL;
+  rule_scales = NULL;
+  for (int k = 0; k < 2; ++k) {
+
+    free(path_counts[k]);
+    free(path_stamps[k]);
+    path_counts[k] = path_stamps[k] = NULL;
+    covered_paths[k] = 0;
+
+  }
+
+  coverage_stamp = 0;
+  num_entries = 0;
+  covered_rules = 0;
+
+}
@@ -0,0 +1,107 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "f1_c_fuzz.h"
+#include "grammar_runtime.h"
+#include "stats.h"
+#include "tree.h"
+
+size_t            node_min_lens[F1_RUNTIME_MAX_NODE_TYPES];
+size_t            node_num_rules[F1_RUNTIME_MAX_NODE_TYPES];
+const double *    node_rule_weights[F1_RUNTIME_MAX_NODE_TYPES];
+const size_t *    node_rule_tiers[F1_RUNTIME_MAX_NODE_TYPES];
+size_t            node_num_rule_tiers[F1_RUNTIME_MAX_NODE_TYPES];
+gen_rule_picker_t gen_rule_picker = NULL;
+
+static grammar_runtime_t *f1_grammar = NULL;
+
+bool f1_runtime_load(const char *filename) {
+
+  grammar_runtime_t *grammar = grammar_runtime_load(filename);
+  if (!grammar) return false;
+
+  if (grammar->num_node_types > F1_RUNTIME_MAX_NODE_TYPES) {
+
+    fprintf(stderr, "Too many node types in %s: %zu (at most %d)\n", filename,
+            grammar->num_node_types - 1, F1_RUNTIME_MAX_NODE_TYPES - 1);
+    grammar_runtime_free(grammar);
+    return false;
+
+  }
+
+  f1_runtime_unload();
+  f1_grammar = grammar;
+
+  size_t n = grammar->num_node_types;
+  memcpy(node_min_lens, grammar->node_min_lens, n * sizeof(size_t));
+  memcpy(node_num_rules, grammar->node_num_rules, n * sizeof(size_t));
+  memcpy(node_rule_weights, grammar->node_rule_weights, n * sizeof(double *));
+  memcpy(node_rule_tiers, grammar->node_rule_tiers, n * sizeof(size_t *));
+  memcpy(node_num_rule_tiers, grammar->node_num_rule_tiers, n * sizeof(size_t));
+  return true;
+
+}
+
+void f1_runtime_unload() {
+
+  if (!f1_grammar) return;
+
+  memset(node_min_lens, 0, sizeof(node_min_lens));
+  memset(node_num_rules, 0, sizeof(node_num_rules));
+  memset(node_rule_weights, 0, sizeof(node_rule_weights));
+  memset(node_rule_tiers, 0, sizeof(node_rule_tiers));
+  memset(node_num_rule_tiers, 0, sizeof(node_num_rule_tiers));
+
+  grammar_runtime_free(f1_grammar);
+  f1_grammar = NULL;
+
+}
+
+const char *node_type_str(int node_type) {
+
+  if (!f1_grammar || node_type < 0 ||
+      (size_t)node_type >= f1_grammar->num_node_types)
+    return "";
+  return f1_grammar->node_type_strs[node_type];
+
+}
+
+node_t *gen_node(int node_type, int max_len, int *consumed, int rule_index) {
+
+  return grammar_runtime_gen_node(f1_grammar, gen_rule_picker, node_type,
+                                  max_len, consumed, rule_index);
+
+}
+
+tree_t *gen_init__(int max_len) {
+
+  return grammar_runtime_gen_tree(f1_grammar, gen_rule_picker, max_len);
+
+}
+
+// In place of the ANTLR4 shim
+tree_t *tree_from_buf(const uint8_t *data_buf, size_t data_size) {
+
+  STATS_PROFILE(STATS_PROFILE_TREE_FROM_BUF);
+
+  return grammar_runtime_parse(f1_grammar, data_buf, data_size);
+
+}
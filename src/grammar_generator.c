@@ -24,6 +24,7 @@
 #include <time.h>
 
 #include "f1_c_fuzz.h"
+#include "rule_weights.h"
 #include "utils.h"
 
 int main(int argc, const char *argv[]) {
@@ -53,6 +54,9 @@ int main(int argc, const char *argv[]) {
   printf("Using seed %d\n", seed);
   random_set_seed((uint64_t)seed);
 
+  // The static rule weights of the grammar file, if any
+  rule_weights_init();
+
   if (!create_directory(out_dir)) {
 
     fprintf(stderr, "Cannot create the output directory\n");
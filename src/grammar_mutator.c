@@ -31,7 +31,17 @@
 #include "tree_mutation.h"
 #include "tree_trimming.h"
 #include "chunk_store.h"
+#include "coverage.h"
+#include "node_weights.h"
+#include "parse_pool.h"
+#include "probes.h"
+#include "rule_weights.h"
+#include "stats.h"
+#include "trace.h"
+#include "tree_cache.h"
+#include "tree_store.h"
 #include "utils.h"
+#include "warm_start.h"
 
 // default number of mutations of three mutation strategies
 // env: RANDOM_MUTATION_STEPS
@@ -41,22 +51,101 @@ size_t default_random_recursive_mutation_steps = 1000;
 // env: SPLICING_MUTATION_STEPS
 size_t default_splicing_mutation_steps = 1000;
 
+// rendering test cases of at least this many bytes with multiple threads
+// env: PARALLEL_RENDER_THRESHOLD (0 disables the parallel rendering)
+static size_t parallel_render_threshold = 4 * 1024 * 1024;
+// env: PARALLEL_RENDER_THREADS
+static size_t parallel_render_threads = 4;
+
+// memory budget (in MB) of deserialized trees kept in memory
+// env: TREE_CACHE_SIZE (0 disables the tree cache)
+static size_t tree_cache_size = 0;
+
+// load all trees in this trees folder at the initialization stage
+// env: WARM_START_DIR
+static const char *warm_start_dir = NULL;
+
+// host-wide folder of trees shared by all instances
+// env: TREE_STORE_DIR
+static const char *tree_store_dir = NULL;
+// env: WARM_START_THREADS
+static size_t warm_start_threads = 4;
+// env: WARM_START_MEM_LIMIT (in MB)
+static size_t warm_start_mem_limit = 1024;
+
+// number of threads parsing imported test cases in the background
+// env: PARSE_THREADS (0 parses them synchronously)
+static size_t parse_threads = 2;
+
+// minimal interval (in seconds) between updates of `grammar_mutator_stats`
+// env: STATS_INTERVAL (0 disables the statistics file)
+static size_t stats_update_interval = 60;
+
+// pick the nodes to mutate by the learned yield of their types
+// env: WEIGHTED_PICK (0 picks them uniformly, unless NODE_WEIGHTS_FILE is set)
+static size_t weighted_pick = 0;
+// a table of static weights of node types
+// env: NODE_WEIGHTS_FILE
+static const char *node_weights_file = NULL;
+// bias the generation and the rules mutation toward rarely covered rules
+// env: COVERAGE_BIAS
+static size_t coverage_bias = 0;
+
+// record all calls into this trace file
+// env: TRACE_FILE
+static const char *trace_filename = NULL;
+
+#ifdef F1_RUNTIME
+// the grammar file of the runtime build, loaded at the initialization
+// env: GRAMMAR_FILE
+static const char *grammar_file = NULL;
+#endif
+
+// the effective configuration ("NAME=value ..."), recorded in traces
+static char trace_config[1024];
+
+// The number of non-terminal nodes of a sized tree, as a probe argument
+static inline size_t probe_tree_size(tree_t *tree) {
+
+  return tree && tree->root ? tree->root->non_term_size : 0;
+
+}
+
 static void load_env_configs() {
 
   char *ptr;
-  char *env_vars[4] = {
+  char *env_vars[13] = {
       "RANDOM_MUTATION_STEPS",
       "RANDOM_RECURSIVE_MUTATION_STEPS",
       "SPLICING_MUTATION_STEPS",
+      "PARALLEL_RENDER_THRESHOLD",
+      "PARALLEL_RENDER_THREADS",
+      "TREE_CACHE_SIZE",
+      "WARM_START_THREADS",
+      "WARM_START_MEM_LIMIT",
+      "PARSE_THREADS",
+      "STATS_INTERVAL",
+      "WEIGHTED_PICK",
+      "COVERAGE_BIAS",
       NULL
   };
-  size_t *configs[4] = {
+  size_t *configs[13] = {
       &default_random_mutation_steps,
       &default_random_recursive_mutation_steps,
       &default_splicing_mutation_steps,
+      &parallel_render_threshold,
+      &parallel_render_threads,
+      &tree_cache_size,
+      &warm_start_threads,
+      &warm_start_mem_limit,
+      &parse_threads,
+      &stats_update_interval,
+      &weighted_pick,
+      &coverage_bias,
       NULL
   };
-  int i = 0;
+  int    i = 0;
+  size_t len = 0;
 
   while (env_vars[i] != NULL && configs[i] != NULL) {
 
@@ -66,36 +155,123 @@ static void load_env_configs() {
       *(configs[i]) = strtol(ptr, NULL, 10);
 
     }
+
+    if (len < sizeof(trace_config))
+      len += snprintf(trace_config + len, sizeof(trace_config) - len,
+                      "%s%s=%zu", len ? " " : "", env_vars[i], *(configs[i]));
     ++i;
 
   }
 
+  ptr = getenv("WARM_START_DIR");
+  if (ptr && *ptr) warm_start_dir = ptr;
+
+  ptr = getenv("TREE_STORE_DIR");
+  if (ptr && *ptr) tree_store_dir = ptr;
+
+  ptr = getenv("NODE_WEIGHTS_FILE");
+  if (ptr && *ptr) node_weights_file = ptr;
+
+  // Not inherited by the next initialization, e.g., in tests
+  ptr = getenv("TRACE_FILE");
+  trace_filename = ptr && *ptr ? ptr : NULL;
+
+#ifdef F1_RUNTIME
+  ptr = getenv("GRAMMAR_FILE");
+  grammar_file = ptr && *ptr ? ptr : NULL;
+#endif
+
+}
+
+// Finish recording a call, which started at `start` (see `stats_cycles`)
+static inline void trace_call_end(trace_record_t *record, uint64_t start) {
+
+  record->time_ns = (uint64_t)stats_cycles_to_ns(stats_cycles() - start);
+  trace_write(record);
+
 }
 
 my_mutator_t *afl_custom_init(afl_t *afl, unsigned int seed) {
 
+  PROBE1(init__entry, seed);
+
+  uint64_t start = stats_cycles();
   random_set_seed(seed);
 
   load_env_configs();
 
+#ifdef F1_RUNTIME
+  // before any table of the grammar is used
+  if (!grammar_file) {
+
+    fprintf(stderr, "Missing the grammar file, please set GRAMMAR_FILE\n");
+    PROBE1(init__return, NULL);
+    return NULL;
+
+  }
+
+  if (!f1_runtime_load(grammar_file)) {
+
+    PROBE1(init__return, NULL);
+    return NULL;
+
+  }
+
+#endif
+
+  tree_set_parallel_render(parallel_render_threshold, parallel_render_threads);
+
+  stats_init(stats_update_interval);
   chunk_store_init();
+  tree_cache_init(tree_cache_size * 1024 * 1024);
+  if (tree_store_dir) tree_store_init(tree_store_dir);
+
+  // before any tree is sized
+  node_weights_init(node_weights_file, weighted_pick);
+  rule_weights_init();
+  coverage_init(coverage_bias);
+
+  if (warm_start_dir)
+    warm_start_load_trees(warm_start_dir, warm_start_threads,
+                          warm_start_mem_limit * 1024 * 1024, true, NULL);
 
   my_mutator_t *data = (my_mutator_t *)calloc(1, sizeof(my_mutator_t));
   if (!data) {
 
     perror("custom mutator structure allocation error (afl_custom_init)");
+    PROBE1(init__return, NULL);
     return NULL;
 
   }
 
   data->afl = afl;
 
+  if (parse_threads > 0) data->parse_pool = parse_pool_create(parse_threads);
+
+  if (trace_filename && trace_start(trace_filename)) {
+
+    trace_record_t record = {.op = TRACE_INIT,
+                             .args = {seed, true},
+                             .strs = {trace_config}};
+    trace_call_end(&record, start);
+
+  }
+
+  PROBE1(init__return, data);
   return data;
 
 }
 
 void afl_custom_deinit(my_mutator_t *data) {
 
+  PROBE1(deinit__entry, data);
+
+  uint64_t start = stats_cycles();
+
+  // stop parsing threads before the chunk store goes away
+  parse_pool_free(data->parse_pool);
+  data->parse_pool = NULL;
+
   if (data->tree_cur) tree_free(data->tree_cur);
   if (data->mutated_tree) tree_free(data->mutated_tree);
   if (data->trimmed_tree) tree_free(data->trimmed_tree);
@@ -122,23 +298,69 @@ void afl_custom_deinit(my_mutator_t *data) {
   free(data->fuzz_buf);
   free(data);
 
+  // the final statistics, before the chunk store and the tree cache are gone
+  stats_write();
+  stats_write_yield();
+
   chunk_store_clear();
+  tree_cache_clear();
+  tree_store_clear();
+  node_weights_clear();
+  coverage_clear();
+  rule_weights_clear();
 
-}
+  // stop rendering threads
+  tree_set_parallel_render(0, 0);
 
-// For each interesting test case in the queue
-uint8_t afl_custom_queue_get(my_mutator_t *data, const uint8_t *filename) {
+#ifdef F1_RUNTIME
+  // after all trees are gone
+  f1_runtime_unload();
+#endif
 
-  const char *fn = (const char *)filename;
-  data->filename_cur = filename;
-  if (data->tree_cur) {
+  if (trace_is_recording()) {
 
-    // Clear the previous tree
-    tree_free(data->tree_cur);
+    trace_record_t record = {.op = TRACE_DEINIT};
+    trace_call_end(&record, start);
+    trace_stop();
 
   }
 
-  data->tree_cur = NULL;
+  PROBE0(deinit__return);
+
+}
+
+// Keep a copy of the tree of a queue entry in the tree cache
+static void queue_cache_tree(const char *name, tree_t *tree) {
+
+  if (tree_cache_size == 0) return;
+
+  tree_t *cached_tree = tree_clone(tree);
+  if (!tree_cache_put(name, cached_tree)) tree_free(cached_tree);
+
+}
+
+// Hand over a tree parsed in the background to the chunk store and the tree
+// cache. The tree file has been written by the parse pool.
+static void queue_ingest_parsed_tree(__attribute__((unused)) void *arg,
+                                     __attribute__((unused))
+                                     const char *test_case_fn,
+                                     const char *tree_fn, tree_t *tree) {
+
+  chunk_store_add_tree(tree);
+  if (tree_fn[0]) coverage_add_tree(strrchr(tree_fn, '/') + 1, tree);
+
+  if (tree_fn[0] && tree_cache_put(strrchr(tree_fn, '/') + 1, tree)) return;
+  tree_free(tree);
+
+}
+
+// Find the tree file of a test case, and create the trees folder if needed.
+// `tree_fn` is set to an empty string if the test case is not in a queue.
+// Returns the name of the tree file, or NULL on errors.
+static const char *queue_get_tree_filename(my_mutator_t *data, const char *fn,
+                                           char tree_fn[PATH_MAX]) {
+
+  tree_fn[0] = '\0';
 
   // Figure out where the "trees" folder is stashed!
   // Strip off the file portion of the filename:
@@ -147,7 +369,7 @@ uint8_t afl_custom_queue_get(my_mutator_t *data, const uint8_t *filename) {
 
     // Should not reach here
     perror("No folder in filename (afl_custom_queue_get)");
-    return 0;
+    return NULL;
 
   }
 
@@ -179,7 +401,8 @@ uint8_t afl_custom_queue_get(my_mutator_t *data, const uint8_t *filename) {
 
     // Should not reach here
     perror("No parent folder in filename (afl_custom_queue_get)");
-    return 0;
+    free(tree_out_dir);
+    return NULL;
 
   }
 
@@ -187,40 +410,88 @@ uint8_t afl_custom_queue_get(my_mutator_t *data, const uint8_t *filename) {
   if (strcmp(last_dir, "/queue") != 0 && strcmp(last_dir, "/_resume") != 0) {
 
     free(tree_out_dir);
-    tree_out_dir = NULL;
-    data->tree_fn_cur[0] = '\0';
+    return use_name;
 
-  } else {
+  }
 
-    // Copy "/trees" (including the null) to replace the old folder name
-    memcpy(last_dir, "/trees", 7);
+  // The statistics file is next to `fuzzer_stats`, in the parent folder
+  if (unlikely(stats_update_interval > 0 && !stats_get_filename()[0])) {
 
-    // Set up the (expected) tree filename
-    snprintf(
-        data->tree_fn_cur, PATH_MAX - 1, "%s/%s", tree_out_dir,
-        use_name);
+    *last_dir = '\0';
+    snprintf(tree_fn, PATH_MAX - 1, "%s/" STATS_FILENAME, tree_out_dir);
+    stats_set_filename(tree_fn);
 
-    // Check if we need to create the tree output directory
-    if (unlikely(data->tree_out_dir_exist == 0)) {
+  }
 
-      // Check whether the directory exists
-      if (!create_directory(tree_out_dir)) {
+  // Copy "/trees" (including the null) to replace the old folder name
+  memcpy(last_dir, "/trees", 7);
 
-        // error
-        perror("Cannot create the output directory (afl_custom_queue_get)");
-        free(tree_out_dir);
-        return 0;
+  // Set up the (expected) tree filename
+  snprintf(tree_fn, PATH_MAX - 1, "%s/%s", tree_out_dir, use_name);
 
-      }
+  // Check if we need to create the tree output directory
+  if (unlikely(data->tree_out_dir_exist == 0)) {
+
+    // Check whether the directory exists
+    if (!create_directory(tree_out_dir)) {
+
+      // error
+      perror("Cannot create the output directory (afl_custom_queue_get)");
+      free(tree_out_dir);
+      return NULL;
 
     }
 
-    free(tree_out_dir);
+  }
+
+  free(tree_out_dir);
+
+  return use_name;
+
+}
+
+// For each interesting test case in the queue
+static uint8_t mutator_queue_get(my_mutator_t *data, const uint8_t *filename) {
+
+  const char *fn = (const char *)filename;
+  PROBE1(queue_get__entry, fn);
+
+  data->filename_cur = filename;
+  if (data->tree_cur) {
+
+    // Clear the previous tree
+    tree_free(data->tree_cur);
+
+  }
+
+  data->tree_cur = NULL;
+
+  // A pending background parse of this test case is finished first, so that
+  // the tree file below is complete
+  parse_pool_wait(data->parse_pool, fn);
+  parse_pool_drain(data->parse_pool, queue_ingest_parsed_tree, data);
+
+  const char *use_name = queue_get_tree_filename(data, fn, data->tree_fn_cur);
+  if (unlikely(!use_name)) {
+
+    PROBE2(queue_get__return, 0, 0);
+    return 0;
 
   }
 
   if (strlen(data->tree_fn_cur)) {
 
+    // Cached trees carry their sizes and are already in the chunk store
+    data->tree_cur = tree_cache_get(use_name);
+    if (data->tree_cur) {
+
+      coverage_add_tree(use_name, data->tree_cur);
+      stats_add_source(STATS_FROM_TREE_CACHE);
+      PROBE2(queue_get__return, 1, probe_tree_size(data->tree_cur));
+      return 1;
+
+    }
+
     // Read the corresponding serialized tree from file
     data->tree_cur = read_tree_from_file(data->tree_fn_cur);
     if (data->tree_cur) {
@@ -228,43 +499,60 @@ uint8_t afl_custom_queue_get(my_mutator_t *data, const uint8_t *filename) {
       // We already had this tree in the trees folder, so compute its size and then we're done!
       tree_get_size(data->tree_cur);
       chunk_store_add_tree(data->tree_cur);
+      queue_cache_tree(use_name, data->tree_cur);
+      coverage_add_tree(use_name, data->tree_cur);
+      stats_add_source(STATS_FROM_TREE_FILE);
+      PROBE2(queue_get__return, 1, probe_tree_size(data->tree_cur));
       return 1;
 
     }
 
   }
 
-  // try to parse the test case
-  data->tree_cur = load_tree_from_test_case(fn);
+  // try to parse the test case (or find it in the tree store), and cache the
+  // info from this test case in our trees folder
+  data->tree_cur = tree_store_load_test_case(fn, data->tree_fn_cur);
   if (data->tree_cur) {
 
-    // Now that we've parsed it, cache the info from this test case in
-    // our trees folder and in the chunk store
+    // Now that we've got it, cache the info from this test case in memory and
+    // in the chunk store
     tree_get_size(data->tree_cur);
-    if (strlen(data->tree_fn_cur)) write_tree_to_file(data->tree_cur, data->tree_fn_cur);
+    if (strlen(data->tree_fn_cur)) queue_cache_tree(use_name, data->tree_cur);
+
     chunk_store_add_tree(data->tree_cur);
+    coverage_add_tree(use_name, data->tree_cur);
+    stats_add_source(STATS_FROM_TEST_CASE);
+    PROBE2(queue_get__return, 1, probe_tree_size(data->tree_cur));
     return 1;
 
   }
 
   // parsing error, skip the current test case
+  stats_add_source(STATS_NO_TREE);
+  PROBE2(queue_get__return, 0, 0);
 
   return 0;
 
 }
 
 // Trimming
-int32_t afl_custom_init_trim(my_mutator_t *                   data,
-                             __attribute__((unused)) uint8_t *buf,
-                             __attribute__((unused)) size_t   buf_size) {
+static int32_t mutator_init_trim(my_mutator_t *data) {
+
+  PROBE1(init_trim__entry, probe_tree_size(data->tree_cur));
+
+  if (!data->tree_cur) {
 
-  if (!data->tree_cur) return 0;
+    PROBE1(init_trim__return, 0);
+    return 0;
+
+  }
 
   tree_get_non_terminal_nodes(data->tree_cur);
   tree_get_recursion_edges(data->tree_cur);
 
   data->cur_trimming_stage = 0;
   data->trim_was_effective = false;
+  data->trim_orig_len = tree_get_data_len(data->tree_cur);
 
   data->cur_subtree_trimming_step = 0;
   data->finished_subtree_trimming_nodes = 0;
@@ -275,16 +563,22 @@ int32_t afl_custom_init_trim(my_mutator_t *                   data,
   data->total_recursive_trimming_steps =
       data->tree_cur->root->recursion_edge_size;
 
+  PROBE1(init_trim__return, data->total_subtree_trimming_steps +
+                                data->total_recursive_trimming_steps);
   return data->total_subtree_trimming_steps +
          data->total_recursive_trimming_steps;
 
 }
 
-size_t afl_custom_trim(my_mutator_t *data, uint8_t **out_buf) {
+static size_t mutator_trim(my_mutator_t *data, uint8_t **out_buf) {
+
+  tree_t * trimmed_tree = NULL;
+  size_t   trimmed_size = 0;
+  tree_t * tree_cur = data->tree_cur;
+  uint64_t start = stats_cycles();
 
-  tree_t *trimmed_tree = NULL;
-  size_t  trimmed_size = 0;
-  tree_t *tree_cur = data->tree_cur;
+  PROBE2(trim__entry, data->cur_trimming_stage,
+         data->cur_subtree_trimming_step + data->cur_recursive_trimming_step);
 
   if (data->cur_trimming_stage == 0) {
 
@@ -304,34 +598,47 @@ size_t afl_custom_trim(my_mutator_t *data, uint8_t **out_buf) {
     // should not reach here
     *out_buf = NULL;
     perror("wrong trimming stage (afl_custom_trim)");
+    PROBE3(trim__return, data->cur_trimming_stage, 0, 0);
     return 0;
 
   }
 
-  tree_to_buf(trimmed_tree);
   tree_get_size(trimmed_tree);
   data->trimmed_tree = trimmed_tree;
 
   // maybe_grow is optimized to be quick for reused buffers.
-  trimmed_size = trimmed_tree->data_len;
+  trimmed_size = tree_get_data_len(trimmed_tree);
   uint8_t *trimmed_out =
       (uint8_t *)maybe_grow(BUF_PARAMS(data, fuzz), trimmed_size);
   if (!trimmed_out) {
 
     *out_buf = NULL;
     perror("custom mutator allocation (maybe_grow)");
+    PROBE3(trim__return, data->cur_trimming_stage, 0, 0);
     return 0;            /* afl-fuzz will very likely error out after this. */
 
   }
 
-  memcpy(trimmed_out, trimmed_tree->data_buf, trimmed_size);
+  // Render the trimmed tree directly into the reused buffer
   *out_buf = trimmed_out;
+  trimmed_size = tree_render_to_buf(trimmed_tree, trimmed_out, trimmed_size);
+
+  stats_add_stage(data->cur_trimming_stage == 0 ? STATS_SUBTREE_TRIMMING
+                                                : STATS_RECURSIVE_TRIMMING,
+                  stats_cycles() - start);
+  stats_maybe_write();
 
+  PROBE3(trim__return, data->cur_trimming_stage,
+         probe_tree_size(trimmed_tree), trimmed_size);
   return trimmed_size;
 
 }
 
-int32_t afl_custom_post_trim(my_mutator_t *data, int success) {
+static int32_t mutator_post_trim(my_mutator_t *data, int success) {
+
+  uint8_t prev_trimming_stage = data->cur_trimming_stage;
+
+  PROBE2(post_trim__entry, success, data->cur_trimming_stage);
 
   if (success) {
     // Keep track that we will need to rewrite the tree file later
@@ -421,25 +728,43 @@ int32_t afl_custom_post_trim(my_mutator_t *data, int success) {
 
   }
 
+  if (prev_trimming_stage <= 1 && data->cur_trimming_stage > 1)
+    stats_add_trim(data->trim_orig_len, tree_get_data_len(data->tree_cur));
+
   // If we're done and we reduced the tree, then save the tree back to the
   // file and write it to the chunk store for use in future splice mutations:
   if (data->trim_was_effective && data->cur_trimming_stage > 1) {
 
     // Update the corresponding tree file
-    write_tree_to_file(data->tree_cur, data->tree_fn_cur);
+    tree_store_save_tree(data->tree_cur, data->tree_fn_cur);
     chunk_store_add_tree(data->tree_cur);
+    if (strlen(data->tree_fn_cur))
+      queue_cache_tree(strrchr(data->tree_fn_cur, '/') + 1, data->tree_cur);
 
   }
 
+  PROBE2(post_trim__return, data->cur_trimming_stage,
+         probe_tree_size(data->tree_cur));
   return data->cur_subtree_trimming_step + data->cur_recursive_trimming_step;
 
 }
 
-uint32_t afl_custom_fuzz_count(my_mutator_t *                         data,
-                               __attribute__((unused)) const uint8_t *buf,
-                               __attribute__((unused)) size_t buf_size) {
+static uint32_t mutator_fuzz_count(my_mutator_t *data) {
+
+  PROBE1(fuzz_count__entry, probe_tree_size(data->tree_cur));
+
+  if (!data->tree_cur) {
+
+    PROBE1(fuzz_count__return, 0);
+    return 0;
+
+  }
+
+  // the weight sums of the tree, with the latest learned weights
+  if (node_weights_update()) tree_get_size(data->tree_cur);
 
-  if (!data->tree_cur) return 0;
+  // the rare rules of the rules mutation below
+  coverage_update();
 
   tree_get_non_terminal_nodes(data->tree_cur);
   tree_get_recursion_edges(data->tree_cur);
@@ -482,11 +807,11 @@ uint32_t afl_custom_fuzz_count(my_mutator_t *                         data,
 
       }
 
-      if (data->cur_rules_mutation_rule_id !=
-          data->cur_rules_mutation_node->rule_id)
+      if (rules_mutation_tries(data->cur_rules_mutation_node,
+                               data->cur_rules_mutation_rule_id))
         break;
 
-      // skip the current rule id
+      // skip the current rule id (and the common ones if biased)
       ++data->cur_rules_mutation_rule_id;
 
     }
@@ -500,23 +825,26 @@ uint32_t afl_custom_fuzz_count(my_mutator_t *                         data,
 
   }
 
-  return data->total_rules_mutation_steps + data->total_random_mutation_steps +
-         data->total_random_recursive_mutation_steps +
-         data->total_splicing_mutation_steps;
+  uint32_t count = data->total_rules_mutation_steps +
+                   data->total_random_mutation_steps +
+                   data->total_random_recursive_mutation_steps +
+                   data->total_splicing_mutation_steps;
+  PROBE1(fuzz_count__return, count);
+  return count;
 
 }
 
 // Fuzz the given test case several times, which is defined by the
 // `custom_mutator_stage` in `afl-fuzz-one.c`
-size_t afl_custom_fuzz(my_mutator_t *data, __attribute__((unused)) uint8_t *buf,
-                       __attribute__((unused)) size_t   buf_size,
-                       uint8_t **                       out_buf,
-                       __attribute__((unused)) uint8_t *add_buf,
-                       __attribute__((unused)) size_t   add_buf_size,
-                       size_t                           max_size) {
+static size_t mutator_fuzz(my_mutator_t *data, uint8_t **out_buf,
+                           size_t max_size) {
+
+  tree_t * tree = NULL;
+  size_t   mutated_size = 0;
+  uint8_t  stage = data->cur_fuzzing_stage;
+  uint64_t start;
 
-  tree_t *tree = NULL;
-  size_t  mutated_size = 0;
+  PROBE3(fuzz__entry, stage, data->cur_fuzzing_step, max_size);
 
   if (data->mutated_tree) {
 
@@ -538,7 +866,12 @@ size_t afl_custom_fuzz(my_mutator_t *data, __attribute__((unused)) uint8_t *buf,
 
   }
 
-  switch (data->cur_fuzzing_stage) {
+  // the node and rule of the rules mutation, or the size of the input tree
+  PROBE3(mutation__start, stage,
+         stage == 0 ? (int)data->cur_rules_mutation_node->id : -1,
+         probe_tree_size(tree));
+  start = stats_cycles();
+  switch (stage) {
 
     case 0:
       // rules mutation
@@ -555,7 +888,7 @@ size_t afl_custom_fuzz(my_mutator_t *data, __attribute__((unused)) uint8_t *buf,
         // random recursive mutation
         const unsigned RRM_GROWTH = 10; // Allow 2**RRM_GROWTH of bytes of expansion
         tree_t *rrm_tree = NULL;
-        tree_to_buf(tree);
+        size_t data_len = tree_get_data_len(tree);
         int failed_count = 8;
         do {
           if (failed_count-- <= 0) {
@@ -565,12 +898,12 @@ size_t afl_custom_fuzz(my_mutator_t *data, __attribute__((unused)) uint8_t *buf,
           if (rrm_tree) tree_free(rrm_tree);
           rrm_tree =
               random_recursive_mutation(tree, random_below(RRM_GROWTH + 1));
-          tree_to_buf(rrm_tree);
+          tree_get_size(rrm_tree);
 
           // Make sure that the mutation doesn't grow more than RRM_GROWTH bytes per attempt!
           // This is protecting against random_recursive_mutation's ability to
           // create MASSIVE growth in a short period of time by duplicating big nodes.
-        } while (rrm_tree->data_len > (1 << RRM_GROWTH) + tree->data_len);
+        } while (tree_get_data_len(rrm_tree) > (1 << RRM_GROWTH) + data_len);
 
         tree = rrm_tree;
         break;
@@ -582,6 +915,7 @@ size_t afl_custom_fuzz(my_mutator_t *data, __attribute__((unused)) uint8_t *buf,
       break;
     default:
       perror("mutation error, invalid choice (afl_custom_fuzz)");
+      PROBE3(fuzz__return, stage, 0, 0);
       return 0;
 
   }
@@ -589,10 +923,17 @@ size_t afl_custom_fuzz(my_mutator_t *data, __attribute__((unused)) uint8_t *buf,
   if (!tree) {
 
     perror("mutation error, empty tree (afl_custom_fuzz)");
+    PROBE3(fuzz__return, stage, 0, 0);
     return 0;
 
   }
 
+  // the stages are in the same order as the mutation stages
+  stats_add_stage(STATS_RULES_MUTATION + stage, stats_cycles() - start);
+  data->mutated_stage = stage;
+  data->mutated_node_type = tree_mutation_get_node_type();
+  stats_add_mutation(STATS_RULES_MUTATION + stage, data->mutated_node_type);
+
   // update internal status
   ++data->cur_fuzzing_step;
   if (data->cur_fuzzing_stage == 0) {
@@ -621,11 +962,11 @@ size_t afl_custom_fuzz(my_mutator_t *data, __attribute__((unused)) uint8_t *buf,
 
         }
 
-        if (data->cur_rules_mutation_rule_id !=
-            data->cur_rules_mutation_node->rule_id)
+        if (rules_mutation_tries(data->cur_rules_mutation_node,
+                                 data->cur_rules_mutation_rule_id))
           break;
 
-        // skip the current rule id
+        // skip the current rule id (and the common ones if biased)
         ++data->cur_rules_mutation_rule_id;
 
       }
@@ -670,10 +1011,12 @@ size_t afl_custom_fuzz(my_mutator_t *data, __attribute__((unused)) uint8_t *buf,
 
   }
 
-  tree_to_buf(tree);
   tree_get_size(tree);
+  PROBE3(mutation__done, stage, probe_tree_size(tree), tree_get_data_len(tree));
   data->mutated_tree = tree;
-  mutated_size = tree->data_len <= max_size ? tree->data_len : max_size;
+  mutated_size = tree_get_data_len(tree);
+  bool truncated = mutated_size > max_size;
+  if (truncated) mutated_size = max_size;
 
   // maybe_grow is optimized to be quick for reused buffers.
   uint8_t *mutated_out =
@@ -682,29 +1025,59 @@ size_t afl_custom_fuzz(my_mutator_t *data, __attribute__((unused)) uint8_t *buf,
 
     *out_buf = NULL;
     perror("custom mutator, fuzzing buffer allocation error (afl_custom_fuzz)");
+    PROBE3(fuzz__return, stage, 0, 0);
     return 0;            /* afl-fuzz will very likely error out after this. */
 
   }
 
-  memcpy(mutated_out, tree->data_buf, mutated_size);
+  // Render the mutated tree directly into the reused buffer, stopping at
+  // `max_size`
   *out_buf = mutated_out;
+  mutated_size = tree_render_to_buf(tree, mutated_out, mutated_size);
+
+  stats_add_output(tree->root ? tree->root->non_term_size : 0, mutated_size,
+                   truncated);
+  stats_maybe_write();
+
+  PROBE3(fuzz__return, stage, probe_tree_size(tree), mutated_size);
   return mutated_size;
 
 }
 
 // Save interesting mutated test cases
-void afl_custom_queue_new_entry(my_mutator_t * data,
-                                const uint8_t *filename_new_queue,
-                                const uint8_t *filename_orig_queue) {
+static void mutator_queue_new_entry(my_mutator_t * data,
+                                    const uint8_t *filename_new_queue,
+                                    const uint8_t *filename_orig_queue) {
+
+  PROBE2(queue_new_entry__entry, filename_new_queue, filename_orig_queue);
 
   // If this is an initial case or sync, then we will get called with a null "filename_orig_queue".
   if (unlikely(!filename_orig_queue || !data->mutated_tree)) {
 
+    // Parse it in the background, unless no parse pool is available. The
+    // result will be collected by any later call, and `afl_custom_queue_get`
+    // waits for it if needed.
+    if (data->parse_pool) {
+
+      parse_pool_drain(data->parse_pool, queue_ingest_parsed_tree, data);
+
+      const char *fn = (const char *)filename_new_queue;
+      if (queue_get_tree_filename(data, fn, data->new_tree_fn) &&
+          parse_pool_submit(data->parse_pool, fn, data->new_tree_fn)) {
+
+        PROBE0(queue_new_entry__return);
+        return;
+
+      }
+
+    }
+
     // In that situation, we can skip it here and let afl_custom_queue_get() import the data later,
     // or we can prefetch it here to ensure that it gets into our splicing data set (chunk_store) asap.
     // Choosing the second option for now, but if this is inefficient we can just return instead of
     // calling afl_custom_queue_get().
-    afl_custom_queue_get(data, filename_new_queue);
+    mutator_queue_get(data, filename_new_queue);
+    PROBE0(queue_new_entry__return);
     return;
 
   }
@@ -718,6 +1091,7 @@ void afl_custom_queue_new_entry(my_mutator_t * data,
 
     // Should not reach here
     fprintf(stderr, "Invalid filename_new_queue (afl_custom_queue_new_entry)\n");
+    PROBE0(queue_new_entry__return);
     return;
 
   }
@@ -725,14 +1099,155 @@ void afl_custom_queue_new_entry(my_mutator_t * data,
   // Replace "queue" with "trees"
   memcpy(found, "/trees", 6);
 
+  stats_add_new_entry(STATS_RULES_MUTATION + data->mutated_stage,
+                      data->mutated_node_type);
+
   // Write the mutated tree to the file
-  write_tree_to_file(data->mutated_tree, data->new_tree_fn);
+  tree_store_save_tree(data->mutated_tree, data->new_tree_fn);
 
   // Store all subtrees in the newly added tree
   chunk_store_add_tree(data->mutated_tree);
+  coverage_add_tree(found + 7, data->mutated_tree);
 
-  /* Once the test case is added into the queue, we will clear `mutated_tree` */
-  tree_free(data->mutated_tree);
+  /* Once the test case is added into the queue, we will clear `mutated_tree`,
+    unless the tree cache takes it over */
+  if (!tree_cache_put(found + 7, data->mutated_tree))
+    tree_free(data->mutated_tree);
   data->mutated_tree = NULL;
 
+  PROBE0(queue_new_entry__return);
+
+}
+
+// The callbacks of afl-fuzz, which record every call into the trace file if
+// recording (see `TRACE_FILE`)
+
+uint8_t afl_custom_queue_get(my_mutator_t *data, const uint8_t *filename) {
+
+  if (likely(!trace_is_recording())) return mutator_queue_get(data, filename);
+
+  size_t         len;
+  trace_record_t record = {.op = TRACE_QUEUE_GET,
+                           .strs = {(const char *)filename}};
+  record.args[1] = trace_hash_file((const char *)filename, &len);
+  record.args[0] = len;
+
+  uint64_t start = stats_cycles();
+  uint8_t  ret = mutator_queue_get(data, filename);
+  record.args[2] = ret;
+  trace_call_end(&record, start);
+
+  return ret;
+
+}
+
+int32_t afl_custom_init_trim(my_mutator_t *data, uint8_t *buf,
+                             size_t buf_size) {
+
+  if (likely(!trace_is_recording())) return mutator_init_trim(data);
+
+  trace_record_t record = {.op = TRACE_INIT_TRIM,
+                           .args = {buf_size, trace_hash(buf, buf_size)}};
+
+  uint64_t start = stats_cycles();
+  int32_t  ret = mutator_init_trim(data);
+  record.args[2] = ret;
+  trace_call_end(&record, start);
+
+  return ret;
+
+}
+
+size_t afl_custom_trim(my_mutator_t *data, uint8_t **out_buf) {
+
+  if (likely(!trace_is_recording())) return mutator_trim(data, out_buf);
+
+  trace_record_t record = {.op = TRACE_TRIM};
+
+  uint64_t start = stats_cycles();
+  size_t   ret = mutator_trim(data, out_buf);
+  record.args[0] = ret;
+  record.args[1] = trace_hash(*out_buf, *out_buf ? ret : 0);
+  trace_call_end(&record, start);
+
+  return ret;
+
+}
+
+int32_t afl_custom_post_trim(my_mutator_t *data, int success) {
+
+  if (likely(!trace_is_recording())) return mutator_post_trim(data, success);
+
+  trace_record_t record = {.op = TRACE_POST_TRIM, .args = {success != 0}};
+
+  uint64_t start = stats_cycles();
+  int32_t  ret = mutator_post_trim(data, success);
+  record.args[1] = ret;
+  trace_call_end(&record, start);
+
+  return ret;
+
+}
+
+uint32_t afl_custom_fuzz_count(my_mutator_t *data, const uint8_t *buf,
+                               size_t buf_size) {
+
+  if (likely(!trace_is_recording())) return mutator_fuzz_count(data);
+
+  trace_record_t record = {.op = TRACE_FUZZ_COUNT,
+                           .args = {buf_size, trace_hash(buf, buf_size)}};
+
+  uint64_t start = stats_cycles();
+  uint32_t ret = mutator_fuzz_count(data);
+  record.args[2] = ret;
+  trace_call_end(&record, start);
+
+  return ret;
+
+}
+
+size_t afl_custom_fuzz(my_mutator_t *data, uint8_t *buf, size_t buf_size,
+                       uint8_t **out_buf, uint8_t *add_buf,
+                       size_t add_buf_size, size_t max_size) {
+
+  if (likely(!trace_is_recording()))
+    return mutator_fuzz(data, out_buf, max_size);
+
+  trace_record_t record = {
+      .op = TRACE_FUZZ,
+      .args = {buf_size, trace_hash(buf, buf_size), add_buf_size,
+               trace_hash(add_buf, add_buf ? add_buf_size : 0), max_size}};
+
+  uint64_t start = stats_cycles();
+  size_t   ret = mutator_fuzz(data, out_buf, max_size);
+  record.args[5] = ret;
+  record.args[6] = trace_hash(*out_buf, *out_buf ? ret : 0);
+  trace_call_end(&record, start);
+
+  return ret;
+
+}
+
+void afl_custom_queue_new_entry(my_mutator_t * data,
+                                const uint8_t *filename_new_queue,
+                                const uint8_t *filename_orig_queue) {
+
+  if (likely(!trace_is_recording())) {
+
+    mutator_queue_new_entry(data, filename_new_queue, filename_orig_queue);
+    return;
+
+  }
+
+  size_t         len;
+  trace_record_t record = {.op = TRACE_QUEUE_NEW_ENTRY,
+                           .strs = {(const char *)filename_new_queue,
+                                    (const char *)filename_orig_queue}};
+  record.args[1] = trace_hash_file((const char *)filename_new_queue, &len);
+  record.args[0] = len;
+
+  uint64_t start = stats_cycles();
+  mutator_queue_new_entry(data, filename_new_queue, filename_orig_queue);
+  trace_call_end(&record, start);
+
 }
@@ -0,0 +1,1672 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "grammar_runtime.h"
+#include "helpers.h"
+#include "map.h"
+#include "tree.h"
+#include "utils.h"
+
+// the optional key of the static rule weights (see `grammars/f1_common.py`)
+#define GRAMMAR_WEIGHTS_KEY "@weights"
+
+#define GRAMMAR_INF ((size_t)-1)
+
+typedef struct grammar_token {
+
+  uint32_t    node_type;  // 0 for a terminal
+  uint32_t    len;        // the length of a terminal in bytes
+  size_t      cost;       // the minimal length in characters
+  const char *val;        // the terminal
+
+} grammar_token_t;
+
+typedef struct grammar_rule {
+
+  uint32_t         node_type;
+  uint32_t         num_tokens;
+  uint32_t         num_non_terms;
+  uint32_t         lr0;  // the Earley item with the dot before the first token
+  size_t           cost;
+  grammar_token_t *tokens;
+
+} grammar_rule_t;
+
+struct grammar_runtime_rules {
+
+  // the rules of all node types, sorted by node types and then by rule ids
+  grammar_rule_t * rules;
+  grammar_token_t *tokens;
+  size_t *         first_rule;  // of each node type
+
+  // the cheap rule (see `node_rule_tiers`) that leads to the lowest subtree
+  // of each node type, which ends the recursion of cheap subtrees
+  size_t *cheap_rule;
+
+  // the rule of each LR(0) item, i.e., a rule and a position in it
+  uint32_t *lr0_rules;
+
+  // the node types that no rule refers to, i.e., the possible roots
+  uint32_t *entry_types;
+  size_t    num_entry_types;
+
+};
+
+/* Loading */
+
+typedef struct raw_token {
+
+  char *   val;
+  uint32_t len;
+  uint32_t node_type;
+  size_t   cost;
+
+} raw_token_t;
+
+typedef struct raw_rule {
+
+  uint32_t     key;
+  uint32_t     orig;  // the index of the rule of the key in the grammar file
+  size_t       cost;
+  size_t       first_token;
+  size_t       num_tokens;
+  raw_token_t *tokens;
+
+} raw_rule_t;
+
+typedef struct raw_key {
+
+  char *  name;
+  size_t  num_rules;
+  size_t  cost;
+  double *weights;
+  size_t  num_weights;
+
+} raw_key_t;
+
+typedef struct grammar_loader {
+
+  const char *buf;
+  const char *p;
+  const char *end;
+
+  // the last parsed string, always NUL-terminated
+  char * str;
+  size_t str_len;
+  size_t str_size;
+
+  raw_key_t *keys;
+  size_t     num_keys;
+  size_t     keys_size;
+
+  // the rules and tokens of all keys, in the order of the grammar file
+  raw_rule_t * rules;
+  size_t       num_rules;
+  size_t       rules_size;
+  raw_token_t *tokens;
+  size_t       num_tokens;
+  size_t       tokens_size;
+
+  // the keys of "@weights", with no rules
+  raw_key_t *weights;
+  size_t     num_weights;
+  size_t     weights_size;
+
+  map_int_t key_ids;  // the index of each key
+
+} grammar_loader_t;
+
+static bool loader_error(grammar_loader_t *l, const char *msg) {
+
+  fprintf(stderr, "Invalid grammar at byte %zu: %s\n", (size_t)(l->p - l->buf),
+          msg);
+  return false;
+
+}
+
+static void json_skip_ws(grammar_loader_t *l) {
+
+  while (l->p < l->end &&
+         (*l->p == ' ' || *l->p == '\t' || *l->p == '\n' || *l->p == '\r'))
+    ++l->p;
+
+}
+
+static bool json_consume(grammar_loader_t *l, char c) {
+
+  json_skip_ws(l);
+  if (l->p == l->end || *l->p != c) return false;
+
+  ++l->p;
+  return true;
+
+}
+
+static bool json_expect(grammar_loader_t *l, char c) {
+
+  if (json_consume(l, c)) return true;
+
+  char msg[] = "expected ' '";
+  msg[10] = c;
+  return loader_error(l, msg);
+
+}
+
+static bool loader_put(grammar_loader_t *l, const char *s, size_t n) {
+
+  if (!maybe_grow((void **)&l->str, &l->str_size, l->str_len + n + 1)) {
+
+    perror("grammar_runtime_load (realloc)");
+    return false;
+
+  }
+
+  memcpy(l->str + l->str_len, s, n);
+  l->str_len += n;
+  l->str[l->str_len] = '\0';
+  return true;
+
+}
+
+static bool json_hex4(grammar_loader_t *l, uint32_t *out) {
+
+  if (l->end - l->p < 4) return loader_error(l, "truncated \\u escape");
+
+  *out = 0;
+  for (int i = 0; i < 4; ++i) {
+
+    char     c = *l->p++;
+    uint32_t v;
+    if (c >= '0' && c <= '9')
+      v = c - '0';
+    else if (c >= 'a' && c <= 'f')
+      v = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+      v = c - 'A' + 10;
+    else
+      return loader_error(l, "invalid \\u escape");
+
+    *out = (*out << 4) | v;
+
+  }
+
+  return true;
+
+}
+
+// Decode a \u escape (after "\u") into UTF-8, joining surrogate pairs
+static bool json_unicode(grammar_loader_t *l) {
+
+  uint32_t cp;
+  if (!json_hex4(l, &cp)) return false;
+
+  if (cp >= 0xD800 && cp < 0xDC00 && l->end - l->p >= 6 && l->p[0] == '\\' &&
+      l->p[1] == 'u') {
+
+    const char *p = l->p;
+    uint32_t    low;
+    l->p += 2;
+    if (!json_hex4(l, &low)) return false;
+
+    if (low >= 0xDC00 && low < 0xE000)
+      cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+    else
+      l->p = p;  // a lone high surrogate
+
+  }
+
+  char   utf8[4];
+  size_t n;
+  if (cp < 0x80) {
+
+    utf8[0] = cp;
+    n = 1;
+
+  } else if (cp < 0x800) {
+
+    utf8[0] = 0xC0 | (cp >> 6);
+    utf8[1] = 0x80 | (cp & 0x3F);
+    n = 2;
+
+  } else if (cp < 0x10000) {
+
+    utf8[0] = 0xE0 | (cp >> 12);
+    utf8[1] = 0x80 | ((cp >> 6) & 0x3F);
+    utf8[2] = 0x80 | (cp & 0x3F);
+    n = 3;
+
+  } else {
+
+    utf8[0] = 0xF0 | (cp >> 18);
+    utf8[1] = 0x80 | ((cp >> 12) & 0x3F);
+    utf8[2] = 0x80 | ((cp >> 6) & 0x3F);
+    utf8[3] = 0x80 | (cp & 0x3F);
+    n = 4;
+
+  }
+
+  return loader_put(l, utf8, n);
+
+}
+
+// Parse a string into `l->str`
+static bool json_string(grammar_loader_t *l) {
+
+  if (!json_expect(l, '"')) return false;
+
+  l->str_len = 0;
+  if (!loader_put(l, "", 0)) return false;
+
+  while (l->p < l->end && *l->p != '"') {
+
+    const char *start = l->p;
+    while (l->p < l->end && *l->p != '"' && *l->p != '\\')
+      ++l->p;
+    if (!loader_put(l, start, l->p - start)) return false;
+    if (l->p == l->end || *l->p == '"') break;
+
+    // an escape sequence
+    if (++l->p == l->end) break;
+    char c = *l->p++;
+    switch (c) {
+
+      case '"':
+      case '\\':
+      case '/':
+        break;
+      case 'b':
+        c = '\b';
+        break;
+      case 'f':
+        c = '\f';
+        break;
+      case 'n':
+        c = '\n';
+        break;
+      case 'r':
+        c = '\r';
+        break;
+      case 't':
+        c = '\t';
+        break;
+      case 'u':
+        if (!json_unicode(l)) return false;
+        continue;
+      default:
+        return loader_error(l, "invalid escape");
+
+    }
+
+    if (!loader_put(l, &c, 1)) return false;
+
+  }
+
+  if (l->p == l->end) return loader_error(l, "unterminated string");
+
+  ++l->p;
+  return true;
+
+}
+
+static bool json_number(grammar_loader_t *l, double *out) {
+
+  json_skip_ws(l);
+
+  char   num[64];
+  size_t n = 0;
+  while (l->p < l->end && n + 1 < sizeof(num) && *l->p &&
+         strchr("+-.0123456789eE", *l->p))
+    num[n++] = *l->p++;
+  num[n] = '\0';
+
+  char *end = NULL;
+  *out = strtod(num, &end);
+  if (n == 0 || end != num + n) return loader_error(l, "invalid number");
+  return true;
+
+}
+
+// "@weights": {"<key>": [1, 2, ...], ...}
+static bool loader_parse_weights(grammar_loader_t *l) {
+
+  if (!json_expect(l, '{')) return false;
+  if (json_consume(l, '}')) return true;
+
+  do {
+
+    if (!json_string(l)) return false;
+    if (!maybe_grow((void **)&l->weights, &l->weights_size,
+                    (l->num_weights + 1) * sizeof(raw_key_t))) {
+
+      perror("grammar_runtime_load (realloc)");
+      return false;
+
+    }
+
+    // The weights of unknown keys are reported after all keys are read
+    raw_key_t *key = &l->weights[l->num_weights];
+    memset(key, 0, sizeof(raw_key_t));
+    key->name = strdup(l->str);
+    if (!key->name) {
+
+      perror("grammar_runtime_load (malloc)");
+      return false;
+
+    }
+
+    ++l->num_weights;
+    if (!json_expect(l, ':') || !json_expect(l, '[')) return false;
+    if (json_consume(l, ']')) continue;
+
+    size_t weights_size = 0;
+    do {
+
+      double w;
+      if (!json_number(l, &w)) return false;
+      if (!maybe_grow((void **)&key->weights, &weights_size,
+                      (key->num_weights + 1) * sizeof(double))) {
+
+        perror("grammar_runtime_load (realloc)");
+        return false;
+
+      }
+
+      key->weights[key->num_weights++] = w;
+
+    } while (json_consume(l, ','));
+
+    if (!json_expect(l, ']')) return false;
+
+  } while (json_consume(l, ','));
+
+  return json_expect(l, '}');
+
+}
+
+// "<key>": [["token", ...], ...]
+static bool loader_parse_rules(grammar_loader_t *l, uint32_t key) {
+
+  if (!json_expect(l, '[')) return false;
+  if (json_consume(l, ']')) return true;
+
+  do {
+
+    if (!json_expect(l, '[')) return false;
+    if (!maybe_grow((void **)&l->rules, &l->rules_size,
+                    (l->num_rules + 1) * sizeof(raw_rule_t))) {
+
+      perror("grammar_runtime_load (realloc)");
+      return false;
+
+    }
+
+    raw_rule_t *rule = &l->rules[l->num_rules++];
+    memset(rule, 0, sizeof(raw_rule_t));
+    rule->key = key;
+    rule->orig = l->keys[key].num_rules++;
+    rule->first_token = l->num_tokens;
+
+    if (json_consume(l, ']')) continue;
+
+    do {
+
+      if (!json_string(l)) return false;
+      if (!maybe_grow((void **)&l->tokens, &l->tokens_size,
+                      (l->num_tokens + 1) * sizeof(raw_token_t))) {
+
+        perror("grammar_runtime_load (realloc)");
+        return false;
+
+      }
+
+      raw_token_t *token = &l->tokens[l->num_tokens];
+      memset(token, 0, sizeof(raw_token_t));
+      token->val = malloc(l->str_len + 1);
+      if (!token->val) {
+
+        perror("grammar_runtime_load (malloc)");
+        return false;
+
+      }
+
+      memcpy(token->val, l->str, l->str_len + 1);
+      token->len = l->str_len;
+      ++l->num_tokens;
+      ++l->rules[l->num_rules - 1].num_tokens;
+
+    } while (json_consume(l, ','));
+
+    if (!json_expect(l, ']')) return false;
+
+  } while (json_consume(l, ','));
+
+  return json_expect(l, ']');
+
+}
+
+static bool loader_parse(grammar_loader_t *l) {
+
+  if (!json_expect(l, '{')) return false;
+
+  if (!json_consume(l, '}')) {
+
+    do {
+
+      if (!json_string(l) || !json_expect(l, ':')) return false;
+
+      if (!strcmp(l->str, GRAMMAR_WEIGHTS_KEY)) {
+
+        if (!loader_parse_weights(l)) return false;
+        continue;
+
+      }
+
+      if (strlen(l->str) != l->str_len || map_get_(&l->key_ids.base, l->str))
+        return loader_error(l, "duplicate or invalid key");
+
+      if (!maybe_grow((void **)&l->keys, &l->keys_size,
+                      (l->num_keys + 1) * sizeof(raw_key_t))) {
+
+        perror("grammar_runtime_load (realloc)");
+        return false;
+
+      }
+
+      raw_key_t *key = &l->keys[l->num_keys];
+      memset(key, 0, sizeof(raw_key_t));
+      key->name = strdup(l->str);
+      if (!key->name || map_set(&l->key_ids, key->name, l->num_keys)) {
+
+        perror("grammar_runtime_load (malloc)");
+        free(key->name);
+        return false;
+
+      }
+
+      key->cost = GRAMMAR_INF;
+      if (!loader_parse_rules(l, l->num_keys++)) return false;
+
+    } while (json_consume(l, ','));
+
+    if (!json_expect(l, '}')) return false;
+
+  }
+
+  json_skip_ws(l);
+  if (l->p != l->end) return loader_error(l, "trailing data");
+  if (l->num_keys == 0) return loader_error(l, "no keys");
+
+  // Attach the weights to their keys; the last ones of a key take effect
+  bool ok = true;
+  for (size_t i = 0; i < l->num_weights; ++i) {
+
+    raw_key_t *weights = &l->weights[i];
+    int *      id = map_get_(&l->key_ids.base, weights->name);
+    if (!id) {
+
+      fprintf(stderr, "Invalid grammar: %s: unknown key %s\n",
+              GRAMMAR_WEIGHTS_KEY, weights->name);
+      ok = false;
+      continue;
+
+    }
+
+    raw_key_t *key = &l->keys[*id];
+    free(key->weights);
+    key->weights = weights->weights;
+    key->num_weights = weights->num_weights;
+    weights->weights = NULL;
+
+  }
+
+  return ok;
+
+}
+
+static void loader_free(grammar_loader_t *l) {
+
+  for (size_t i = 0; i < l->num_keys; ++i) {
+
+    free(l->keys[i].name);
+    free(l->keys[i].weights);
+
+  }
+
+  for (size_t i = 0; i < l->num_weights; ++i) {
+
+    free(l->weights[i].name);
+    free(l->weights[i].weights);
+
+  }
+
+  for (size_t i = 0; i < l->num_tokens; ++i)
+    free(l->tokens[i].val);
+
+  free(l->keys);
+  free(l->weights);
+  free(l->rules);
+  free(l->tokens);
+  free(l->str);
+  map_deinit(&l->key_ids);
+
+}
+
+// The number of characters of a UTF-8 string, as the length in the grammar
+static size_t utf8_len(const char *s, size_t len) {
+
+  size_t n = 0;
+  for (size_t i = 0; i < len; ++i)
+    if (((uint8_t)s[i] & 0xC0) != 0x80) ++n;
+
+  return n;
+
+}
+
+static int raw_rule_cmp(const void *a, const void *b) {
+
+  const raw_rule_t *x = a;
+  const raw_rule_t *y = b;
+  if (x->key != y->key) return x->key < y->key ? -1 : 1;
+  if (x->cost != y->cost) return x->cost < y->cost ? -1 : 1;
+
+  // Then, by their tokens (as `sorted` in `grammars/f1_common.py`)
+  for (size_t i = 0; i < x->num_tokens && i < y->num_tokens; ++i) {
+
+    const raw_token_t *s = &x->tokens[i];
+    const raw_token_t *t = &y->tokens[i];
+    int c = memcmp(s->val, t->val, s->len < t->len ? s->len : t->len);
+    if (c) return c;
+    if (s->len != t->len) return s->len < t->len ? -1 : 1;
+
+  }
+
+  if (x->num_tokens != y->num_tokens)
+    return x->num_tokens < y->num_tokens ? -1 : 1;
+  return x->orig < y->orig ? -1 : x->orig > y->orig;
+
+}
+
+// Compute the minimal lengths of all keys and rules, and sort the rules
+static bool loader_resolve(grammar_loader_t *l) {
+
+  for (size_t i = 0; i < l->num_tokens; ++i) {
+
+    raw_token_t *token = &l->tokens[i];
+    int *        id = strlen(token->val) == token->len
+                          ? map_get_(&l->key_ids.base, token->val)
+                          : NULL;
+    token->node_type = id ? *id + 1 : 0;
+    token->cost = id ? 0 : utf8_len(token->val, token->len);
+
+  }
+
+  for (size_t i = 0; i < l->num_rules; ++i)
+    l->rules[i].tokens = &l->tokens[l->rules[i].first_token];
+
+  // The minimal length of a key is the minimum of its rules, until none
+  // changes (as `compute_cost` in `grammars/f1_common.py`)
+  bool changed = true;
+  while (changed) {
+
+    changed = false;
+    for (size_t i = 0; i < l->num_rules; ++i) {
+
+      raw_rule_t *rule = &l->rules[i];
+      size_t      cost = 0;
+      for (size_t j = 0; j < rule->num_tokens; ++j) {
+
+        raw_token_t *token = &rule->tokens[j];
+        size_t       c =
+            token->node_type ? l->keys[token->node_type - 1].cost : token->cost;
+        if (c == GRAMMAR_INF) {
+
+          cost = GRAMMAR_INF;
+          break;
+
+        }
+
+        cost += c;
+
+      }
+
+      rule->cost = cost;
+      if (cost < l->keys[rule->key].cost) {
+
+        l->keys[rule->key].cost = cost;
+        changed = true;
+
+      }
+
+    }
+
+  }
+
+  bool ok = true;
+  for (size_t i = 0; i < l->num_keys; ++i) {
+
+    raw_key_t *key = &l->keys[i];
+    if (key->cost == GRAMMAR_INF) {
+
+      fprintf(stderr, "Invalid grammar: %s cannot be expanded\n", key->name);
+      ok = false;
+
+    }
+
+    if (!key->weights) continue;
+
+    if (key->num_weights != key->num_rules) {
+
+      fprintf(stderr,
+              "Invalid grammar: %s: %s has %zu rules, but %zu weights\n",
+              GRAMMAR_WEIGHTS_KEY, key->name, key->num_rules,
+              key->num_weights);
+      ok = false;
+      continue;
+
+    }
+
+    for (size_t j = 0; j < key->num_weights; ++j) {
+
+      if (!(key->weights[j] >= 0) || !isfinite(key->weights[j])) {
+
+        fprintf(stderr, "Invalid grammar: %s: invalid weights of %s\n",
+                GRAMMAR_WEIGHTS_KEY, key->name);
+        ok = false;
+        break;
+
+      }
+
+    }
+
+  }
+
+  if (ok) qsort(l->rules, l->num_rules, sizeof(raw_rule_t), raw_rule_cmp);
+  return ok;
+
+}
+
+void grammar_runtime_free(grammar_runtime_t *grammar) {
+
+  if (!grammar) return;
+
+  grammar_runtime_rules_t *rules = grammar->rules;
+  for (size_t i = 0; i < grammar->num_node_types; ++i) {
+
+    if (grammar->node_type_strs) free((char *)grammar->node_type_strs[i]);
+    if (grammar->node_rule_weights)
+      free((double *)grammar->node_rule_weights[i]);
+    if (grammar->node_rule_tiers) free((size_t *)grammar->node_rule_tiers[i]);
+
+    if (!rules || !rules->rules || !rules->first_rule ||
+        !grammar->node_num_rules)
+      continue;
+
+    // The terminals of the rules
+    grammar_rule_t *first = &rules->rules[rules->first_rule[i]];
+    for (size_t j = 0; j < grammar->node_num_rules[i]; ++j)
+      for (uint32_t k = 0; k < first[j].num_tokens; ++k)
+        if (!first[j].tokens[k].node_type)
+          free((char *)first[j].tokens[k].val);
+
+  }
+
+  if (rules) {
+
+    free(rules->rules);
+    free(rules->tokens);
+    free(rules->first_rule);
+    free(rules->cheap_rule);
+    free(rules->lr0_rules);
+    free(rules->entry_types);
+    free(rules);
+
+  }
+
+  free(grammar->node_type_strs);
+  free(grammar->node_min_lens);
+  free(grammar->node_num_rules);
+  free(grammar->node_rule_weights);
+  free(grammar->node_rule_tiers);
+  free(grammar->node_num_rule_tiers);
+  free(grammar);
+
+}
+
+// "NODE_" and the key without its first and last characters in upper case,
+// e.g., "NODE_JSON_VALUE" for "<json-value>" (as `grammars/f1_c_gen.py`)
+static char *node_type_name(const char *key) {
+
+  size_t len = strlen(key);
+  len = len >= 2 ? len - 2 : 0;
+
+  char *name = malloc(len + 6);
+  if (!name) return NULL;
+
+  memcpy(name, "NODE_", 5);
+  for (size_t i = 0; i < len; ++i) {
+
+    char c = key[i + 1];
+    name[i + 5] = c == '-' ? '_' : (c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c);
+
+  }
+
+  name[len + 5] = '\0';
+  return name;
+
+}
+
+static bool grammar_build_names(grammar_runtime_t *g, grammar_loader_t *l) {
+
+  map_int_t names;
+  map_init(&names);
+
+  bool ok = true;
+  for (size_t i = 0; ok && i < g->num_node_types; ++i) {
+
+    char *name =
+        i ? node_type_name(l->keys[i - 1].name) : strdup("NODE_TERM__");
+    g->node_type_strs[i] = name;
+    if (!name) {
+
+      perror("grammar_runtime_load (malloc)");
+      ok = false;
+
+    } else if (map_get_(&names.base, name)) {
+
+      fprintf(stderr, "Invalid grammar: %s of %s is not unique\n", name,
+              l->keys[i - 1].name);
+      ok = false;
+
+    } else if (map_set(&names, name, i)) {
+
+      perror("grammar_runtime_load (malloc)");
+      ok = false;
+
+    }
+
+  }
+
+  map_deinit(&names);
+  return ok;
+
+}
+
+// Find the cheap rule that leads to the lowest subtree of each node type
+static bool grammar_build_cheap_rules(grammar_runtime_t *g) {
+
+  grammar_runtime_rules_t *rules = g->rules;
+  size_t *heights = malloc(g->num_node_types * sizeof(size_t));
+  if (!heights) {
+
+    perror("grammar_runtime_load (malloc)");
+    return false;
+
+  }
+
+  for (size_t i = 0; i < g->num_node_types; ++i)
+    heights[i] = GRAMMAR_INF;
+
+  bool changed = true;
+  while (changed) {
+
+    changed = false;
+    for (size_t i = 1; i < g->num_node_types; ++i) {
+
+      grammar_rule_t *first = &rules->rules[rules->first_rule[i]];
+      for (size_t j = 0; j < g->node_rule_tiers[i][0]; ++j) {
+
+        size_t height = 1;
+        for (uint32_t k = 0; k < first[j].num_tokens; ++k) {
+
+          uint32_t type = first[j].tokens[k].node_type;
+          if (!type) continue;
+
+          if (heights[type] == GRAMMAR_INF) {
+
+            height = GRAMMAR_INF;
+            break;
+
+          }
+
+          if (heights[type] + 1 > height) height = heights[type] + 1;
+
+        }
+
+        if (height < heights[i]) {
+
+          heights[i] = height;
+          rules->cheap_rule[i] = j;
+          changed = true;
+
+        }
+
+      }
+
+    }
+
+  }
+
+  // The cheap rules of all node types always lead to finite subtrees, as the
+  // minimal lengths are the lengths of such subtrees
+  free(heights);
+  return true;
+
+}
+
+static bool grammar_build_entries(grammar_runtime_t *g) {
+
+  grammar_runtime_rules_t *rules = g->rules;
+  bool *referred = calloc(g->num_node_types, sizeof(bool));
+  rules->entry_types = calloc(g->num_node_types, sizeof(uint32_t));
+  if (!referred || !rules->entry_types) {
+
+    perror("grammar_runtime_load (calloc)");
+    free(referred);
+    return false;
+
+  }
+
+  // The rules of a node type referring to itself do not count, e.g.,
+  // <expr> ::= <expr> "+" <n> | <n> is still a root
+  for (size_t i = 1; i < g->num_node_types; ++i) {
+
+    grammar_rule_t *first = &rules->rules[rules->first_rule[i]];
+    for (size_t j = 0; j < g->node_num_rules[i]; ++j)
+      for (uint32_t k = 0; k < first[j].num_tokens; ++k)
+        if (first[j].tokens[k].node_type != i)
+          referred[first[j].tokens[k].node_type] = true;
+
+  }
+
+  for (size_t i = 1; i < g->num_node_types; ++i)
+    if (!referred[i]) rules->entry_types[rules->num_entry_types++] = i;
+
+  // Every node type is referred to, e.g., a recursive start rule
+  if (rules->num_entry_types == 0)
+    rules->entry_types[rules->num_entry_types++] = 1;
+
+  free(referred);
+  return true;
+
+}
+
+static grammar_runtime_t *grammar_build(grammar_loader_t *l) {
+
+  grammar_runtime_t *g = calloc(1, sizeof(grammar_runtime_t));
+  if (!g) {
+
+    perror("grammar_runtime_load (calloc)");
+    return NULL;
+
+  }
+
+  size_t n = l->num_keys + 1;
+  g->num_node_types = n;
+  g->node_type_strs = calloc(n, sizeof(char *));
+  g->node_min_lens = calloc(n, sizeof(size_t));
+  g->node_num_rules = calloc(n, sizeof(size_t));
+  g->node_rule_weights = calloc(n, sizeof(double *));
+  g->node_rule_tiers = calloc(n, sizeof(size_t *));
+  g->node_num_rule_tiers = calloc(n, sizeof(size_t));
+  g->rules = calloc(1, sizeof(grammar_runtime_rules_t));
+
+  size_t num_rules = 0, num_tokens = 0, num_lr0 = 0;
+  for (size_t i = 0; i < l->num_rules; ++i) {
+
+    if (l->rules[i].cost == GRAMMAR_INF) continue;
+    ++num_rules;
+    num_tokens += l->rules[i].num_tokens;
+    num_lr0 += l->rules[i].num_tokens + 1;
+
+  }
+
+  grammar_runtime_rules_t *rules = g->rules;
+  if (rules) {
+
+    rules->rules = calloc(num_rules, sizeof(grammar_rule_t));
+    rules->tokens = calloc(num_tokens + 1, sizeof(grammar_token_t));
+    rules->first_rule = calloc(n, sizeof(size_t));
+    rules->cheap_rule = calloc(n, sizeof(size_t));
+    rules->lr0_rules = calloc(num_lr0, sizeof(uint32_t));
+
+  }
+
+  if (!g->node_type_strs || !g->node_min_lens || !g->node_num_rules ||
+      !g->node_rule_weights || !g->node_rule_tiers ||
+      !g->node_num_rule_tiers || !rules || !rules->rules || !rules->tokens ||
+      !rules->first_rule || !rules->cheap_rule || !rules->lr0_rules) {
+
+    perror("grammar_runtime_load (calloc)");
+    grammar_runtime_free(g);
+    return NULL;
+
+  }
+
+  // The rules that can be expanded, already sorted by keys and lengths
+  grammar_token_t *token = rules->tokens;
+  size_t           lr0 = 0;
+  for (size_t i = 0, j = 0; i < l->num_rules; ++i) {
+
+    raw_rule_t *raw = &l->rules[i];
+    if (raw->cost == GRAMMAR_INF) continue;
+
+    raw_key_t *key = &l->keys[raw->key];
+    uint32_t   type = raw->key + 1;
+    if (g->node_num_rules[type] == 0) {
+
+      rules->first_rule[type] = j;
+      g->node_min_lens[type] = key->cost;
+
+    }
+
+    size_t          rule_id = g->node_num_rules[type]++;
+    grammar_rule_t *rule = &rules->rules[j++];
+    rule->node_type = type;
+    rule->num_tokens = raw->num_tokens;
+    rule->lr0 = lr0;
+    rule->cost = raw->cost;
+    rule->tokens = token;
+    for (size_t k = 0; k <= raw->num_tokens; ++k)
+      rules->lr0_rules[lr0++] = rule - rules->rules;
+
+    for (size_t k = 0; k < raw->num_tokens; ++k, ++token) {
+
+      raw_token_t *t = &raw->tokens[k];
+      token->node_type = t->node_type;
+      token->len = t->len;
+      if (t->node_type) {
+
+        token->cost = l->keys[t->node_type - 1].cost;
+        ++rule->num_non_terms;
+
+      } else {
+
+        // Moved into the grammar
+        token->cost = t->cost;
+        token->val = t->val;
+        t->val = NULL;
+
+      }
+
+    }
+
+    // The static weights, in the same order as the rules
+    if (key->weights) {
+
+      double *weights = (double *)g->node_rule_weights[type];
+      if (!weights) {
+
+        weights = calloc(key->num_rules, sizeof(double));
+        g->node_rule_weights[type] = weights;
+
+      }
+
+      if (weights) weights[rule_id] = key->weights[raw->orig];
+
+    }
+
+  }
+
+  // The numbers of rules up to each distinct length
+  bool ok = true;
+  for (size_t i = 1; ok && i < n; ++i) {
+
+    grammar_rule_t *first = &rules->rules[rules->first_rule[i]];
+    size_t          num_rules_i = g->node_num_rules[i];
+    size_t *        tiers = calloc(num_rules_i, sizeof(size_t));
+    g->node_rule_tiers[i] = tiers;
+    if (!tiers || (l->keys[i - 1].weights && !g->node_rule_weights[i])) {
+
+      perror("grammar_runtime_load (calloc)");
+      ok = false;
+      break;
+
+    }
+
+    for (size_t j = 0; j < num_rules_i; ++j)
+      if (j + 1 == num_rules_i || first[j + 1].cost != first[j].cost)
+        tiers[g->node_num_rule_tiers[i]++] = j + 1;
+
+  }
+
+  ok = ok && grammar_build_names(g, l) && grammar_build_cheap_rules(g) &&
+       grammar_build_entries(g);
+  if (!ok) {
+
+    grammar_runtime_free(g);
+    return NULL;
+
+  }
+
+  return g;
+
+}
+
+grammar_runtime_t *grammar_runtime_load_buf(const char *buf, size_t len) {
+
+  grammar_loader_t l;
+  memset(&l, 0, sizeof(l));
+  l.buf = l.p = buf;
+  l.end = buf + len;
+  map_init(&l.key_ids);
+
+  grammar_runtime_t *grammar = NULL;
+  if (loader_parse(&l) && loader_resolve(&l)) grammar = grammar_build(&l);
+
+  loader_free(&l);
+  return grammar;
+
+}
+
+grammar_runtime_t *grammar_runtime_load(const char *filename) {
+
+  FILE *f = fopen(filename, "rb");
+  if (!f) {
+
+    perror(filename);
+    return NULL;
+
+  }
+
+  char * buf = NULL;
+  size_t size = 0, len = 0;
+  while (maybe_grow((void **)&buf, &size, len + 4096)) {
+
+    size_t n = fread(buf + len, 1, size - len, f);
+    len += n;
+    if (n == 0) break;
+
+  }
+
+  bool failed = !buf || ferror(f);
+  fclose(f);
+  if (failed) {
+
+    fprintf(stderr, "Cannot read the grammar file: %s\n", filename);
+    free(buf);
+    return NULL;
+
+  }
+
+  grammar_runtime_t *grammar = grammar_runtime_load_buf(buf, len);
+  if (!grammar) fprintf(stderr, "Cannot load the grammar file: %s\n", filename);
+
+  free(buf);
+  return grammar;
+
+}
+
+/* Generation */
+
+// Split the remaining budget (as `get_random_len` of the generated code)
+static inline int grammar_random_len(int num_subnodes,
+                                     int total_remaining_len) {
+
+  int ret = total_remaining_len;
+  for (int i = 0; i < num_subnodes - 1; ++i) {
+
+    int temp = random_below(total_remaining_len + 1);
+    if (temp < ret) ret = temp;
+
+  }
+
+  return ret;
+
+}
+
+// Generate a subtree of the minimal length from the cheap rules, which are
+// picked uniformly up to `GRAMMAR_RUNTIME_CHEAP_DEPTH`
+static node_t *grammar_gen_cheap(const grammar_runtime_t *g, uint32_t type,
+                                 size_t depth) {
+
+  const grammar_runtime_rules_t *rules = g->rules;
+
+  size_t rule_id = depth < GRAMMAR_RUNTIME_CHEAP_DEPTH
+                       ? random_below(g->node_rule_tiers[type][0])
+                       : rules->cheap_rule[type];
+  const grammar_rule_t *rule = &rules->rules[rules->first_rule[type] + rule_id];
+
+  node_t *node = node_create_with_rule_id(type, rule_id);
+  node_init_subnodes(node, rule->num_tokens);
+  for (uint32_t i = 0; i < rule->num_tokens; ++i) {
+
+    const grammar_token_t *token = &rule->tokens[i];
+    node_t *               subnode =
+        token->node_type ? grammar_gen_cheap(g, token->node_type, depth + 1)
+                         : node_create_with_val(0, token->val, token->len);
+    node->subnodes[i] = subnode;
+    subnode->parent = node;
+
+  }
+
+  return node;
+
+}
+
+node_t *grammar_runtime_gen_node(const grammar_runtime_t *g,
+                                 grammar_runtime_picker_t picker,
+                                 int node_type, int max_len, int *consumed,
+                                 int rule_index) {
+
+  const grammar_runtime_rules_t *rules = g->rules;
+  uint32_t                       type = node_type;
+
+  if (max_len < (int)g->node_min_lens[type]) {
+
+    *consumed = g->node_min_lens[type];
+    return grammar_gen_cheap(g, type, 0);
+
+  }
+
+  const grammar_rule_t *first = &rules->rules[rules->first_rule[type]];
+  int                   val = rule_index;
+  if (rule_index < 0 || (size_t)rule_index >= g->node_num_rules[type]) {
+
+    // The rules are sorted by their minimal lengths
+    const size_t *tiers = g->node_rule_tiers[type];
+    int           rules_that_fit = tiers[0];
+    for (size_t i = 1; i < g->node_num_rule_tiers[type] &&
+                       first[tiers[i] - 1].cost <= (size_t)max_len;
+         ++i)
+      rules_that_fit = tiers[i];
+
+    val = picker ? picker(node_type, rules_that_fit)
+                 : (int)random_below(rules_that_fit);
+
+  }
+
+  const grammar_rule_t *rule = &first[val];
+  node_t *              node = node_create_with_rule_id(type, val);
+  node_init_subnodes(node, rule->num_tokens);
+
+  *consumed = 0;
+  int remaining_len = max_len - (int)rule->cost;
+  int num_non_terms = rule->num_non_terms;
+  for (uint32_t i = 0; i < rule->num_tokens; ++i) {
+
+    const grammar_token_t *token = &rule->tokens[i];
+    node_t *               subnode;
+    if (token->node_type) {
+
+      int subnode_max_len = grammar_random_len(num_non_terms--, remaining_len) +
+                            (int)token->cost;
+      int subnode_consumed = 0;
+      remaining_len += token->cost;
+      subnode =
+          grammar_runtime_gen_node(g, picker, token->node_type,
+                                   subnode_max_len, &subnode_consumed, -1);
+      remaining_len -= subnode_consumed;
+      *consumed += subnode_consumed;
+      node->non_term_size += 1;
+      if (token->node_type == type) node->recursion_edge_size += 1;
+
+    } else {
+
+      subnode = node_create_with_val(0, token->val, token->len);
+      *consumed += token->cost;
+
+    }
+
+    node->subnodes[i] = subnode;
+    subnode->parent = node;
+
+  }
+
+  return node;
+
+}
+
+tree_t *grammar_runtime_gen_tree(const grammar_runtime_t *grammar,
+                                 grammar_runtime_picker_t picker, int max_len) {
+
+  tree_t *tree = tree_create();
+  int     consumed = 0;
+  tree->root =
+      grammar_runtime_gen_node(grammar, picker, 1, max_len, &consumed, -1);
+  return tree;
+
+}
+
+/* Parsing */
+
+// An Earley item in the set of a position of the input: the LR(0) item, and
+// the position where the rule starts
+typedef struct earley_item {
+
+  uint32_t lr0;
+  uint32_t origin;
+
+} earley_item_t;
+
+typedef struct earley_set {
+
+  earley_item_t *items;
+  size_t         items_size;
+  uint32_t       num_items;
+
+  // (node type << 32 | item index) of the items before a non-terminal, sorted
+  // once the set is complete
+  uint64_t *waiting;
+  uint32_t  num_waiting;
+
+} earley_set_t;
+
+typedef struct earley_key {
+
+  uint32_t set;  // plus one, or 0 for an empty slot
+  uint32_t lr0;
+  uint32_t origin;
+
+} earley_key_t;
+
+typedef struct earley_parser {
+
+  const grammar_runtime_t *      grammar;
+  const grammar_runtime_rules_t *rules;
+
+  const uint8_t *buf;
+  uint32_t       len;
+
+  earley_set_t *sets;
+  uint32_t      last_set;  // the last set with any item
+
+  // all items of all sets, for checking duplicates and building the tree
+  earley_key_t *keys;
+  size_t        keys_mask;
+  size_t        num_items;
+
+  // the set (plus one) in which each node type is last predicted
+  uint32_t *predicted;
+
+  bool failed;
+
+} earley_parser_t;
+
+static inline size_t earley_hash(uint32_t set, uint32_t lr0, uint32_t origin) {
+
+  uint64_t h = set * 0x9E3779B97F4A7C15ULL ^ lr0 * 0xC2B2AE3D27D4EB4FULL ^
+               origin * 0x165667B19E3779F9ULL;
+  h ^= h >> 31;
+  h *= 0x94D049BB133111EBULL;
+  return h ^ (h >> 29);
+
+}
+
+static inline earley_key_t *earley_find(const earley_parser_t *p, uint32_t set,
+                                        uint32_t lr0, uint32_t origin) {
+
+  size_t i = earley_hash(set, lr0, origin) & p->keys_mask;
+  while (p->keys[i].set) {
+
+    earley_key_t *key = &p->keys[i];
+    if (key->set == set + 1 && key->lr0 == lr0 && key->origin == origin)
+      return key;
+    i = (i + 1) & p->keys_mask;
+
+  }
+
+  return &p->keys[i];
+
+}
+
+static inline bool earley_has(const earley_parser_t *p, uint32_t set,
+                              uint32_t lr0, uint32_t origin) {
+
+  return earley_find(p, set, lr0, origin)->set != 0;
+
+}
+
+static bool earley_grow_keys(earley_parser_t *p) {
+
+  earley_key_t *old_keys = p->keys;
+  size_t        old_size = p->keys_mask + 1;
+
+  p->keys = calloc(old_size * 2, sizeof(earley_key_t));
+  if (!p->keys) {
+
+    perror("grammar_runtime_parse (calloc)");
+    p->keys = old_keys;
+    return false;
+
+  }
+
+  p->keys_mask = old_size * 2 - 1;
+  for (size_t i = 0; i < old_size; ++i) {
+
+    earley_key_t *key = &old_keys[i];
+    if (key->set) *earley_find(p, key->set - 1, key->lr0, key->origin) = *key;
+
+  }
+
+  free(old_keys);
+  return true;
+
+}
+
+static void earley_add(earley_parser_t *p, uint32_t set, uint32_t lr0,
+                       uint32_t origin) {
+
+  earley_key_t *key = earley_find(p, set, lr0, origin);
+  if (key->set) return;
+
+  // Too many items, e.g., due to a highly ambiguous grammar
+  if (p->num_items >= GRAMMAR_RUNTIME_MAX_ITEMS) {
+
+    p->failed = true;
+    return;
+
+  }
+
+  earley_set_t *s = &p->sets[set];
+  if (!maybe_grow((void **)&s->items, &s->items_size,
+                  (s->num_items + 1) * sizeof(earley_item_t))) {
+
+    perror("grammar_runtime_parse (realloc)");
+    s->num_items = 0;
+    p->failed = true;
+    return;
+
+  }
+
+  key->set = set + 1;
+  key->lr0 = lr0;
+  key->origin = origin;
+  s->items[s->num_items].lr0 = lr0;
+  s->items[s->num_items].origin = origin;
+  ++s->num_items;
+  if (set > p->last_set) p->last_set = set;
+
+  // At most half full
+  if (++p->num_items * 2 > p->keys_mask + 1 && !earley_grow_keys(p))
+    p->failed = true;
+
+}
+
+// The next token of an LR(0) item, or NULL at the end of its rule
+static inline const grammar_token_t *earley_next(const earley_parser_t *p,
+                                                 uint32_t               lr0,
+                                                 const grammar_rule_t **rule) {
+
+  const grammar_rule_t *r = &p->rules->rules[p->rules->lr0_rules[lr0]];
+  uint32_t              dot = lr0 - r->lr0;
+  *rule = r;
+  return dot < r->num_tokens ? &r->tokens[dot] : NULL;
+
+}
+
+static void earley_predict(earley_parser_t *p, uint32_t set, uint32_t type) {
+
+  if (p->predicted[type] == set + 1) return;
+  p->predicted[type] = set + 1;
+
+  const grammar_rule_t *first =
+      &p->rules->rules[p->rules->first_rule[type]];
+  for (size_t i = 0; i < p->grammar->node_num_rules[type]; ++i)
+    earley_add(p, set, first[i].lr0, set);
+
+}
+
+static void earley_complete(earley_parser_t *p, uint32_t set, uint32_t type,
+                            uint32_t origin) {
+
+  const earley_set_t *s = &p->sets[origin];
+
+  uint64_t key = (uint64_t)type << 32;
+  uint32_t lo = 0, hi = s->num_waiting;
+  while (lo < hi) {
+
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (s->waiting[mid] < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+
+  }
+
+  for (; lo < s->num_waiting && (s->waiting[lo] >> 32) == type; ++lo) {
+
+    earley_item_t item = s->items[(uint32_t)s->waiting[lo]];
+    earley_add(p, set, item.lr0 + 1, item.origin);
+
+  }
+
+}
+
+static int earley_waiting_cmp(const void *a, const void *b) {
+
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+
+}
+
+static void earley_process(earley_parser_t *p, uint32_t set) {
+
+  earley_set_t *s = &p->sets[set];
+  uint32_t      num_waiting = 0;
+  for (uint32_t i = 0; i < s->num_items && !p->failed; ++i) {
+
+    earley_item_t          item = s->items[i];
+    const grammar_rule_t * rule;
+    const grammar_token_t *token = earley_next(p, item.lr0, &rule);
+
+    if (!token) {
+
+      // The rules completed in this set are nullable, which the prediction
+      // has skipped (Aycock and Horspool)
+      if (item.origin != set)
+        earley_complete(p, set, rule->node_type, item.origin);
+
+    } else if (token->node_type) {
+
+      ++num_waiting;
+      earley_predict(p, set, token->node_type);
+      if (p->grammar->node_min_lens[token->node_type] == 0)
+        earley_add(p, set, item.lr0 + 1, item.origin);
+
+    } else if (token->len == 0) {
+
+      earley_add(p, set, item.lr0 + 1, item.origin);
+
+    } else if (token->len <= p->len - set &&
+               !memcmp(p->buf + set, token->val, token->len)) {
+
+      earley_add(p, set + token->len, item.lr0 + 1, item.origin);
+
+    }
+
+  }
+
+  if (p->failed || num_waiting == 0) return;
+
+  s->waiting = malloc(num_waiting * sizeof(uint64_t));
+  if (!s->waiting) {
+
+    perror("grammar_runtime_parse (malloc)");
+    p->failed = true;
+    return;
+
+  }
+
+  for (uint32_t i = 0; i < s->num_items; ++i) {
+
+    const grammar_rule_t * rule;
+    const grammar_token_t *token = earley_next(p, s->items[i].lr0, &rule);
+    if (token && token->node_type)
+      s->waiting[s->num_waiting++] = (uint64_t)token->node_type << 32 | i;
+
+  }
+
+  qsort(s->waiting, s->num_waiting, sizeof(uint64_t), earley_waiting_cmp);
+
+}
+
+// The start of a subtree of `type` that ends at `end` and follows the item
+// `lr0` of `origin`, or UINT32_MAX if there is none
+static uint32_t earley_split(const earley_parser_t *p, uint32_t type,
+                             uint32_t origin, uint32_t end, uint32_t lr0) {
+
+  const earley_set_t *s = &p->sets[end];
+  for (uint32_t i = 0; i < s->num_items; ++i) {
+
+    earley_item_t         item = s->items[i];
+    const grammar_rule_t *rule;
+    if (item.origin < origin || item.origin >= end ||
+        earley_next(p, item.lr0, &rule) || rule->node_type != type)
+      continue;
+
+    if (earley_has(p, item.origin, lr0, origin)) return item.origin;
+
+  }
+
+  if (p->grammar->node_min_lens[type] == 0 && earley_has(p, end, lr0, origin))
+    return end;
+
+  return UINT32_MAX;
+
+}
+
+// Build the subtree of `type` from `start` to `end`. `same` is the number of
+// ancestors of the same span, which ends cycles of rules such as <a> ::= <b>
+// and <b> ::= <a>.
+static node_t *earley_build(const earley_parser_t *p, uint32_t type,
+                            uint32_t start, uint32_t end, size_t depth,
+                            size_t same) {
+
+  const grammar_runtime_t *g = p->grammar;
+  if (depth > GRAMMAR_RUNTIME_MAX_DEPTH || same > g->num_node_types)
+    return NULL;
+
+  // An empty subtree is the lowest one
+  if (start == end && g->node_min_lens[type] == 0)
+    return grammar_gen_cheap(g, type, GRAMMAR_RUNTIME_CHEAP_DEPTH);
+
+  const grammar_rule_t *first = &p->rules->rules[p->rules->first_rule[type]];
+  for (size_t r = 0; r < g->node_num_rules[type]; ++r) {
+
+    const grammar_rule_t *rule = &first[r];
+    if (!earley_has(p, end, rule->lr0 + rule->num_tokens, start)) continue;
+
+    // From the last token to the first one
+    node_t * node = node_create_with_rule_id(type, r);
+    uint32_t pos = end;
+    uint32_t i = rule->num_tokens;
+    node_init_subnodes(node, rule->num_tokens);
+    for (; i > 0; --i) {
+
+      const grammar_token_t *token = &rule->tokens[i - 1];
+      uint32_t               lr0 = rule->lr0 + i - 1;
+      node_t *               subnode;
+      if (!token->node_type) {
+
+        if (token->len > pos - start ||
+            !earley_has(p, pos - token->len, lr0, start))
+          break;
+
+        subnode = node_create_with_val(0, token->val, token->len);
+        pos -= token->len;
+
+      } else {
+
+        uint32_t mid = earley_split(p, token->node_type, start, pos, lr0);
+        if (mid == UINT32_MAX) break;
+
+        subnode =
+            earley_build(p, token->node_type, mid, pos, depth + 1,
+                         mid == start && pos == end ? same + 1 : 0);
+        if (!subnode) break;
+        pos = mid;
+
+      }
+
+      node->subnodes[i - 1] = subnode;
+      subnode->parent = node;
+
+    }
+
+    if (i == 0) return node;
+    node_free(node);
+
+  }
+
+  return NULL;
+
+}
+
+tree_t *grammar_runtime_parse(const grammar_runtime_t *grammar,
+                              const uint8_t *data_buf, size_t data_size) {
+
+  if (!grammar || data_size >= UINT32_MAX) return NULL;
+
+  earley_parser_t p;
+  memset(&p, 0, sizeof(p));
+  p.grammar = grammar;
+  p.rules = grammar->rules;
+  p.buf = data_buf;
+  p.len = data_size;
+  p.sets = calloc(data_size + 1, sizeof(earley_set_t));
+  p.keys_mask = 1023;
+  p.keys = calloc(p.keys_mask + 1, sizeof(earley_key_t));
+  p.predicted = calloc(grammar->num_node_types, sizeof(uint32_t));
+
+  node_t *root = NULL;
+  if (!p.sets || !p.keys || !p.predicted) {
+
+    perror("grammar_runtime_parse (calloc)");
+    goto out;
+
+  }
+
+  for (size_t i = 0; i < p.rules->num_entry_types; ++i)
+    earley_predict(&p, 0, p.rules->entry_types[i]);
+
+  // A set without items ends the parsing, unless later sets have some
+  for (uint32_t i = 0; i <= p.len && i <= p.last_set && !p.failed; ++i)
+    earley_process(&p, i);
+
+  for (size_t i = 0; !p.failed && !root && i < p.rules->num_entry_types; ++i)
+    root = earley_build(&p, p.rules->entry_types[i], 0, p.len, 0, 0);
+
+out:
+  if (p.sets) {
+
+    for (size_t i = 0; i <= data_size; ++i) {
+
+      free(p.sets[i].items);
+      free(p.sets[i].waiting);
+
+    }
+
+  }
+
+  free(p.sets);
+  free(p.keys);
+  free(p.predicted);
+  if (!root) return NULL;
+
+  tree_t *tree = tree_create();
+  tree->root = root;
+  return tree;
+
+}
@@ -0,0 +1,387 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunk_store.h"
+#include "f1_c_fuzz.h"
+#include "helpers.h"
+#include "libfuzzer_mutator.h"
+#include "node_weights.h"
+#include "rule_weights.h"
+#include "tree.h"
+#include "tree_mutation.h"
+#include "utils.h"
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+#undef XXH_INLINE_ALL
+
+// The number of mutations tried before falling back to the generation, if the
+// mutated test cases do not fit into `max_size`
+#define LIBFUZZER_MAX_ATTEMPTS 8
+
+// The budget of generated test cases (as in `afl_custom_fuzz`) and of
+// generated subtrees (see `tree_set_max_len`)
+#define LIBFUZZER_GEN_MAX_LEN 500
+#define LIBFUZZER_SUBTREE_MAX_LEN 1000
+
+// The random recursive mutation repeats a recursion up to 2^4 times
+#define LIBFUZZER_RRM_MAX_EXP 4
+
+// A direct-mapped cache slot: the tree of the test case with `hash` and `len`
+typedef struct libfuzzer_cache_slot {
+
+  uint64_t hash;
+  size_t   len;
+  tree_t * tree;
+  bool     harvested;  // whether the subtrees are in the chunk store
+
+} libfuzzer_cache_slot_t;
+
+static bool                    libfuzzer_ready = false;
+static libfuzzer_cache_slot_t *cache_slots = NULL;
+static size_t                  cache_mask = 0;
+static bool                    weighted_pick = false;
+
+static libfuzzer_mutator_stats_t libfuzzer_stats;
+
+static void libfuzzer_init() {
+
+  if (likely(libfuzzer_ready)) return;
+
+  size_t num_slots = LIBFUZZER_CACHE_SLOTS;
+  char * ptr = getenv("LIBFUZZER_CACHE_SLOTS");
+  if (ptr && *ptr) num_slots = strtoul(ptr, NULL, 10);
+
+  // A power of two, so that a slot is picked by masking the hash. Zero slots
+  // disable the cache.
+  if (num_slots > 0) {
+
+    size_t n = 1;
+    while (n < num_slots)
+      n <<= 1;
+
+    cache_slots = calloc(n, sizeof(libfuzzer_cache_slot_t));
+    if (!cache_slots) perror("libfuzzer_init (calloc)");
+    cache_mask = n - 1;
+
+  }
+
+  chunk_store_init();
+
+  // The static weights only, since libFuzzer reports no new queue entries
+  ptr = getenv("NODE_WEIGHTS_FILE");
+  weighted_pick = node_weights_init(ptr && *ptr ? ptr : NULL, false);
+  rule_weights_init();
+
+  memset(&libfuzzer_stats, 0, sizeof(libfuzzer_stats));
+  libfuzzer_ready = true;
+
+}
+
+// Take the tree of a test case out of the cache, or parse it (and add its
+// subtrees to the chunk store). The caller owns the returned tree, which is
+// sized, or NULL if the test case cannot be parsed.
+static tree_t *libfuzzer_take_tree(const uint8_t *buf, size_t len,
+                                   uint64_t hash, bool *harvested) {
+
+  if (cache_slots) {
+
+    libfuzzer_cache_slot_t *slot = &cache_slots[hash & cache_mask];
+    if (slot->tree && slot->hash == hash && slot->len == len) {
+
+      tree_t *tree = slot->tree;
+      *harvested = slot->harvested;
+      slot->tree = NULL;
+      ++libfuzzer_stats.cache_hits;
+      return tree;
+
+    }
+
+  }
+
+  // Nothing to parse, e.g., an empty corpus
+  if (len == 0) return NULL;
+
+  ++libfuzzer_stats.num_parsed;
+  tree_t *tree = tree_from_buf(buf, len);
+  if (!tree || !tree->root) {
+
+    if (tree) tree_free(tree);
+    return NULL;
+
+  }
+
+  tree_get_size(tree);
+  chunk_store_add_tree(tree);
+  *harvested = true;
+  return tree;
+
+}
+
+// Keep a sized tree in the cache, which takes the ownership of the tree and
+// replaces the previous tree of the slot
+static void libfuzzer_cache_put(uint64_t hash, size_t len, tree_t *tree,
+                                bool harvested) {
+
+  if (!cache_slots) {
+
+    tree_free(tree);
+    return;
+
+  }
+
+  libfuzzer_cache_slot_t *slot = &cache_slots[hash & cache_mask];
+  if (slot->tree) tree_free(slot->tree);
+
+  slot->hash = hash;
+  slot->len = len;
+  slot->tree = tree;
+  slot->harvested = harvested;
+
+}
+
+// Generate a sized tree, halving the budget until the test case fits into
+// `max_size` (unless the smallest test case does not fit)
+static tree_t *libfuzzer_generate(size_t max_size) {
+
+  int     max_len = max_size < LIBFUZZER_GEN_MAX_LEN ? (int)max_size
+                                                     : LIBFUZZER_GEN_MAX_LEN;
+  tree_t *tree = NULL;
+  while (true) {
+
+    tree = gen_init__(max_len);
+    tree_get_size(tree);
+    if (tree_get_data_len(tree) <= max_size || max_len == 0) break;
+
+    tree_free(tree);
+    max_len /= 2;
+
+  }
+
+  ++libfuzzer_stats.num_generated;
+  return tree;
+
+}
+
+static inline node_t *libfuzzer_pick_node(node_t *root) {
+
+  if (weighted_pick) return node_pick_weighted_non_term_subnode(root);
+  return node_pick_non_term_subnode(root);
+
+}
+
+// Pick a random node of type `id` in a subtree (reservoir sampling)
+static void libfuzzer_sample_node(node_t *node, uint32_t id, size_t *seen,
+                                  node_t **picked) {
+
+  // `node` may be NULL due to parsing errors
+  if (unlikely(!node)) return;
+
+  if (node->id == id && random_below(++(*seen)) == 0) *picked = node;
+
+  for (uint32_t i = 0; i < node->subnode_count; ++i)
+    libfuzzer_sample_node(node->subnodes[i], id, seen, picked);
+
+}
+
+// Replace a random subtree of `tree` with a subtree of the same node type from
+// `donor`, or from the chunk store if `donor` has no such subtree
+static tree_t *libfuzzer_crossover(tree_t *tree, tree_t *donor) {
+
+  tree_t *mutated_tree = tree_clone(tree);
+  node_t *node = libfuzzer_pick_node(mutated_tree->root);
+  if (unlikely(!node)) return mutated_tree;
+
+  size_t  seen = 0;
+  node_t *picked = NULL;
+  if (donor) libfuzzer_sample_node(donor->root, node->id, &seen, &picked);
+  if (!picked) {
+
+    tree_free(mutated_tree);
+    return splicing_mutation(tree);
+
+  }
+
+  node_t *parent = node->parent;
+  node_t *replace_node = node_clone(picked);
+  if (!parent) {
+
+    node_free(node);
+    mutated_tree->root = replace_node;
+
+  } else if (node_replace_subnode(parent, node, replace_node)) {
+
+    node_free(node);
+
+  } else {
+
+    node_free(replace_node);
+
+  }
+
+  return mutated_tree;
+
+}
+
+// Render a sized tree into `out`, and cache it by the hash of the output,
+// unless it has been truncated
+static size_t libfuzzer_output(tree_t *tree, uint8_t *out, size_t max_size) {
+
+  if (unlikely(!tree)) return 0;
+
+  size_t len = tree_get_data_len(tree);
+  if (len > max_size) {
+
+    ++libfuzzer_stats.num_truncated;
+    len = tree_render_to_buf(tree, out, max_size);
+    tree_free(tree);
+    return len;
+
+  }
+
+  len = tree_render_to_buf(tree, out, len);
+  libfuzzer_cache_put(XXH3_64bits(out, len), len, tree, false);
+  return len;
+
+}
+
+size_t LLVMFuzzerCustomMutator(uint8_t *data, size_t size, size_t max_size,
+                               unsigned int seed) {
+
+  libfuzzer_init();
+  random_set_seed(seed);
+  ++libfuzzer_stats.num_calls;
+
+  tree_set_max_len(max_size < LIBFUZZER_SUBTREE_MAX_LEN
+                       ? max_size
+                       : LIBFUZZER_SUBTREE_MAX_LEN);
+
+  uint64_t hash = XXH3_64bits(data, size);
+  bool     harvested = false;
+  tree_t * tree = libfuzzer_take_tree(data, size, hash, &harvested);
+
+  tree_t *mutated_tree = NULL;
+  for (int i = 0; tree && i < LIBFUZZER_MAX_ATTEMPTS; ++i) {
+
+    mutated_tree = random_any_mutation(tree, LIBFUZZER_RRM_MAX_EXP);
+    if (!mutated_tree) continue;
+
+    tree_get_size(mutated_tree);
+    if (tree_get_data_len(mutated_tree) <= max_size) break;
+
+    tree_free(mutated_tree);
+    mutated_tree = NULL;
+
+  }
+
+  if (!mutated_tree) mutated_tree = libfuzzer_generate(max_size);
+
+  // `data` is overwritten below
+  if (tree) libfuzzer_cache_put(hash, size, tree, harvested);
+
+  return libfuzzer_output(mutated_tree, data, max_size);
+
+}
+
+size_t LLVMFuzzerCustomCrossOver(const uint8_t *data1, size_t size1,
+                                 const uint8_t *data2, size_t size2,
+                                 uint8_t *out, size_t max_out_size,
+                                 unsigned int seed) {
+
+  libfuzzer_init();
+  random_set_seed(seed);
+  ++libfuzzer_stats.num_calls;
+
+  tree_set_max_len(max_out_size < LIBFUZZER_SUBTREE_MAX_LEN
+                       ? max_out_size
+                       : LIBFUZZER_SUBTREE_MAX_LEN);
+
+  uint64_t hash1 = XXH3_64bits(data1, size1);
+  uint64_t hash2 = XXH3_64bits(data2, size2);
+  bool     harvested1 = false, harvested2 = false;
+  tree_t * tree1 = libfuzzer_take_tree(data1, size1, hash1, &harvested1);
+  bool     same = hash1 == hash2 && size1 == size2;
+  tree_t * tree2 =
+      same ? tree1 : libfuzzer_take_tree(data2, size2, hash2, &harvested2);
+
+  // The second test case is from the corpus of libFuzzer
+  if (same) harvested2 = harvested1;
+  if (tree2 && !harvested2) {
+
+    chunk_store_add_tree(tree2);
+    harvested2 = true;
+    if (same) harvested1 = true;
+
+  }
+
+  tree_t *mutated_tree = NULL;
+  for (int i = 0; tree1 && i < LIBFUZZER_MAX_ATTEMPTS; ++i) {
+
+    mutated_tree = libfuzzer_crossover(tree1, tree2);
+    if (!mutated_tree) continue;
+
+    tree_get_size(mutated_tree);
+    if (tree_get_data_len(mutated_tree) <= max_out_size) break;
+
+    tree_free(mutated_tree);
+    mutated_tree = NULL;
+
+  }
+
+  if (!mutated_tree) mutated_tree = libfuzzer_generate(max_out_size);
+
+  if (tree1) libfuzzer_cache_put(hash1, size1, tree1, harvested1);
+  if (tree2 && !same) libfuzzer_cache_put(hash2, size2, tree2, harvested2);
+
+  return libfuzzer_output(mutated_tree, out, max_out_size);
+
+}
+
+void libfuzzer_mutator_get_stats(libfuzzer_mutator_stats_t *stats) {
+
+  if (stats) *stats = libfuzzer_stats;
+
+}
+
+void libfuzzer_mutator_deinit() {
+
+  if (!libfuzzer_ready) return;
+
+  if (cache_slots) {
+
+    for (size_t i = 0; i <= cache_mask; ++i)
+      if (cache_slots[i].tree) tree_free(cache_slots[i].tree);
+    free(cache_slots);
+    cache_slots = NULL;
+
+  }
+
+  cache_mask = 0;
+  chunk_store_clear();
+  node_weights_clear();
+  rule_weights_clear();
+  tree_set_max_len(LIBFUZZER_SUBTREE_MAX_LEN);
+
+  weighted_pick = false;
+  libfuzzer_ready = false;
+
+}
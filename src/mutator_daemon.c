@@ -0,0 +1,745 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chunk_store.h"
+#include "f1_c_fuzz.h"
+#include "helpers.h"
+#include "list.h"
+#include "mutator_daemon.h"
+#include "node_weights.h"
+#include "parse_pool.h"
+#include "rule_weights.h"
+#include "tree.h"
+#include "tree_mutation.h"
+#include "utils.h"
+
+// The number of mutations tried before truncating a mutant, if the mutants do
+// not fit into `max_size`
+#define DAEMON_MAX_ATTEMPTS 8
+
+// The random recursive mutation repeats a recursion up to 2^4 times
+#define DAEMON_RRM_MAX_EXP 4
+
+// The number of generated trees (and their budget) if no tree is loaded
+#define DAEMON_GEN_TREES 64
+#define DAEMON_GEN_MAX_LEN 500
+
+typedef struct daemon_ctx daemon_ctx_t;
+
+typedef struct daemon_worker {
+
+  pthread_t     thread;
+  daemon_ctx_t *ctx;
+  uint64_t      seed;
+  int           client_fd;  // the connection being served, or -1
+
+  BUF_VAR(uint8_t, in);   // the payload of a request
+  BUF_VAR(uint8_t, out);  // the response
+
+} daemon_worker_t;
+
+struct daemon_ctx {
+
+  int listen_fd;
+
+  // Guards `stopping` and `client_fd` of the workers, so that the main thread
+  // can shut down all connections
+  pthread_mutex_t lock;
+  bool            stopping;
+
+  // The corpus and the chunk store, which are read by the mutations and
+  // written by added inputs
+  pthread_rwlock_t corpus_lock;
+  BUF_VAR(tree_t *, trees);
+  size_t num_trees;
+
+  daemon_worker_t *workers;
+  size_t           num_workers;
+
+  // Updated atomically by the workers
+  uint64_t num_requests;
+  uint64_t num_mutants;
+  uint64_t num_added;
+
+  double start;
+
+};
+
+static double daemon_now() {
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+
+}
+
+static bool read_full(int fd, void *buf, size_t len) {
+
+  uint8_t *p = buf;
+  while (len) {
+
+    ssize_t n = read(fd, p, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    len -= n;
+
+  }
+
+  return true;
+
+}
+
+static bool write_full(int fd, const void *buf, size_t len) {
+
+  const uint8_t *p = buf;
+  while (len) {
+
+    // A closed connection must not kill the daemon by SIGPIPE
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    p += n;
+    len -= n;
+
+  }
+
+  return true;
+
+}
+
+// Add a sized tree into the corpus, and its subtrees into the chunk store. The
+// caller holds the write lock.
+static uint32_t daemon_add_tree(daemon_ctx_t *ctx, tree_t *tree) {
+
+  if (!maybe_grow(BUF_PARAMS(ctx, trees),
+                  (ctx->num_trees + 1) * sizeof(tree_t *))) {
+
+    perror("mutator_daemon (realloc)");
+    exit(EXIT_FAILURE);
+
+  }
+
+  chunk_store_add_tree(tree);
+  ctx->trees_buf[ctx->num_trees] = tree;
+  return ctx->num_trees++;
+
+}
+
+static void daemon_add_parsed(void *arg, const char *test_case_fn,
+                              const char *tree_fn, tree_t *tree) {
+
+  (void)test_case_fn;
+  (void)tree_fn;
+  daemon_add_tree(arg, tree);
+
+}
+
+// Append the files of a folder to `filenames`
+static bool daemon_list_dir(const char *path, list_t *filenames) {
+
+  DIR *d = opendir(path);
+  if (!d) {
+
+    perror(path);
+    return false;
+
+  }
+
+  size_t         dir_len = strlen(path);
+  struct dirent *p;
+  while ((p = readdir(d))) {
+
+    // Skip hidden files, "." and ".."
+    if (p->d_name[0] == '.') continue;
+    if (p->d_type == DT_DIR) continue;
+
+    size_t len = dir_len + strlen(p->d_name) + 2;
+    char * filename = malloc(len);
+    if (!filename) {
+
+      perror("mutator_daemon (malloc)");
+      closedir(d);
+      return false;
+
+    }
+
+    snprintf(filename, len, "%s/%s", path, p->d_name);
+    list_append(filenames, filename);
+
+  }
+
+  closedir(d);
+  return true;
+
+}
+
+// Parse all test cases of a folder with `num_threads` threads
+static bool daemon_load_seeds(daemon_ctx_t *ctx, const char *seeds_dir,
+                              size_t num_threads) {
+
+  list_t *filenames = list_create();
+  if (!daemon_list_dir(seeds_dir, filenames)) return false;
+
+  parse_pool_t *pool = parse_pool_create(num_threads);
+  if (!pool) return false;
+
+  for (list_node_t *p = filenames->head; p; p = p->next)
+    parse_pool_submit(pool, p->data, "");
+
+  for (list_node_t *p = filenames->head; p; p = p->next)
+    parse_pool_wait(pool, p->data);
+  parse_pool_drain(pool, daemon_add_parsed, ctx);
+
+  parse_pool_free(pool);
+  list_free_with_data_free_func(filenames, free);
+  return true;
+
+}
+
+static bool daemon_load_trees(daemon_ctx_t *ctx, const char *trees_dir) {
+
+  list_t *filenames = list_create();
+  if (!daemon_list_dir(trees_dir, filenames)) return false;
+
+  for (list_node_t *p = filenames->head; p; p = p->next) {
+
+    tree_t *tree = read_tree_from_file(p->data);
+    if (!tree) continue;
+
+    tree_get_size(tree);
+    daemon_add_tree(ctx, tree);
+
+  }
+
+  list_free_with_data_free_func(filenames, free);
+  return true;
+
+}
+
+// Render `count` mutants of a tree (or of random trees) into the response,
+// each a uint32_t length followed by the test case. The batch ends early if it
+// would exceed `MUTATOR_DAEMON_MAX_LEN`. The caller holds the read lock.
+static uint32_t daemon_mutate(daemon_worker_t *w, uint32_t tree_id,
+                              uint32_t count, uint32_t max_size,
+                              size_t *len) {
+
+  daemon_ctx_t *ctx = w->ctx;
+  uint32_t      i;
+  for (i = 0; i < count; ++i) {
+
+    tree_t *tree = ctx->trees_buf[tree_id == MUTATOR_DAEMON_ANY_TREE
+                                      ? random_below(ctx->num_trees)
+                                      : tree_id];
+
+    // Retry oversized mutants, and truncate the last one
+    tree_t *mutated_tree = NULL;
+    for (int j = 0; j < DAEMON_MAX_ATTEMPTS; ++j) {
+
+      if (mutated_tree) tree_free(mutated_tree);
+      mutated_tree = random_any_mutation(tree, DAEMON_RRM_MAX_EXP);
+      tree_get_size(mutated_tree);
+      if (tree_get_data_len(mutated_tree) <= max_size) break;
+
+    }
+
+    size_t data_len = tree_get_data_len(mutated_tree);
+    if (data_len > max_size) data_len = max_size;
+
+    size_t needed = *len + sizeof(uint32_t) + data_len;
+    if (needed > sizeof(mutator_daemon_response_t) + MUTATOR_DAEMON_MAX_LEN) {
+
+      tree_free(mutated_tree);
+      break;
+
+    }
+
+    if (!maybe_grow(BUF_PARAMS(w, out), needed)) {
+
+      perror("mutator_daemon (realloc)");
+      exit(EXIT_FAILURE);
+
+    }
+
+    uint32_t mutant_len =
+        tree_render_to_buf(mutated_tree, w->out_buf + *len + sizeof(uint32_t),
+                           data_len);
+    memcpy(w->out_buf + *len, &mutant_len, sizeof(uint32_t));
+    *len += sizeof(uint32_t) + mutant_len;
+    tree_free(mutated_tree);
+
+  }
+
+  __atomic_fetch_add(&ctx->num_mutants, i, __ATOMIC_RELAXED);
+  return i;
+
+}
+
+static void daemon_get_stats(daemon_ctx_t *ctx, mutator_daemon_stats_t *stats) {
+
+  pthread_rwlock_rdlock(&ctx->corpus_lock);
+  stats->num_trees = ctx->num_trees;
+  stats->num_chunks = chunk_store_get_num_chunks();
+  pthread_rwlock_unlock(&ctx->corpus_lock);
+
+  stats->num_requests = __atomic_load_n(&ctx->num_requests, __ATOMIC_RELAXED);
+  stats->num_mutants = __atomic_load_n(&ctx->num_mutants, __ATOMIC_RELAXED);
+  stats->num_added = __atomic_load_n(&ctx->num_added, __ATOMIC_RELAXED);
+  stats->uptime_ms = (daemon_now() - ctx->start) * 1000;
+
+}
+
+// Serve one request, and return False if the connection has to be closed
+static bool daemon_serve_request(daemon_worker_t *w, int fd) {
+
+  daemon_ctx_t *           ctx = w->ctx;
+  mutator_daemon_request_t req;
+  if (!read_full(fd, &req, sizeof(req))) return false;
+
+  mutator_daemon_response_t resp = {MUTATOR_DAEMON_MAGIC, MUTATOR_DAEMON_OK, 0,
+                                    0};
+  size_t                    len = sizeof(resp);
+  if (!maybe_grow(BUF_PARAMS(w, out), len)) {
+
+    perror("mutator_daemon (realloc)");
+    exit(EXIT_FAILURE);
+
+  }
+
+  // The stream cannot be resynchronized after a malformed header
+  bool keep = req.magic == MUTATOR_DAEMON_MAGIC &&
+              req.len <= MUTATOR_DAEMON_MAX_LEN;
+  if (keep && req.len) {
+
+    if (!maybe_grow(BUF_PARAMS(w, in), req.len)) {
+
+      perror("mutator_daemon (realloc)");
+      exit(EXIT_FAILURE);
+
+    }
+
+    if (!read_full(fd, w->in_buf, req.len)) return false;
+
+  }
+
+  if (!keep) {
+
+    resp.status = MUTATOR_DAEMON_BAD_REQUEST;
+
+  } else if (req.op == MUTATOR_DAEMON_MUTATE) {
+
+    if (req.count == 0 || req.count > MUTATOR_DAEMON_MAX_COUNT ||
+        req.max_size == 0) {
+
+      resp.status = MUTATOR_DAEMON_BAD_REQUEST;
+
+    } else {
+
+      pthread_rwlock_rdlock(&ctx->corpus_lock);
+      if (ctx->num_trees == 0 || (req.tree_id != MUTATOR_DAEMON_ANY_TREE &&
+                                  req.tree_id >= ctx->num_trees))
+        resp.status = MUTATOR_DAEMON_NO_TREE;
+      else
+        resp.value =
+            daemon_mutate(w, req.tree_id, req.count, req.max_size, &len);
+      pthread_rwlock_unlock(&ctx->corpus_lock);
+
+    }
+
+  } else if (req.op == MUTATOR_DAEMON_ADD) {
+
+    // Parse outside the lock, since parsing is thread-safe
+    tree_t *tree = req.len ? tree_from_buf(w->in_buf, req.len) : NULL;
+    if (!tree || !tree->root) {
+
+      if (tree) tree_free(tree);
+      resp.status = MUTATOR_DAEMON_PARSE_ERROR;
+
+    } else {
+
+      tree_get_size(tree);
+      pthread_rwlock_wrlock(&ctx->corpus_lock);
+      resp.value = daemon_add_tree(ctx, tree);
+      pthread_rwlock_unlock(&ctx->corpus_lock);
+      __atomic_fetch_add(&ctx->num_added, 1, __ATOMIC_RELAXED);
+
+    }
+
+  } else if (req.op == MUTATOR_DAEMON_STATS) {
+
+    mutator_daemon_stats_t stats;
+    daemon_get_stats(ctx, &stats);
+    if (!maybe_grow(BUF_PARAMS(w, out), len + sizeof(stats))) {
+
+      perror("mutator_daemon (realloc)");
+      exit(EXIT_FAILURE);
+
+    }
+
+    memcpy(w->out_buf + len, &stats, sizeof(stats));
+    len += sizeof(stats);
+
+  } else {
+
+    resp.status = MUTATOR_DAEMON_BAD_REQUEST;
+
+  }
+
+  resp.len = len - sizeof(resp);
+  memcpy(w->out_buf, &resp, sizeof(resp));
+  __atomic_fetch_add(&ctx->num_requests, 1, __ATOMIC_RELAXED);
+
+  return write_full(fd, w->out_buf, len) && keep;
+
+}
+
+// Accept connections one by one, and serve each until it is closed
+static void *daemon_worker(void *arg) {
+
+  daemon_worker_t *w = arg;
+  daemon_ctx_t *   ctx = w->ctx;
+
+  // The random numbers are thread-local
+  random_set_seed(w->seed);
+
+  while (true) {
+
+    int fd = accept(ctx->listen_fd, NULL, NULL);
+    if (fd < 0) {
+
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      if (!__atomic_load_n(&ctx->stopping, __ATOMIC_RELAXED))
+        perror("mutator_daemon (accept)");
+      break;
+
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    bool stopping = __atomic_load_n(&ctx->stopping, __ATOMIC_RELAXED);
+    if (!stopping) w->client_fd = fd;
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (stopping) {
+
+      close(fd);
+      break;
+
+    }
+
+    while (daemon_serve_request(w, fd)) {}
+
+    pthread_mutex_lock(&ctx->lock);
+    w->client_fd = -1;
+    close(fd);
+    pthread_mutex_unlock(&ctx->lock);
+
+  }
+
+  return NULL;
+
+}
+
+static int daemon_listen(const char *path) {
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+
+    fprintf(stderr, "The socket path is too long: %s\n", path);
+    return -1;
+
+  }
+
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+
+    perror("mutator_daemon (socket)");
+    return -1;
+
+  }
+
+  // Replace the socket of a previous run
+  struct stat st;
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+
+    perror(path);
+    close(fd);
+    return -1;
+
+  }
+
+  return fd;
+
+}
+
+static void daemon_report(daemon_ctx_t *ctx, double *last_time,
+                          uint64_t *last_mutants) {
+
+  mutator_daemon_stats_t stats;
+  daemon_get_stats(ctx, &stats);
+
+  double now = daemon_now();
+  double interval = now - *last_time;
+  double uptime = now - ctx->start;
+  fprintf(stderr,
+          "[mutator_daemon] %zu trees, %zu chunks, %zu requests, %zu added, "
+          "%.0f mutants/s (%.0f overall)\n",
+          (size_t)stats.num_trees, (size_t)stats.num_chunks,
+          (size_t)stats.num_requests, (size_t)stats.num_added,
+          interval > 0 ? (stats.num_mutants - *last_mutants) / interval : 0.0,
+          uptime > 0 ? stats.num_mutants / uptime : 0.0);
+
+  *last_time = now;
+  *last_mutants = stats.num_mutants;
+
+}
+
+static void usage(const char *prog) {
+
+  printf(
+      "%s [-j <threads>] [-i <seeds_dir>] [-t <trees_dir>] [-s <seed>]\n"
+      "       [-r <seconds>] <socket>\n"
+      "\n"
+      "Serve batches of mutants over a Unix domain socket (see\n"
+      "include/mutator_daemon.h for the protocol).\n"
+      "\n"
+      "  -j <threads>    the number of worker threads, each serving one\n"
+      "                  connection at a time (default: the number of CPUs)\n"
+      "  -i <seeds_dir>  parse the test cases of a folder into the corpus\n"
+      "  -t <trees_dir>  load the serialized trees of a folder into the\n"
+      "                  corpus (e.g., `out/default/trees`). Without any\n"
+      "                  loaded tree, %d trees are generated.\n"
+      "  -s <seed>       the random seed (default: the current time)\n"
+      "  -r <seconds>    report the throughput on stderr every <seconds>\n"
+      "                  seconds, or never if 0 (default: 10)\n",
+      prog, DAEMON_GEN_TREES);
+
+}
+
+int main(int argc, char *argv[]) {
+
+  long        num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t      num_threads = num_cpus > 0 ? num_cpus : 1;
+  const char *seeds_dir = NULL;
+  const char *trees_dir = NULL;
+  uint64_t    seed = time(NULL);
+  long        report_interval = 10;
+  int         opt;
+
+  while ((opt = getopt(argc, argv, "j:i:t:s:r:h")) != -1) {
+
+    switch (opt) {
+
+      case 'j':
+        num_threads = strtoul(optarg, NULL, 10);
+        break;
+      case 'i':
+        seeds_dir = optarg;
+        break;
+      case 't':
+        trees_dir = optarg;
+        break;
+      case 's':
+        seed = strtoull(optarg, NULL, 10);
+        break;
+      case 'r':
+        report_interval = strtol(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : EXIT_FAILURE;
+
+    }
+
+  }
+
+  if (optind != argc - 1) {
+
+    usage(argv[0]);
+    return 0;
+
+  }
+
+  if (num_threads == 0) num_threads = 1;
+  const char *socket_path = argv[optind];
+
+  daemon_ctx_t *ctx = calloc(1, sizeof(daemon_ctx_t));
+  if (!ctx) {
+
+    perror("mutator_daemon (calloc)");
+    return EXIT_FAILURE;
+
+  }
+
+  pthread_mutex_init(&ctx->lock, NULL);
+
+  // Prefer writers, so that added inputs are not starved by mutations
+  pthread_rwlockattr_t attr;
+  pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+  pthread_rwlockattr_setkind_np(&attr,
+                                PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+  pthread_rwlock_init(&ctx->corpus_lock, &attr);
+  pthread_rwlockattr_destroy(&attr);
+
+  random_set_seed(seed);
+  chunk_store_init();
+
+  // The same environment variables as the grammar mutator, but the weights
+  // are static, since no new queue entries are reported
+  char *ptr = getenv("NODE_WEIGHTS_FILE");
+  node_weights_init(ptr && *ptr ? ptr : NULL, false);
+  rule_weights_init();
+
+  double start = daemon_now();
+  if (seeds_dir && !daemon_load_seeds(ctx, seeds_dir, num_threads))
+    return EXIT_FAILURE;
+  if (trees_dir && !daemon_load_trees(ctx, trees_dir)) return EXIT_FAILURE;
+
+  if (ctx->num_trees == 0) {
+
+    for (int i = 0; i < DAEMON_GEN_TREES; ++i) {
+
+      tree_t *tree = gen_init__(DAEMON_GEN_MAX_LEN);
+      tree_get_size(tree);
+      daemon_add_tree(ctx, tree);
+
+    }
+
+  }
+
+  fprintf(stderr, "[mutator_daemon] %zu trees and %zu chunks in %.2f s\n",
+          ctx->num_trees, chunk_store_get_num_chunks(), daemon_now() - start);
+
+  ctx->listen_fd = daemon_listen(socket_path);
+  if (ctx->listen_fd < 0) return EXIT_FAILURE;
+
+  // Only the main thread handles the signals to stop, and the workers inherit
+  // the signal mask
+  sigset_t sigs;
+  sigemptyset(&sigs);
+  sigaddset(&sigs, SIGINT);
+  sigaddset(&sigs, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &sigs, NULL);
+
+  ctx->num_workers = num_threads;
+  ctx->workers = calloc(num_threads, sizeof(daemon_worker_t));
+  if (!ctx->workers) {
+
+    perror("mutator_daemon (calloc)");
+    return EXIT_FAILURE;
+
+  }
+
+  ctx->start = daemon_now();
+  for (size_t i = 0; i < num_threads; ++i) {
+
+    daemon_worker_t *w = &ctx->workers[i];
+    w->ctx = ctx;
+    w->seed = seed + i + 1;
+    w->client_fd = -1;
+    if (pthread_create(&w->thread, NULL, daemon_worker, w) != 0) {
+
+      perror("mutator_daemon (pthread_create)");
+      return EXIT_FAILURE;
+
+    }
+
+  }
+
+  fprintf(stderr, "[mutator_daemon] serving on %s with %zu threads\n",
+          socket_path, num_threads);
+
+  double   last_time = ctx->start;
+  uint64_t last_mutants = 0;
+  while (true) {
+
+    int sig;
+    if (report_interval > 0) {
+
+      struct timespec timeout = {report_interval, 0};
+      sig = sigtimedwait(&sigs, NULL, &timeout);
+
+    } else {
+
+      sig = sigwaitinfo(&sigs, NULL);
+
+    }
+
+    if (sig == SIGINT || sig == SIGTERM) break;
+    if (sig < 0 && errno == EAGAIN)
+      daemon_report(ctx, &last_time, &last_mutants);
+
+  }
+
+  // Wake up all workers blocked in `accept` or `read`
+  pthread_mutex_lock(&ctx->lock);
+  __atomic_store_n(&ctx->stopping, true, __ATOMIC_RELAXED);
+  shutdown(ctx->listen_fd, SHUT_RDWR);
+  for (size_t i = 0; i < num_threads; ++i)
+    if (ctx->workers[i].client_fd >= 0)
+      shutdown(ctx->workers[i].client_fd, SHUT_RDWR);
+  pthread_mutex_unlock(&ctx->lock);
+
+  for (size_t i = 0; i < num_threads; ++i) {
+
+    pthread_join(ctx->workers[i].thread, NULL);
+    free(ctx->workers[i].in_buf);
+    free(ctx->workers[i].out_buf);
+
+  }
+
+  daemon_report(ctx, &last_time, &last_mutants);
+
+  close(ctx->listen_fd);
+  unlink(socket_path);
+
+  for (size_t i = 0; i < ctx->num_trees; ++i)
+    tree_free(ctx->trees_buf[i]);
+  free(ctx->trees_buf);
+  free(ctx->workers);
+  chunk_store_clear();
+  node_weights_clear();
+  rule_weights_clear();
+  pthread_rwlock_destroy(&ctx->corpus_lock);
+  pthread_mutex_destroy(&ctx->lock);
+  free(ctx);
+
+  return 0;
+
+}
@@ -0,0 +1,217 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "f1_c_fuzz.h"
+#include "node_weights.h"
+#include "stats.h"
+#include "tree.h"
+#include "tree_mutation.h"
+
+#define NUM_NODE_TYPES (sizeof(node_num_rules) / sizeof(node_num_rules[0]))
+
+// The learned yield of a node type starts at the average yield, as if it had
+// been mutated this many times
+#define NODE_WEIGHTS_PRIOR (100)
+
+// the largest static weight, so that weight sums do not overflow
+#define NODE_WEIGHTS_MAX_STATIC (1000000)
+
+static bool     node_weights_learn = false;
+static double   node_static_weights[NUM_NODE_TYPES];
+static uint32_t node_weights[NUM_NODE_TYPES];
+
+// the number of mutations at the last update of the learned weights
+static size_t node_weights_last_update = 0;
+
+// "NODE_ARRAY" can also be written as "array"
+static int node_weights_find_type(const char *name) {
+
+  for (size_t i = 1; i < NUM_NODE_TYPES; ++i) {
+
+    const char *type = node_type_str(i);
+    if (strcasecmp(type, name) == 0) return i;
+    if (strncmp(type, "NODE_", 5) == 0 && strcasecmp(type + 5, name) == 0)
+      return i;
+
+  }
+
+  return -1;
+
+}
+
+static bool node_weights_load(const char *filename) {
+
+  FILE *f = fopen(filename, "r");
+  if (!f) {
+
+    perror("Cannot open the weight table (node_weights_init)");
+    return false;
+
+  }
+
+  char   line[1024], name[512];
+  double weight;
+  size_t line_no = 0;
+  bool   ok = true;
+  while (fgets(line, sizeof(line), f)) {
+
+    ++line_no;
+    char *ptr = line + strspn(line, " \t");
+    if (*ptr == '#' || *ptr == '\n' || *ptr == '\0') continue;
+
+    if (sscanf(ptr, "%511s %lf", name, &weight) != 2 || !(weight >= 0) ||
+        weight > NODE_WEIGHTS_MAX_STATIC) {
+
+      fprintf(stderr, "Invalid weight at %s:%zu\n", filename, line_no);
+      ok = false;
+      break;
+
+    }
+
+    int type = node_weights_find_type(name);
+    if (type < 0) {
+
+      fprintf(stderr, "Unknown node type at %s:%zu: %s (ignored)\n", filename,
+              line_no, name);
+      continue;
+
+    }
+
+    node_static_weights[type] = weight;
+
+  }
+
+  fclose(f);
+  return ok;
+
+}
+
+// Scale the static weights, and check whether any weight has changed
+static bool node_weights_scale(const double *scales) {
+
+  bool changed = false;
+  for (size_t i = 1; i < NUM_NODE_TYPES; ++i) {
+
+    double   weight = NODE_WEIGHT_ONE * node_static_weights[i] * scales[i];
+    uint32_t fixed = (uint32_t)llround(weight);
+    if (fixed == 0 && weight > 0) fixed = 1;
+
+    if (fixed != node_weights[i]) changed = true;
+    node_weights[i] = fixed;
+
+  }
+
+  return changed;
+
+}
+
+bool node_weights_init(const char *filename, bool learn) {
+
+  double scales[NUM_NODE_TYPES];
+
+  node_weights_clear();
+  if (!filename && !learn) return false;
+
+  for (size_t i = 0; i < NUM_NODE_TYPES; ++i) {
+
+    node_static_weights[i] = 1;
+    scales[i] = 1;
+
+  }
+
+  if (filename && !node_weights_load(filename)) return false;
+
+  node_weights_learn = learn;
+  node_weights_last_update = 0;
+  node_weights_scale(scales);
+  node_set_type_weights(node_weights, NUM_NODE_TYPES);
+  tree_set_weighted_pick(true);
+
+  return true;
+
+}
+
+bool node_weights_update() {
+
+  size_t mutations[NUM_NODE_TYPES], entries[NUM_NODE_TYPES];
+  double scales[NUM_NODE_TYPES];
+  size_t total_mutations = 0, total_entries = 0;
+
+  if (!node_weights_learn) return false;
+
+  for (size_t i = 1; i < NUM_NODE_TYPES; ++i) {
+
+    mutations[i] = entries[i] = 0;
+    for (int stage = STATS_RULES_MUTATION; stage <= STATS_SPLICING_MUTATION;
+         ++stage) {
+
+      mutations[i] += stats_get_mutation_count(stage, i);
+      entries[i] += stats_get_new_entry_count(stage, i);
+
+    }
+
+    total_mutations += mutations[i];
+    total_entries += entries[i];
+
+  }
+
+  // `stats_init` resets the counts
+  if (total_mutations < node_weights_last_update)
+    node_weights_last_update = 0;
+  if (total_mutations - node_weights_last_update <
+      NODE_WEIGHTS_UPDATE_INTERVAL)
+    return false;
+  node_weights_last_update = total_mutations;
+
+  // Nothing to learn from before the first new queue entry
+  double mean = (double)total_entries / total_mutations;
+  for (size_t i = 1; i < NUM_NODE_TYPES; ++i) {
+
+    scales[i] = 1;
+    if (total_entries == 0) continue;
+
+    double yield = (entries[i] + NODE_WEIGHTS_PRIOR * mean) /
+                   (mutations[i] + NODE_WEIGHTS_PRIOR);
+    double scale = yield / mean;
+    if (scale > NODE_WEIGHTS_MAX_SCALE) scale = NODE_WEIGHTS_MAX_SCALE;
+    if (scale < 1.0 / NODE_WEIGHTS_MAX_SCALE)
+      scale = 1.0 / NODE_WEIGHTS_MAX_SCALE;
+    scales[i] = scale;
+
+  }
+
+  if (!node_weights_scale(scales)) return false;
+
+  node_set_type_weights(node_weights, NUM_NODE_TYPES);
+  return true;
+
+}
+
+void node_weights_clear() {
+
+  node_set_type_weights(NULL, 0);
+  tree_set_weighted_pick(false);
+  node_weights_learn = false;
+  node_weights_last_update = 0;
+
+}
@@ -0,0 +1,312 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "helpers.h"
+#include "list.h"
+#include "map.h"
+#include "parse_pool.h"
+#include "thread_pool.h"
+#include "tree_store.h"
+
+typedef enum parse_job_state {
+
+  PARSE_JOB_QUEUED,
+  PARSE_JOB_RUNNING,
+  PARSE_JOB_DONE
+
+} parse_job_state_t;
+
+typedef struct parse_job {
+
+  char *            test_case_fn;
+  char *            tree_fn;
+  tree_t *          tree;  // NULL if the test case cannot be parsed
+  parse_job_state_t state;
+
+} parse_job_t;
+
+typedef map_t(parse_job_t *) parse_job_map_t;
+
+struct parse_pool {
+
+  thread_pool_t *threads;
+
+  pthread_mutex_t lock;
+  pthread_cond_t  job_done;
+
+  list_t *        queued_jobs;  // FIFO of queued jobs
+  list_t *        done_jobs;    // finished jobs, waiting to be drained
+  parse_job_map_t jobs;         // all jobs not drained yet, by test case
+  size_t          num_pending;  // queued or running jobs
+
+};
+
+static void parse_job_free(parse_job_t *job) {
+
+  if (!job) return;
+
+  if (job->tree) tree_free(job->tree);
+  free(job->test_case_fn);
+  free(job->tree_fn);
+  free(job);
+
+}
+
+// The job is owned by the running thread, so no lock is needed while parsing
+static void parse_job_run(parse_pool_t *pool, parse_job_t *job) {
+
+  tree_t *tree = NULL;
+
+  // Same as `afl_custom_queue_get`, an existing tree file (e.g., dumped by the
+  // grammar generator) takes precedence over parsing the test case
+  if (job->tree_fn[0]) tree = read_tree_from_file(job->tree_fn);
+
+  if (!tree) tree = tree_store_load_test_case(job->test_case_fn, job->tree_fn);
+
+  if (tree) tree_get_size(tree);
+
+  pthread_mutex_lock(&pool->lock);
+  job->tree = tree;
+  job->state = PARSE_JOB_DONE;
+  list_append(pool->done_jobs, job);
+  --pool->num_pending;
+  pthread_cond_broadcast(&pool->job_done);
+  pthread_mutex_unlock(&pool->lock);
+
+}
+
+// Each submission queues one task, which runs the oldest queued job. Jobs
+// taken over by `parse_pool_wait` leave tasks that find nothing to do.
+static void parse_pool_work(void *arg) {
+
+  parse_pool_t *pool = (parse_pool_t *)arg;
+
+  pthread_mutex_lock(&pool->lock);
+  parse_job_t *job = (parse_job_t *)list_pop_front(pool->queued_jobs);
+  if (job) job->state = PARSE_JOB_RUNNING;
+  pthread_mutex_unlock(&pool->lock);
+
+  if (job) parse_job_run(pool, job);
+
+}
+
+parse_pool_t *parse_pool_create(size_t num_threads) {
+
+  parse_pool_t *pool = calloc(1, sizeof(parse_pool_t));
+  if (!pool) {
+
+    perror("parse_pool_create (calloc)");
+    return NULL;
+
+  }
+
+  pool->threads = thread_pool_create(num_threads);
+  if (!pool->threads) {
+
+    free(pool);
+    return NULL;
+
+  }
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->job_done, NULL);
+  pool->queued_jobs = list_create();
+  pool->done_jobs = list_create();
+  map_init(&pool->jobs);
+
+  return pool;
+
+}
+
+void parse_pool_free(parse_pool_t *pool) {
+
+  if (!pool) return;
+
+  // Drop all queued jobs, so that the worker threads only finish running jobs
+  pthread_mutex_lock(&pool->lock);
+  parse_job_t *job;
+  while ((job = (parse_job_t *)list_pop_front(pool->queued_jobs))) {
+
+    map_remove(&pool->jobs, job->test_case_fn);
+    --pool->num_pending;
+    parse_job_free(job);
+
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+
+  thread_pool_free(pool->threads);
+
+  list_free_with_data_free_func(pool->done_jobs, (data_free_t)parse_job_free);
+  list_free(pool->queued_jobs);
+  map_deinit(&pool->jobs);
+
+  pthread_cond_destroy(&pool->job_done);
+  pthread_mutex_destroy(&pool->lock);
+
+  free(pool);
+
+}
+
+bool parse_pool_submit(parse_pool_t *pool, const char *test_case_fn,
+                       const char *tree_fn) {
+
+  if (!pool || !test_case_fn) return false;
+
+  pthread_mutex_lock(&pool->lock);
+
+  if (map_get(&pool->jobs, test_case_fn)) {
+
+    pthread_mutex_unlock(&pool->lock);
+    return true;
+
+  }
+
+  parse_job_t *job = calloc(1, sizeof(parse_job_t));
+  if (job) {
+
+    job->test_case_fn = strdup(test_case_fn);
+    job->tree_fn = strdup(tree_fn ? tree_fn : "");
+
+  }
+
+  if (!job || !job->test_case_fn || !job->tree_fn) {
+
+    pthread_mutex_unlock(&pool->lock);
+    perror("parse_pool_submit (malloc)");
+    parse_job_free(job);
+    return false;
+
+  }
+
+  job->state = PARSE_JOB_QUEUED;
+  map_set(&pool->jobs, test_case_fn, job);
+  list_append(pool->queued_jobs, job);
+  ++pool->num_pending;
+
+  pthread_mutex_unlock(&pool->lock);
+
+  // Fall back to parsing on the calling thread
+  if (unlikely(!thread_pool_submit(pool->threads, parse_pool_work, pool)))
+    parse_pool_work(pool);
+
+  return true;
+
+}
+
+bool parse_pool_wait(parse_pool_t *pool, const char *test_case_fn) {
+
+  if (!pool || !test_case_fn) return false;
+
+  pthread_mutex_lock(&pool->lock);
+
+  parse_job_t **p_job = map_get(&pool->jobs, test_case_fn);
+  if (!p_job) {
+
+    pthread_mutex_unlock(&pool->lock);
+    return false;
+
+  }
+
+  parse_job_t *job = *p_job;
+  if (job->state == PARSE_JOB_QUEUED) {
+
+    // Parse on demand rather than waiting for the queue to catch up
+    list_remove(pool->queued_jobs, job);
+    job->state = PARSE_JOB_RUNNING;
+    pthread_mutex_unlock(&pool->lock);
+
+    parse_job_run(pool, job);
+    return true;
+
+  }
+
+  while (job->state != PARSE_JOB_DONE)
+    pthread_cond_wait(&pool->job_done, &pool->lock);
+
+  pthread_mutex_unlock(&pool->lock);
+
+  return true;
+
+}
+
+size_t parse_pool_drain(parse_pool_t *pool, parse_pool_result_func_t func,
+                        void *arg) {
+
+  if (!pool) return 0;
+
+  pthread_mutex_lock(&pool->lock);
+
+  if (list_empty(pool->done_jobs)) {
+
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+
+  }
+
+  list_t *done_jobs = pool->done_jobs;
+  pool->done_jobs = list_create();
+
+  parse_job_t *job;
+  list_node_t *node = done_jobs->head;
+  while (node) {
+
+    job = (parse_job_t *)node->data;
+    map_remove(&pool->jobs, job->test_case_fn);
+    node = node->next;
+
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+
+  size_t num_done = done_jobs->size;
+  while ((job = (parse_job_t *)list_pop_front(done_jobs))) {
+
+    if (job->tree && func) {
+
+      func(arg, job->test_case_fn, job->tree_fn, job->tree);
+      job->tree = NULL;
+
+    }
+
+    parse_job_free(job);
+
+  }
+
+  list_free(done_jobs);
+
+  return num_done;
+
+}
+
+size_t parse_pool_get_num_pending(parse_pool_t *pool) {
+
+  if (!pool) return 0;
+
+  pthread_mutex_lock(&pool->lock);
+  size_t num_pending = pool->num_pending;
+  pthread_mutex_unlock(&pool->lock);
+
+  return num_pending;
+
+}
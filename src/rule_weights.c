@@ -0,0 +1,328 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "f1_c_fuzz.h"
+#include "helpers.h"
+#include "rule_weights.h"
+#include "utils.h"
+
+#define NUM_NODE_TYPES (sizeof(node_num_rules) / sizeof(node_num_rules[0]))
+
+// Walker's alias method: rule `i` is kept with a probability of
+// `probs[i] / RULE_WEIGHTS_ALIAS_ONE`, and replaced with `aliases[i]` otherwise
+typedef struct rule_alias_table {
+
+  uint32_t  num_rules;  // the budget tier
+  uint32_t *probs;
+  uint32_t *aliases;
+
+} rule_alias_table_t;
+
+static bool rule_weights_ready = false;
+static bool has_static_weights = false;
+
+// one table per budget tier of each node type
+static rule_alias_table_t *alias_tables[NUM_NODE_TYPES];
+
+// the dynamic scales of the rules of each node type, or NULL for all ones
+static double *rule_scales[NUM_NODE_TYPES];
+static size_t  num_scaled_types = 0;
+
+static void rule_weights_update_picker() {
+
+  if (has_static_weights || num_scaled_types > 0)
+    gen_rule_picker = rule_weights_pick;
+  else if (gen_rule_picker == rule_weights_pick)
+    gen_rule_picker = NULL;
+
+}
+
+static void rule_weights_build_table(rule_alias_table_t *table,
+                                     uint32_t node_type, uint32_t *small,
+                                     uint32_t *large, double *probs) {
+
+  uint32_t n = table->num_rules;
+  double   total = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+
+    probs[i] = rule_weights_get(node_type, i);
+    total += probs[i];
+
+  }
+
+  // Uniform, if nothing has a weight
+  if (!(total > 0) || !isfinite(total)) {
+
+    for (uint32_t i = 0; i < n; ++i) {
+
+      table->probs[i] = RULE_WEIGHTS_ALIAS_ONE;
+      table->aliases[i] = i;
+
+    }
+
+    return;
+
+  }
+
+  // Split the rules by whether they are above or below the average weight
+  uint32_t num_small = 0, num_large = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+
+    probs[i] = probs[i] * n / total;
+    if (probs[i] < 1)
+      small[num_small++] = i;
+    else
+      large[num_large++] = i;
+
+  }
+
+  // Fill up each small rule with a large one
+  while (num_small > 0 && num_large > 0) {
+
+    uint32_t s = small[--num_small];
+    uint32_t l = large[num_large - 1];
+
+    table->probs[s] = (uint32_t)lround(probs[s] * RULE_WEIGHTS_ALIAS_ONE);
+    table->aliases[s] = l;
+
+    probs[l] -= 1 - probs[s];
+    if (probs[l] < 1) {
+
+      --num_large;
+      small[num_small++] = l;
+
+    }
+
+  }
+
+  // The rest is (up to rounding errors) exactly average
+  while (num_large > 0) {
+
+    uint32_t l = large[--num_large];
+    table->probs[l] = RULE_WEIGHTS_ALIAS_ONE;
+    table->aliases[l] = l;
+
+  }
+
+  while (num_small > 0) {
+
+    uint32_t s = small[--num_small];
+    table->probs[s] = RULE_WEIGHTS_ALIAS_ONE;
+    table->aliases[s] = s;
+
+  }
+
+}
+
+static bool rule_weights_build_type(uint32_t node_type) {
+
+  size_t    num_rules = node_num_rules[node_type];
+  uint32_t *indices = malloc(2 * num_rules * sizeof(uint32_t));
+  double *  probs = malloc(num_rules * sizeof(double));
+  if (!indices || !probs) {
+
+    perror("rule_weights_build_type (malloc)");
+    free(indices);
+    free(probs);
+    return false;
+
+  }
+
+  for (size_t i = 0; i < node_num_rule_tiers[node_type]; ++i)
+    rule_weights_build_table(&alias_tables[node_type][i], node_type, indices,
+                             indices + num_rules, probs);
+
+  free(indices);
+  free(probs);
+  return true;
+
+}
+
+// Allocate and build all alias tables
+static bool rule_weights_setup() {
+
+  has_static_weights = false;
+  for (size_t i = 1; i < NUM_NODE_TYPES; ++i) {
+
+    if (node_rule_weights[i]) has_static_weights = true;
+
+    size_t num_tiers = node_num_rule_tiers[i];
+    alias_tables[i] = calloc(num_tiers, sizeof(rule_alias_table_t));
+    if (!alias_tables[i]) goto error;
+
+    for (size_t j = 0; j < num_tiers; ++j) {
+
+      rule_alias_table_t *table = &alias_tables[i][j];
+      table->num_rules = node_rule_tiers[i][j];
+      table->probs = malloc(2 * table->num_rules * sizeof(uint32_t));
+      if (!table->probs) goto error;
+      table->aliases = table->probs + table->num_rules;
+
+    }
+
+    if (!rule_weights_build_type(i)) goto error;
+
+  }
+
+  rule_weights_ready = true;
+  return true;
+
+error:
+  perror("rule_weights_setup (malloc)");
+  rule_weights_clear();
+  return false;
+
+}
+
+bool rule_weights_init() {
+
+  rule_weights_clear();
+  if (!rule_weights_setup()) return false;
+
+  rule_weights_update_picker();
+  return has_static_weights;
+
+}
+
+bool rule_weights_set_scales(uint32_t node_type, const double *scales) {
+
+  if (node_type == 0 || node_type >= NUM_NODE_TYPES) return false;
+
+  // Nothing to reset
+  if (!scales && !rule_weights_ready) return false;
+  if (!rule_weights_ready && !rule_weights_setup()) return false;
+
+  size_t num_rules = node_num_rules[node_type];
+  if (scales) {
+
+    if (!rule_scales[node_type]) {
+
+      rule_scales[node_type] = malloc(num_rules * sizeof(double));
+      if (!rule_scales[node_type]) {
+
+        perror("rule_weights_set_scales (malloc)");
+        return false;
+
+      }
+
+      ++num_scaled_types;
+
+    }
+
+    memcpy(rule_scales[node_type], scales, num_rules * sizeof(double));
+
+  } else if (rule_scales[node_type]) {
+
+    free(rule_scales[node_type]);
+    rule_scales[node_type] = NULL;
+    --num_scaled_types;
+
+  }
+
+  if (!rule_weights_build_type(node_type)) return false;
+
+  rule_weights_update_picker();
+  return true;
+
+}
+
+double rule_weights_get(uint32_t node_type, uint32_t rule_id) {
+
+  if (node_type == 0 || node_type >= NUM_NODE_TYPES ||
+      rule_id >= node_num_rules[node_type])
+    return 0;
+
+  double weight = 1;
+  if (node_rule_weights[node_type])
+    weight = node_rule_weights[node_type][rule_id];
+  if (rule_scales[node_type]) weight *= rule_scales[node_type][rule_id];
+  return weight;
+
+}
+
+int rule_weights_pick(int node_type, int rules_that_fit) {
+
+  if (unlikely(!rule_weights_ready || node_type <= 0 ||
+               (size_t)node_type >= NUM_NODE_TYPES))
+    return random_below(rules_that_fit);
+
+  // There are only a few budget tiers per node type
+  rule_alias_table_t *table = NULL;
+  for (size_t i = 0; i < node_num_rule_tiers[node_type]; ++i) {
+
+    if (alias_tables[node_type][i].num_rules == (uint32_t)rules_that_fit) {
+
+      table = &alias_tables[node_type][i];
+      break;
+
+    }
+
+  }
+
+  if (unlikely(!table)) return random_below(rules_that_fit);
+
+  // One random number for both the rule and the coin flip, if it fits
+  uint32_t rule_id, coin;
+  if (likely(table->num_rules <= UINT32_MAX / RULE_WEIGHTS_ALIAS_ONE)) {
+
+    uint32_t r = random_below(table->num_rules * RULE_WEIGHTS_ALIAS_ONE);
+    rule_id = r / RULE_WEIGHTS_ALIAS_ONE;
+    coin = r % RULE_WEIGHTS_ALIAS_ONE;
+
+  } else {
+
+    rule_id = random_below(table->num_rules);
+    coin = random_below(RULE_WEIGHTS_ALIAS_ONE);
+
+  }
+
+  return coin < table->probs[rule_id] ? (int)rule_id
+                                      : (int)table->aliases[rule_id];
+
+}
+
+void rule_weights_clear() {
+
+  if (gen_rule_picker == rule_weights_pick) gen_rule_picker = NULL;
+
+  for (size_t i = 1; i < NUM_NODE_TYPES; ++i) {
+
+    if (alias_tables[i]) {
+
+      for (size_t j = 0; j < node_num_rule_tiers[i]; ++j)
+        free(alias_tables[i][j].probs);
+      free(alias_tables[i]);
+      alias_tables[i] = NULL;
+
+    }
+
+    free(rule_scales[i]);
+    rule_scales[i] = NULL;
+
+  }
+
+  num_scaled_types = 0;
+  has_static_weights = false;
+  rule_weights_ready = false;
+
+}
@@ -0,0 +1,622 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chunk_store.h"
+#include "coverage.h"
+#include "f1_c_fuzz.h"
+#include "stats.h"
+#include "tree_cache.h"
+
+// Latencies are kept in log-linear buckets: values below 8 are exact, and
+// every power of two above is split into 8 buckets (< 12.5% error)
+#define STATS_SUB_BUCKET_BITS (3)
+#define STATS_NUM_SUB_BUCKETS (1 << STATS_SUB_BUCKET_BITS)
+#define STATS_NUM_BUCKETS \
+  ((64 - STATS_SUB_BUCKET_BITS + 1) * STATS_NUM_SUB_BUCKETS)
+
+// Read the clock at least this often (in ns) before the next write is due,
+// which bounds the error of the estimated cycle rate
+#define STATS_MAX_CHECK_NS (1000000000ULL)
+
+#define NUM_NODE_TYPES (sizeof(node_num_rules) / sizeof(node_num_rules[0]))
+
+// Mutations are attributed to node types; the last slot counts mutations
+// that did not change the tree
+#define STATS_NUM_MUTATION_STAGES (STATS_SPLICING_MUTATION + 1)
+#define STATS_NUM_YIELD_TYPES (NUM_NODE_TYPES + 1)
+
+typedef struct stats_histogram {
+
+  size_t   count;
+  uint64_t total_cycles;
+  size_t   buckets[STATS_NUM_BUCKETS];
+
+} stats_histogram_t;
+
+// Updated by multiple threads (the parse pool and the warm start)
+typedef struct stats_load_counters {
+
+  size_t   count;
+  size_t   failures;
+  uint64_t total_cycles;
+
+} stats_load_counters_t;
+
+static const char *stats_stage_names[STATS_NUM_STAGES] = {
+    "rules_mutation",    "random_mutation",    "random_recursive_mutation",
+    "splicing_mutation", "subtree_trimming", "recursive_trimming"};
+
+static const char *stats_yield_stage_names[STATS_NUM_MUTATION_STAGES] = {
+    "rules", "random", "recursive", "splicing"};
+
+static const char *stats_load_names[STATS_NUM_LOADS] = {"parse",
+                                                        "deserialize"};
+
+static const char *stats_profile_names[STATS_NUM_PROFILES] = {
+    "tree_from_buf",
+    "tree_deserialize",
+    "tree_clone",
+    "tree_to_buf",
+    "tree_get_size",
+    "rules_mutation",
+    "random_mutation",
+    "random_recursive_mutation",
+    "splicing_mutation",
+    "chunk_store_add_tree",
+    "write_tree_to_file"};
+
+static size_t stats_interval = 0;
+static char   stats_filename[PATH_MAX];
+
+static stats_histogram_t     stats_stages[STATS_NUM_STAGES];
+static stats_load_counters_t stats_loads[STATS_NUM_LOADS];
+static size_t                stats_sources[STATS_NUM_SOURCES];
+
+// Updated by multiple threads, and kept by `stats_init`
+static stats_histogram_t stats_profiles[STATS_NUM_PROFILES];
+
+static size_t stats_num_outputs = 0;
+static size_t stats_total_tree_size = 0;
+static size_t stats_total_out_len = 0;
+static size_t stats_num_truncated = 0;
+
+static size_t stats_num_trims = 0;
+static size_t stats_trim_orig_len = 0;
+static size_t stats_trim_saved_len = 0;
+
+static size_t stats_mutations[STATS_NUM_MUTATION_STAGES][STATS_NUM_YIELD_TYPES];
+static size_t stats_new_entries[STATS_NUM_MUTATION_STAGES]
+                               [STATS_NUM_YIELD_TYPES];
+
+// The clock at the start of the program, which calibrates the cycle counter
+static uint64_t stats_calib_cycles = 0;
+static uint64_t stats_calib_ns = 0;
+
+// The clock at `stats_init`
+static uint64_t stats_start_ns = 0;
+static time_t   stats_start_time = 0;
+
+static uint64_t stats_last_write_ns = 0;
+static uint64_t stats_next_check_cycles = 0;
+
+static uint64_t stats_now_ns() {
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+}
+
+__attribute__((constructor)) static void stats_calibrate() {
+
+  stats_calib_cycles = stats_cycles();
+  stats_calib_ns = stats_now_ns();
+
+}
+
+// Cycles per ns since the start of the program
+static double stats_cycle_rate(uint64_t cycles, uint64_t ns) {
+
+  if (ns <= stats_calib_ns || cycles <= stats_calib_cycles) return 1;
+  return (double)(cycles - stats_calib_cycles) / (ns - stats_calib_ns);
+
+}
+
+static size_t stats_bucket(uint64_t cycles) {
+
+  if (cycles < STATS_NUM_SUB_BUCKETS) return cycles;
+
+  int exp = 63 - __builtin_clzll(cycles);
+  int shift = exp - STATS_SUB_BUCKET_BITS;
+  return (shift + 1) * STATS_NUM_SUB_BUCKETS +
+         ((cycles >> shift) & (STATS_NUM_SUB_BUCKETS - 1));
+
+}
+
+// The largest value of a bucket
+static uint64_t stats_bucket_max(size_t bucket) {
+
+  if (bucket < STATS_NUM_SUB_BUCKETS) return bucket;
+
+  int      shift = bucket / STATS_NUM_SUB_BUCKETS - 1;
+  uint64_t min = (uint64_t)(STATS_NUM_SUB_BUCKETS +
+                            bucket % STATS_NUM_SUB_BUCKETS)
+                 << shift;
+  return min + ((1ULL << shift) - 1);
+
+}
+
+void stats_init(size_t interval) {
+
+  stats_interval = interval;
+  stats_filename[0] = '\0';
+
+  memset(stats_stages, 0, sizeof(stats_stages));
+  memset(stats_loads, 0, sizeof(stats_loads));
+  memset(stats_sources, 0, sizeof(stats_sources));
+
+  stats_num_outputs = 0;
+  stats_total_tree_size = 0;
+  stats_total_out_len = 0;
+  stats_num_truncated = 0;
+
+  stats_num_trims = 0;
+  stats_trim_orig_len = 0;
+  stats_trim_saved_len = 0;
+
+  memset(stats_mutations, 0, sizeof(stats_mutations));
+  memset(stats_new_entries, 0, sizeof(stats_new_entries));
+
+  stats_start_ns = stats_now_ns();
+  stats_start_time = time(NULL);
+  stats_last_write_ns = stats_start_ns;
+  stats_next_check_cycles = 0;
+
+}
+
+void stats_set_filename(const char *filename) {
+
+  if (stats_interval == 0 || !filename) return;
+  snprintf(stats_filename, PATH_MAX, "%s", filename);
+
+}
+
+const char *stats_get_filename() {
+
+  return stats_filename;
+
+}
+
+void stats_add_stage(stats_stage_t stage, uint64_t cycles) {
+
+  stats_histogram_t *hist = &stats_stages[stage];
+  ++hist->count;
+  hist->total_cycles += cycles;
+  ++hist->buckets[stats_bucket(cycles)];
+
+}
+
+void stats_add_load(stats_load_t load, uint64_t cycles, bool success) {
+
+  stats_load_counters_t *counters = &stats_loads[load];
+  __atomic_fetch_add(&counters->count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&counters->total_cycles, cycles, __ATOMIC_RELAXED);
+  if (!success) __atomic_fetch_add(&counters->failures, 1, __ATOMIC_RELAXED);
+
+}
+
+void stats_add_source(stats_source_t source) {
+
+  ++stats_sources[source];
+
+}
+
+void stats_add_output(size_t tree_size, size_t out_len, bool truncated) {
+
+  ++stats_num_outputs;
+  stats_total_tree_size += tree_size;
+  stats_total_out_len += out_len;
+  if (truncated) ++stats_num_truncated;
+
+}
+
+void stats_add_trim(size_t orig_len, size_t trimmed_len) {
+
+  ++stats_num_trims;
+  stats_trim_orig_len += orig_len;
+  if (trimmed_len < orig_len) stats_trim_saved_len += orig_len - trimmed_len;
+
+}
+
+static inline size_t stats_yield_type(int node_type) {
+
+  if (node_type < 0 || (size_t)node_type >= NUM_NODE_TYPES)
+    return NUM_NODE_TYPES;
+  return node_type;
+
+}
+
+void stats_add_mutation(stats_stage_t stage, int node_type) {
+
+  if (stage >= STATS_NUM_MUTATION_STAGES) return;
+  ++stats_mutations[stage][stats_yield_type(node_type)];
+
+}
+
+void stats_add_new_entry(stats_stage_t stage, int node_type) {
+
+  if (stage >= STATS_NUM_MUTATION_STAGES) return;
+  ++stats_new_entries[stage][stats_yield_type(node_type)];
+
+}
+
+size_t stats_get_mutation_count(stats_stage_t stage, int node_type) {
+
+  if (stage >= STATS_NUM_MUTATION_STAGES) return 0;
+  return stats_mutations[stage][stats_yield_type(node_type)];
+
+}
+
+size_t stats_get_new_entry_count(stats_stage_t stage, int node_type) {
+
+  if (stage >= STATS_NUM_MUTATION_STAGES) return 0;
+  return stats_new_entries[stage][stats_yield_type(node_type)];
+
+}
+
+void stats_add_profile(stats_profile_t profile, uint64_t cycles) {
+
+  stats_histogram_t *hist = &stats_profiles[profile];
+  __atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&hist->total_cycles, cycles, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&hist->buckets[stats_bucket(cycles)], 1,
+                     __ATOMIC_RELAXED);
+
+}
+
+// Nearest rank, out of the buckets that are being updated
+static uint64_t stats_percentile(stats_histogram_t *hist, double percentile) {
+
+  size_t count = __atomic_load_n(&hist->count, __ATOMIC_RELAXED);
+  if (count == 0) return 0;
+
+  size_t rank = (size_t)(percentile * (count - 1)) + 1;
+  size_t seen = 0;
+  for (size_t i = 0; i < STATS_NUM_BUCKETS; ++i) {
+
+    seen += __atomic_load_n(&hist->buckets[i], __ATOMIC_RELAXED);
+    if (seen >= rank) return stats_bucket_max(i);
+
+  }
+
+  return stats_bucket_max(STATS_NUM_BUCKETS - 1);
+
+}
+
+size_t stats_get_stage_count(stats_stage_t stage) {
+
+  return stats_stages[stage].count;
+
+}
+
+uint64_t stats_get_stage_percentile(stats_stage_t stage, double percentile) {
+
+  return stats_percentile(&stats_stages[stage], percentile);
+
+}
+
+const char *stats_get_profile_name(stats_profile_t profile) {
+
+  return stats_profile_names[profile];
+
+}
+
+size_t stats_get_profile_count(stats_profile_t profile) {
+
+  return __atomic_load_n(&stats_profiles[profile].count, __ATOMIC_RELAXED);
+
+}
+
+uint64_t stats_get_profile_percentile(stats_profile_t profile,
+                                      double          percentile) {
+
+  return stats_percentile(&stats_profiles[profile], percentile);
+
+}
+
+void stats_reset_profiles() {
+
+  memset(stats_profiles, 0, sizeof(stats_profiles));
+
+}
+
+double stats_cycles_to_ns(uint64_t cycles) {
+
+  return cycles / stats_cycle_rate(stats_cycles(), stats_now_ns());
+
+}
+
+static void stats_write_chunks(void *arg, const char *node_type,
+                               size_t num_chunks) {
+
+  fprintf((FILE *)arg, "chunks_%-37s: %zu\n", node_type, num_chunks);
+
+}
+
+// The key of a stage, a load or a hot path, e.g., "parse_count", padded as
+// the other keys
+static void stats_write_key(FILE *f, const char *prefix, const char *name,
+                            const char *suffix) {
+
+  int len = fprintf(f, "%s%s_%s", prefix, name, suffix);
+  fprintf(f, "%*s: ", len < 44 ? 44 - len : 0, "");
+
+}
+
+static double stats_ratio(double a, double b) {
+
+  return b > 0 ? a / b : 0;
+
+}
+
+static const char *stats_yield_type_name(size_t node_type) {
+
+  return node_type < NUM_NODE_TYPES ? node_type_str(node_type) : "unchanged";
+
+}
+
+bool stats_write() {
+
+  char tmp_filename[PATH_MAX + 4];
+
+  if (stats_filename[0] == '\0') return false;
+
+  uint64_t now_cycles = stats_cycles();
+  uint64_t now_ns = stats_now_ns();
+  double   us_per_cycle = 1 / stats_cycle_rate(now_cycles, now_ns) / 1000;
+
+  snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", stats_filename);
+  FILE *f = fopen(tmp_filename, "w");
+  if (!f) {
+
+    perror("Cannot write the statistics file");
+    return false;
+
+  }
+
+  fprintf(f, "%-44s: %lld\n", "start_time", (long long)stats_start_time);
+  fprintf(f, "%-44s: %lld\n", "last_update", (long long)time(NULL));
+  fprintf(f, "%-44s: %.0lf\n", "run_time",
+          (double)(now_ns - stats_start_ns) / 1e9);
+
+  for (int i = 0; i < STATS_NUM_STAGES; ++i) {
+
+    stats_histogram_t *hist = &stats_stages[i];
+    const char        *name = stats_stage_names[i];
+    double             total_us = hist->total_cycles * us_per_cycle;
+
+    stats_write_key(f, "", name, "count");
+    fprintf(f, "%zu\n", hist->count);
+    stats_write_key(f, "", name, "mean_us");
+    fprintf(f, "%.2lf\n", stats_ratio(total_us, hist->count));
+    stats_write_key(f, "", name, "p99_us");
+    fprintf(f, "%.2lf\n", stats_get_stage_percentile(i, 0.99) * us_per_cycle);
+    stats_write_key(f, "", name, "per_sec");
+    fprintf(f, "%.2lf\n", stats_ratio(hist->count, total_us / 1e6));
+
+  }
+
+  for (int i = 0; i < STATS_NUM_LOADS; ++i) {
+
+    stats_load_counters_t *counters = &stats_loads[i];
+    const char            *name = stats_load_names[i];
+    uint64_t total_cycles =
+        __atomic_load_n(&counters->total_cycles, __ATOMIC_RELAXED);
+    size_t count = __atomic_load_n(&counters->count, __ATOMIC_RELAXED);
+    double total_us = total_cycles * us_per_cycle;
+
+    stats_write_key(f, "", name, "count");
+    fprintf(f, "%zu\n", count);
+    stats_write_key(f, "", name, "failures");
+    fprintf(f, "%zu\n", __atomic_load_n(&counters->failures, __ATOMIC_RELAXED));
+    stats_write_key(f, "", name, "mean_us");
+    fprintf(f, "%.2lf\n", stats_ratio(total_us, count));
+    stats_write_key(f, "", name, "time");
+    fprintf(f, "%.3lf\n", total_us / 1e6);
+
+  }
+
+  size_t num_queue_gets = 0;
+  for (int i = 0; i < STATS_NUM_SOURCES; ++i)
+    num_queue_gets += stats_sources[i];
+  fprintf(f, "%-44s: %zu\n", "queue_get_count", num_queue_gets);
+  fprintf(f, "%-44s: %.2lf%%\n", "tree_cache_hit_rate",
+          100 * stats_ratio(stats_sources[STATS_FROM_TREE_CACHE],
+                            num_queue_gets));
+  fprintf(f, "%-44s: %.2lf%%\n", "tree_file_hit_rate",
+          100 * stats_ratio(stats_sources[STATS_FROM_TREE_FILE],
+                            num_queue_gets));
+  fprintf(f, "%-44s: %.2lf%%\n", "test_case_load_rate",
+          100 * stats_ratio(stats_sources[STATS_FROM_TEST_CASE],
+                            num_queue_gets));
+  fprintf(f, "%-44s: %zu\n", "no_tree_count", stats_sources[STATS_NO_TREE]);
+  fprintf(f, "%-44s: %zu\n", "tree_cache_trees", tree_cache_get_num_trees());
+  fprintf(f, "%-44s: %zu\n", "tree_cache_mem_size", tree_cache_get_mem_size());
+
+  fprintf(f, "%-44s: %zu\n", "output_count", stats_num_outputs);
+  fprintf(f, "%-44s: %.1lf\n", "avg_tree_size",
+          stats_ratio(stats_total_tree_size, stats_num_outputs));
+  fprintf(f, "%-44s: %.1lf\n", "avg_output_len",
+          stats_ratio(stats_total_out_len, stats_num_outputs));
+  fprintf(f, "%-44s: %zu\n", "truncated_count", stats_num_truncated);
+
+  fprintf(f, "%-44s: %zu\n", "trim_count", stats_num_trims);
+  fprintf(f, "%-44s: %zu\n", "trim_saved_bytes", stats_trim_saved_len);
+  fprintf(f, "%-44s: %.2lf%%\n", "trim_saved_rate",
+          100 * stats_ratio(stats_trim_saved_len, stats_trim_orig_len));
+
+  // Only the node types that have been mutated in a stage
+  for (int i = 0; i < STATS_NUM_MUTATION_STAGES; ++i) {
+
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "yield_%s_", stats_yield_stage_names[i]);
+    for (size_t j = 0; j < STATS_NUM_YIELD_TYPES; ++j) {
+
+      if (!stats_mutations[i][j] && !stats_new_entries[i][j]) continue;
+
+      const char *name = stats_yield_type_name(j);
+      stats_write_key(f, prefix, name, "mutations");
+      fprintf(f, "%zu\n", stats_mutations[i][j]);
+      stats_write_key(f, prefix, name, "entries");
+      fprintf(f, "%zu\n", stats_new_entries[i][j]);
+
+    }
+
+  }
+
+  // Only the hot paths that are profiled (see ENABLE_PROFILING)
+  for (int i = 0; i < STATS_NUM_PROFILES; ++i) {
+
+    const char *name = stats_profile_names[i];
+    size_t      count = stats_get_profile_count(i);
+    if (count == 0) continue;
+
+    stats_write_key(f, "profile_", name, "count");
+    fprintf(f, "%zu\n", count);
+    stats_write_key(f, "profile_", name, "p50_us");
+    fprintf(f, "%.3lf\n", stats_get_profile_percentile(i, 0.5) * us_per_cycle);
+    stats_write_key(f, "profile_", name, "p99_us");
+    fprintf(f, "%.3lf\n", stats_get_profile_percentile(i, 0.99) * us_per_cycle);
+    stats_write_key(f, "profile_", name, "p999_us");
+    fprintf(f, "%.3lf\n",
+            stats_get_profile_percentile(i, 0.999) * us_per_cycle);
+    stats_write_key(f, "profile_", name, "max_us");
+    fprintf(f, "%.3lf\n", stats_get_profile_percentile(i, 1) * us_per_cycle);
+
+  }
+
+  // The structural coverage of the kept inputs
+  fprintf(f, "%-44s: %zu\n", "coverage_entries", coverage_get_num_entries());
+  fprintf(f, "%-44s: %zu\n", "coverage_rules", coverage_get_covered_rules());
+  fprintf(f, "%-44s: %zu\n", "coverage_rules_total", coverage_get_num_rules());
+  fprintf(f, "%-44s: %.2lf%%\n", "coverage_rules_rate",
+          100 * stats_ratio(coverage_get_covered_rules(),
+                            coverage_get_num_rules()));
+  fprintf(f, "%-44s: %zu\n", "coverage_paths_2",
+          coverage_get_covered_paths(2));
+  fprintf(f, "%-44s: %zu\n", "coverage_paths_3",
+          coverage_get_covered_paths(3));
+
+  fprintf(f, "%-44s: %zu\n", "chunk_store_chunks",
+          chunk_store_get_num_chunks());
+  chunk_store_foreach_type(stats_write_chunks, f);
+
+  if (fclose(f) != 0 || rename(tmp_filename, stats_filename) != 0) {
+
+    perror("Cannot write the statistics file");
+    unlink(tmp_filename);
+    return false;
+
+  }
+
+  return true;
+
+}
+
+bool stats_write_yield() {
+
+  char yield_filename[PATH_MAX + 64];
+  char tmp_filename[PATH_MAX + 68];
+
+  if (stats_filename[0] == '\0') return false;
+
+  // In the folder of the statistics file
+  const char *slash = strrchr(stats_filename, '/');
+  int         dir_len = slash ? (int)(slash - stats_filename + 1) : 0;
+  snprintf(yield_filename, sizeof(yield_filename), "%.*s%s", dir_len,
+           stats_filename, STATS_YIELD_FILENAME);
+  snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", yield_filename);
+
+  FILE *f = fopen(tmp_filename, "w");
+  if (!f) {
+
+    perror("Cannot write the yield statistics");
+    return false;
+
+  }
+
+  fprintf(f, "node_type,stage,mutations,new_entries,yield\n");
+  for (size_t j = 0; j < STATS_NUM_YIELD_TYPES; ++j) {
+
+    for (int i = 0; i < STATS_NUM_MUTATION_STAGES; ++i) {
+
+      size_t mutations = stats_mutations[i][j];
+      size_t new_entries = stats_new_entries[i][j];
+      if (!mutations && !new_entries) continue;
+
+      fprintf(f, "%s,%s,%zu,%zu,%.6lf\n", stats_yield_type_name(j),
+              stats_yield_stage_names[i], mutations, new_entries,
+              stats_ratio(new_entries, mutations));
+
+    }
+
+  }
+
+  if (fclose(f) != 0 || rename(tmp_filename, yield_filename) != 0) {
+
+    perror("Cannot write the yield statistics");
+    unlink(tmp_filename);
+    return false;
+
+  }
+
+  return true;
+
+}
+
+bool stats_maybe_write() {
+
+  if (stats_filename[0] == '\0') return false;
+
+  // The common case: the next write is not due yet
+  uint64_t now_cycles = stats_cycles();
+  if (now_cycles < stats_next_check_cycles) return false;
+
+  uint64_t now_ns = stats_now_ns();
+  uint64_t interval_ns = (uint64_t)stats_interval * 1000000000;
+  uint64_t elapsed_ns = now_ns - stats_last_write_ns;
+  bool     due = elapsed_ns >= interval_ns;
+
+  // Estimate when the next write is due, but read the clock again at least
+  // every STATS_MAX_CHECK_NS
+  uint64_t wait_ns = due ? interval_ns : interval_ns - elapsed_ns;
+  if (wait_ns > STATS_MAX_CHECK_NS) wait_ns = STATS_MAX_CHECK_NS;
+  stats_next_check_cycles =
+      now_cycles + wait_ns * stats_cycle_rate(now_cycles, now_ns);
+
+  if (!due) return false;
+
+  stats_last_write_ns = now_ns;
+  return stats_write();
+
+}
@@ -0,0 +1,200 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "helpers.h"
+#include "list.h"
+#include "thread_pool.h"
+
+typedef struct thread_pool_task {
+
+  thread_pool_func_t func;
+  void *             arg;
+
+} thread_pool_task_t;
+
+struct thread_pool {
+
+  pthread_mutex_t lock;
+  pthread_cond_t  task_available;  // signaled when a task is queued
+  pthread_cond_t  all_done;        // signaled when `num_pending` drops to 0
+
+  list_t *tasks;        // queued tasks
+  size_t  num_pending;  // queued or running tasks
+  bool    stop;
+
+  pthread_t *threads;
+  size_t     num_threads;
+
+};
+
+static void *thread_pool_worker(void *arg) {
+
+  thread_pool_t *     pool = (thread_pool_t *)arg;
+  thread_pool_task_t *task = NULL;
+
+  while (true) {
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (list_empty(pool->tasks) && !pool->stop)
+      pthread_cond_wait(&pool->task_available, &pool->lock);
+
+    if (list_empty(pool->tasks) && pool->stop) {
+
+      pthread_mutex_unlock(&pool->lock);
+      break;
+
+    }
+
+    task = (thread_pool_task_t *)list_pop_front(pool->tasks);
+    pthread_mutex_unlock(&pool->lock);
+
+    task->func(task->arg);
+    free(task);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->num_pending == 0) pthread_cond_broadcast(&pool->all_done);
+    pthread_mutex_unlock(&pool->lock);
+
+  }
+
+  return NULL;
+
+}
+
+thread_pool_t *thread_pool_create(size_t num_threads) {
+
+  if (num_threads == 0) return NULL;
+
+  thread_pool_t *pool = calloc(1, sizeof(thread_pool_t));
+  if (!pool) {
+
+    perror("thread_pool_create (calloc)");
+    return NULL;
+
+  }
+
+  pool->tasks = list_create();
+  pool->threads = calloc(num_threads, sizeof(pthread_t));
+  if (!pool->tasks || !pool->threads) {
+
+    perror("thread_pool_create (calloc)");
+    list_free(pool->tasks);
+    free(pool->threads);
+    free(pool);
+    return NULL;
+
+  }
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->task_available, NULL);
+  pthread_cond_init(&pool->all_done, NULL);
+
+  for (size_t i = 0; i < num_threads; ++i) {
+
+    if (pthread_create(&pool->threads[i], NULL, thread_pool_worker, pool) !=
+        0) {
+
+      perror("thread_pool_create (pthread_create)");
+      break;
+
+    }
+
+    ++pool->num_threads;
+
+  }
+
+  if (unlikely(pool->num_threads == 0)) {
+
+    thread_pool_free(pool);
+    return NULL;
+
+  }
+
+  return pool;
+
+}
+
+void thread_pool_free(thread_pool_t *pool) {
+
+  if (!pool) return;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = true;
+  pthread_cond_broadcast(&pool->task_available);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (size_t i = 0; i < pool->num_threads; ++i)
+    pthread_join(pool->threads[i], NULL);
+
+  pthread_cond_destroy(&pool->all_done);
+  pthread_cond_destroy(&pool->task_available);
+  pthread_mutex_destroy(&pool->lock);
+
+  list_free_with_data_free_func(pool->tasks, free);
+  free(pool->threads);
+  free(pool);
+
+}
+
+bool thread_pool_submit(thread_pool_t *pool, thread_pool_func_t func,
+                        void *arg) {
+
+  if (!pool || !func) return false;
+
+  thread_pool_task_t *task = malloc(sizeof(thread_pool_task_t));
+  if (!task) {
+
+    perror("thread_pool_submit (malloc)");
+    return false;
+
+  }
+
+  task->func = func;
+  task->arg = arg;
+
+  pthread_mutex_lock(&pool->lock);
+  list_append(pool->tasks, task);
+  ++pool->num_pending;
+  pthread_cond_signal(&pool->task_available);
+  pthread_mutex_unlock(&pool->lock);
+
+  return true;
+
+}
+
+void thread_pool_wait(thread_pool_t *pool) {
+
+  if (!pool) return;
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->num_pending != 0)
+    pthread_cond_wait(&pool->all_done, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+
+}
+
+inline size_t thread_pool_get_num_threads(thread_pool_t *pool) {
+
+  return pool ? pool->num_threads : 0;
+
+}
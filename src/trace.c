@@ -0,0 +1,340 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "f1_c_fuzz.h"
+#include "helpers.h"
+#include "trace.h"
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+#undef XXH_INLINE_ALL
+
+// Layout of a trace file:
+//   header: "GMTRACE", the format version (1 byte), and the hash of the
+//           grammar (8 bytes, little endian)
+//   records: the call (1 byte), the latency in ns, and the arguments, all as
+//            LEB128 varints, followed by the strings, each as a varint of
+//            (length + 1) and the characters. A length of 0 marks NULL.
+#define TRACE_MAGIC "GMTRACE"
+#define TRACE_MAGIC_LEN (7)
+#define TRACE_VERSION (1)
+#define TRACE_BUF_SIZE (1024 * 1024)
+
+#define NUM_NODE_TYPES (sizeof(node_num_rules) / sizeof(node_num_rules[0]))
+
+struct trace_reader {
+
+  FILE * file;
+  char * strs[TRACE_MAX_STRS];
+  size_t str_sizes[TRACE_MAX_STRS];
+
+};
+
+// The name, the number of arguments and the number of strings of each call
+static const char *trace_op_names[TRACE_NUM_OPS] = {
+    "init",       "deinit",    "queue_get", "queue_new_entry", "fuzz_count",
+    "fuzz",       "init_trim", "trim",      "post_trim"};
+static const uint8_t trace_num_args[TRACE_NUM_OPS] = {2, 0, 3, 2, 3,
+                                                       7, 3, 2, 2};
+static const uint8_t trace_num_strs[TRACE_NUM_OPS] = {1, 0, 1, 2, 0,
+                                                       0, 0, 0, 0};
+
+static FILE *trace_file = NULL;
+static char *trace_file_buf = NULL;
+
+const char *trace_op_name(trace_op_t op) {
+
+  if (op >= TRACE_NUM_OPS) return "unknown";
+  return trace_op_names[op];
+
+}
+
+uint64_t trace_hash(const uint8_t *buf, size_t len) {
+
+  return XXH3_64bits(buf, len);
+
+}
+
+uint64_t trace_hash_file(const char *filename, size_t *len) {
+
+  *len = 0;
+
+  int fd = open(filename, O_RDONLY);
+  if (unlikely(fd < 0)) return 0;
+
+  struct stat info;
+  if (unlikely(fstat(fd, &info) != 0)) {
+
+    close(fd);
+    return 0;
+
+  }
+
+  *len = info.st_size;
+  if (*len == 0) {
+
+    close(fd);
+    return trace_hash(NULL, 0);
+
+  }
+
+  uint8_t *buf = (uint8_t *)mmap(0, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (unlikely(buf == MAP_FAILED)) return 0;
+
+  uint64_t hash = trace_hash(buf, *len);
+  munmap(buf, *len);
+
+  return hash;
+
+}
+
+// Traces are only replayed with the grammar that they are recorded with
+static uint64_t trace_grammar_hash() {
+
+  XXH3_state_t state;
+  XXH3_64bits_reset(&state);
+
+  for (size_t i = 0; i < NUM_NODE_TYPES; ++i) {
+
+    const char *name = node_type_str(i);
+    XXH3_64bits_update(&state, name, strlen(name) + 1);
+    XXH3_64bits_update(&state, &node_num_rules[i], sizeof(node_num_rules[i]));
+
+  }
+
+  return XXH3_64bits_digest(&state);
+
+}
+
+static inline size_t trace_put_varint(uint8_t *buf, uint64_t val) {
+
+  size_t len = 0;
+  while (val >= 0x80) {
+
+    buf[len++] = (uint8_t)(val | 0x80);
+    val >>= 7;
+
+  }
+
+  buf[len++] = (uint8_t)val;
+  return len;
+
+}
+
+bool trace_start(const char *filename) {
+
+  trace_stop();
+
+  trace_file = fopen(filename, "wb");
+  if (!trace_file) {
+
+    perror("Cannot create the trace file (trace_start)");
+    return false;
+
+  }
+
+  // Most calls only copy a few bytes into the buffer
+  trace_file_buf = malloc(TRACE_BUF_SIZE);
+  if (trace_file_buf)
+    setvbuf(trace_file, trace_file_buf, _IOFBF, TRACE_BUF_SIZE);
+
+  uint8_t  header[TRACE_MAGIC_LEN + 1 + 8];
+  uint64_t grammar_hash = trace_grammar_hash();
+  memcpy(header, TRACE_MAGIC, TRACE_MAGIC_LEN);
+  header[TRACE_MAGIC_LEN] = TRACE_VERSION;
+  for (int i = 0; i < 8; ++i)
+    header[TRACE_MAGIC_LEN + 1 + i] = (uint8_t)(grammar_hash >> (8 * i));
+
+  if (fwrite(header, sizeof(header), 1, trace_file) != 1) {
+
+    perror("Cannot write the trace file (trace_start)");
+    trace_stop();
+    return false;
+
+  }
+
+  return true;
+
+}
+
+void trace_stop() {
+
+  if (trace_file) fclose(trace_file);
+  trace_file = NULL;
+
+  free(trace_file_buf);
+  trace_file_buf = NULL;
+
+}
+
+bool trace_is_recording() {
+
+  return trace_file != NULL;
+
+}
+
+void trace_write(const trace_record_t *record) {
+
+  if (!trace_file || record->op >= TRACE_NUM_OPS) return;
+
+  uint8_t buf[1 + 10 * (1 + TRACE_MAX_ARGS)];
+  size_t  len = 0;
+
+  buf[len++] = (uint8_t)record->op;
+  len += trace_put_varint(buf + len, record->time_ns);
+  for (uint8_t i = 0; i < trace_num_args[record->op]; ++i)
+    len += trace_put_varint(buf + len, record->args[i]);
+
+  fwrite(buf, 1, len, trace_file);
+
+  for (uint8_t i = 0; i < trace_num_strs[record->op]; ++i) {
+
+    const char *str = record->strs[i];
+    size_t      str_len = str ? strlen(str) : 0;
+    len = trace_put_varint(buf, str ? str_len + 1 : 0);
+    fwrite(buf, 1, len, trace_file);
+    if (str_len) fwrite(str, 1, str_len, trace_file);
+
+  }
+
+}
+
+trace_reader_t *trace_reader_open(const char *filename) {
+
+  FILE *file = fopen(filename, "rb");
+  if (!file) {
+
+    perror("Cannot open the trace file (trace_reader_open)");
+    return NULL;
+
+  }
+
+  uint8_t header[TRACE_MAGIC_LEN + 1 + 8];
+  if (fread(header, sizeof(header), 1, file) != 1 ||
+      memcmp(header, TRACE_MAGIC, TRACE_MAGIC_LEN) != 0 ||
+      header[TRACE_MAGIC_LEN] != TRACE_VERSION) {
+
+    fprintf(stderr, "Not a trace file: %s\n", filename);
+    fclose(file);
+    return NULL;
+
+  }
+
+  uint64_t grammar_hash = 0;
+  for (int i = 0; i < 8; ++i)
+    grammar_hash |= (uint64_t)header[TRACE_MAGIC_LEN + 1 + i] << (8 * i);
+  if (grammar_hash != trace_grammar_hash()) {
+
+    fprintf(stderr, "The trace is recorded with another grammar: %s\n",
+            filename);
+    fclose(file);
+    return NULL;
+
+  }
+
+  trace_reader_t *reader = calloc(1, sizeof(trace_reader_t));
+  if (!reader) {
+
+    fclose(file);
+    return NULL;
+
+  }
+
+  reader->file = file;
+  return reader;
+
+}
+
+static bool trace_get_varint(FILE *file, uint64_t *val) {
+
+  *val = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+
+    int c = getc_unlocked(file);
+    if (c == EOF) return false;
+
+    *val |= (uint64_t)(c & 0x7f) << shift;
+    if (!(c & 0x80)) return true;
+
+  }
+
+  return false;
+
+}
+
+bool trace_read(trace_reader_t *reader, trace_record_t *record) {
+
+  int c = getc_unlocked(reader->file);
+  if (c == EOF || c >= TRACE_NUM_OPS) return false;
+
+  memset(record, 0, sizeof(trace_record_t));
+  record->op = (trace_op_t)c;
+
+  if (!trace_get_varint(reader->file, &record->time_ns)) return false;
+  for (uint8_t i = 0; i < trace_num_args[record->op]; ++i) {
+
+    if (!trace_get_varint(reader->file, &record->args[i])) return false;
+
+  }
+
+  for (uint8_t i = 0; i < trace_num_strs[record->op]; ++i) {
+
+    uint64_t len;
+    if (!trace_get_varint(reader->file, &len)) return false;
+    if (len == 0) continue;  // NULL
+
+    // Keep the buffer for the next records
+    if (len > reader->str_sizes[i]) {
+
+      char *str = realloc(reader->strs[i], len);
+      if (!str) return false;
+      reader->strs[i] = str;
+      reader->str_sizes[i] = len;
+
+    }
+
+    if (len > 1 && fread(reader->strs[i], len - 1, 1, reader->file) != 1)
+      return false;
+    reader->strs[i][len - 1] = '\0';
+    record->strs[i] = reader->strs[i];
+
+  }
+
+  return true;
+
+}
+
+void trace_reader_close(trace_reader_t *reader) {
+
+  if (!reader) return;
+
+  fclose(reader->file);
+  for (int i = 0; i < TRACE_MAX_STRS; ++i)
+    free(reader->strs[i]);
+  free(reader);
+
+}
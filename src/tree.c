@@ -21,10 +21,42 @@
 #include <sys/mman.h>
 
 #include "tree.h"
+#include "probes.h"
+#include "stats.h"
+#include "thread_pool.h"
 #include "utils.h"
 
 #define TREE_BUF_PREALLOC_SIZE (64)
 
+// Parallel rendering (see `tree_set_parallel_render`). Each worker thread gets
+// a few chunks, so that one large subtree does not stall the others.
+#define TREE_RENDER_CHUNKS_PER_THREAD (4)
+#define TREE_RENDER_MIN_CHUNK_SIZE (64 * 1024)
+
+// The weights of node types (see `node_set_type_weights`)
+static uint32_t *node_type_weights = NULL;
+static size_t    node_num_type_weights = 0;
+
+static size_t         parallel_render_threshold = 0;
+static size_t         parallel_render_num_threads = 0;
+static thread_pool_t *render_pool = NULL;
+
+typedef struct render_chunk {
+
+  node_t *node;
+  size_t  offset;  // the position of the subtree in the output buffer
+
+} render_chunk_t;
+
+typedef struct render_task {
+
+  uint8_t *       buf;
+  size_t          max_size;
+  render_chunk_t *chunks;
+  size_t          num_chunks;
+
+} render_task_t;
+
 node_t *node_create(uint32_t id) {
 
   node_t *node = calloc(1, sizeof(node_t));
@@ -39,6 +71,7 @@ node_t *node_create(uint32_t id) {
   node->recursion_edge_size = 0;
   if (id != 0) {  // "0" means the terminal node
     node->non_term_size = 1;
+    node->weight_sum = node_get_type_weight(id);
 
   }
 
@@ -118,6 +151,8 @@ void node_free(node_t *node) {
 
   node->recursion_edge_size = 0;
   node->non_term_size = 0;
+  node->data_len = 0;
+  node->weight_sum = 0;
 
   // val buf
   if (node->val_buf) {
@@ -214,6 +249,8 @@ node_t *node_clone(node_t *node) {
 
   new_node->recursion_edge_size = node->recursion_edge_size;
   new_node->non_term_size = node->non_term_size;
+  new_node->data_len = node->data_len;
+  new_node->weight_sum = node->weight_sum;
 
   // val
   node_set_val(new_node, node->val_buf, node->val_len);
@@ -270,6 +307,8 @@ void node_get_size(node_t *node) {
     // terminal node
     node->non_term_size = 0;
     node->recursion_edge_size = 0;
+    node->data_len = node->val_len;
+    node->weight_sum = 0;
 
     return;
 
@@ -277,6 +316,8 @@ void node_get_size(node_t *node) {
 
   node->non_term_size = 1;
   node->recursion_edge_size = 0;
+  node->data_len = 0;
+  node->weight_sum = node_get_type_weight(node->id);
 
   node_t *subnode = NULL;
   for (uint32_t i = 0; i < node->subnode_count; ++i) {
@@ -295,9 +336,14 @@ void node_get_size(node_t *node) {
 
     node->recursion_edge_size += subnode->recursion_edge_size;
     node->non_term_size += subnode->non_term_size;
+    node->data_len += subnode->data_len;
+    node->weight_sum += subnode->weight_sum;
 
   }
 
+  // Same as `_node_to_buf`, a node without subnodes is dumped as its value
+  if (node->subnode_count == 0) node->data_len = node->val_len;
+
 }
 
 bool node_replace_subnode(node_t *root, node_t *subnode, node_t *new_subnode) {
@@ -361,6 +407,84 @@ node_t *node_pick_non_term_subnode(node_t *node) {
 
 }
 
+node_t *node_pick_weighted_non_term_subnode(node_t *node) {
+
+  if (!node || node->id == 0) return NULL;
+
+  // Fall back to the uniform picking if nothing has a weight
+  if (unlikely(node->weight_sum == 0)) return node_pick_non_term_subnode(node);
+
+  // Walk down with the same random number: the subnodes come first, and the
+  // rest of the weight sum belongs to the node itself
+  uint64_t prob = random_below64(node->weight_sum);
+  while (true) {
+
+    node_t *next = NULL;
+    for (uint32_t i = 0; i < node->subnode_count; ++i) {
+
+      node_t *subnode = node->subnodes[i];
+
+      // `subnode` may be NULL due to parsing errors
+      if (unlikely(!subnode) || subnode->id == 0) continue;
+
+      if (prob < subnode->weight_sum) {
+
+        next = subnode;
+        break;
+
+      }
+
+      prob -= subnode->weight_sum;
+
+    }
+
+    if (!next) return node;
+    node = next;
+
+  }
+
+}
+
+void node_set_type_weights(const uint32_t *weights, size_t num_types) {
+
+  // Parsing threads may be creating nodes, so that the weights are updated in
+  // place (see `node_weights_update`)
+  if (weights && num_types == node_num_type_weights) {
+
+    for (size_t i = 0; i < num_types; ++i)
+      __atomic_store_n(&node_type_weights[i], weights[i], __ATOMIC_RELAXED);
+    return;
+
+  }
+
+  free(node_type_weights);
+  node_type_weights = NULL;
+  node_num_type_weights = 0;
+
+  if (!weights || num_types == 0) return;
+
+  node_type_weights = malloc(num_types * sizeof(uint32_t));
+  if (!node_type_weights) {
+
+    perror("node_set_type_weights (malloc)");
+    return;
+
+  }
+
+  memcpy(node_type_weights, weights, num_types * sizeof(uint32_t));
+  node_num_type_weights = num_types;
+
+}
+
+inline uint32_t node_get_type_weight(uint32_t id) {
+
+  if (id == 0) return 0;
+  if (id < node_num_type_weights)
+    return __atomic_load_n(&node_type_weights[id], __ATOMIC_RELAXED);
+  return NODE_WEIGHT_ONE;
+
+}
+
 edge_t node_pick_recursion_edge(node_t *node) {
 
   edge_t ret = {NULL, NULL, 0};
@@ -470,6 +594,33 @@ void _node_to_buf(tree_t *tree, node_t *node) {
 
 }
 
+static size_t _node_render_to_buf(node_t *node, uint8_t *buf,
+                                  size_t max_size) {
+
+  if (!node || max_size == 0) return 0;
+
+  // dump `val` if this is a leaf node
+  if (node->subnode_count == 0) {
+
+    size_t len = node->val_len <= max_size ? node->val_len : max_size;
+    if (len) memcpy(buf, node->val_buf, len);
+    return len;
+
+  }
+
+  // subnodes
+  size_t written = 0;
+  for (uint32_t i = 0; i < node->subnode_count && written < max_size; ++i) {
+
+    written += _node_render_to_buf(node->subnodes[i], buf + written,
+                                   max_size - written);
+
+  }
+
+  return written;
+
+}
+
 void _node_get_recursion_edges(tree_t *tree, node_t *node) {
 
   if (!tree || !node) return;
@@ -606,6 +757,18 @@ node_t *_node_deserialize(const uint8_t *data_buf, size_t data_size,
   memcpy(&(node->val_len), data_buf + ser_len, sizeof(node->val_len));
   ser_len += sizeof(node->val_len);
 
+  // Reject corrupted lengths before reading past the buffer or allocating
+  // for subnodes that cannot exist
+  if (node->val_len > data_size - ser_len ||
+      node->subnode_count > (data_size - ser_len - node->val_len) / min_len) {
+
+    // No subnode has been allocated yet
+    node->subnode_count = 0;
+    node_free(node);
+    return NULL;
+
+  }
+
   // - `val_buf`
   node_set_val(node, (data_buf + ser_len), node->val_len);
   ser_len += node->val_len;
@@ -694,6 +857,8 @@ void tree_free(tree_t *tree) {
 
 void tree_to_buf(tree_t *tree) {
 
+  STATS_PROFILE(STATS_PROFILE_TREE_TO_BUF);
+
   if (!tree) return;
 
   maybe_grow(BUF_PARAMS(tree, data), TREE_BUF_PREALLOC_SIZE);
@@ -703,6 +868,186 @@ void tree_to_buf(tree_t *tree) {
 
 }
 
+static void _render_task_run(void *arg) {
+
+  render_task_t * task = (render_task_t *)arg;
+  render_chunk_t *chunk = NULL;
+  size_t          len;
+
+  for (size_t i = 0; i < task->num_chunks; ++i) {
+
+    chunk = &task->chunks[i];
+
+    // Never write across the boundary of the chunk, which belongs to others
+    len = task->max_size - chunk->offset;
+    if (chunk->node->data_len < len) len = chunk->node->data_len;
+    _node_render_to_buf(chunk->node, task->buf + chunk->offset, len);
+
+  }
+
+}
+
+/**
+ * Split the tree into disjoint subtrees, whose lengths are at most
+ * `chunk_size` unless they are leaf nodes. The position of each subtree in the
+ * output is the prefix sum of the cached lengths of its preceding siblings.
+ * Subtrees are visited with an explicit stack, as trees can be very deep.
+ */
+static render_chunk_t *_tree_split_render_chunks(node_t *root, size_t max_size,
+                                                 size_t  chunk_size,
+                                                 size_t *num_chunks) {
+
+  render_chunk_t *chunks = NULL, *stack = NULL;
+  size_t          chunks_size = 0, stack_size = 0;
+  size_t          chunks_len = 0, stack_len = 0;
+  render_chunk_t  cur;
+
+  if (!maybe_grow((void **)&stack, &stack_size, sizeof(render_chunk_t)))
+    goto error;
+  stack[stack_len++] = (render_chunk_t){root, 0};
+
+  while (stack_len) {
+
+    cur = stack[--stack_len];
+    if (cur.offset >= max_size || cur.node->data_len == 0) continue;
+
+    if (cur.node->data_len <= chunk_size || cur.node->subnode_count == 0) {
+
+      if (!maybe_grow((void **)&chunks, &chunks_size,
+                      (chunks_len + 1) * sizeof(render_chunk_t)))
+        goto error;
+      chunks[chunks_len++] = cur;
+      continue;
+
+    }
+
+    // Push subnodes in the reverse order, so that chunks are sorted by offset
+    if (!maybe_grow((void **)&stack, &stack_size,
+                    (stack_len + cur.node->subnode_count) *
+                        sizeof(render_chunk_t)))
+      goto error;
+
+    size_t  end = cur.offset + cur.node->data_len;
+    node_t *subnode = NULL;
+    for (uint32_t i = cur.node->subnode_count; i > 0; --i) {
+
+      subnode = cur.node->subnodes[i - 1];
+      if (unlikely(!subnode)) continue;
+
+      end -= subnode->data_len;
+      stack[stack_len++] = (render_chunk_t){subnode, end};
+
+    }
+
+  }
+
+  free(stack);
+  *num_chunks = chunks_len;
+  return chunks;
+
+error:
+  perror("tree render chunk allocation (maybe_grow)");
+  free(stack);
+  free(chunks);
+  return NULL;
+
+}
+
+static bool _tree_render_parallel(tree_t *tree, uint8_t *buf,
+                                  size_t max_size) {
+
+  if (!render_pool) {
+
+    render_pool = thread_pool_create(parallel_render_num_threads);
+    if (!render_pool) return false;
+
+  }
+
+  size_t num_threads = thread_pool_get_num_threads(render_pool);
+  size_t chunk_size = max_size / (num_threads * TREE_RENDER_CHUNKS_PER_THREAD);
+  if (chunk_size < TREE_RENDER_MIN_CHUNK_SIZE)
+    chunk_size = TREE_RENDER_MIN_CHUNK_SIZE;
+
+  size_t          num_chunks = 0;
+  render_chunk_t *chunks =
+      _tree_split_render_chunks(tree->root, max_size, chunk_size, &num_chunks);
+  if (!chunks) return false;
+
+  render_task_t *tasks = calloc(num_threads, sizeof(render_task_t));
+  if (!tasks) {
+
+    perror("tree render task allocation (calloc)");
+    free(chunks);
+    return false;
+
+  }
+
+  // Assign consecutive chunks to each thread with a similar number of bytes
+  size_t bytes_per_task = max_size / num_threads + 1;
+  size_t num_tasks = 0, first = 0;
+  for (size_t i = 0; i < num_chunks; ++i) {
+
+    // The last task takes all remaining chunks
+    if (i + 1 < num_chunks &&
+        (num_tasks + 1 == num_threads ||
+         chunks[i + 1].offset < (num_tasks + 1) * bytes_per_task))
+      continue;
+
+    tasks[num_tasks] =
+        (render_task_t){buf, max_size, chunks + first, i + 1 - first};
+    first = i + 1;
+    ++num_tasks;
+
+  }
+
+  for (size_t i = 0; i < num_tasks; ++i) {
+
+    if (!thread_pool_submit(render_pool, _render_task_run, &tasks[i]))
+      _render_task_run(&tasks[i]);
+
+  }
+
+  thread_pool_wait(render_pool);
+
+  free(tasks);
+  free(chunks);
+  return true;
+
+}
+
+size_t tree_render_to_buf(tree_t *tree, uint8_t *buf, size_t max_size) {
+
+  STATS_PROFILE(STATS_PROFILE_TREE_TO_BUF);
+
+  if (!tree || !buf) return 0;
+
+  size_t data_len = tree_get_data_len(tree);
+  if (data_len < max_size) max_size = data_len;
+
+  if (parallel_render_threshold && max_size >= parallel_render_threshold &&
+      parallel_render_num_threads > 1 &&
+      _tree_render_parallel(tree, buf, max_size))
+    return max_size;
+
+  return _node_render_to_buf(tree->root, buf, max_size);
+
+}
+
+void tree_set_parallel_render(size_t threshold, size_t num_threads) {
+
+  if (render_pool && (threshold == 0 ||
+                      num_threads != parallel_render_num_threads)) {
+
+    thread_pool_free(render_pool);
+    render_pool = NULL;
+
+  }
+
+  parallel_render_threshold = threshold;
+  parallel_render_num_threads = num_threads;
+
+}
+
 void tree_serialize(tree_t *tree) {
 
   if (!tree) return;
@@ -716,6 +1061,8 @@ void tree_serialize(tree_t *tree) {
 
 tree_t *tree_deserialize(const uint8_t *data_buf, size_t data_size) {
 
+  STATS_PROFILE(STATS_PROFILE_TREE_DESERIALIZE);
+
   size_t  consumed_size = 0;
   node_t *root = _node_deserialize(data_buf, data_size, &consumed_size);
   if (!root) return NULL;
@@ -734,6 +1081,8 @@ tree_t *tree_deserialize(const uint8_t *data_buf, size_t data_size) {
 
 tree_t *tree_clone(tree_t *tree) {
 
+  STATS_PROFILE(STATS_PROFILE_TREE_CLONE);
+
   tree_t *new_tree = tree_create();
   new_tree->root = node_clone(tree->root);
 
@@ -756,12 +1105,41 @@ inline bool tree_equal(tree_t *tree_a, tree_t *tree_b) {
 
 inline size_t tree_get_size(tree_t *tree) {
 
-  if (tree->root->id == 0) return 0;
+  STATS_PROFILE(STATS_PROFILE_TREE_GET_SIZE);
+
   node_get_size(tree->root);
+  if (tree->root->id == 0) return 0;
   return tree->root->non_term_size;
 
 }
 
+inline size_t tree_get_data_len(tree_t *tree) {
+
+  if (!tree || !tree->root) return 0;
+  return tree->root->data_len;
+
+}
+
+static size_t _node_get_mem_size(node_t *node) {
+
+  if (!node) return 0;
+
+  size_t mem_size = sizeof(node_t) + node->val_size +
+                    node->subnode_count * sizeof(node_t *);
+  for (uint32_t i = 0; i < node->subnode_count; ++i)
+    mem_size += _node_get_mem_size(node->subnodes[i]);
+
+  return mem_size;
+
+}
+
+size_t tree_get_mem_size(tree_t *tree) {
+
+  if (!tree) return 0;
+  return _node_get_mem_size(tree->root);
+
+}
+
 void tree_get_recursion_edges(tree_t *tree) {
 
   if (!tree) return;
@@ -815,7 +1193,11 @@ tree_t *read_tree_from_file(const char *filename) {
   close(fd);
 
   // Deserialize the data to recover the tree
+  PROBE1(deserialize__start, tree_file_size);
+  uint64_t start = stats_cycles();
   tree = tree_deserialize(tree_buf, tree_file_size);
+  stats_add_load(STATS_DESERIALIZE, stats_cycles() - start, tree != NULL);
+  PROBE2(deserialize__done, tree_file_size, tree ? (int)tree->root->id : -1);
   munmap(tree_buf, tree_file_size);
   if (unlikely(!tree)) {
 
@@ -858,7 +1240,11 @@ tree_t *load_tree_from_test_case(const char *filename) {
   close(fd);
 
   // Deserialize the data to recover the tree
+  PROBE1(parse__start, file_size);
+  uint64_t start = stats_cycles();
   tree = tree_from_buf(buf, file_size);
+  stats_add_load(STATS_PARSE, stats_cycles() - start, tree != NULL);
+  PROBE2(parse__done, file_size, tree ? (int)tree->root->id : -1);
   munmap(buf, file_size);
   if (unlikely(!tree)) {
 
@@ -873,8 +1259,12 @@ tree_t *load_tree_from_test_case(const char *filename) {
 
 void write_tree_to_file(tree_t *tree, const char *filename) {
 
+  STATS_PROFILE(STATS_PROFILE_WRITE_TREE_TO_FILE);
+
   int fd, ret;
 
+  PROBE2(write_tree__start, filename, tree->root->non_term_size);
+
   // Serialize the tree
   tree_serialize(tree);
 
@@ -883,6 +1273,7 @@ void write_tree_to_file(tree_t *tree, const char *filename) {
   if (unlikely(fd < 0)) {
 
     perror("Unable to create the file (write_tree_to_file)");
+    PROBE2(write_tree__done, tree->ser_len, false);
     return;
 
   }
@@ -892,6 +1283,7 @@ void write_tree_to_file(tree_t *tree, const char *filename) {
   if (unlikely(ret < 0)) {
 
     perror("Unable to write (write_tree_to_file)");
+    PROBE2(write_tree__done, tree->ser_len, false);
     return;
 
   }
@@ -899,12 +1291,15 @@ void write_tree_to_file(tree_t *tree, const char *filename) {
   if (unlikely((size_t)ret != tree->ser_len)) {
 
     perror("Short write to tree file (write_tree_to_file)");
+    PROBE2(write_tree__done, tree->ser_len, false);
     return;
 
   }
 
   close(fd);
 
+  PROBE2(write_tree__done, tree->ser_len, true);
+
 }
 
 void dump_tree_to_test_case(tree_t *tree, const char *filename) {
@@ -0,0 +1,119 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include "map.h"
+#include "tree_cache.h"
+
+typedef struct tree_cache_entry {
+
+  tree_t *tree;
+  size_t  mem_size;
+
+} tree_cache_entry_t;
+
+typedef map_t(tree_cache_entry_t) tree_cache_map_t;
+
+static tree_cache_map_t tree_cache;
+static size_t           tree_cache_max_mem_size = 0;
+static size_t           tree_cache_mem_size = 0;
+static size_t           tree_cache_num_trees = 0;
+
+void tree_cache_init(size_t max_mem_size) {
+
+  map_init(&tree_cache);
+  tree_cache_max_mem_size = max_mem_size;
+  tree_cache_mem_size = 0;
+  tree_cache_num_trees = 0;
+
+}
+
+bool tree_cache_put(const char *name, tree_t *tree) {
+
+  if (!name || !tree || !tree->root) return false;
+
+  // Never keep a stale copy around, even if the new tree does not fit
+  tree_cache_remove(name);
+
+  if (tree_cache_max_mem_size == 0) return false;
+
+  size_t mem_size = tree_get_mem_size(tree);
+  if (tree_cache_mem_size + mem_size > tree_cache_max_mem_size) return false;
+
+  tree_cache_entry_t entry = {.tree = tree, .mem_size = mem_size};
+  if (map_set(&tree_cache, name, entry) != 0) return false;
+
+  tree_cache_mem_size += mem_size;
+  ++tree_cache_num_trees;
+
+  return true;
+
+}
+
+tree_t *tree_cache_get(const char *name) {
+
+  if (!name || tree_cache_num_trees == 0) return NULL;
+
+  tree_cache_entry_t *entry = map_get(&tree_cache, name);
+  if (!entry) return NULL;
+
+  return tree_clone(entry->tree);
+
+}
+
+void tree_cache_remove(const char *name) {
+
+  if (!name || tree_cache_num_trees == 0) return;
+
+  tree_cache_entry_t *entry = map_get(&tree_cache, name);
+  if (!entry) return;
+
+  tree_free(entry->tree);
+  tree_cache_mem_size -= entry->mem_size;
+  --tree_cache_num_trees;
+
+  map_remove(&tree_cache, name);
+
+}
+
+inline size_t tree_cache_get_num_trees() {
+
+  return tree_cache_num_trees;
+
+}
+
+inline size_t tree_cache_get_mem_size() {
+
+  return tree_cache_mem_size;
+
+}
+
+void tree_cache_clear() {
+
+  const char *key;
+  map_iter_t  iter = map_iter(&tree_cache);
+  while ((key = map_next(&tree_cache, &iter))) {
+
+    tree_free(map_get(&tree_cache, key)->tree);
+
+  }
+
+  map_deinit(&tree_cache);
+  tree_cache_mem_size = 0;
+  tree_cache_num_trees = 0;
+
+}
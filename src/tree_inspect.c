@@ -0,0 +1,765 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "f1_c_fuzz.h"
+#include "list.h"
+#include "thread_pool.h"
+#include "tree.h"
+
+#define NUM_NODE_TYPES (sizeof(node_num_rules) / sizeof(node_num_rules[0]))
+
+// The default number of steps of the random, random recursive and splicing
+// mutations, same as the grammar mutator
+#define INSPECT_DEFAULT_STEPS (1000)
+
+// The set of subtree hashes is split into shards, each with its own lock
+#define INSPECT_NUM_SHARDS (64)
+#define INSPECT_SHARD_INIT_CAP (1024)
+
+typedef struct inspect_tree {
+
+  const char *filename;
+  bool        ok;
+
+  size_t file_size;
+  size_t non_term_size;
+  size_t term_size;
+  size_t depth;
+  size_t data_len;
+  size_t recursion_edges;
+  size_t rules_steps;  // the steps of the deterministic rules mutation
+  size_t steps;        // the steps of all mutations
+  double cost;         // the estimated cost of fuzzing this tree once
+
+} inspect_tree_t;
+
+typedef struct inspect_counts {
+
+  size_t *type_nodes;     // the number of nodes of each type
+  size_t *type_distinct;  // the number of distinct subtrees of each type
+  size_t *rule_nodes;     // the number of nodes of each (type, rule) pair
+
+} inspect_counts_t;
+
+typedef struct inspect_shard {
+
+  pthread_mutex_t lock;
+  uint64_t *      slots;  // open addressing, 0 marks an empty slot
+  size_t          cap;
+  size_t          size;
+
+} inspect_shard_t;
+
+typedef struct inspect_ctx {
+
+  inspect_tree_t *trees;
+  size_t          num_trees;
+  size_t          next_tree;  // the next tree to inspect, taken atomically
+
+  size_t steps_per_tree;  // the steps of all non-deterministic mutations
+  size_t recursive_steps;
+
+  pthread_mutex_t  lock;
+  inspect_counts_t counts;  // merged counts of all worker threads
+
+  inspect_shard_t shards[INSPECT_NUM_SHARDS];
+
+} inspect_ctx_t;
+
+// The state of walking through one tree
+typedef struct inspect_walk {
+
+  inspect_ctx_t *   ctx;
+  inspect_counts_t *counts;
+  size_t            term_size;
+  size_t            depth;
+  size_t            rules_steps;
+
+} inspect_walk_t;
+
+static size_t rule_offsets[NUM_NODE_TYPES + 1];
+
+static double inspect_now() {
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+
+}
+
+static size_t inspect_env(const char *name, size_t default_val) {
+
+  const char *ptr = getenv(name);
+  if (!ptr) return default_val;
+  return strtoul(ptr, NULL, 10);
+
+}
+
+static bool inspect_counts_init(inspect_counts_t *counts) {
+
+  counts->type_nodes = calloc(NUM_NODE_TYPES, sizeof(size_t));
+  counts->type_distinct = calloc(NUM_NODE_TYPES, sizeof(size_t));
+  // The last entry counts rule ids out of range
+  counts->rule_nodes =
+      calloc(rule_offsets[NUM_NODE_TYPES] + 1, sizeof(size_t));
+  return counts->type_nodes && counts->type_distinct && counts->rule_nodes;
+
+}
+
+static void inspect_counts_free(inspect_counts_t *counts) {
+
+  free(counts->type_nodes);
+  free(counts->type_distinct);
+  free(counts->rule_nodes);
+
+}
+
+static inline uint64_t inspect_mix(uint64_t h, uint64_t v) {
+
+  h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+  return h * 0xff51afd7ed558ccdULL;
+
+}
+
+// Insert a subtree hash, and return whether it has not been seen before
+static bool inspect_set_insert(inspect_ctx_t *ctx, uint64_t hash) {
+
+  if (!hash) hash = 1;
+
+  inspect_shard_t *shard = &ctx->shards[hash >> 58];
+  bool             inserted = false;
+
+  pthread_mutex_lock(&shard->lock);
+
+  // Keep the load factor below 1/2
+  if ((shard->size + 1) * 2 > shard->cap) {
+
+    size_t    new_cap = shard->cap ? shard->cap * 2 : INSPECT_SHARD_INIT_CAP;
+    uint64_t *new_slots = calloc(new_cap, sizeof(uint64_t));
+    if (!new_slots) {
+
+      perror("tree_inspect (calloc)");
+      exit(EXIT_FAILURE);
+
+    }
+
+    for (size_t i = 0; i < shard->cap; ++i) {
+
+      if (!shard->slots[i]) continue;
+
+      size_t j = shard->slots[i] & (new_cap - 1);
+      while (new_slots[j])
+        j = (j + 1) & (new_cap - 1);
+      new_slots[j] = shard->slots[i];
+
+    }
+
+    free(shard->slots);
+    shard->slots = new_slots;
+    shard->cap = new_cap;
+
+  }
+
+  size_t i = hash & (shard->cap - 1);
+  while (shard->slots[i] && shard->slots[i] != hash)
+    i = (i + 1) & (shard->cap - 1);
+
+  if (!shard->slots[i]) {
+
+    shard->slots[i] = hash;
+    ++shard->size;
+    inserted = true;
+
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+
+  return inserted;
+
+}
+
+// Whether all node types of a subtree belong to this grammar, which is checked
+// before any node of the tree is counted
+static bool inspect_node_valid(node_t *node) {
+
+  if (node->id >= NUM_NODE_TYPES) return false;
+
+  for (uint32_t i = 0; i < node->subnode_count; ++i)
+    if (!inspect_node_valid(node->subnodes[i])) return false;
+
+  return true;
+
+}
+
+// Count the nodes of a valid subtree, and return its hash, which covers the
+// same fields as `node_equal`
+static uint64_t inspect_node(inspect_walk_t *walk, node_t *node,
+                             size_t depth) {
+
+  if (depth > walk->depth) walk->depth = depth;
+
+  uint64_t hash = inspect_mix(node->id, node->rule_id);
+
+  // FNV-1a of the attached value
+  uint64_t val_hash = 0xcbf29ce484222325ULL;
+  for (uint32_t i = 0; i < node->val_len; ++i)
+    val_hash = (val_hash ^ node->val_buf[i]) * 0x100000001b3ULL;
+  hash = inspect_mix(hash, val_hash);
+
+  for (uint32_t i = 0; i < node->subnode_count; ++i) {
+
+    uint64_t subnode_hash = inspect_node(walk, node->subnodes[i], depth + 1);
+    hash = inspect_mix(hash, subnode_hash);
+
+  }
+
+  ++walk->counts->type_nodes[node->id];
+
+  if (node->id == 0) {
+
+    ++walk->term_size;
+    return hash;
+
+  }
+
+  if (node->rule_id < node_num_rules[node->id]) {
+
+    ++walk->counts->rule_nodes[rule_offsets[node->id] + node->rule_id];
+
+  } else {
+
+    ++walk->counts->rule_nodes[rule_offsets[NUM_NODE_TYPES]];
+
+  }
+
+  // Same as `rules_mutation_count`
+  if (node_num_rules[node->id] > 0)
+    walk->rules_steps += node_num_rules[node->id] - 1;
+
+  // Only non-terminal subtrees can be spliced
+  if (inspect_set_insert(walk->ctx, hash))
+    ++walk->counts->type_distinct[node->id];
+
+  return hash;
+
+}
+
+static void inspect_file(inspect_ctx_t *ctx, inspect_tree_t *result,
+                         inspect_counts_t *counts) {
+
+  int fd = open(result->filename, O_RDONLY);
+  if (fd < 0) return;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+
+    close(fd);
+    return;
+
+  }
+
+  result->file_size = st.st_size;
+
+  void *buf = mmap(NULL, result->file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (buf == MAP_FAILED) return;
+
+  madvise(buf, result->file_size, MADV_SEQUENTIAL);
+  tree_t *tree = tree_deserialize(buf, result->file_size);
+  munmap(buf, result->file_size);
+
+  // A tree of another grammar is left out of the corpus-wide counts as well
+  if (!tree) return;
+  if (!tree->root || !inspect_node_valid(tree->root)) {
+
+    tree_free(tree);
+    return;
+
+  }
+
+  inspect_walk_t walk = {.ctx = ctx, .counts = counts};
+  inspect_node(&walk, tree->root, 1);
+
+  result->ok = true;
+  result->non_term_size = tree_get_size(tree);
+  result->term_size = walk.term_size;
+  result->depth = walk.depth;
+  result->data_len = tree_get_data_len(tree);
+  result->recursion_edges = tree->root->recursion_edge_size;
+  result->rules_steps = walk.rules_steps;
+
+  // Every step clones the tree and renders the mutated one
+  result->steps = walk.rules_steps + ctx->steps_per_tree;
+  if (result->recursion_edges > 0) result->steps += ctx->recursive_steps;
+  result->cost = (double)result->steps * (result->non_term_size +
+                                          result->term_size +
+                                          result->data_len);
+
+  tree_free(tree);
+
+}
+
+static void inspect_worker(void *arg) {
+
+  inspect_ctx_t *  ctx = (inspect_ctx_t *)arg;
+  inspect_counts_t counts;
+
+  if (!inspect_counts_init(&counts)) {
+
+    perror("tree_inspect (calloc)");
+    exit(EXIT_FAILURE);
+
+  }
+
+  while (true) {
+
+    size_t i = __atomic_fetch_add(&ctx->next_tree, 1, __ATOMIC_RELAXED);
+    if (i >= ctx->num_trees) break;
+
+    inspect_file(ctx, &ctx->trees[i], &counts);
+
+  }
+
+  pthread_mutex_lock(&ctx->lock);
+  for (size_t i = 0; i < NUM_NODE_TYPES; ++i) {
+
+    ctx->counts.type_nodes[i] += counts.type_nodes[i];
+    ctx->counts.type_distinct[i] += counts.type_distinct[i];
+
+  }
+
+  for (size_t i = 0; i <= rule_offsets[NUM_NODE_TYPES]; ++i)
+    ctx->counts.rule_nodes[i] += counts.rule_nodes[i];
+  pthread_mutex_unlock(&ctx->lock);
+
+  inspect_counts_free(&counts);
+
+}
+
+// Append a tree file, or all files in a trees folder
+static bool inspect_add_path(const char *path, list_t *filenames) {
+
+  struct stat st;
+  if (stat(path, &st) != 0) {
+
+    perror(path);
+    return false;
+
+  }
+
+  if (!S_ISDIR(st.st_mode)) {
+
+    list_append(filenames, strdup(path));
+    return true;
+
+  }
+
+  DIR *d = opendir(path);
+  if (!d) {
+
+    perror(path);
+    return false;
+
+  }
+
+  size_t         dir_len = strlen(path);
+  struct dirent *p;
+  while ((p = readdir(d))) {
+
+    // Skip hidden files, "." and ".."
+    if (p->d_name[0] == '.') continue;
+    if (p->d_type == DT_DIR) continue;
+
+    size_t len = dir_len + strlen(p->d_name) + 2;
+    char * filename = malloc(len);
+    if (!filename) {
+
+      perror("tree_inspect (malloc)");
+      closedir(d);
+      return false;
+
+    }
+
+    snprintf(filename, len, "%s/%s", path, p->d_name);
+    list_append(filenames, filename);
+
+  }
+
+  closedir(d);
+
+  return true;
+
+}
+
+static int compare_size(const void *a, const void *b) {
+
+  size_t x = *(const size_t *)a, y = *(const size_t *)b;
+  return (x > y) - (x < y);
+
+}
+
+static int compare_cost(const void *a, const void *b) {
+
+  double x = (*(inspect_tree_t *const *)a)->cost;
+  double y = (*(inspect_tree_t *const *)b)->cost;
+  return (x < y) - (x > y);
+
+}
+
+// Print the distribution of a per-tree field, e.g., `depth`
+static void print_distribution(const char *name, inspect_tree_t *trees,
+                               size_t num_trees, size_t field_offset,
+                               size_t *values) {
+
+  size_t n = 0;
+  double sum = 0;
+  for (size_t i = 0; i < num_trees; ++i) {
+
+    if (!trees[i].ok) continue;
+    values[n] = *(size_t *)((uint8_t *)&trees[i] + field_offset);
+    sum += values[n];
+    ++n;
+
+  }
+
+  if (!n) return;
+  qsort(values, n, sizeof(size_t), compare_size);
+
+  printf("%-18s %12zu %12zu %12zu %12zu %14.1f %16.0f\n", name, values[0],
+         values[(size_t)(0.5 * (n - 1))], values[(size_t)(0.99 * (n - 1))],
+         values[n - 1], sum / n, sum);
+
+}
+
+// Sort indices by `sort_counts[index]`, the highest count first
+static const size_t *sort_counts;
+
+static int compare_sort_counts(const void *a, const void *b) {
+
+  size_t x = sort_counts[*(const size_t *)a];
+  size_t y = sort_counts[*(const size_t *)b];
+  return (x < y) - (x > y);
+
+}
+
+static void print_histograms(inspect_counts_t *counts) {
+
+  size_t total_nodes = 0, total_subtrees = 0, total_distinct = 0;
+  for (size_t i = 0; i < NUM_NODE_TYPES; ++i) {
+
+    total_nodes += counts->type_nodes[i];
+    if (i == 0) continue;
+    total_subtrees += counts->type_nodes[i];
+    total_distinct += counts->type_distinct[i];
+
+  }
+
+  if (!total_nodes) return;
+
+  printf("\nsubtrees           : %zu non-terminal, %zu distinct, %.2f%% "
+         "duplicates\n",
+         total_subtrees, total_distinct,
+         total_subtrees
+             ? 100.0 * (total_subtrees - total_distinct) / total_subtrees
+             : 0.0);
+
+  size_t *order = malloc(
+      (NUM_NODE_TYPES + rule_offsets[NUM_NODE_TYPES]) * sizeof(size_t));
+  if (!order) return;
+
+  // Node types, the most frequent first
+  for (size_t i = 0; i < NUM_NODE_TYPES; ++i)
+    order[i] = i;
+  sort_counts = counts->type_nodes;
+  qsort(order, NUM_NODE_TYPES, sizeof(size_t), compare_sort_counts);
+
+  printf("\n%-24s %12s %8s %12s %10s\n", "node type", "nodes", "nodes%",
+         "distinct", "dup%");
+  for (size_t k = 0; k < NUM_NODE_TYPES; ++k) {
+
+    size_t i = order[k];
+    size_t n = counts->type_nodes[i];
+    if (!n) continue;
+
+    if (i == 0) {
+
+      printf("%-24s %12zu %7.2f%% %12s %10s\n", "(terminal)", n,
+             100.0 * n / total_nodes, "-", "-");
+      continue;
+
+    }
+
+    size_t d = counts->type_distinct[i];
+    printf("%-24s %12zu %7.2f%% %12zu %9.2f%%\n", node_type_str(i), n,
+           100.0 * n / total_nodes, d, 100.0 * (n - d) / n);
+
+  }
+
+  // Rules, the most frequent first
+  size_t num_rules = rule_offsets[NUM_NODE_TYPES];
+  for (size_t i = 0; i < num_rules; ++i)
+    order[i] = i;
+  sort_counts = counts->rule_nodes;
+  qsort(order, num_rules, sizeof(size_t), compare_sort_counts);
+
+  printf("\n%-24s %6s %12s %8s\n", "node type", "rule", "nodes", "type%");
+  for (size_t k = 0; k < num_rules; ++k) {
+
+    size_t i = order[k];
+    size_t n = counts->rule_nodes[i];
+    if (!n) break;
+
+    size_t type = 0;
+    while (rule_offsets[type + 1] <= i)
+      ++type;
+
+    printf("%-24s %6zu %12zu %7.2f%%\n", node_type_str(type),
+           i - rule_offsets[type], n, 100.0 * n / counts->type_nodes[type]);
+
+  }
+
+  if (counts->rule_nodes[num_rules])
+    printf("%-24s %6s %12zu\n", "(unknown rule)", "-",
+           counts->rule_nodes[num_rules]);
+
+  free(order);
+
+}
+
+static void print_top_costs(inspect_tree_t *trees, size_t num_trees,
+                            size_t num_ok, size_t top) {
+
+  inspect_tree_t **sorted = malloc(num_ok * sizeof(inspect_tree_t *));
+  if (!sorted) return;
+
+  size_t n = 0;
+  double total_cost = 0;
+  for (size_t i = 0; i < num_trees; ++i) {
+
+    if (!trees[i].ok) continue;
+    sorted[n++] = &trees[i];
+    total_cost += trees[i].cost;
+
+  }
+
+  qsort(sorted, n, sizeof(inspect_tree_t *), compare_cost);
+  if (top > n) top = n;
+
+  printf("\n%8s %10s %10s %8s %12s  %s\n", "cost%", "steps", "nodes", "depth",
+         "bytes", "tree");
+
+  double top_cost = 0;
+  for (size_t i = 0; i < top; ++i) {
+
+    inspect_tree_t *t = sorted[i];
+    top_cost += t->cost;
+    printf("%7.2f%% %10zu %10zu %8zu %12zu  %s\n",
+           total_cost > 0 ? 100.0 * t->cost / total_cost : 0.0, t->steps,
+           t->non_term_size + t->term_size, t->depth, t->data_len,
+           t->filename);
+
+  }
+
+  printf("The top %zu trees (%.2f%% of all trees) take %.2f%% of the "
+         "estimated mutation cost\n",
+         top, 100.0 * top / n, total_cost > 0 ? 100.0 * top_cost / total_cost
+                                              : 0.0);
+
+  free(sorted);
+
+}
+
+static void usage(const char *prog) {
+
+  printf(
+      "%s [-j <threads>] [-t <top>] <trees_dir or tree file>...\n"
+      "\n"
+      "Report node counts, depths, rendered sizes, node type and rule\n"
+      "histograms, recursion edges and duplicate subtrees of serialized\n"
+      "trees.\n"
+      "\n"
+      "  -j <threads>  the number of threads (default: the number of CPUs)\n"
+      "  -t <top>      list the <top> trees with the highest estimated\n"
+      "                mutation cost, i.e., the number of fuzzing steps times\n"
+      "                the size of the tree and its test case (default: 10)\n",
+      prog);
+
+}
+
+int main(int argc, char *argv[]) {
+
+  long   num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t num_threads = num_cpus > 0 ? num_cpus : 1;
+  size_t top = 10;
+  int    opt;
+
+  while ((opt = getopt(argc, argv, "j:t:h")) != -1) {
+
+    switch (opt) {
+
+      case 'j':
+        num_threads = strtoul(optarg, NULL, 10);
+        break;
+      case 't':
+        top = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return opt == 'h' ? 0 : EXIT_FAILURE;
+
+    }
+
+  }
+
+  if (optind >= argc) {
+
+    usage(argv[0]);
+    return 0;
+
+  }
+
+  for (size_t i = 0; i < NUM_NODE_TYPES; ++i)
+    rule_offsets[i + 1] = rule_offsets[i] + node_num_rules[i];
+
+  list_t *filenames = list_create();
+  for (int i = optind; i < argc; ++i) {
+
+    if (!inspect_add_path(argv[i], filenames)) return EXIT_FAILURE;
+
+  }
+
+  inspect_ctx_t *ctx = calloc(1, sizeof(inspect_ctx_t));
+  if (!ctx || !inspect_counts_init(&ctx->counts)) {
+
+    perror("tree_inspect (calloc)");
+    return EXIT_FAILURE;
+
+  }
+
+  ctx->num_trees = filenames->size;
+  ctx->trees = calloc(ctx->num_trees + 1, sizeof(inspect_tree_t));
+  if (!ctx->trees) {
+
+    perror("tree_inspect (calloc)");
+    return EXIT_FAILURE;
+
+  }
+
+  for (size_t i = 0; i < ctx->num_trees; ++i)
+    ctx->trees[i].filename = list_pop_front(filenames);
+
+  ctx->steps_per_tree =
+      inspect_env("RANDOM_MUTATION_STEPS", INSPECT_DEFAULT_STEPS) +
+      inspect_env("SPLICING_MUTATION_STEPS", INSPECT_DEFAULT_STEPS);
+  ctx->recursive_steps =
+      inspect_env("RANDOM_RECURSIVE_MUTATION_STEPS", INSPECT_DEFAULT_STEPS);
+
+  pthread_mutex_init(&ctx->lock, NULL);
+  for (size_t i = 0; i < INSPECT_NUM_SHARDS; ++i)
+    pthread_mutex_init(&ctx->shards[i].lock, NULL);
+
+  double start = inspect_now();
+
+  // Every worker thread takes trees one by one until all are inspected
+  thread_pool_t *pool = NULL;
+  if (num_threads > 1 && ctx->num_trees > 1)
+    pool = thread_pool_create(num_threads);
+
+  if (pool) {
+
+    for (size_t i = 0; i < num_threads; ++i)
+      thread_pool_submit(pool, inspect_worker, ctx);
+    thread_pool_free(pool);
+
+  } else {
+
+    inspect_worker(ctx);
+
+  }
+
+  double elapsed = inspect_now() - start;
+
+  size_t num_ok = 0, total_bytes = 0;
+  for (size_t i = 0; i < ctx->num_trees; ++i) {
+
+    total_bytes += ctx->trees[i].file_size;
+    if (ctx->trees[i].ok) ++num_ok;
+
+  }
+
+  printf("trees              : %zu (%zu unreadable), %.1f MB in %.2f s\n",
+         num_ok, ctx->num_trees - num_ok, total_bytes / (1024.0 * 1024.0),
+         elapsed);
+
+  size_t *values = malloc((ctx->num_trees + 1) * sizeof(size_t));
+  if (num_ok && values) {
+
+    printf("\n%-18s %12s %12s %12s %12s %14s %16s\n", "per tree", "min", "p50",
+           "p99", "max", "mean", "total");
+    print_distribution("non-terminals", ctx->trees, ctx->num_trees,
+                       offsetof(inspect_tree_t, non_term_size), values);
+    print_distribution("terminals", ctx->trees, ctx->num_trees,
+                       offsetof(inspect_tree_t, term_size), values);
+    print_distribution("depth", ctx->trees, ctx->num_trees,
+                       offsetof(inspect_tree_t, depth), values);
+    print_distribution("rendered bytes", ctx->trees, ctx->num_trees,
+                       offsetof(inspect_tree_t, data_len), values);
+    print_distribution("serialized bytes", ctx->trees, ctx->num_trees,
+                       offsetof(inspect_tree_t, file_size), values);
+    print_distribution("recursion edges", ctx->trees, ctx->num_trees,
+                       offsetof(inspect_tree_t, recursion_edges), values);
+    print_distribution("rules steps", ctx->trees, ctx->num_trees,
+                       offsetof(inspect_tree_t, rules_steps), values);
+
+    print_histograms(&ctx->counts);
+    if (top) print_top_costs(ctx->trees, ctx->num_trees, num_ok, top);
+
+  }
+
+  free(values);
+
+  for (size_t i = 0; i < INSPECT_NUM_SHARDS; ++i) {
+
+    free(ctx->shards[i].slots);
+    pthread_mutex_destroy(&ctx->shards[i].lock);
+
+  }
+
+  pthread_mutex_destroy(&ctx->lock);
+  inspect_counts_free(&ctx->counts);
+  for (size_t i = 0; i < ctx->num_trees; ++i)
+    free((char *)ctx->trees[i].filename);
+  free(ctx->trees);
+  free(ctx);
+  list_free(filenames);
+
+  return num_ok ? 0 : EXIT_FAILURE;
+
+}
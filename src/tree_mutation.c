@@ -19,23 +19,66 @@
 #include "tree_mutation.h"
 #include "f1_c_fuzz.h"
 #include "chunk_store.h"
+#include "coverage.h"
+#include "probes.h"
+#include "stats.h"
+#include "utils.h"
 
 static size_t max_tree_len = 1000;
 
+// the node type of the last mutation of this thread, or -1 if the tree was not
+// changed
+static THREAD_LOCAL int mutated_node_type = -1;
+
+// pick nodes by the weights of their types
+static bool weighted_pick = false;
+
+// only try the rare rules in the rules mutation
+static bool coverage_bias = false;
+
 void tree_set_max_len(size_t max_len) {
 
   max_tree_len = max_len;
 
 }
 
-tree_t *random_mutation(tree_t *tree) {
+void tree_set_weighted_pick(bool enabled) {
+
+  weighted_pick = enabled;
+
+}
+
+void tree_set_coverage_bias(bool enabled) {
+
+  coverage_bias = enabled;
+
+}
+
+static inline node_t *pick_non_term_subnode(node_t *root) {
+
+  if (weighted_pick) return node_pick_weighted_non_term_subnode(root);
+  return node_pick_non_term_subnode(root);
+
+}
+
+int tree_mutation_get_node_type() {
 
+  return mutated_node_type;
+
+}
+
+// Replace a random node of a clone of `tree` with a new subtree. If
+// `other_rule`, the new subtree is generated by another rule of the node, like
+// the rules mutation, but without touching `tree`.
+static tree_t *_random_mutation(tree_t *tree, bool other_rule) {
+
+  mutated_node_type = -1;
   if (unlikely(!tree)) return NULL;
 
   tree_t *mutated_tree = tree_clone(tree);
 
   // Randomly pick a node in the tree
-  node_t *node = node_pick_non_term_subnode(mutated_tree->root);
+  node_t *node = pick_non_term_subnode(mutated_tree->root);
   if (unlikely(node == NULL)) {
 
     // By design, _pick_non_term_node should not return NULL
@@ -45,11 +88,20 @@ tree_t *random_mutation(tree_t *tree) {
   }
 
   node_t *parent = node->parent;
+  PROBE2(random_mutation, node->id, node->non_term_size);
+  mutated_node_type = node->id;
+
+  int rule_id = -1;
+  if (other_rule && node_num_rules[node->id] > 1) {
+
+    rule_id = random_below(node_num_rules[node->id] - 1);
+    if ((uint32_t)rule_id >= node->rule_id) ++rule_id;
+
+  }
 
   // Generate a new node
-  gen_func_t gen_func = gen_funcs[node->id];
-  int        consumed = 0;
-  node_t *   replace_node = gen_func(max_tree_len, &consumed, -1);
+  int     consumed = 0;
+  node_t *replace_node = gen_node(node->id, max_tree_len, &consumed, rule_id);
 
   if (!parent) {  // no parent, meaning that the picked node is the root node
     // Destroy the original root node
@@ -74,8 +126,19 @@ tree_t *random_mutation(tree_t *tree) {
 
 }
 
+tree_t *random_mutation(tree_t *tree) {
+
+  STATS_PROFILE(STATS_PROFILE_RANDOM_MUTATION);
+
+  return _random_mutation(tree, false);
+
+}
+
 tree_t *rules_mutation(tree_t *tree, node_t *node, uint32_t rule_id) {
 
+  STATS_PROFILE(STATS_PROFILE_RULES_MUTATION);
+
+  mutated_node_type = -1;
   if (unlikely(!tree)) return NULL;
   if (unlikely(!node)) return NULL;
   if (unlikely(node->id == 0)) return NULL;
@@ -86,11 +149,12 @@ tree_t *rules_mutation(tree_t *tree, node_t *node, uint32_t rule_id) {
 
   tree_t *mutated_tree = NULL;
   node_t *parent = node->parent;
+  PROBE2(rules_mutation, node->id, rule_id);
+  mutated_node_type = node->id;
 
   // Generate a new node
-  gen_func_t gen_func = gen_funcs[node->id];
-  int        consumed = 0;
-  node_t *   replace_node = gen_func(max_tree_len, &consumed, rule_id);
+  int     consumed = 0;
+  node_t *replace_node = gen_node(node->id, max_tree_len, &consumed, rule_id);
 
   if (!parent) {
 
@@ -128,6 +192,13 @@ size_t _node_rules_mutation_count(node_t *node) {
   if (unlikely(node_num_rules[node->id] <= 0)) return 0;
 
   size_t ret = node_num_rules[node->id] - 1;
+  if (coverage_bias) {
+
+    ret = 0;
+    for (uint32_t i = 0; i < node_num_rules[node->id]; ++i)
+      if (rules_mutation_tries(node, i)) ++ret;
+
+  }
 
   node_t *subnode;
   for (size_t i = 0; i < node->subnode_count; ++i) {
@@ -148,8 +219,18 @@ size_t rules_mutation_count(tree_t *tree) {
 
 }
 
+bool rules_mutation_tries(node_t *node, uint32_t rule_id) {
+
+  if (node->rule_id == rule_id) return false;
+  return !coverage_bias || coverage_is_rare(node->id, rule_id);
+
+}
+
 tree_t *random_recursive_mutation(tree_t *tree, uint8_t n) {
 
+  STATS_PROFILE(STATS_PROFILE_RANDOM_RECURSIVE_MUTATION);
+
+  mutated_node_type = -1;
   if (unlikely(!tree)) return NULL;
 
   tree_t *mutated_tree = tree_clone(tree);
@@ -165,6 +246,8 @@ tree_t *random_recursive_mutation(tree_t *tree, uint8_t n) {
   node_t *parent = picked_edge.parent;
   node_t *tail = picked_edge.subnode;
   size_t  offset = picked_edge.subnode_offset;
+  PROBE2(random_recursive_mutation, parent->id, n);
+  mutated_node_type = parent->id;
 
   // detach the tail
   tail->parent = NULL;
@@ -194,12 +277,15 @@ tree_t *random_recursive_mutation(tree_t *tree, uint8_t n) {
 
 tree_t *splicing_mutation(tree_t *tree) {
 
+  STATS_PROFILE(STATS_PROFILE_SPLICING_MUTATION);
+
+  mutated_node_type = -1;
   if (unlikely(!tree)) return NULL;
 
   tree_t *mutated_tree = tree_clone(tree);
 
   // randomly pick a node in the tree
-  node_t *node = node_pick_non_term_subnode(mutated_tree->root);
+  node_t *node = pick_non_term_subnode(mutated_tree->root);
   if (unlikely(node == NULL)) {
 
     // By design, _pick_non_term_node should not return NULL
@@ -220,6 +306,10 @@ tree_t *splicing_mutation(tree_t *tree) {
 
   }
 
+  PROBE3(splicing_mutation, node->id, node->non_term_size,
+         replace_node->non_term_size);
+  mutated_node_type = node->id;
+
   if (!parent) {  // no parent, meaning that the picked node is the root node
     // Destroy the original root node
     node_free(node);
@@ -242,3 +332,32 @@ tree_t *splicing_mutation(tree_t *tree) {
   return mutated_tree;
 
 }
+
+tree_t *random_any_mutation(tree_t *tree, uint8_t max_n) {
+
+  mutated_node_type = -1;
+  if (unlikely(!tree)) return NULL;
+
+  switch (random_below(4)) {
+
+    case 0: {
+
+      STATS_PROFILE(STATS_PROFILE_RULES_MUTATION);
+      return _random_mutation(tree, true);
+
+    }
+
+    case 1:
+      return random_mutation(tree);
+
+    case 2:
+      if (!tree->root || tree->root->recursion_edge_size == 0)
+        return random_mutation(tree);
+      return random_recursive_mutation(tree, random_below(max_n + 1));
+
+    default:
+      return splicing_mutation(tree);
+
+  }
+
+}
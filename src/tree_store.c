@@ -0,0 +1,395 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "helpers.h"
+#include "probes.h"
+#include "stats.h"
+#include "tree_store.h"
+#include "utils.h"
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+#undef XXH_INLINE_ALL
+
+// Layout of the store folder:
+//   objects/<first two characters of the key>/<key>: serialized trees
+//   tmp/: trees being written, which are linked into `objects` once complete
+static char *tree_store_dir = NULL;
+static bool  tree_store_is_enabled = false;
+
+// makes temporary filenames unique among threads
+static unsigned long tree_store_tmp_counter = 0;
+
+static void tree_store_key_from_hash(XXH128_hash_t hash,
+                                     char          key[TREE_STORE_KEY_LEN + 1]) {
+
+  snprintf(key, TREE_STORE_KEY_LEN + 1, "%016llx%016llx",
+           (unsigned long long)hash.high64, (unsigned long long)hash.low64);
+
+}
+
+static void tree_store_object_path(const char *key, char path[PATH_MAX]) {
+
+  snprintf(path, PATH_MAX, "%s/objects/%.2s/%s", tree_store_dir, key, key);
+
+}
+
+// A unique temporary filename in the folder `dir` (of `dir_len` characters),
+// which is hidden from scans of the folder
+static bool tree_store_tmp_path(const char *dir, int dir_len, const char *name,
+                                char path[PATH_MAX]) {
+
+  unsigned long counter =
+      __atomic_fetch_add(&tree_store_tmp_counter, 1, __ATOMIC_RELAXED);
+  int len = snprintf(path, PATH_MAX, "%.*s/.%s.%d-%lu", dir_len, dir, name,
+                     (int)getpid(), counter);
+
+  return len > 0 && len < PATH_MAX;
+
+}
+
+static bool tree_store_write_file(const char *filename, const uint8_t *buf,
+                                  size_t len) {
+
+  int fd = open(filename, O_WRONLY | O_CREAT | O_EXCL, 0600);
+  if (unlikely(fd < 0)) {
+
+    perror("Unable to create the file (tree store)");
+    return false;
+
+  }
+
+  ssize_t ret = write(fd, buf, len);
+  close(fd);
+  if (unlikely(ret < 0 || (size_t)ret != len)) {
+
+    perror("Unable to write (tree store)");
+    unlink(filename);
+    return false;
+
+  }
+
+  return true;
+
+}
+
+// Atomically make `tree_fn` a link to `path`. Without `path`, or if hardlinks
+// are not supported (e.g., the store is on another file system), the tree is
+// written to a new file instead, so that the old linked tree stays intact.
+static bool tree_store_link_file(tree_t *tree, const char *path,
+                                 const char *tree_fn, size_t *written) {
+
+  char        tmp_path[PATH_MAX];
+  const char *slash = strrchr(tree_fn, '/');
+  bool        ok = slash ? tree_store_tmp_path(tree_fn, slash - tree_fn,
+                                               slash + 1, tmp_path)
+                         : tree_store_tmp_path(".", 1, tree_fn, tmp_path);
+  if (unlikely(!ok)) return false;
+
+  if (!path || link(path, tmp_path) != 0) {
+
+    tree_serialize(tree);
+    if (!tree_store_write_file(tmp_path, tree->ser_buf, tree->ser_len))
+      return false;
+    *written += tree->ser_len;
+
+  }
+
+  if (rename(tmp_path, tree_fn) != 0) {
+
+    perror("Unable to replace the tree file (tree store)");
+    unlink(tmp_path);
+    return false;
+
+  }
+
+  return true;
+
+}
+
+// A write of a tree file, like `write_tree_to_file` (see `write_tree__start`)
+static bool tree_store_link(tree_t *tree, const char *path,
+                            const char *tree_fn) {
+
+  STATS_PROFILE(STATS_PROFILE_WRITE_TREE_TO_FILE);
+
+  size_t written = 0;
+  PROBE2(write_tree__start, tree_fn, tree->root->non_term_size);
+  bool ok = tree_store_link_file(tree, path, tree_fn, &written);
+  PROBE2(write_tree__done, written, ok);
+  return ok;
+
+}
+
+bool tree_store_init(const char *store_dir) {
+
+  tree_store_clear();
+  if (!store_dir || !*store_dir) return false;
+
+  // Leave enough room for the paths of stored trees
+  if (strlen(store_dir) + 2 * TREE_STORE_KEY_LEN + 64 >= PATH_MAX) {
+
+    fprintf(stderr, "Tree store path is too long (tree_store_init)\n");
+    return false;
+
+  }
+
+  char path[PATH_MAX];
+  snprintf(path, PATH_MAX, "%s/objects", store_dir);
+  if (!create_directory(store_dir) || !create_directory(path)) {
+
+    perror("Cannot create the tree store (tree_store_init)");
+    return false;
+
+  }
+
+  snprintf(path, PATH_MAX, "%s/tmp", store_dir);
+  if (!create_directory(path)) {
+
+    perror("Cannot create the tree store (tree_store_init)");
+    return false;
+
+  }
+
+  tree_store_dir = strdup(store_dir);
+  tree_store_is_enabled = tree_store_dir != NULL;
+  return tree_store_is_enabled;
+
+}
+
+void tree_store_clear() {
+
+  tree_store_is_enabled = false;
+  free(tree_store_dir);
+  tree_store_dir = NULL;
+
+}
+
+inline bool tree_store_enabled() {
+
+  return tree_store_is_enabled;
+
+}
+
+void tree_store_hash_buf(const uint8_t *buf, size_t len,
+                         char key[TREE_STORE_KEY_LEN + 1]) {
+
+  tree_store_key_from_hash(XXH3_128bits(buf, len), key);
+
+}
+
+bool tree_store_hash_file(const char *filename,
+                          char        key[TREE_STORE_KEY_LEN + 1]) {
+
+  int fd = open(filename, O_RDONLY);
+  if (unlikely(fd < 0)) return false;
+
+  struct stat info;
+  if (unlikely(fstat(fd, &info) != 0)) {
+
+    close(fd);
+    return false;
+
+  }
+
+  size_t file_size = info.st_size;
+  if (file_size == 0) {
+
+    close(fd);
+    tree_store_hash_buf(NULL, 0, key);
+    return true;
+
+  }
+
+  uint8_t *buf = (uint8_t *)mmap(0, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (unlikely(buf == MAP_FAILED)) return false;
+
+  tree_store_hash_buf(buf, file_size, key);
+  munmap(buf, file_size);
+
+  return true;
+
+}
+
+// Same as `_node_to_buf`, but feeds the hash instead of the data buffer
+static void tree_store_update_hash(node_t *node, XXH3_state_t *state) {
+
+  if (!node) return;
+
+  // hash `val` if this is a leaf node
+  if (node->subnode_count == 0) {
+
+    if (node->val_len) XXH3_128bits_update(state, node->val_buf, node->val_len);
+    return;
+
+  }
+
+  for (uint32_t i = 0; i < node->subnode_count; ++i)
+    tree_store_update_hash(node->subnodes[i], state);
+
+}
+
+void tree_store_hash_tree(tree_t *tree, char key[TREE_STORE_KEY_LEN + 1]) {
+
+  XXH3_state_t state;
+  XXH3_128bits_reset(&state);
+
+  if (tree) tree_store_update_hash(tree->root, &state);
+
+  tree_store_key_from_hash(XXH3_128bits_digest(&state), key);
+
+}
+
+static bool tree_store_put_file(tree_t *tree, const char *key,
+                                const char *path, const char *tree_fn,
+                                size_t *written) {
+
+  if (access(path, F_OK) != 0) {
+
+    // Write the whole tree under a temporary name at first, so that readers
+    // never see a partial tree
+    char tmp_path[PATH_MAX];
+    char tmp_dir[PATH_MAX];
+    int  tmp_dir_len = snprintf(tmp_dir, PATH_MAX, "%s/tmp", tree_store_dir);
+    tree_store_tmp_path(tmp_dir, tmp_dir_len, key, tmp_path);
+
+    tree_serialize(tree);
+    if (!tree_store_write_file(tmp_path, tree->ser_buf, tree->ser_len))
+      return false;
+    *written += tree->ser_len;
+
+    char object_dir[PATH_MAX];
+    snprintf(object_dir, PATH_MAX, "%s/objects/%.2s", tree_store_dir, key);
+    if (mkdir(object_dir, 0700) != 0 && errno != EEXIST) {
+
+      perror("Cannot create the tree store folder (tree_store_put)");
+      unlink(tmp_path);
+      return false;
+
+    }
+
+    // Unlike `rename`, `link` never replaces the tree written by another
+    // instance in the meantime, which is identical anyway
+    if (link(tmp_path, path) != 0 && errno != EEXIST) {
+
+      perror("Cannot add the tree to the tree store (tree_store_put)");
+      unlink(tmp_path);
+      return false;
+
+    }
+
+    unlink(tmp_path);
+
+  }
+
+  if (tree_fn && *tree_fn)
+    return tree_store_link_file(tree, path, tree_fn, written);
+
+  return true;
+
+}
+
+bool tree_store_put(tree_t *tree, const char *key, const char *tree_fn) {
+
+  if (!tree_store_is_enabled || !tree || !key) return false;
+
+  STATS_PROFILE(STATS_PROFILE_WRITE_TREE_TO_FILE);
+
+  char path[PATH_MAX];
+  tree_store_object_path(key, path);
+
+  size_t written = 0;
+  PROBE2(write_tree__start, tree_fn && *tree_fn ? tree_fn : path,
+         tree->root->non_term_size);
+  bool ok = tree_store_put_file(tree, key, path, tree_fn, &written);
+  PROBE2(write_tree__done, written, ok);
+  return ok;
+
+}
+
+tree_t *tree_store_get(const char *key, const char *tree_fn) {
+
+  if (!tree_store_is_enabled || !key) return NULL;
+
+  char path[PATH_MAX];
+  tree_store_object_path(key, path);
+
+  tree_t *tree = read_tree_from_file(path);
+  if (!tree) return NULL;
+
+  if (tree_fn && *tree_fn) tree_store_link(tree, path, tree_fn);
+
+  return tree;
+
+}
+
+void tree_store_save_tree(tree_t *tree, const char *tree_fn) {
+
+  // e.g., a queue entry without a trees folder
+  if (!tree_fn || !*tree_fn) return;
+
+  if (tree_store_is_enabled) {
+
+    char key[TREE_STORE_KEY_LEN + 1];
+    tree_store_hash_tree(tree, key);
+    if (tree_store_put(tree, key, tree_fn)) return;
+
+  }
+
+  // The tree file may still be a link into the store (e.g., written by an
+  // earlier run), which must not be overwritten in place
+  tree_store_link(tree, NULL, tree_fn);
+
+}
+
+tree_t *tree_store_load_test_case(const char *test_case_fn,
+                                  const char *tree_fn) {
+
+  char    key[TREE_STORE_KEY_LEN + 1];
+  bool    has_key = false;
+  tree_t *tree = NULL;
+
+  if (tree_store_is_enabled) {
+
+    // Another instance may have parsed the same test case already
+    has_key = tree_store_hash_file(test_case_fn, key);
+    if (has_key) tree = tree_store_get(key, tree_fn);
+    if (tree) return tree;
+
+  }
+
+  tree = load_tree_from_test_case(test_case_fn);
+  if (!tree || !tree_fn || !*tree_fn) return tree;
+
+  if (!has_key || !tree_store_put(tree, key, tree_fn))
+    tree_store_link(tree, NULL, tree_fn);
+
+  return tree;
+
+}
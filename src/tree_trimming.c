@@ -24,9 +24,8 @@ tree_t *subtree_trimming(tree_t *tree, node_t *node) {
   tree_t *trimmed_tree = NULL;
 
   // generate the minimal subtree
-  gen_func_t gen_func = gen_funcs[node->id];
-  int        consumed = 0;
-  node_t *   min_node = gen_func(0, &consumed, -1);
+  int     consumed = 0;
+  node_t *min_node = gen_node(node->id, 0, &consumed, -1);
 
   node_t *parent = node->parent;
   if (!parent) {
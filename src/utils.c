@@ -123,8 +123,8 @@ char * strrstr(const char * haystack, const char * needle) {
 
 }
 
-// Random number generators
-static RANDOM_RETURN random_seed[3];
+// Random number generators, one per thread
+static THREAD_LOCAL RANDOM_RETURN random_seed[3];
 #define ROTL(d, lrot) ((d << (lrot)) | (d >> (8 * sizeof(d) - (lrot))))
 #define HASH_SEED 0xa5b35705
 
@@ -187,3 +187,23 @@ uint32_t random_below(uint32_t limit) {
   return unbiased_rnd % limit;
 
 }
+
+uint64_t random_below64(uint64_t limit) {
+
+  // The same random numbers as `random_below` for small limits
+  if (limit <= UINT32_MAX) return random_below(limit);
+
+  uint64_t unbiased_rnd;
+  do {
+
+#ifdef WORD_SIZE_64
+    unbiased_rnd = random_next();
+#else
+    unbiased_rnd = ((uint64_t)random_next() << 32) | random_next();
+#endif
+
+  } while (unlikely(unbiased_rnd >= (UINT64_MAX - (UINT64_MAX % limit))));
+
+  return unbiased_rnd % limit;
+
+}
@@ -0,0 +1,317 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chunk_store.h"
+#include "chunk_store_internal.h"
+#include "list.h"
+#include "thread_pool.h"
+#include "tree.h"
+#include "tree_cache.h"
+#include "warm_start.h"
+
+// The number of tree files being loaded per worker thread. It bounds the
+// memory held by loaded but not yet ingested trees.
+#define WARM_START_JOBS_PER_THREAD (16)
+
+// Report the progress at most once per interval (in seconds)
+#define WARM_START_PROGRESS_INTERVAL (1.0)
+
+typedef struct warm_start_ctx warm_start_ctx_t;
+
+typedef struct warm_start_job {
+
+  warm_start_ctx_t *ctx;
+
+  char *      filename;
+  const char *name;  // points to the basename in `filename`
+
+  // Filled by the worker thread
+  tree_t *tree;
+  size_t  mem_size;
+  char    root_hash[16 + 1];
+
+} warm_start_job_t;
+
+struct warm_start_ctx {
+
+  pthread_mutex_t lock;
+  pthread_cond_t  job_done;
+  list_t *        done_jobs;  // loaded jobs, waiting to be ingested
+
+};
+
+static double warm_start_now() {
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+
+}
+
+static void warm_start_job_free(warm_start_job_t *job) {
+
+  if (!job) return;
+
+  if (job->tree) tree_free(job->tree);
+  free(job->filename);
+  free(job);
+
+}
+
+// Runs on worker threads, so it must not touch the chunk store, the tree cache
+// or the random number generator
+static void warm_start_load_tree(void *arg) {
+
+  warm_start_job_t *job = (warm_start_job_t *)arg;
+  warm_start_ctx_t *ctx = job->ctx;
+
+  job->tree = read_tree_from_file(job->filename);
+  if (job->tree && !job->tree->root) {
+
+    tree_free(job->tree);
+    job->tree = NULL;
+
+  }
+
+  if (job->tree) {
+
+    tree_get_size(job->tree);
+    job->mem_size = tree_get_mem_size(job->tree);
+    hash_node(job->tree->root, job->root_hash);
+
+  }
+
+  pthread_mutex_lock(&ctx->lock);
+  list_append(ctx->done_jobs, job);
+  pthread_cond_signal(&ctx->job_done);
+  pthread_mutex_unlock(&ctx->lock);
+
+}
+
+static list_t *warm_start_scan(const char *trees_dir, warm_start_ctx_t *ctx) {
+
+  DIR *d = opendir(trees_dir);
+  if (!d) return NULL;
+
+  list_t *       jobs = list_create();
+  size_t         dir_len = strlen(trees_dir);
+  struct dirent *p;
+
+  while ((p = readdir(d))) {
+
+    // Skip hidden files, "." and ".."
+    if (p->d_name[0] == '.') continue;
+    if (p->d_type == DT_DIR) continue;
+
+    warm_start_job_t *job = calloc(1, sizeof(warm_start_job_t));
+    size_t            len = dir_len + strlen(p->d_name) + 2;
+    if (job) job->filename = malloc(len);
+    if (!job || !job->filename) {
+
+      perror("warm start (malloc)");
+      free(job);
+      break;
+
+    }
+
+    snprintf(job->filename, len, "%s/%s", trees_dir, p->d_name);
+    job->name = job->filename + dir_len + 1;
+    job->ctx = ctx;
+    list_append(jobs, job);
+
+  }
+
+  closedir(d);
+
+  return jobs;
+
+}
+
+// Runs on the calling thread
+static void warm_start_ingest(warm_start_job_t *job, size_t mem_budget,
+                              warm_start_stats_t *stats) {
+
+  tree_t *tree = job->tree;
+
+  if (!tree) {
+
+    ++stats->num_failed;
+    return;
+
+  }
+
+  if (stats->mem_size + job->mem_size > mem_budget) {
+
+    ++stats->num_skipped;
+    return;
+
+  }
+
+  stats->mem_size += job->mem_size;
+  ++stats->num_loaded;
+
+  bool seen = map_get(&seen_chunks, job->root_hash) != NULL;
+  if (seen) ++stats->num_duplicates;
+
+  if (tree_cache_put(job->name, tree)) {
+
+    // The cache owns the tree now, so the chunk store needs a copy
+    job->tree = NULL;
+    ++stats->num_cached;
+    if (!seen) chunk_store_add_tree(tree);
+
+  } else if (!seen) {
+
+    // Hand the nodes over to the chunk store without cloning them
+    chunk_store_take_node(tree->root);
+    tree->root = NULL;
+
+  }
+
+}
+
+static void warm_start_report(const char *trees_dir, warm_start_stats_t *stats,
+                              size_t num_done, bool finished) {
+
+  if (finished) {
+
+    fprintf(stderr,
+            "[warm start] %s: loaded %zu trees (%zu cached, %zu duplicates, "
+            "%zu failed, %zu skipped), %.1f MB in %.2f s\n",
+            trees_dir, stats->num_loaded, stats->num_cached,
+            stats->num_duplicates, stats->num_failed, stats->num_skipped,
+            stats->mem_size / (1024.0 * 1024.0), stats->elapsed);
+
+  } else {
+
+    fprintf(stderr, "[warm start] %s: %zu/%zu trees, %.1f MB, %.1f s\n",
+            trees_dir, num_done, stats->num_files,
+            stats->mem_size / (1024.0 * 1024.0), stats->elapsed);
+
+  }
+
+}
+
+bool warm_start_load_trees(const char *trees_dir, size_t num_threads,
+                           size_t mem_budget, bool verbose,
+                           warm_start_stats_t *stats) {
+
+  warm_start_stats_t local_stats;
+  if (!stats) stats = &local_stats;
+  memset(stats, 0, sizeof(warm_start_stats_t));
+
+  if (!trees_dir) return false;
+
+  double start = warm_start_now();
+  double last_report = start;
+
+  warm_start_ctx_t ctx;
+  pthread_mutex_init(&ctx.lock, NULL);
+  pthread_cond_init(&ctx.job_done, NULL);
+  ctx.done_jobs = list_create();
+
+  list_t *pending_jobs = warm_start_scan(trees_dir, &ctx);
+  if (!pending_jobs) {
+
+    perror("Cannot open the trees folder (warm start)");
+    list_free(ctx.done_jobs);
+    pthread_cond_destroy(&ctx.job_done);
+    pthread_mutex_destroy(&ctx.lock);
+    return false;
+
+  }
+
+  stats->num_files = pending_jobs->size;
+
+  // Without a pool, every job is loaded on the calling thread at submission
+  thread_pool_t *pool = NULL;
+  if (num_threads > 0 && stats->num_files > 1)
+    pool = thread_pool_create(num_threads);
+  size_t max_running_jobs =
+      pool ? thread_pool_get_num_threads(pool) * WARM_START_JOBS_PER_THREAD : 1;
+
+  size_t            num_running = 0;
+  size_t            num_done = 0;
+  warm_start_job_t *job = NULL;
+
+  while (true) {
+
+    // Keep the worker threads busy until the memory budget is reached
+    while (!list_empty(pending_jobs) && num_running < max_running_jobs &&
+           stats->mem_size < mem_budget) {
+
+      job = (warm_start_job_t *)list_pop_front(pending_jobs);
+      if (!pool || !thread_pool_submit(pool, warm_start_load_tree, job))
+        warm_start_load_tree(job);
+      ++num_running;
+
+    }
+
+    if (num_running == 0) break;
+
+    pthread_mutex_lock(&ctx.lock);
+    while (list_empty(ctx.done_jobs))
+      pthread_cond_wait(&ctx.job_done, &ctx.lock);
+    job = (warm_start_job_t *)list_pop_front(ctx.done_jobs);
+    pthread_mutex_unlock(&ctx.lock);
+
+    --num_running;
+    ++num_done;
+
+    warm_start_ingest(job, mem_budget, stats);
+    warm_start_job_free(job);
+
+    if (verbose) {
+
+      double now = warm_start_now();
+      if (now - last_report >= WARM_START_PROGRESS_INTERVAL) {
+
+        stats->elapsed = now - start;
+        warm_start_report(trees_dir, stats, num_done, false);
+        last_report = now;
+
+      }
+
+    }
+
+  }
+
+  // Files that have never been loaded due to the memory budget
+  stats->num_skipped += pending_jobs->size;
+  list_free_with_data_free_func(pending_jobs,
+                                (data_free_t)warm_start_job_free);
+
+  thread_pool_free(pool);
+
+  list_free(ctx.done_jobs);
+  pthread_cond_destroy(&ctx.job_done);
+  pthread_mutex_destroy(&ctx.lock);
+
+  stats->elapsed = warm_start_now() - start;
+  if (verbose) warm_start_report(trees_dir, stats, num_done, true);
+
+  return true;
+
+}
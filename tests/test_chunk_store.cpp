@@ -92,6 +92,7 @@ TEST_F(ChunkStoreTest, AddNode) {
   chunk_store_take_node(node_clone(node1));
   chunk_store_take_node(node_clone(node2));
   EXPECT_EQ(num_seen_chunks(), 2);
+  EXPECT_EQ(chunk_store_get_num_chunks(), 2);
 
   list_t **p_node_list = map_get(&chunk_store, node_type_str(node1->id));
   EXPECT_NE(p_node_list, nullptr);
@@ -122,6 +123,7 @@ TEST_F(ChunkStoreTest, AddTree) {
 
   chunk_store_add_tree(tree);
   EXPECT_EQ(num_seen_chunks(), 4);
+  EXPECT_EQ(chunk_store_get_num_chunks(), 4);
   list_t **p_node_list = map_get(&chunk_store, node_type_str(node1->id));
   EXPECT_NE(p_node_list, nullptr);
   list_t *node_list = *p_node_list;
@@ -131,6 +133,37 @@ TEST_F(ChunkStoreTest, AddTree) {
 
 }
 
+static void count_type_chunks(void *arg, const char *node_type,
+                              size_t num_chunks) {
+
+  auto counts = (map_int_t *)arg;
+  map_set(counts, node_type, (int)num_chunks);
+
+}
+
+TEST_F(ChunkStoreTest, ForeachType) {
+
+  auto node1 = node_create(1);
+  auto node2 = node_create_with_val(0, "{", 1);
+  auto node3 = node_create_with_val(0, "}", 1);
+  node_init_subnodes(node1, 2);
+  node_set_subnode(node1, 0, node2);
+  node_set_subnode(node1, 1, node3);
+
+  chunk_store_take_node(node_clone(node1));
+
+  map_int_t counts;
+  map_init(&counts);
+  chunk_store_foreach_type(count_type_chunks, &counts);
+  EXPECT_EQ(counts.base.nnodes, 2);
+  EXPECT_EQ(*map_get(&counts, node_type_str(node1->id)), 1);
+  EXPECT_EQ(*map_get(&counts, node_type_str(node2->id)), 2);
+  map_deinit(&counts);
+
+  node_free(node1);
+
+}
+
 TEST_F(ChunkStoreTest, GetAlternativeNode) {
 
   // input: nullptr, output: nullptr
@@ -0,0 +1,194 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <cmath>
+#include <string>
+
+#include "coverage.h"
+#include "f1_c_fuzz.h"
+#include "rule_weights.h"
+#include "tree.h"
+#include "tree_mutation.h"
+#include "utils.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+#define NUM_NODE_TYPES (sizeof(node_num_rules) / sizeof(node_num_rules[0]))
+
+class CoverageTest : public ::testing::Test {
+
+ protected:
+  CoverageTest() = default;
+
+  void SetUp() override {
+
+    random_set_seed(0);
+
+  }
+
+  void TearDown() override {
+
+    coverage_clear();
+    rule_weights_clear();
+
+  }
+
+  // sign -> onenine (rule `rule_id`) -> "<rule_id + 1>"
+  static tree_t *create_onenine_tree(uint32_t rule_id) {
+
+    char    val[] = {(char)('1' + rule_id), '\0'};
+    node_t *onenine = node_create_with_rule_id(NODE_ONENINE, rule_id);
+    node_init_subnodes(onenine, 1);
+    node_set_subnode(onenine, 0, node_create_with_val(0, val, 1));
+
+    tree_t *tree = tree_create();
+    tree->root = node_create_with_rule_id(NODE_SIGN, 0);
+    node_init_subnodes(tree->root, 1);
+    node_set_subnode(tree->root, 0, onenine);
+    tree_get_size(tree);
+    return tree;
+
+  }
+
+};
+
+TEST_F(CoverageTest, AddTree) {
+
+  tree_t *tree = gen_init__(1000);
+
+  // Not initialized
+  EXPECT_FALSE(coverage_add_tree("id:000000", tree));
+  EXPECT_EQ(coverage_get_num_rules(), 0);
+
+  coverage_init(false);
+  size_t num_rules = 0;
+  for (size_t i = 1; i < NUM_NODE_TYPES; ++i)
+    num_rules += node_num_rules[i];
+  EXPECT_EQ(coverage_get_num_rules(), num_rules);
+  EXPECT_EQ(coverage_get_covered_rules(), 0);
+
+  EXPECT_TRUE(coverage_add_tree("id:000000", tree));
+  EXPECT_EQ(coverage_get_num_entries(), 1);
+  EXPECT_EQ(coverage_get_rule_count(NODE_START, 0), 1);
+
+  size_t covered_rules = coverage_get_covered_rules();
+  EXPECT_GT(covered_rules, 0);
+  EXPECT_LE(covered_rules, num_rules);
+  EXPECT_GT(coverage_get_covered_paths(2), 0);
+  EXPECT_GT(coverage_get_covered_paths(3), 0);
+  EXPECT_EQ(coverage_get_covered_paths(4), 0);
+
+  // An input is counted once, however often it is visited
+  EXPECT_FALSE(coverage_add_tree("id:000000", tree));
+  EXPECT_EQ(coverage_get_num_entries(), 1);
+  EXPECT_EQ(coverage_get_rule_count(NODE_START, 0), 1);
+  EXPECT_EQ(coverage_get_covered_rules(), covered_rules);
+
+  // A rule is counted once per input, however often it appears
+  EXPECT_TRUE(coverage_add_tree("id:000001", tree));
+  EXPECT_EQ(coverage_get_rule_count(NODE_START, 0), 2);
+  EXPECT_EQ(coverage_get_rule_count(NODE_JSON, 0), 2);
+
+  tree_free(tree);
+
+}
+
+TEST_F(CoverageTest, RareRules) {
+
+  coverage_init(false);
+
+  for (int i = 0; i < 10; ++i) {
+
+    tree_t *tree = create_onenine_tree(0);
+    EXPECT_TRUE(coverage_add_tree(("id:" + to_string(i)).c_str(), tree));
+    tree_free(tree);
+
+  }
+
+  EXPECT_EQ(coverage_get_rule_count(NODE_ONENINE, 0), 10);
+  EXPECT_EQ(coverage_get_rule_count(NODE_ONENINE, 1), 0);
+  EXPECT_EQ(coverage_get_covered_rules(), 2);
+  EXPECT_EQ(coverage_get_covered_paths(2), 1);
+  EXPECT_EQ(coverage_get_covered_paths(3), 0);
+
+  // Unchanged until the next update
+  EXPECT_TRUE(coverage_is_rare(NODE_ONENINE, 0));
+  EXPECT_TRUE(coverage_update());
+  EXPECT_FALSE(coverage_update());
+  EXPECT_FALSE(coverage_is_rare(NODE_ONENINE, 0));
+  for (uint32_t i = 1; i < node_num_rules[NODE_ONENINE]; ++i)
+    EXPECT_TRUE(coverage_is_rare(NODE_ONENINE, i));
+
+  // Not biased
+  EXPECT_EQ(gen_rule_picker, nullptr);
+
+}
+
+TEST_F(CoverageTest, Bias) {
+
+  tree_t *tree = create_onenine_tree(1);
+  node_t *onenine = tree->root->subnodes[0];
+
+  // 2 other rules of `sign` and 8 other rules of `onenine`
+  EXPECT_EQ(rules_mutation_count(tree), 10);
+
+  coverage_init(true);
+  EXPECT_EQ(gen_rule_picker, rule_weights_pick);
+
+  tree_t *common_tree = create_onenine_tree(0);
+  EXPECT_TRUE(coverage_add_tree("id:000000", common_tree));
+  tree_free(common_tree);
+
+  // Only the rare rules, as of the last update
+  EXPECT_TRUE(rules_mutation_tries(onenine, 0));
+  coverage_update();
+  EXPECT_FALSE(rules_mutation_tries(onenine, 0));
+  EXPECT_FALSE(rules_mutation_tries(onenine, 1));
+  EXPECT_TRUE(rules_mutation_tries(onenine, 2));
+  EXPECT_EQ(rules_mutation_count(tree), 2 + 7);
+
+  // Rule 0 weighs 1 / sqrt(2) of any other rule: ~8.1% of 1000 picks, but the
+  // generation still covers all rules
+  EXPECT_DOUBLE_EQ(rule_weights_get(NODE_ONENINE, 0), 1 / sqrt(2.0));
+  EXPECT_DOUBLE_EQ(rule_weights_get(NODE_ONENINE, 1), 1);
+  int generated[9] = {};
+  for (int i = 0; i < 1000; ++i) {
+
+    int     consumed = 0;
+    node_t *node = gen_node_onenine(100, &consumed, -1);
+    ++generated[node->rule_id];
+    node_free(node);
+
+  }
+
+  EXPECT_GT(generated[0], 40);
+  EXPECT_LT(generated[0], 120);
+  for (int i = 1; i < 9; ++i)
+    EXPECT_GT(generated[i], 0);
+
+  coverage_clear();
+  EXPECT_EQ(gen_rule_picker, nullptr);
+  EXPECT_DOUBLE_EQ(rule_weights_get(NODE_ONENINE, 0), 1);
+  EXPECT_TRUE(rules_mutation_tries(onenine, 0));
+  EXPECT_EQ(rules_mutation_count(tree), 10);
+
+  tree_free(tree);
+
+}
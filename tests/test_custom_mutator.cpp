@@ -21,6 +21,7 @@
 #include <cstdlib>
 
 #include <string>
+#include <vector>
 
 #include "custom_mutator.h"
 #include "f1_c_fuzz.h"
@@ -323,6 +324,43 @@ TEST_F(CustomMutatorTest, Trimming) {
 
 }
 
+TEST_F(CustomMutatorTest, ImportSyncedEntries) {
+
+  // prepare trees, as if they were synced from other instances
+  vector<tree_t *> trees;
+  for (int i = 0; i < 8; ++i) {
+
+    auto tree = gen_init__(20);
+    string fn = "afl_test_fuzz_out/queue/sync_" + to_string(i);
+    string tree_fn = "afl_test_fuzz_out/trees/sync_" + to_string(i);
+    dump_tree_to_test_case(tree, fn.c_str());
+    write_tree_to_file(tree, tree_fn.c_str());
+    trees.push_back(tree);
+
+    // imported entries have no original queue entry
+    afl_custom_queue_new_entry(mutator->data, (const uint8_t *)fn.c_str(),
+                               nullptr);
+
+  }
+
+  // the tree is available, even if it is still queued for parsing
+  for (int i = 7; i >= 0; --i) {
+
+    string fn = "afl_test_fuzz_out/queue/sync_" + to_string(i);
+    uint8_t ret =
+        afl_custom_queue_get(mutator->data, (const uint8_t *)fn.c_str());
+    ASSERT_EQ(ret, 1);
+    EXPECT_TRUE(tree_equal(mutator->data->tree_cur, trees[i]));
+
+  }
+
+  EXPECT_EQ(parse_pool_get_num_pending(mutator->data->parse_pool), 0);
+
+  for (auto tree : trees)
+    tree_free(tree);
+
+}
+
 int main(int argc, char **argv) {
 
   ::testing::InitGoogleTest(&argc, argv);
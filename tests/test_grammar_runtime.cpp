@@ -0,0 +1,248 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <cstring>
+#include <string>
+
+#include "f1_c_fuzz.h"
+#include "grammar_runtime.h"
+#include "tree.h"
+#include "utils.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+#define NUM_NODE_TYPES (sizeof(node_num_rules) / sizeof(node_num_rules[0]))
+
+class GrammarRuntimeTest : public ::testing::Test {
+
+ protected:
+  grammar_runtime_t *grammar = nullptr;
+
+  GrammarRuntimeTest() = default;
+
+  void SetUp() override {
+
+    random_set_seed(0);
+
+  }
+
+  void TearDown() override {
+
+    grammar_runtime_free(grammar);
+
+  }
+
+  static grammar_runtime_t *load(const char *json) {
+
+    return grammar_runtime_load_buf(json, strlen(json));
+
+  }
+
+  static string render(tree_t *tree) {
+
+    tree_to_buf(tree);
+    return string((const char *)tree->data_buf, tree->data_len);
+
+  }
+
+  // Parse a test case, and render the parse tree again
+  string reparse(const string &input) {
+
+    tree_t *tree = grammar_runtime_parse(
+        grammar, (const uint8_t *)input.data(), input.size());
+    if (!tree) return "(null)";
+
+    string output = render(tree);
+    tree_free(tree);
+    return output;
+
+  }
+
+};
+
+TEST_F(GrammarRuntimeTest, SameTables) {
+
+  // The same tables as the generated code of the same grammar file
+  grammar = grammar_runtime_load(GRAMMAR_FILE_PATH);
+  ASSERT_NE(grammar, nullptr);
+  ASSERT_EQ(grammar->num_node_types, NUM_NODE_TYPES);
+
+  for (size_t i = 0; i < NUM_NODE_TYPES; ++i) {
+
+    EXPECT_STREQ(grammar->node_type_strs[i], node_type_str(i));
+    EXPECT_EQ(grammar->node_min_lens[i], node_min_lens[i]);
+    ASSERT_EQ(grammar->node_num_rules[i], node_num_rules[i]);
+    ASSERT_EQ(grammar->node_num_rule_tiers[i], node_num_rule_tiers[i]);
+    for (size_t j = 0; j < node_num_rule_tiers[i]; ++j)
+      EXPECT_EQ(grammar->node_rule_tiers[i][j], node_rule_tiers[i][j]);
+
+    ASSERT_EQ(grammar->node_rule_weights[i] == nullptr,
+              node_rule_weights[i] == nullptr);
+    for (size_t j = 0; node_rule_weights[i] && j < node_num_rules[i]; ++j)
+      EXPECT_DOUBLE_EQ(grammar->node_rule_weights[i][j],
+                       node_rule_weights[i][j]);
+
+  }
+
+}
+
+TEST_F(GrammarRuntimeTest, GenerateAndParse) {
+
+  grammar = grammar_runtime_load(GRAMMAR_FILE_PATH);
+  ASSERT_NE(grammar, nullptr);
+
+  for (int i = 0; i < 100; ++i) {
+
+    // Generated trees are of the same node types as the generated code
+    tree_t *tree = grammar_runtime_gen_tree(grammar, nullptr, 100);
+    ASSERT_NE(tree->root, nullptr);
+    EXPECT_EQ(tree->root->id, 1);
+    tree_get_size(tree);
+    for (size_t j = 0; j < 10; ++j) {
+
+      node_t *node = node_pick_non_term_subnode(tree->root);
+      ASSERT_NE(node, nullptr);
+      ASSERT_LT(node->id, NUM_NODE_TYPES);
+      EXPECT_LT(node->rule_id, node_num_rules[node->id]);
+
+    }
+
+    // And their test cases parse into the same test cases
+    string input = render(tree);
+    EXPECT_EQ(reparse(input), input);
+    tree_free(tree);
+
+  }
+
+}
+
+TEST_F(GrammarRuntimeTest, SmallBudget) {
+
+  grammar = grammar_runtime_load(GRAMMAR_FILE_PATH);
+  ASSERT_NE(grammar, nullptr);
+
+  // The smallest subtree of each node type, in place of the pool of cheap
+  // trees of the generated code
+  for (size_t i = 1; i < NUM_NODE_TYPES; ++i) {
+
+    int     consumed = -1;
+    node_t *node = grammar_runtime_gen_node(grammar, nullptr, i, 0, &consumed,
+                                            -1);
+    ASSERT_NE(node, nullptr);
+    EXPECT_EQ(node->id, i);
+    EXPECT_EQ((size_t)consumed, node_min_lens[i]);
+    node_free(node);
+
+  }
+
+}
+
+TEST_F(GrammarRuntimeTest, RuleOrderAndWeights) {
+
+  grammar = load(
+      "{\"<start>\": [[\"<a>\"]],"
+      " \"<a>\": [[\"xx\"], [\"y\"], [\"<a>\", \"z\"], [\"<a>\"]],"
+      " \"@weights\": {\"<a>\": [1, 2, 3, 4]}}");
+  ASSERT_NE(grammar, nullptr);
+  ASSERT_EQ(grammar->num_node_types, 3);
+  EXPECT_STREQ(grammar->node_type_strs[2], "NODE_A");
+
+  // <a> ::= <a> | "y" | <a> "z" | "xx", by their lengths and then tokens
+  ASSERT_EQ(grammar->node_num_rules[2], 4);
+  EXPECT_EQ(grammar->node_min_lens[2], 1);
+  ASSERT_EQ(grammar->node_num_rule_tiers[2], 2);
+  EXPECT_EQ(grammar->node_rule_tiers[2][0], 2);
+  EXPECT_EQ(grammar->node_rule_tiers[2][1], 4);
+  ASSERT_NE(grammar->node_rule_weights[2], nullptr);
+  EXPECT_DOUBLE_EQ(grammar->node_rule_weights[2][0], 4);
+  EXPECT_DOUBLE_EQ(grammar->node_rule_weights[2][1], 2);
+  EXPECT_DOUBLE_EQ(grammar->node_rule_weights[2][2], 3);
+  EXPECT_DOUBLE_EQ(grammar->node_rule_weights[2][3], 1);
+  EXPECT_EQ(grammar->node_rule_weights[1], nullptr);
+
+  // <a> ::= <a> is a cycle of any length
+  EXPECT_EQ(reparse("yzz"), "yzz");
+  EXPECT_EQ(reparse("xxz"), "xxz");
+  EXPECT_EQ(reparse("zy"), "(null)");
+
+}
+
+TEST_F(GrammarRuntimeTest, ParseNullableAndAmbiguous) {
+
+  grammar = load(
+      "{\"<start>\": [[\"<list>\"]],"
+      " \"<list>\": [[], [\"<item>\", \"<list>\"]],"
+      " \"<item>\": [[\"a\"], [\"<e>\", \"b\"], [\"<e>\", \"<e>\", \"a\"]],"
+      " \"<e>\": [[\"\"], [\"c\"], [\"<e>\"]],"
+      " \"<expr>\": [[\"<expr>\", \"+\", \"<n>\"], [\"<n>\"]],"
+      " \"<n>\": [[\"1\"], [\"\\u00e9\"]]}");
+  ASSERT_NE(grammar, nullptr);
+
+  EXPECT_EQ(reparse(""), "");
+  EXPECT_EQ(reparse("abcbcca"), "abcbcca");
+  EXPECT_EQ(reparse("abx"), "(null)");
+
+  // Another root, which no rule refers to either
+  EXPECT_EQ(reparse("1+\xc3\xa9+1"), "1+\xc3\xa9+1");
+
+  string  input = "cb";
+  tree_t *tree = grammar_runtime_parse(grammar, (const uint8_t *)input.data(),
+                                       input.size());
+  ASSERT_NE(tree, nullptr);
+  ASSERT_EQ(tree->root->id, 1);
+  ASSERT_EQ(tree->root->subnode_count, 1);
+
+  // <list> ::= <item> <list>, with an empty <list>
+  node_t *list = tree->root->subnodes[0];
+  ASSERT_EQ(list->id, 2);
+  ASSERT_EQ(list->subnode_count, 2);
+  EXPECT_EQ(list->subnodes[0]->id, 3);
+  EXPECT_EQ(list->subnodes[1]->subnode_count, 0);
+  tree_free(tree);
+
+}
+
+TEST_F(GrammarRuntimeTest, InvalidGrammars) {
+
+  const char *invalid[] = {
+      "",
+      "{}",
+      "[]",
+      "{\"<start>\": [[\"x\"]]",
+      "{\"<start>\": [[\"x\"]]} x",
+      "{\"<start>\": [[\"\\q\"]]}",
+      "{\"<start>\": [[1]]}",
+      // cannot be expanded
+      "{\"<start>\": [[\"<start>\"]]}",
+      // the same name of node types
+      "{\"<a-b>\": [[\"x\"]], \"<a_b>\": [[\"y\"]]}",
+      "{\"<start>\": [[\"x\"]], \"<start>\": [[\"y\"]]}",
+      // invalid weights
+      "{\"<start>\": [[\"x\"]], \"@weights\": {\"<start>\": [1, 2]}}",
+      "{\"<start>\": [[\"x\"]], \"@weights\": {\"<start>\": [-1]}}",
+      "{\"<start>\": [[\"x\"]], \"@weights\": {\"<other>\": [1]}}",
+  };
+
+  for (const char *json : invalid)
+    EXPECT_EQ(load(json), nullptr) << json;
+
+  EXPECT_EQ(grammar_runtime_load("/nonexistent/grammar.json"), nullptr);
+
+}
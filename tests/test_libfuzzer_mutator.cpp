@@ -0,0 +1,150 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <cstring>
+#include <vector>
+
+#include "chunk_store.h"
+#include "f1_c_fuzz.h"
+#include "libfuzzer_mutator.h"
+#include "tree.h"
+#include "utils.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+class LibFuzzerMutatorTest : public ::testing::Test {
+
+ protected:
+  LibFuzzerMutatorTest() = default;
+
+  void TearDown() override {
+
+    libfuzzer_mutator_deinit();
+
+  }
+
+};
+
+TEST_F(LibFuzzerMutatorTest, MutateFromScratch) {
+
+  vector<uint8_t> buf(4096);
+  size_t          size = 0;
+
+  // An empty input is generated, and each output is found in the cache
+  for (unsigned int seed = 0; seed < 100; ++seed) {
+
+    size = LLVMFuzzerCustomMutator(buf.data(), size, buf.size(), seed);
+    EXPECT_GT(size, 0);
+    EXPECT_LE(size, buf.size());
+
+  }
+
+  libfuzzer_mutator_stats_t stats;
+  libfuzzer_mutator_get_stats(&stats);
+  EXPECT_EQ(stats.num_calls, 100);
+  EXPECT_GE(stats.num_generated, 1);
+  EXPECT_GE(stats.cache_hits, 90);
+
+}
+
+TEST_F(LibFuzzerMutatorTest, MaxSize) {
+
+  uint8_t buf[16];
+  size_t  size = 0;
+
+  for (unsigned int seed = 0; seed < 1000; ++seed) {
+
+    size = LLVMFuzzerCustomMutator(buf, size, sizeof(buf), seed);
+    EXPECT_LE(size, sizeof(buf));
+
+  }
+
+  // Mutations that do not fit are retried or generated again, so that few
+  // outputs are truncated
+  libfuzzer_mutator_stats_t stats;
+  libfuzzer_mutator_get_stats(&stats);
+  EXPECT_LT(stats.num_truncated, 100);
+
+}
+
+TEST_F(LibFuzzerMutatorTest, Deterministic) {
+
+  vector<uint8_t> input(4096), out1(4096), out2(4096);
+  size_t          size = LLVMFuzzerCustomMutator(input.data(), 0, 4096, 0);
+
+  // The same input and seed lead to the same output
+  memcpy(out1.data(), input.data(), size);
+  memcpy(out2.data(), input.data(), size);
+  size_t size1 = LLVMFuzzerCustomMutator(out1.data(), size, 4096, 42);
+  size_t size2 = LLVMFuzzerCustomMutator(out2.data(), size, 4096, 42);
+  ASSERT_EQ(size1, size2);
+  EXPECT_EQ(memcmp(out1.data(), out2.data(), size1), 0);
+
+}
+
+TEST_F(LibFuzzerMutatorTest, CrossOver) {
+
+  vector<uint8_t> data1(4096), data2(4096), out(4096);
+  size_t          size1 = LLVMFuzzerCustomMutator(data1.data(), 0, 4096, 1);
+  size_t          size2 = LLVMFuzzerCustomMutator(data2.data(), 0, 4096, 2);
+
+  // The second input is harvested once
+  for (unsigned int seed = 0; seed < 100; ++seed) {
+
+    size_t size = LLVMFuzzerCustomCrossOver(data1.data(), size1, data2.data(),
+                                            size2, out.data(), 64, seed);
+    EXPECT_LE(size, 64);
+
+  }
+
+  EXPECT_GT(chunk_store_get_num_chunks(), 0);
+
+  libfuzzer_mutator_stats_t stats;
+  libfuzzer_mutator_get_stats(&stats);
+  EXPECT_EQ(stats.num_calls, 102);
+  EXPECT_GE(stats.cache_hits, 200);
+
+}
+
+TEST_F(LibFuzzerMutatorTest, ParsingInputs) {
+
+  // A test case of the grammar, which is parsed once and then cached
+  tree_t *tree = gen_init__(100);
+  tree_to_buf(tree);
+  vector<uint8_t> input(tree->data_buf, tree->data_buf + tree->data_len);
+  tree_free(tree);
+
+  vector<uint8_t> buf(4096);
+  for (unsigned int seed = 0; seed < 10; ++seed) {
+
+    memcpy(buf.data(), input.data(), input.size());
+    size_t size =
+        LLVMFuzzerCustomMutator(buf.data(), input.size(), buf.size(), seed);
+    EXPECT_LE(size, buf.size());
+
+  }
+
+  libfuzzer_mutator_stats_t stats;
+  libfuzzer_mutator_get_stats(&stats);
+  EXPECT_EQ(stats.num_parsed, 1);
+  EXPECT_EQ(stats.cache_hits, 9);
+  EXPECT_GT(chunk_store_get_num_chunks(), 0);
+
+}
@@ -0,0 +1,199 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <dlfcn.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include "custom_mutator.h"
+#include "f1_c_fuzz.h"
+#include "grammar_runtime.h"
+#include "tree.h"
+#include "utils.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+// The custom mutator callbacks of a grammar mutator library
+typedef struct mutator_api {
+
+  decltype(&afl_custom_init)       init;
+  decltype(&afl_custom_deinit)     deinit;
+  decltype(&afl_custom_queue_get)  queue_get;
+  decltype(&afl_custom_fuzz_count) fuzz_count;
+  decltype(&afl_custom_fuzz)       fuzz;
+
+} mutator_api_t;
+
+// Another grammar than the one of the generated code, which is loaded by the
+// runtime library
+static const char *expr_grammar =
+    "{\"<start>\": [[\"<expr>\"]],"
+    " \"<expr>\": [[\"<expr>\", \"+\", \"<term>\"], [\"<term>\"]],"
+    " \"<term>\": [[\"(\", \"<expr>\", \")\"], [\"<digit>\"]],"
+    " \"<digit>\": [[\"0\"], [\"1\"], [\"2\"], [\"3\"], [\"4\"], [\"5\"],"
+    "               [\"6\"], [\"7\"], [\"8\"], [\"9\"]]}";
+
+class MultipleGrammarsTest : public ::testing::Test {
+
+ protected:
+  string test_dir = "multiple_grammars_test";
+  string expr_grammar_fn = test_dir + "/expr.json";
+
+  void *runtime_lib = nullptr;
+
+  MultipleGrammarsTest() = default;
+
+  void SetUp() override {
+
+    random_set_seed(0);
+
+    ASSERT_TRUE(create_directory(test_dir.c_str()));
+    for (const char *name : {"/generated", "/runtime"}) {
+
+      string out_dir = test_dir + name;
+      ASSERT_TRUE(create_directory(out_dir.c_str()));
+      ASSERT_TRUE(create_directory((out_dir + "/queue").c_str()));
+      ASSERT_TRUE(create_directory((out_dir + "/trees").c_str()));
+
+    }
+
+    ofstream(expr_grammar_fn) << expr_grammar;
+
+  }
+
+  void TearDown() override {
+
+    if (runtime_lib) dlclose(runtime_lib);
+    unsetenv("GRAMMAR_FILE");
+    remove_directory(test_dir.c_str());
+
+  }
+
+  static bool load_api(void *lib, mutator_api_t *api) {
+
+    api->init = (decltype(api->init))dlsym(lib, "afl_custom_init");
+    api->deinit = (decltype(api->deinit))dlsym(lib, "afl_custom_deinit");
+    api->queue_get =
+        (decltype(api->queue_get))dlsym(lib, "afl_custom_queue_get");
+    api->fuzz_count =
+        (decltype(api->fuzz_count))dlsym(lib, "afl_custom_fuzz_count");
+    api->fuzz = (decltype(api->fuzz))dlsym(lib, "afl_custom_fuzz");
+    return api->init && api->deinit && api->queue_get && api->fuzz_count &&
+           api->fuzz;
+
+  }
+
+  static bool parses(const grammar_runtime_t *grammar, const uint8_t *buf,
+                     size_t len) {
+
+    tree_t *tree = grammar_runtime_parse(grammar, buf, len);
+    if (!tree) return false;
+    tree_free(tree);
+    return true;
+
+  }
+
+};
+
+TEST_F(MultipleGrammarsTest, FuzzWithBothGrammars) {
+
+  // The library of the generated code is linked into this program, and the
+  // runtime library is loaded in the same way as AFL++ loads custom mutators.
+  // Their references to the symbols that both libraries define (e.g.,
+  // `tree_free`) must still bind to their own.
+  ASSERT_EQ(setenv("GRAMMAR_FILE", expr_grammar_fn.c_str(), 1), 0);
+  runtime_lib = dlopen(RUNTIME_LIB_PATH, RTLD_NOW);
+  ASSERT_NE(runtime_lib, nullptr) << dlerror();
+
+  mutator_api_t generated = {afl_custom_init, afl_custom_deinit,
+                             afl_custom_queue_get, afl_custom_fuzz_count,
+                             afl_custom_fuzz};
+  mutator_api_t runtime;
+  ASSERT_TRUE(load_api(runtime_lib, &runtime));
+
+  my_mutator_t *generated_data = generated.init(nullptr, 0);
+  my_mutator_t *runtime_data = runtime.init(nullptr, 0);
+  ASSERT_NE(generated_data, nullptr);
+  ASSERT_NE(runtime_data, nullptr);
+
+  // A tree of the generated code, and a test case of the other grammar
+  string generated_fn = test_dir + "/generated/queue/id_0";
+  string runtime_fn = test_dir + "/runtime/queue/id_0";
+  tree_t *tree = gen_init__(100);
+  dump_tree_to_test_case(tree, generated_fn.c_str());
+  write_tree_to_file(tree, (test_dir + "/generated/trees/id_0").c_str());
+  tree_free(tree);
+  ofstream(runtime_fn) << "(1+2)+3";
+
+  ASSERT_EQ(generated.queue_get(generated_data,
+                                (const uint8_t *)generated_fn.c_str()),
+            1);
+  ASSERT_EQ(
+      runtime.queue_get(runtime_data, (const uint8_t *)runtime_fn.c_str()), 1);
+
+  grammar_runtime_t *generated_grammar =
+      grammar_runtime_load(GRAMMAR_FILE_PATH);
+  grammar_runtime_t *runtime_grammar =
+      grammar_runtime_load(expr_grammar_fn.c_str());
+  ASSERT_NE(generated_grammar, nullptr);
+  ASSERT_NE(runtime_grammar, nullptr);
+
+  // Fuzz with both mutators in turn, each of which mutates the trees of its
+  // own grammar
+  uint32_t generated_num = generated.fuzz_count(generated_data, nullptr, 0);
+  uint32_t runtime_num = runtime.fuzz_count(runtime_data, nullptr, 0);
+  EXPECT_GT(generated_num, 0);
+  EXPECT_GT(runtime_num, 0);
+
+  size_t generated_bad = 0, runtime_bad = 0;
+  for (uint32_t i = 0; i < 200; ++i) {
+
+    uint8_t *buf = nullptr;
+    size_t   len;
+    if (i < generated_num) {
+
+      len = generated.fuzz(generated_data, nullptr, 0, &buf, nullptr, 0,
+                           1 << 20);
+      ASSERT_NE(buf, nullptr);
+      if (!parses(generated_grammar, buf, len)) ++generated_bad;
+
+    }
+
+    if (i < runtime_num) {
+
+      len = runtime.fuzz(runtime_data, nullptr, 0, &buf, nullptr, 0, 1 << 20);
+      ASSERT_NE(buf, nullptr);
+      if (!parses(runtime_grammar, buf, len)) ++runtime_bad;
+
+    }
+
+  }
+
+  EXPECT_EQ(generated_bad, 0);
+  EXPECT_EQ(runtime_bad, 0);
+
+  grammar_runtime_free(generated_grammar);
+  grammar_runtime_free(runtime_grammar);
+  runtime.deinit(runtime_data);
+  generated.deinit(generated_data);
+
+}
@@ -0,0 +1,220 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <string>
+#include <vector>
+
+#include "f1_c_fuzz.h"
+#include "parse_pool.h"
+#include "tree.h"
+#include "utils.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+#define NUM_NODE_TYPES (sizeof(node_num_rules) / sizeof(node_num_rules[0]))
+
+class ParsePoolTest : public ::testing::Test {
+
+ protected:
+  string           test_dir = "parse_pool_test";
+  vector<string>   test_case_fns;
+  vector<string>   tree_fns;
+  vector<tree_t *> trees;
+  vector<tree_t *> parsed_trees;
+
+  ParsePoolTest() = default;
+
+  void SetUp() override {
+
+    random_set_seed(0);
+
+    ASSERT_TRUE(create_directory(test_dir.c_str()));
+    for (int i = 0; i < 16; ++i) {
+
+      tree_t *tree = gen_init__(100);
+      tree_get_size(tree);
+
+      string test_case_fn = test_dir + "/test_case_" + to_string(i);
+      string tree_fn = test_dir + "/tree_" + to_string(i);
+      dump_tree_to_test_case(tree, test_case_fn.c_str());
+      test_case_fns.push_back(test_case_fn);
+      tree_fns.push_back(tree_fn);
+      trees.push_back(tree);
+
+    }
+
+  }
+
+  void TearDown() override {
+
+    for (auto tree : trees)
+      tree_free(tree);
+    for (auto tree : parsed_trees)
+      tree_free(tree);
+
+    remove_directory(test_dir.c_str());
+
+  }
+
+  static void collect_tree(void *arg, __attribute__((unused)) const char *fn,
+                           __attribute__((unused)) const char *tree_fn,
+                           tree_t *tree) {
+
+    ((ParsePoolTest *)arg)->parsed_trees.push_back(tree);
+
+  }
+
+};
+
+TEST_F(ParsePoolTest, ReadTreeFiles) {
+
+  parse_pool_t *pool = parse_pool_create(2);
+  ASSERT_NE(pool, nullptr);
+
+  // the tree files exist, so no parsing is needed
+  for (size_t i = 0; i < trees.size(); ++i) {
+
+    write_tree_to_file(trees[i], tree_fns[i].c_str());
+    EXPECT_TRUE(parse_pool_submit(pool, test_case_fns[i].c_str(),
+                                  tree_fns[i].c_str()));
+
+  }
+
+  // submitting a pending test case again is a no-op
+  EXPECT_TRUE(
+      parse_pool_submit(pool, test_case_fns[0].c_str(), tree_fns[0].c_str()));
+
+  // either waits for the worker threads or loads it on the calling thread
+  for (size_t i = 0; i < trees.size(); ++i)
+    EXPECT_TRUE(parse_pool_wait(pool, test_case_fns[i].c_str()));
+  EXPECT_EQ(parse_pool_get_num_pending(pool), 0);
+
+  EXPECT_EQ(parse_pool_drain(pool, collect_tree, this), trees.size());
+  ASSERT_EQ(parsed_trees.size(), trees.size());
+  for (auto parsed_tree : parsed_trees) {
+
+    bool found = false;
+    for (auto tree : trees)
+      found |= tree_equal(parsed_tree, tree);
+    EXPECT_TRUE(found);
+    EXPECT_GT(tree_get_data_len(parsed_tree), 0);
+
+  }
+
+  // all results have been collected
+  EXPECT_FALSE(parse_pool_wait(pool, test_case_fns[0].c_str()));
+  EXPECT_EQ(parse_pool_drain(pool, collect_tree, this), 0);
+
+  parse_pool_free(pool);
+
+}
+
+TEST_F(ParsePoolTest, FreeWithPendingTestCases) {
+
+  parse_pool_t *pool = parse_pool_create(1);
+  ASSERT_NE(pool, nullptr);
+
+  for (size_t i = 0; i < trees.size(); ++i)
+    EXPECT_TRUE(parse_pool_submit(pool, test_case_fns[i].c_str(), ""));
+
+  // queued test cases and results are dropped
+  parse_pool_free(pool);
+
+}
+
+TEST_F(ParsePoolTest, ParseTestCases) {
+
+  parse_pool_t *pool = parse_pool_create(2);
+  ASSERT_NE(pool, nullptr);
+
+  for (size_t i = 0; i < trees.size(); ++i)
+    EXPECT_TRUE(parse_pool_submit(pool, test_case_fns[i].c_str(),
+                                  tree_fns[i].c_str()));
+  for (size_t i = 0; i < trees.size(); ++i)
+    parse_pool_wait(pool, test_case_fns[i].c_str());
+
+  EXPECT_EQ(parse_pool_drain(pool, collect_tree, this), trees.size());
+  EXPECT_EQ(parsed_trees.size(), trees.size());
+
+  // the parsed trees are written to the tree files
+  for (size_t i = 0; i < trees.size(); ++i) {
+
+    tree_t *tree = read_tree_from_file(tree_fns[i].c_str());
+    EXPECT_NE(tree, nullptr);
+    tree_free(tree);
+
+  }
+
+  parse_pool_free(pool);
+
+}
+
+TEST_F(ParsePoolTest, UpdateWeightsWhileLoading) {
+
+  vector<uint32_t> weights[2];
+  for (size_t i = 0; i < NUM_NODE_TYPES; ++i) {
+
+    weights[0].push_back(NODE_WEIGHT_ONE);
+    weights[1].push_back(NODE_WEIGHT_ONE * (i % 3));
+
+  }
+
+  node_set_type_weights(weights[0].data(), NUM_NODE_TYPES);
+  parse_pool_t *pool = parse_pool_create(2);
+  ASSERT_NE(pool, nullptr);
+
+  for (size_t i = 0; i < trees.size(); ++i)
+    write_tree_to_file(trees[i], tree_fns[i].c_str());
+
+  // the weights change while the worker threads are creating nodes
+  for (int round = 0; round < 8; ++round) {
+
+    for (size_t i = 0; i < trees.size(); ++i)
+      EXPECT_TRUE(parse_pool_submit(pool, test_case_fns[i].c_str(),
+                                    tree_fns[i].c_str()));
+    for (int i = 0; i < 1000; ++i)
+      node_set_type_weights(weights[i % 2].data(), NUM_NODE_TYPES);
+    for (size_t i = 0; i < trees.size(); ++i)
+      parse_pool_wait(pool, test_case_fns[i].c_str());
+    parse_pool_drain(pool, collect_tree, this);
+
+  }
+
+  parse_pool_free(pool);
+  ASSERT_EQ(parsed_trees.size(), 8 * trees.size());
+
+  // the weight sums with the last weights
+  node_set_type_weights(weights[1].data(), NUM_NODE_TYPES);
+  for (auto tree : trees)
+    tree_get_size(tree);
+  for (auto parsed_tree : parsed_trees) {
+
+    tree_get_size(parsed_tree);
+    bool found = false;
+    for (auto tree : trees)
+      found |= tree_equal(parsed_tree, tree) &&
+               parsed_tree->root->weight_sum == tree->root->weight_sum;
+    EXPECT_TRUE(found);
+
+  }
+
+  node_set_type_weights(nullptr, 0);
+
+}
@@ -0,0 +1,148 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <cmath>
+
+#include "f1_c_fuzz.h"
+#include "rule_weights.h"
+#include "tree.h"
+#include "utils.h"
+
+#include "gtest/gtest.h"
+
+class RuleWeightsTest : public ::testing::Test {
+
+ protected:
+  RuleWeightsTest() = default;
+
+  void SetUp() override {
+
+    random_set_seed(0);
+
+  }
+
+  void TearDown() override {
+
+    rule_weights_clear();
+
+  }
+
+};
+
+TEST_F(RuleWeightsTest, NoStaticWeights) {
+
+  // The JSON grammar has no static weights, so rules are picked uniformly
+  EXPECT_FALSE(rule_weights_init());
+  EXPECT_EQ(gen_rule_picker, nullptr);
+  EXPECT_DOUBLE_EQ(rule_weights_get(NODE_VALUE, 0), 1);
+  EXPECT_DOUBLE_EQ(rule_weights_get(NODE_TERM__, 0), 0);
+
+  // Every node type has at least one budget tier, the last of which fits all
+  // rules
+  for (int i = 1; i <= NODE_ONENINE; ++i) {
+
+    ASSERT_GT(node_num_rule_tiers[i], 0);
+    EXPECT_EQ(node_rule_tiers[i][node_num_rule_tiers[i] - 1],
+              node_num_rules[i]);
+
+  }
+
+}
+
+TEST_F(RuleWeightsTest, Scales) {
+
+  // <sign> ::= "" | "+" | "-"
+  ASSERT_EQ(node_num_rules[NODE_SIGN], 3);
+  double scales[] = {0, 1, 3};
+  ASSERT_TRUE(rule_weights_set_scales(NODE_SIGN, scales));
+  EXPECT_EQ(gen_rule_picker, rule_weights_pick);
+  EXPECT_DOUBLE_EQ(rule_weights_get(NODE_SIGN, 2), 3);
+
+  int counts[3] = {};
+  for (int i = 0; i < 4000; ++i) {
+
+    int rule_id = rule_weights_pick(NODE_SIGN, 3);
+    ASSERT_GE(rule_id, 0);
+    ASSERT_LT(rule_id, 3);
+    ++counts[rule_id];
+
+  }
+
+  // 0, 1000 and 3000 expected
+  EXPECT_EQ(counts[0], 0);
+  EXPECT_GT(counts[1], 850);
+  EXPECT_LT(counts[1], 1150);
+
+  // Only the empty rule fits a budget of 0, which has no weight
+  for (int i = 0; i < 100; ++i)
+    EXPECT_EQ(rule_weights_pick(NODE_SIGN, 1), 0);
+
+  // Not a budget tier: uniformly
+  for (int i = 0; i < 100; ++i)
+    EXPECT_LT(rule_weights_pick(NODE_SIGN, 2), 2);
+
+  // The generated code picks by the weights
+  int plus_count = 0;
+  for (int i = 0; i < 400; ++i) {
+
+    int     consumed = 0;
+    node_t *node = gen_node_sign(100, &consumed, -1);
+    EXPECT_NE(node->rule_id, 0);
+    if (node->rule_id == 1) ++plus_count;
+    node_free(node);
+
+  }
+
+  EXPECT_GT(plus_count, 50);
+  EXPECT_LT(plus_count, 150);
+
+  ASSERT_TRUE(rule_weights_set_scales(NODE_SIGN, nullptr));
+  EXPECT_EQ(gen_rule_picker, nullptr);
+  EXPECT_DOUBLE_EQ(rule_weights_get(NODE_SIGN, 2), 1);
+
+}
+
+TEST_F(RuleWeightsTest, AliasTable) {
+
+  // Random weights of all 9 rules of <onenine>
+  double scales[9];
+  double total = 0;
+  for (int i = 0; i < 9; ++i) {
+
+    scales[i] = random_below(100);
+    total += scales[i];
+
+  }
+
+  ASSERT_TRUE(rule_weights_set_scales(NODE_ONENINE, scales));
+
+  const int n = 90000;
+  int       counts[9] = {};
+  for (int i = 0; i < n; ++i)
+    ++counts[rule_weights_pick(NODE_ONENINE, 9)];
+
+  // Within 5 standard deviations
+  for (int i = 0; i < 9; ++i) {
+
+    double p = scales[i] / total;
+    double sd = sqrt(n * p * (1 - p));
+    EXPECT_NEAR(counts[i], n * p, 5 * sd + 1) << "rule " << i;
+
+  }
+
+}
@@ -0,0 +1,362 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "chunk_store.h"
+#include "custom_mutator.h"
+#include "f1_c_fuzz.h"
+#include "stats.h"
+#include "tree.h"
+#include "tree_mutation.h"
+#include "tree_store.h"
+#include "utils.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+// Read the `key : value` lines of a statistics file
+static map<string, string> read_stats_file(const string &filename) {
+
+  map<string, string> stats;
+  ifstream            file(filename);
+  string              line;
+  while (getline(file, line)) {
+
+    size_t sep = line.find(": ");
+    if (sep == string::npos) continue;
+
+    string key = line.substr(0, sep);
+    key.erase(key.find_last_not_of(' ') + 1);
+    stats[key] = line.substr(sep + 2);
+
+  }
+
+  return stats;
+
+}
+
+class StatsTest : public ::testing::Test {
+
+ protected:
+  string test_dir = "stats_test";
+
+  StatsTest() = default;
+
+  void SetUp() override {
+
+    random_set_seed(0);
+    ASSERT_TRUE(create_directory(test_dir.c_str()));
+
+  }
+
+  void TearDown() override {
+
+    remove_directory(test_dir.c_str());
+
+  }
+
+};
+
+TEST_F(StatsTest, Percentile) {
+
+  stats_init(60);
+  EXPECT_EQ(stats_get_stage_percentile(STATS_RANDOM_MUTATION, 0.99), 0);
+
+  for (int i = 0; i < 99; ++i)
+    stats_add_stage(STATS_RANDOM_MUTATION, 100);
+  stats_add_stage(STATS_RANDOM_MUTATION, 10000);
+  EXPECT_EQ(stats_get_stage_count(STATS_RANDOM_MUTATION), 100);
+  EXPECT_EQ(stats_get_stage_count(STATS_SPLICING_MUTATION), 0);
+
+  // Buckets are at most 1/8 wide
+  uint64_t p99 = stats_get_stage_percentile(STATS_RANDOM_MUTATION, 0.99);
+  EXPECT_GE(p99, 100);
+  EXPECT_LE(p99, 100 + 100 / 8);
+  uint64_t max = stats_get_stage_percentile(STATS_RANDOM_MUTATION, 1);
+  EXPECT_GE(max, 10000);
+  EXPECT_LE(max, 10000 + 10000 / 8);
+
+  // Small latencies are exact
+  stats_add_stage(STATS_SPLICING_MUTATION, 5);
+  EXPECT_EQ(stats_get_stage_percentile(STATS_SPLICING_MUTATION, 0.5), 5);
+
+}
+
+TEST_F(StatsTest, Profile) {
+
+  stats_reset_profiles();
+  EXPECT_STREQ(stats_get_profile_name(STATS_PROFILE_TREE_CLONE), "tree_clone");
+
+  for (int i = 0; i < 999; ++i)
+    stats_add_profile(STATS_PROFILE_TREE_CLONE, 1000);
+  stats_add_profile(STATS_PROFILE_TREE_CLONE, 1000000);
+  EXPECT_EQ(stats_get_profile_count(STATS_PROFILE_TREE_CLONE), 1000);
+
+  // The tail is not hidden by the average
+  EXPECT_LE(stats_get_profile_percentile(STATS_PROFILE_TREE_CLONE, 0.99),
+            1000 + 1000 / 8);
+  EXPECT_GE(stats_get_profile_percentile(STATS_PROFILE_TREE_CLONE, 1),
+            1000000);
+
+  // Kept by `stats_init`, and written to the statistics file
+  string stats_fn = test_dir + "/" STATS_FILENAME;
+  stats_init(60);
+  stats_set_filename(stats_fn.c_str());
+  EXPECT_TRUE(stats_write());
+  auto stats = read_stats_file(stats_fn);
+  EXPECT_EQ(stats["profile_tree_clone_count"], "1000");
+  EXPECT_EQ(stats.count("profile_tree_clone_p999_us"), 1);
+
+  stats_reset_profiles();
+  EXPECT_EQ(stats_get_profile_count(STATS_PROFILE_TREE_CLONE), 0);
+
+}
+
+#ifdef ENABLE_PROFILING
+TEST_F(StatsTest, ProfileHotPaths) {
+
+  stats_reset_profiles();
+
+  tree_t *tree = gen_init__(100);
+  tree_get_size(tree);
+  tree_t *cloned_tree = tree_clone(tree);
+  tree_t *mutated_tree = random_mutation(tree);
+
+  EXPECT_EQ(stats_get_profile_count(STATS_PROFILE_TREE_GET_SIZE), 1);
+  EXPECT_EQ(stats_get_profile_count(STATS_PROFILE_RANDOM_MUTATION), 1);
+  // `random_mutation` clones the tree as well
+  EXPECT_EQ(stats_get_profile_count(STATS_PROFILE_TREE_CLONE), 2);
+  EXPECT_GT(stats_get_profile_percentile(STATS_PROFILE_RANDOM_MUTATION, 1),
+            0);
+
+  tree_free(mutated_tree);
+  tree_free(cloned_tree);
+  tree_free(tree);
+
+}
+
+TEST_F(StatsTest, ProfileRenderingAndTreeFiles) {
+
+  stats_reset_profiles();
+
+  // The paths of the mutator, rather than `tree_to_buf` and
+  // `write_tree_to_file`
+  tree_t *tree = gen_init__(100);
+  uint8_t buf[4096];
+  tree_render_to_buf(tree, buf, sizeof(buf));
+  EXPECT_EQ(stats_get_profile_count(STATS_PROFILE_TREE_TO_BUF), 1);
+
+  string tree_fn = test_dir + "/tree";
+  tree_store_save_tree(tree, tree_fn.c_str());
+  EXPECT_EQ(stats_get_profile_count(STATS_PROFILE_WRITE_TREE_TO_FILE), 1);
+
+  // Adding to the store and linking the tree file is a single write
+  ASSERT_TRUE(tree_store_init((test_dir + "/store").c_str()));
+  tree_store_save_tree(tree, tree_fn.c_str());
+  EXPECT_EQ(stats_get_profile_count(STATS_PROFILE_WRITE_TREE_TO_FILE), 2);
+  tree_store_clear();
+
+  tree_free(tree);
+
+}
+#endif
+
+TEST_F(StatsTest, Disabled) {
+
+  string stats_fn = test_dir + "/" STATS_FILENAME;
+
+  stats_init(0);
+  stats_set_filename(stats_fn.c_str());
+  EXPECT_STREQ(stats_get_filename(), "");
+  EXPECT_FALSE(stats_write());
+  EXPECT_FALSE(stats_maybe_write());
+  EXPECT_FALSE(ifstream(stats_fn).good());
+
+}
+
+TEST_F(StatsTest, WriteFile) {
+
+  string stats_fn = test_dir + "/" STATS_FILENAME;
+
+  chunk_store_init();
+  tree_t *tree = gen_init__(100);
+  chunk_store_add_tree(tree);
+
+  stats_init(60);
+  stats_set_filename(stats_fn.c_str());
+  EXPECT_STREQ(stats_get_filename(), stats_fn.c_str());
+
+  stats_add_stage(STATS_RULES_MUTATION, 1000);
+  stats_add_stage(STATS_RULES_MUTATION, 3000);
+  stats_add_load(STATS_PARSE, 100, true);
+  stats_add_load(STATS_PARSE, 100, false);
+  stats_add_source(STATS_FROM_TREE_CACHE);
+  stats_add_source(STATS_FROM_TEST_CASE);
+  stats_add_output(10, 100, false);
+  stats_add_output(30, 300, true);
+  stats_add_trim(100, 60);
+
+  // The interval has not passed yet
+  EXPECT_FALSE(stats_maybe_write());
+  EXPECT_FALSE(ifstream(stats_fn).good());
+
+  EXPECT_TRUE(stats_write());
+  auto stats = read_stats_file(stats_fn);
+  EXPECT_EQ(stats["rules_mutation_count"], "2");
+  EXPECT_EQ(stats["random_mutation_count"], "0");
+  EXPECT_EQ(stats["parse_count"], "2");
+  EXPECT_EQ(stats["parse_failures"], "1");
+  EXPECT_EQ(stats["deserialize_count"], "0");
+  EXPECT_EQ(stats["queue_get_count"], "2");
+  EXPECT_EQ(stats["tree_cache_hit_rate"], "50.00%");
+  EXPECT_EQ(stats["output_count"], "2");
+  EXPECT_EQ(stats["avg_tree_size"], "20.0");
+  EXPECT_EQ(stats["avg_output_len"], "200.0");
+  EXPECT_EQ(stats["truncated_count"], "1");
+  EXPECT_EQ(stats["trim_saved_bytes"], "40");
+  EXPECT_EQ(stats["trim_saved_rate"], "40.00%");
+  EXPECT_EQ(stats["chunk_store_chunks"],
+            to_string(chunk_store_get_num_chunks()));
+  EXPECT_EQ(stats.count(string("chunks_") + node_type_str(tree->root->id)),
+            1);
+  EXPECT_EQ(stats.count("rules_mutation_p99_us"), 1);
+  EXPECT_EQ(stats.count("start_time"), 1);
+
+  tree_free(tree);
+  chunk_store_clear();
+
+}
+
+TEST_F(StatsTest, CustomMutator) {
+
+  // An afl-fuzz output folder with one queue entry and its tree
+  string out_dir = test_dir + "/default";
+  string queue_dir = out_dir + "/queue";
+  string trees_dir = out_dir + "/trees";
+  ASSERT_TRUE(create_directory(out_dir.c_str()));
+  ASSERT_TRUE(create_directory(queue_dir.c_str()));
+  ASSERT_TRUE(create_directory(trees_dir.c_str()));
+
+  tree_t *tree = gen_init__(100);
+  dump_tree_to_test_case(tree, (queue_dir + "/id:000000").c_str());
+  write_tree_to_file(tree, (trees_dir + "/id:000000").c_str());
+  tree_free(tree);
+
+  my_mutator_t *data = afl_custom_init(nullptr, 0);
+  ASSERT_NE(data, nullptr);
+
+  string fn = queue_dir + "/id:000000";
+  ASSERT_EQ(afl_custom_queue_get(data, (const uint8_t *)fn.c_str()), 1);
+  EXPECT_STREQ(stats_get_filename(), (out_dir + "/" STATS_FILENAME).c_str());
+
+  uint8_t *out_buf = nullptr;
+  afl_custom_fuzz_count(data, nullptr, 0);
+  for (int i = 0; i < 10; ++i)
+    afl_custom_fuzz(data, nullptr, 0, &out_buf, nullptr, 0, 4096);
+
+  size_t num_steps = 0;
+  for (int i = STATS_RULES_MUTATION; i <= STATS_SPLICING_MUTATION; ++i)
+    num_steps += stats_get_stage_count((stats_stage_t)i);
+  EXPECT_EQ(num_steps, 10);
+
+  // The final statistics are written at the end
+  afl_custom_deinit(data);
+  auto stats = read_stats_file(out_dir + "/" STATS_FILENAME);
+  EXPECT_EQ(stats["output_count"], "10");
+  EXPECT_EQ(stats["deserialize_count"], "1");
+  EXPECT_EQ(stats["tree_file_hit_rate"], "100.00%");
+
+}
+
+TEST_F(StatsTest, Yield) {
+
+  string stats_fn = test_dir + "/" STATS_FILENAME;
+  string yield_fn = test_dir + "/" STATS_YIELD_FILENAME;
+
+  stats_init(60);
+  EXPECT_FALSE(stats_write_yield());
+
+  stats_add_mutation(STATS_RANDOM_MUTATION, 1);
+  stats_add_mutation(STATS_RANDOM_MUTATION, 1);
+  stats_add_mutation(STATS_SPLICING_MUTATION, -1);
+  stats_add_new_entry(STATS_RANDOM_MUTATION, 1);
+  EXPECT_EQ(stats_get_mutation_count(STATS_RANDOM_MUTATION, 1), 2);
+  EXPECT_EQ(stats_get_mutation_count(STATS_RULES_MUTATION, 1), 0);
+  EXPECT_EQ(stats_get_mutation_count(STATS_SPLICING_MUTATION, -1), 1);
+  EXPECT_EQ(stats_get_new_entry_count(STATS_RANDOM_MUTATION, 1), 1);
+
+  // Trimming is not a mutation stage
+  stats_add_mutation(STATS_SUBTREE_TRIMMING, 1);
+  EXPECT_EQ(stats_get_mutation_count(STATS_SUBTREE_TRIMMING, 1), 0);
+
+  stats_set_filename(stats_fn.c_str());
+  EXPECT_TRUE(stats_write());
+  auto   stats = read_stats_file(stats_fn);
+  string type = node_type_str(1);
+  EXPECT_EQ(stats["yield_random_" + type + "_mutations"], "2");
+  EXPECT_EQ(stats["yield_random_" + type + "_entries"], "1");
+  EXPECT_EQ(stats["yield_splicing_unchanged_mutations"], "1");
+  EXPECT_EQ(stats.count("yield_rules_" + type + "_mutations"), 0);
+
+  EXPECT_TRUE(stats_write_yield());
+  ifstream     file(yield_fn);
+  stringstream content;
+  content << file.rdbuf();
+  EXPECT_EQ(content.str(), "node_type,stage,mutations,new_entries,yield\n" +
+                               type + ",random,2,1,0.500000\n" +
+                               "unchanged,splicing,1,0,0.000000\n");
+
+  stats_init(60);
+  EXPECT_EQ(stats_get_mutation_count(STATS_RANDOM_MUTATION, 1), 0);
+
+}
+
+TEST_F(StatsTest, YieldCustomMutator) {
+
+  string out_dir = test_dir + "/default";
+  string queue_dir = out_dir + "/queue";
+  ASSERT_TRUE(create_directory(out_dir.c_str()));
+  ASSERT_TRUE(create_directory(queue_dir.c_str()));
+  ASSERT_TRUE(create_directory((out_dir + "/trees").c_str()));
+
+  my_mutator_t *data = afl_custom_init(nullptr, 0);
+  ASSERT_NE(data, nullptr);
+
+  // A random mutation of a generated tree
+  uint8_t *out_buf = nullptr;
+  data->cur_fuzzing_stage = 1;
+  afl_custom_fuzz(data, nullptr, 0, &out_buf, nullptr, 0, 4096);
+  int node_type = data->mutated_node_type;
+  EXPECT_GE(node_type, 0);
+  EXPECT_EQ(stats_get_mutation_count(STATS_RANDOM_MUTATION, node_type), 1);
+
+  // It is saved into the queue
+  string fn = queue_dir + "/id:000001,src:000000,op:custom";
+  string orig_fn = queue_dir + "/id:000000";
+  afl_custom_queue_new_entry(data, (const uint8_t *)fn.c_str(),
+                             (const uint8_t *)orig_fn.c_str());
+  EXPECT_EQ(stats_get_new_entry_count(STATS_RANDOM_MUTATION, node_type), 1);
+
+  afl_custom_deinit(data);
+
+}
@@ -0,0 +1,219 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "custom_mutator.h"
+#include "f1_c_fuzz.h"
+#include "trace.h"
+#include "tree.h"
+#include "utils.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+class TraceTest : public ::testing::Test {
+
+ protected:
+  string test_dir = "trace_test";
+  string trace_fn = test_dir + "/trace";
+
+  TraceTest() = default;
+
+  void SetUp() override {
+
+    random_set_seed(0);
+    ASSERT_TRUE(create_directory(test_dir.c_str()));
+
+  }
+
+  void TearDown() override {
+
+    trace_stop();
+    unsetenv("TRACE_FILE");
+    remove_directory(test_dir.c_str());
+
+  }
+
+  vector<trace_record_t> read_trace() {
+
+    vector<trace_record_t> records;
+    trace_record_t         record;
+    trace_reader_t *       reader = trace_reader_open(trace_fn.c_str());
+    EXPECT_NE(reader, nullptr);
+    if (!reader) return records;
+
+    while (trace_read(reader, &record)) {
+
+      // The strings are only valid until the next record
+      record.strs[0] = record.strs[1] = nullptr;
+      records.push_back(record);
+
+    }
+
+    trace_reader_close(reader);
+    return records;
+
+  }
+
+};
+
+TEST_F(TraceTest, WriteRead) {
+
+  EXPECT_FALSE(trace_is_recording());
+  ASSERT_TRUE(trace_start(trace_fn.c_str()));
+  EXPECT_TRUE(trace_is_recording());
+
+  trace_record_t record = {};
+  record.op = TRACE_QUEUE_NEW_ENTRY;
+  record.time_ns = 1234567;
+  record.args[0] = 42;
+  record.args[1] = UINT64_MAX;
+  record.strs[0] = "out/default/queue/id:000001,src:000000,op:custom";
+  record.strs[1] = nullptr;  // imported test cases
+  trace_write(&record);
+
+  record = {};
+  record.op = TRACE_FUZZ;
+  for (int i = 0; i < TRACE_MAX_ARGS; ++i)
+    record.args[i] = (uint64_t)1 << (9 * i);
+  trace_write(&record);
+
+  record = {};
+  record.op = TRACE_INIT;
+  record.strs[0] = "";
+  trace_write(&record);
+
+  trace_stop();
+  EXPECT_FALSE(trace_is_recording());
+
+  trace_reader_t *reader = trace_reader_open(trace_fn.c_str());
+  ASSERT_NE(reader, nullptr);
+
+  ASSERT_TRUE(trace_read(reader, &record));
+  EXPECT_EQ(record.op, TRACE_QUEUE_NEW_ENTRY);
+  EXPECT_EQ(record.time_ns, 1234567);
+  EXPECT_EQ(record.args[0], 42);
+  EXPECT_EQ(record.args[1], UINT64_MAX);
+  EXPECT_STREQ(record.strs[0],
+               "out/default/queue/id:000001,src:000000,op:custom");
+  EXPECT_EQ(record.strs[1], nullptr);
+
+  ASSERT_TRUE(trace_read(reader, &record));
+  EXPECT_EQ(record.op, TRACE_FUZZ);
+  for (int i = 0; i < TRACE_MAX_ARGS; ++i)
+    EXPECT_EQ(record.args[i], (uint64_t)1 << (9 * i));
+
+  // An empty string is not NULL
+  ASSERT_TRUE(trace_read(reader, &record));
+  EXPECT_EQ(record.op, TRACE_INIT);
+  EXPECT_STREQ(record.strs[0], "");
+
+  EXPECT_FALSE(trace_read(reader, &record));
+  trace_reader_close(reader);
+
+}
+
+TEST_F(TraceTest, NotATrace) {
+
+  ofstream(trace_fn) << "not a trace";
+  EXPECT_EQ(trace_reader_open(trace_fn.c_str()), nullptr);
+  EXPECT_EQ(trace_reader_open((test_dir + "/nonexistent").c_str()), nullptr);
+
+}
+
+TEST_F(TraceTest, CustomMutator) {
+
+  string queue_dir = test_dir + "/queue";
+  string trees_dir = test_dir + "/trees";
+  ASSERT_TRUE(create_directory(queue_dir.c_str()));
+  ASSERT_TRUE(create_directory(trees_dir.c_str()));
+
+  tree_t *tree = gen_init__(100);
+  string  fn = queue_dir + "/id:000000";
+  dump_tree_to_test_case(tree, fn.c_str());
+  write_tree_to_file(tree, (trees_dir + "/id:000000").c_str());
+  tree_free(tree);
+
+  setenv("TRACE_FILE", trace_fn.c_str(), 1);
+  my_mutator_t *data = afl_custom_init(nullptr, 1234);
+  ASSERT_NE(data, nullptr);
+  EXPECT_TRUE(trace_is_recording());
+
+  size_t   len;
+  uint64_t hash = trace_hash_file(fn.c_str(), &len);
+  EXPECT_GT(len, 0);
+  ASSERT_EQ(afl_custom_queue_get(data, (const uint8_t *)fn.c_str()), 1);
+
+  uint8_t  buf[] = "input";
+  uint8_t *out_buf = nullptr;
+  uint32_t count = afl_custom_fuzz_count(data, buf, 5);
+  EXPECT_GT(count, 0);
+
+  vector<uint64_t> out_hashes;
+  for (int i = 0; i < 3; ++i) {
+
+    size_t out_len =
+        afl_custom_fuzz(data, buf, 5, &out_buf, nullptr, 0, 4096);
+    out_hashes.push_back(trace_hash(out_buf, out_len));
+
+  }
+
+  afl_custom_deinit(data);
+  EXPECT_FALSE(trace_is_recording());
+
+  auto records = read_trace();
+  ASSERT_EQ(records.size(), 7);
+
+  EXPECT_EQ(records[0].op, TRACE_INIT);
+  EXPECT_EQ(records[0].args[0], 1234);
+  EXPECT_EQ(records[0].args[1], 1);
+
+  EXPECT_EQ(records[1].op, TRACE_QUEUE_GET);
+  EXPECT_EQ(records[1].args[0], len);
+  EXPECT_EQ(records[1].args[1], hash);
+  EXPECT_EQ(records[1].args[2], 1);
+
+  EXPECT_EQ(records[2].op, TRACE_FUZZ_COUNT);
+  EXPECT_EQ(records[2].args[0], 5);
+  EXPECT_EQ(records[2].args[1], trace_hash(buf, 5));
+  EXPECT_EQ(records[2].args[2], count);
+
+  for (int i = 0; i < 3; ++i) {
+
+    EXPECT_EQ(records[3 + i].op, TRACE_FUZZ);
+    EXPECT_EQ(records[3 + i].args[4], 4096);
+    EXPECT_EQ(records[3 + i].args[6], out_hashes[i]);
+
+  }
+
+  EXPECT_EQ(records[6].op, TRACE_DEINIT);
+
+  // Not recorded without `TRACE_FILE`
+  unsetenv("TRACE_FILE");
+  data = afl_custom_init(nullptr, 1234);
+  ASSERT_NE(data, nullptr);
+  EXPECT_FALSE(trace_is_recording());
+  afl_custom_deinit(data);
+  EXPECT_EQ(read_trace().size(), 7);
+
+}
@@ -18,6 +18,7 @@
 
 #include "tree.h"
 #include "f1_c_fuzz.h"
+#include "utils.h"
 
 #include "gtest/gtest.h"
 #include "gtest_ext.h"
@@ -229,6 +230,73 @@ TEST_F(TreeTest, DumpTreeToBuffer) {
 
 }
 
+TEST_F(TreeTest, RenderTreeToBuffer) {
+
+  uint8_t buf[16];
+
+  tree_get_size(tree);
+  EXPECT_EQ(tree_get_data_len(tree), 7);
+
+  EXPECT_EQ(tree_render_to_buf(tree, buf, sizeof(buf)), 7);
+  EXPECT_MEMEQ("{{123}}", buf, 7);
+
+  // stop once `max_size` is reached
+  EXPECT_EQ(tree_render_to_buf(tree, buf, 3), 3);
+  EXPECT_MEMEQ("{{1", buf, 3);
+
+  EXPECT_EQ(tree_render_to_buf(tree, buf, 0), 0);
+
+  // the data buffer of the tree is not used
+  EXPECT_EQ(tree->data_buf, nullptr);
+
+}
+
+TEST_F(TreeTest, ParallelRenderTreeToBuffer) {
+
+  // ~4 MB: 64 subtrees, each of which has 64 leaf nodes with 1 KB values
+  char val[1024];
+  auto large_tree = tree_create();
+  large_tree->root = node_create(1);
+  node_init_subnodes(large_tree->root, 64);
+  for (int i = 0; i < 64; ++i) {
+
+    auto subnode = node_create(2);
+    node_init_subnodes(subnode, 64);
+    for (int j = 0; j < 64; ++j) {
+
+      memset(val, 'a' + (i + j) % 26, sizeof(val));
+      node_set_subnode(subnode, j, node_create_with_val(0, val, sizeof(val)));
+
+    }
+
+    node_set_subnode(large_tree->root, i, subnode);
+
+  }
+
+  tree_get_size(large_tree);
+  tree_to_buf(large_tree);
+  ASSERT_EQ(tree_get_data_len(large_tree), large_tree->data_len);
+
+  auto buf = (uint8_t *)malloc(large_tree->data_len);
+  tree_set_parallel_render(1024 * 1024, 4);
+
+  EXPECT_EQ(tree_render_to_buf(large_tree, buf, large_tree->data_len),
+            large_tree->data_len);
+  EXPECT_MEMEQ(buf, large_tree->data_buf, large_tree->data_len);
+
+  // truncated output
+  memset(buf, 0, large_tree->data_len);
+  EXPECT_EQ(tree_render_to_buf(large_tree, buf, 3 * 1024 * 1024 + 1),
+            3 * 1024 * 1024 + 1);
+  EXPECT_MEMEQ(buf, large_tree->data_buf, 3 * 1024 * 1024 + 1);
+  EXPECT_EQ(buf[3 * 1024 * 1024 + 1], 0);
+
+  tree_set_parallel_render(0, 0);
+  free(buf);
+  tree_free(large_tree);
+
+}
+
 TEST_F(TreeTest, ParseTreeFromBuffer) {
 
   // A manually constructed tree, which does not follow the grammar
@@ -356,6 +424,77 @@ TEST_F(TreeTest, PickNonTermNodeNeverNull) {
 
 }
 
+TEST_F(TreeTest, WeightSum) {
+
+  // Without weights, the weight sum counts the non-terminal nodes
+  tree_get_size(tree);
+  EXPECT_EQ(node1->weight_sum, node1->non_term_size * NODE_WEIGHT_ONE);
+  EXPECT_EQ(node2->weight_sum, 0);
+
+  uint32_t weights[] = {0, 3, 5};
+  node_set_type_weights(weights, 3);
+  EXPECT_EQ(node_get_type_weight(0), 0);
+  EXPECT_EQ(node_get_type_weight(1), 3);
+  EXPECT_EQ(node_get_type_weight(2), 5);
+  EXPECT_EQ(node_get_type_weight(3), NODE_WEIGHT_ONE);
+
+  // node1 -> {node1', node3}
+  tree_get_size(tree);
+  EXPECT_EQ(node1->weight_sum, 3 * 3);
+  EXPECT_EQ(node3->weight_sum, 3);
+
+  node_t *cloned = node_clone(node1);
+  EXPECT_EQ(cloned->weight_sum, node1->weight_sum);
+  node_free(cloned);
+
+  node_set_type_weights(nullptr, 0);
+  EXPECT_EQ(node_get_type_weight(1), NODE_WEIGHT_ONE);
+
+}
+
+TEST_F(TreeTest, PickWeightedNonTermNode) {
+
+  random_set_seed(0);
+
+  // start -> {json, value}
+  node_t *_start = node_create(1);
+  node_t *_json = node_create(2);
+  node_t *_value = node_create(3);
+  node_init_subnodes(_start, 2);
+  node_set_subnode(_start, 0, _json);
+  node_set_subnode(_start, 1, _value);
+
+  // Never picks a node type without weight
+  uint32_t weights[] = {0, 1, 0, 3};
+  node_set_type_weights(weights, 4);
+  node_get_size(_start);
+  EXPECT_EQ(_start->weight_sum, 4);
+
+  int value_count = 0;
+  for (int i = 0; i < 1000; ++i) {
+
+    node_t *picked_node = node_pick_weighted_non_term_subnode(_start);
+    EXPECT_NE(picked_node, _json);
+    if (picked_node == _value) ++value_count;
+
+  }
+
+  // 750 expected
+  EXPECT_GT(value_count, 650);
+  EXPECT_LT(value_count, 850);
+
+  // Falls back to the uniform picking without any weight
+  uint32_t zero_weights[] = {0, 0, 0, 0};
+  node_set_type_weights(zero_weights, 4);
+  node_get_size(_start);
+  EXPECT_EQ(_start->weight_sum, 0);
+  EXPECT_NE(node_pick_weighted_non_term_subnode(_start), nullptr);
+
+  node_set_type_weights(nullptr, 0);
+  node_free(_start);
+
+}
+
 TEST_F(TreeTest, PickRecursionEdgeNeverNull) {
 
   auto node1 = node_create(1);
@@ -471,6 +610,28 @@ TEST_F(TreeTest, TreeSerializeDeserialize) {
 
 }
 
+TEST_F(TreeTest, TreeDeserializeCorrupted) {
+
+  tree_serialize(tree);
+  size_t   len = tree->ser_len;
+  uint8_t *buf = (uint8_t *)malloc(len);
+  memcpy(buf, tree->ser_buf, len);
+
+  // Truncated
+  EXPECT_EQ(tree_deserialize(buf, len - 1), nullptr);
+
+  // `subnode_count` and `val_len` of the root node are out of range
+  uint32_t huge = 0xffffffff;
+  memcpy(buf + 8, &huge, sizeof(huge));
+  EXPECT_EQ(tree_deserialize(buf, len), nullptr);
+  memcpy(buf + 8, tree->ser_buf + 8, sizeof(huge));
+  memcpy(buf + 12, &huge, sizeof(huge));
+  EXPECT_EQ(tree_deserialize(buf, len), nullptr);
+
+  free(buf);
+
+}
+
 #if defined(ENABLE_PARSING_ARRAY_RB) && defined(ARRAY_RB_PATH)
 TEST_F(TreeTest, ParseArrayRb) {
 
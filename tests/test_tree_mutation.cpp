@@ -17,11 +17,16 @@
  */
 
 #include <array>
+#include <fstream>
 #include <set>
+#include <thread>
+#include <vector>
 
 #include "chunk_store.h"
 #include "custom_mutator.h"
 #include "f1_c_fuzz.h"
+#include "node_weights.h"
+#include "stats.h"
 #include "tree.h"
 #include "tree_mutation.h"
 #include "utils.h"
@@ -134,6 +139,104 @@ TEST(TreeMutationTest, SplicingMutation) {
 
 }
 
+TEST(TreeMutationTest, RandomAnyMutation) {
+
+  random_set_seed(0);  // Fix the random seed
+  chunk_store_init();
+
+  EXPECT_EQ(random_any_mutation(nullptr, 4), nullptr);
+
+  tree_t *tree = gen_init__(100);
+  tree_get_size(tree);
+  chunk_store_add_tree(tree);
+  tree_t *orig = tree_clone(tree);
+
+  // Several threads mutate the same tree, each with its own random numbers
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < 4; ++i) {
+
+    threads.emplace_back([tree, i]() {
+
+      random_set_seed(i);
+      for (int j = 0; j < 100; ++j) {
+
+        tree_t *mutated_tree = random_any_mutation(tree, 4);
+        EXPECT_NE(mutated_tree, nullptr);
+        tree_free(mutated_tree);
+
+      }
+
+    });
+
+  }
+
+  for (auto &thread : threads)
+    thread.join();
+
+  EXPECT_TRUE(tree_equal(tree, orig));
+
+  chunk_store_clear();
+  tree_free(tree);
+  tree_free(orig);
+
+}
+
+TEST(TreeMutationTest, NodeWeights) {
+
+  const char *weights_fn = "node_weights_test";
+  std::ofstream(weights_fn) << "# node weights\n"
+                            << "NODE_ARRAY 2\n"
+                            << "  string 0.5\n"
+                            << "no_such_type 3\n";
+
+  // Neither a weight table nor learning
+  EXPECT_FALSE(node_weights_init(nullptr, false));
+  EXPECT_EQ(node_get_type_weight(NODE_ARRAY), NODE_WEIGHT_ONE);
+
+  EXPECT_FALSE(node_weights_init("nonexistent", false));
+
+  ASSERT_TRUE(node_weights_init(weights_fn, false));
+  EXPECT_EQ(node_get_type_weight(NODE_ARRAY), 2 * NODE_WEIGHT_ONE);
+  EXPECT_EQ(node_get_type_weight(NODE_STRING), NODE_WEIGHT_ONE / 2);
+  EXPECT_EQ(node_get_type_weight(NODE_JSON), NODE_WEIGHT_ONE);
+  EXPECT_EQ(node_get_type_weight(NODE_TERM__), 0);
+
+  // Static weights are not learned
+  stats_init(0);
+  for (int i = 0; i < NODE_WEIGHTS_UPDATE_INTERVAL; ++i)
+    stats_add_mutation(STATS_RANDOM_MUTATION, NODE_JSON);
+  EXPECT_FALSE(node_weights_update());
+
+  // Only `NODE_ARRAY` produces new queue entries
+  ASSERT_TRUE(node_weights_init(weights_fn, true));
+  stats_init(0);
+  EXPECT_FALSE(node_weights_update());
+  for (int i = 0; i < NODE_WEIGHTS_UPDATE_INTERVAL; ++i) {
+
+    stats_add_mutation(STATS_RANDOM_MUTATION, i % 2 ? NODE_ARRAY : NODE_JSON);
+    if (i % 2) stats_add_new_entry(STATS_RANDOM_MUTATION, NODE_ARRAY);
+
+  }
+
+  EXPECT_TRUE(node_weights_update());
+  EXPECT_GT(node_get_type_weight(NODE_ARRAY), 2 * NODE_WEIGHT_ONE);
+  EXPECT_LE(node_get_type_weight(NODE_ARRAY),
+            2 * NODE_WEIGHT_ONE * NODE_WEIGHTS_MAX_SCALE);
+  EXPECT_LT(node_get_type_weight(NODE_JSON), NODE_WEIGHT_ONE);
+  EXPECT_GE(node_get_type_weight(NODE_JSON),
+            NODE_WEIGHT_ONE / NODE_WEIGHTS_MAX_SCALE);
+
+  // Not before the next interval
+  stats_add_mutation(STATS_RANDOM_MUTATION, NODE_JSON);
+  EXPECT_FALSE(node_weights_update());
+
+  node_weights_clear();
+  EXPECT_EQ(node_get_type_weight(NODE_ARRAY), NODE_WEIGHT_ONE);
+  stats_init(0);
+  remove(weights_fn);
+
+}
+
 class TreeMutationUniquenessTest : public ::testing::Test {
 
  protected:
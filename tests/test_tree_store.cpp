@@ -0,0 +1,258 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <sys/stat.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "f1_c_fuzz.h"
+#include "tree.h"
+#include "tree_store.h"
+#include "utils.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+class TreeStoreTest : public ::testing::Test {
+
+ protected:
+  string test_dir = "tree_store_test";
+  string store_dir = test_dir + "/store";
+  string trees_dir = test_dir + "/trees";
+
+  TreeStoreTest() = default;
+
+  void SetUp() override {
+
+    random_set_seed(0);
+
+    ASSERT_TRUE(create_directory(test_dir.c_str()));
+    ASSERT_TRUE(create_directory(trees_dir.c_str()));
+    ASSERT_TRUE(tree_store_init(store_dir.c_str()));
+    ASSERT_TRUE(tree_store_enabled());
+
+  }
+
+  void TearDown() override {
+
+    tree_store_clear();
+    remove_directory(test_dir.c_str());
+
+  }
+
+  static ino_t inode(const string &filename) {
+
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0) return 0;
+    return info.st_ino;
+
+  }
+
+};
+
+TEST_F(TreeStoreTest, HashTree) {
+
+  tree_t *tree = gen_init__(100);
+  tree_to_buf(tree);
+
+  char tree_key[TREE_STORE_KEY_LEN + 1];
+  char buf_key[TREE_STORE_KEY_LEN + 1];
+  tree_store_hash_tree(tree, tree_key);
+  tree_store_hash_buf(tree->data_buf, tree->data_len, buf_key);
+  EXPECT_STREQ(tree_key, buf_key);
+  EXPECT_EQ(strlen(tree_key), TREE_STORE_KEY_LEN);
+
+  string test_case_fn = test_dir + "/test_case";
+  char   file_key[TREE_STORE_KEY_LEN + 1];
+  dump_tree_to_test_case(tree, test_case_fn.c_str());
+  EXPECT_TRUE(tree_store_hash_file(test_case_fn.c_str(), file_key));
+  EXPECT_STREQ(tree_key, file_key);
+
+  EXPECT_FALSE(tree_store_hash_file((test_dir + "/missing").c_str(), file_key));
+
+  tree_free(tree);
+
+}
+
+TEST_F(TreeStoreTest, PutAndGet) {
+
+  tree_t *tree = gen_init__(100);
+  char    key[TREE_STORE_KEY_LEN + 1];
+  tree_store_hash_tree(tree, key);
+
+  EXPECT_EQ(tree_store_get(key, nullptr), nullptr);
+
+  string tree_fn_a = trees_dir + "/a";
+  string tree_fn_b = trees_dir + "/b";
+  EXPECT_TRUE(tree_store_put(tree, key, tree_fn_a.c_str()));
+  // the tree has been stored already
+  EXPECT_TRUE(tree_store_put(tree, key, nullptr));
+
+  tree_t *stored_tree = tree_store_get(key, tree_fn_b.c_str());
+  ASSERT_NE(stored_tree, nullptr);
+  EXPECT_TRUE(tree_equal(stored_tree, tree));
+  tree_free(stored_tree);
+
+  // both tree files share the stored copy
+  EXPECT_NE(inode(tree_fn_a), 0);
+  EXPECT_EQ(inode(tree_fn_a), inode(tree_fn_b));
+
+  tree_t *read_tree = read_tree_from_file(tree_fn_b.c_str());
+  ASSERT_NE(read_tree, nullptr);
+  EXPECT_TRUE(tree_equal(read_tree, tree));
+  tree_free(read_tree);
+
+  tree_free(tree);
+
+}
+
+TEST_F(TreeStoreTest, SaveTreeKeepsStoredTrees) {
+
+  tree_t *tree = gen_init__(100);
+  tree_t *trimmed_tree = gen_init__(10);
+  while (tree_equal(tree, trimmed_tree)) {
+
+    tree_free(trimmed_tree);
+    trimmed_tree = gen_init__(10);
+
+  }
+
+  char key[TREE_STORE_KEY_LEN + 1];
+  tree_store_hash_tree(tree, key);
+
+  string tree_fn = trees_dir + "/a";
+  tree_store_save_tree(tree, tree_fn.c_str());
+
+  // replacing the tree file must not modify the stored tree
+  tree_store_save_tree(trimmed_tree, tree_fn.c_str());
+
+  tree_t *stored_tree = tree_store_get(key, nullptr);
+  ASSERT_NE(stored_tree, nullptr);
+  EXPECT_TRUE(tree_equal(stored_tree, tree));
+  tree_free(stored_tree);
+
+  tree_t *read_tree = read_tree_from_file(tree_fn.c_str());
+  ASSERT_NE(read_tree, nullptr);
+  EXPECT_TRUE(tree_equal(read_tree, trimmed_tree));
+  tree_free(read_tree);
+
+  tree_free(tree);
+  tree_free(trimmed_tree);
+
+}
+
+TEST_F(TreeStoreTest, SaveTreeWithoutTreeFile) {
+
+  tree_t *tree = gen_init__(100);
+  char    key[TREE_STORE_KEY_LEN + 1];
+  tree_store_hash_tree(tree, key);
+
+  // e.g., a trimmed queue entry without a tree file, which is neither stored
+  // nor written to a temporary file that cannot be renamed to ""
+  testing::internal::CaptureStderr();
+  tree_store_save_tree(tree, "");
+  tree_store_save_tree(tree, nullptr);
+  tree_store_clear();
+  tree_store_save_tree(tree, "");
+  EXPECT_EQ(testing::internal::GetCapturedStderr(), "");
+
+  ASSERT_TRUE(tree_store_init(store_dir.c_str()));
+  EXPECT_EQ(tree_store_get(key, nullptr), nullptr);
+
+  tree_free(tree);
+
+}
+
+TEST_F(TreeStoreTest, LoadTestCaseFromStore) {
+
+  tree_t *tree = gen_init__(100);
+  char    key[TREE_STORE_KEY_LEN + 1];
+  tree_store_hash_tree(tree, key);
+  EXPECT_TRUE(tree_store_put(tree, key, nullptr));
+
+  // another instance finds the tree by its test case, without parsing it
+  string test_case_fn = test_dir + "/test_case";
+  string tree_fn = trees_dir + "/test_case";
+  dump_tree_to_test_case(tree, test_case_fn.c_str());
+
+  tree_t *loaded_tree =
+      tree_store_load_test_case(test_case_fn.c_str(), tree_fn.c_str());
+  ASSERT_NE(loaded_tree, nullptr);
+  EXPECT_TRUE(tree_equal(loaded_tree, tree));
+  EXPECT_NE(inode(tree_fn), 0);
+  tree_free(loaded_tree);
+
+  tree_free(tree);
+
+}
+
+TEST_F(TreeStoreTest, ConcurrentPuts) {
+
+  vector<tree_t *> trees;
+  vector<string>   keys;
+  for (int i = 0; i < 16; ++i) {
+
+    tree_t *tree = gen_init__(100);
+    char    key[TREE_STORE_KEY_LEN + 1];
+    tree_store_hash_tree(tree, key);
+    trees.push_back(tree);
+    keys.push_back(key);
+
+  }
+
+  // instances write the same trees at the same time
+  vector<thread> threads;
+  for (int t = 0; t < 4; ++t) {
+
+    threads.emplace_back([&, t]() {
+
+      for (size_t i = 0; i < trees.size(); ++i) {
+
+        string tree_fn = trees_dir + "/" + to_string(t) + "_" + to_string(i);
+        tree_t *tree = tree_clone(trees[i]);
+        EXPECT_TRUE(tree_store_put(tree, keys[i].c_str(), tree_fn.c_str()));
+        tree_free(tree);
+
+      }
+
+    });
+
+  }
+
+  for (auto &th : threads)
+    th.join();
+
+  for (size_t i = 0; i < trees.size(); ++i) {
+
+    tree_t *stored_tree = tree_store_get(keys[i].c_str(), nullptr);
+    ASSERT_NE(stored_tree, nullptr);
+    EXPECT_TRUE(tree_equal(stored_tree, trees[i]));
+    tree_free(stored_tree);
+
+    EXPECT_EQ(inode(trees_dir + "/0_" + to_string(i)),
+              inode(trees_dir + "/3_" + to_string(i)));
+
+  }
+
+  for (auto tree : trees)
+    tree_free(tree);
+
+}
@@ -0,0 +1,190 @@
+/*
+   american fuzzy lop++ - grammar mutator
+   --------------------------------------
+
+   Written by Shengtuo Hu
+
+   Copyright 2020 AFLplusplus Project. All rights reserved.
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at:
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+   A grammar-based custom mutator written for GSoC '20.
+
+ */
+
+#include <cstdint>
+#include <cstdio>
+
+#include <string>
+#include <vector>
+
+#include "chunk_store.h"
+#include "f1_c_fuzz.h"
+#include "tree.h"
+#include "tree_cache.h"
+#include "utils.h"
+#include "warm_start.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+class WarmStartTest : public ::testing::Test {
+
+ protected:
+  string           trees_dir = "warm_start_trees";
+  vector<string>   names;
+  vector<tree_t *> trees;
+
+  WarmStartTest() = default;
+
+  void SetUp() override {
+
+    random_set_seed(0);
+    chunk_store_init();
+    tree_cache_init(SIZE_MAX);
+
+    ASSERT_TRUE(create_directory(trees_dir.c_str()));
+    for (int i = 0; i < 20; ++i) {
+
+      tree_t *tree = gen_init__(100);
+      tree_get_size(tree);
+
+      string name = "id:" + to_string(i);
+      write_tree_to_file(tree, (trees_dir + "/" + name).c_str());
+      names.push_back(name);
+      trees.push_back(tree);
+
+    }
+
+    // an empty file, which cannot be deserialized
+    FILE *f = fopen((trees_dir + "/broken").c_str(), "w");
+    ASSERT_NE(f, nullptr);
+    fclose(f);
+
+  }
+
+  void TearDown() override {
+
+    for (auto tree : trees)
+      tree_free(tree);
+
+    tree_cache_clear();
+    chunk_store_clear();
+    remove_directory(trees_dir.c_str());
+
+  }
+
+};
+
+TEST_F(WarmStartTest, TreeCache) {
+
+  tree_t *tree = tree_clone(trees[0]);
+  size_t  mem_size = tree_get_mem_size(tree);
+  EXPECT_GT(mem_size, 0);
+
+  EXPECT_EQ(tree_cache_get("missing"), nullptr);
+
+  EXPECT_TRUE(tree_cache_put("tree", tree));
+  EXPECT_EQ(tree_cache_get_num_trees(), 1);
+  EXPECT_EQ(tree_cache_get_mem_size(), mem_size);
+
+  tree_t *cached_tree = tree_cache_get("tree");
+  ASSERT_NE(cached_tree, nullptr);
+  EXPECT_NE(cached_tree, tree);
+  EXPECT_TRUE(tree_equal(cached_tree, trees[0]));
+  EXPECT_EQ(tree_get_data_len(cached_tree), tree_get_data_len(trees[0]));
+  tree_free(cached_tree);
+
+  // replace the cached tree
+  EXPECT_TRUE(tree_cache_put("tree", tree_clone(trees[1])));
+  EXPECT_EQ(tree_cache_get_num_trees(), 1);
+  cached_tree = tree_cache_get("tree");
+  EXPECT_TRUE(tree_equal(cached_tree, trees[1]));
+  tree_free(cached_tree);
+
+  tree_cache_remove("tree");
+  EXPECT_EQ(tree_cache_get_num_trees(), 0);
+  EXPECT_EQ(tree_cache_get_mem_size(), 0);
+  EXPECT_EQ(tree_cache_get("tree"), nullptr);
+
+  // the tree does not fit into the memory budget
+  tree_cache_clear();
+  tree_cache_init(1);
+  tree = tree_clone(trees[0]);
+  EXPECT_FALSE(tree_cache_put("tree", tree));
+  EXPECT_EQ(tree_cache_get_num_trees(), 0);
+  tree_free(tree);
+
+}
+
+TEST_F(WarmStartTest, LoadTrees) {
+
+  warm_start_stats_t stats;
+  EXPECT_TRUE(
+      warm_start_load_trees(trees_dir.c_str(), 2, SIZE_MAX, false, &stats));
+
+  EXPECT_EQ(stats.num_files, 21);
+  EXPECT_EQ(stats.num_loaded, 20);
+  EXPECT_EQ(stats.num_cached, 20);
+  EXPECT_EQ(stats.num_failed, 1);
+  EXPECT_EQ(stats.num_skipped, 0);
+  EXPECT_EQ(stats.mem_size, tree_cache_get_mem_size());
+
+  for (size_t i = 0; i < trees.size(); ++i) {
+
+    tree_t *cached_tree = tree_cache_get(names[i].c_str());
+    ASSERT_NE(cached_tree, nullptr);
+    EXPECT_TRUE(tree_equal(cached_tree, trees[i]));
+    EXPECT_EQ(tree_get_data_len(cached_tree), tree_get_data_len(trees[i]));
+    tree_free(cached_tree);
+
+    // all trees are available for splicing
+    node_t *node = chunk_store_get_alternative_node(trees[i]->root);
+    EXPECT_NE(node, nullptr);
+    node_free(node);
+
+  }
+
+}
+
+TEST_F(WarmStartTest, LoadTreesWithoutThreads) {
+
+  tree_cache_clear();
+  tree_cache_init(0);
+
+  warm_start_stats_t stats;
+  EXPECT_TRUE(
+      warm_start_load_trees(trees_dir.c_str(), 0, SIZE_MAX, false, &stats));
+
+  EXPECT_EQ(stats.num_loaded, 20);
+  EXPECT_EQ(stats.num_cached, 0);
+  EXPECT_EQ(stats.num_failed, 1);
+
+  node_t *node = chunk_store_get_alternative_node(trees[0]->root);
+  EXPECT_NE(node, nullptr);
+  node_free(node);
+
+}
+
+TEST_F(WarmStartTest, MemoryBudget) {
+
+  size_t mem_budget = tree_get_mem_size(trees[0]) + tree_get_mem_size(trees[1]);
+
+  warm_start_stats_t stats;
+  EXPECT_TRUE(
+      warm_start_load_trees(trees_dir.c_str(), 2, mem_budget, false, &stats));
+
+  EXPECT_LE(stats.mem_size, mem_budget);
+  EXPECT_LT(stats.num_loaded, 20);
+  EXPECT_EQ(stats.num_loaded + stats.num_failed + stats.num_skipped,
+            stats.num_files);
+
+  EXPECT_FALSE(
+      warm_start_load_trees("warm_start_missing", 2, SIZE_MAX, false, &stats));
+
+}